@@ -74,25 +74,65 @@ bdaddr_t *strtoba(const char *str)
 	return ba;
 }
 
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* Zero for anything that is not a hex digit, otherwise its value + 1 */
+#define HEX(c, v) [c] = (v) + 1
+static const unsigned char hex_values[256] = {
+	HEX('0', 0), HEX('1', 1), HEX('2', 2), HEX('3', 3), HEX('4', 4),
+	HEX('5', 5), HEX('6', 6), HEX('7', 7), HEX('8', 8), HEX('9', 9),
+	HEX('A', 10), HEX('B', 11), HEX('C', 12), HEX('D', 13), HEX('E', 14),
+	HEX('F', 15), HEX('a', 10), HEX('b', 11), HEX('c', 12), HEX('d', 13),
+	HEX('e', 14), HEX('f', 15),
+};
+#undef HEX
+
 int ba2str(const bdaddr_t *ba, char *str)
 {
-	return sprintf(str, "%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
-		ba->b[5], ba->b[4], ba->b[3], ba->b[2], ba->b[1], ba->b[0]);
+	int i;
+
+	for (i = 5; i >= 0; i--) {
+		*str++ = hex_digits[ba->b[i] >> 4];
+		*str++ = hex_digits[ba->b[i] & 0x0f];
+		*str++ = i ? ':' : '\0';
+	}
+
+	return 17;
 }
 
 int str2ba(const char *str, bdaddr_t *ba)
 {
+	bdaddr_t b;
 	int i;
 
-	if (bachk(str) < 0) {
-		memset(ba, 0, sizeof(*ba));
-		return -1;
+	if (!str)
+		goto fail;
+
+	/* Same format bachk() accepts, checked and converted in one pass */
+	for (i = 5; i >= 0; i--, str += 3) {
+		unsigned char hi, lo;
+
+		hi = hex_values[(unsigned char) str[0]];
+		if (!hi)
+			goto fail;
+
+		lo = hex_values[(unsigned char) str[1]];
+		if (!lo)
+			goto fail;
+
+		if (str[2] != (i ? ':' : '\0'))
+			goto fail;
+
+		b.b[i] = (hi - 1) << 4 | (lo - 1);
 	}
 
-	for (i = 5; i >= 0; i--, str += 3)
-		ba->b[i] = strtol(str, NULL, 16);
+	bacpy(ba, &b);
 
 	return 0;
+
+fail:
+	memset(ba, 0, sizeof(*ba));
+	return -1;
 }
 
 int ba2oui(const bdaddr_t *ba, char *str)
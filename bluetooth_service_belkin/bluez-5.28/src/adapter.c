@@ -199,6 +199,7 @@ struct btd_adapter {
 	bool pincode_requested;		/* PIN requested during last bonding */
 	GSList *connections;		/* Connected devices */
 	GSList *devices;		/* Devices structure pointers */
+	GHashTable *devices_by_path;	/* Object path to device index */
 	GSList *connect_list;		/* Devices to connect when found */
 	struct btd_device *connect_le;	/* LE device waiting to be connected */
 	sdp_list_t *services;		/* Services associated to adapter */
@@ -222,6 +223,9 @@ struct btd_adapter {
 	unsigned int pair_device_id;
 	guint pair_device_timeout;
 
+	unsigned int reports_filtered;	/* duplicate reports dropped */
+	unsigned int reports_passed;	/* reports fully processed */
+
 	bool is_default;		/* true if adapter is default one */
 };
 
@@ -1061,6 +1065,16 @@ void adapter_service_remove(struct btd_adapter *adapter, uint32_t handle)
 	remove_record_from_server(rec->handle);
 }
 
+static void adapter_add_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	adapter->devices = g_slist_append(adapter->devices, device);
+
+	/* The path is owned by the device and outlives its table entry */
+	g_hash_table_insert(adapter->devices_by_path,
+					(gpointer) device_get_path(device), device);
+}
+
 static struct btd_device *adapter_create_device(struct btd_adapter *adapter,
 						const bdaddr_t *bdaddr,
 						uint8_t bdaddr_type)
@@ -1071,7 +1085,7 @@ static struct btd_device *adapter_create_device(struct btd_adapter *adapter,
 	if (!device)
 		return NULL;
 
-	adapter->devices = g_slist_append(adapter->devices, device);
+	adapter_add_device(adapter, device);
 
 	return device;
 }
@@ -1107,6 +1121,7 @@ void btd_adapter_remove_device(struct btd_adapter *adapter,
 	adapter->connect_list = g_slist_remove(adapter->connect_list, dev);
 
 	adapter->devices = g_slist_remove(adapter->devices, dev);
+	g_hash_table_remove(adapter->devices_by_path, device_get_path(dev));
 
 	adapter->discovery_found = g_slist_remove(adapter->discovery_found,
 									dev);
@@ -1597,6 +1612,9 @@ static void invalidate_rssi(gpointer a)
 
 static void discovery_cleanup(struct btd_adapter *adapter)
 {
+	DBG("reports filtered %u passed %u", adapter->reports_filtered,
+						adapter->reports_passed);
+
 	g_slist_free_full(adapter->discovery_found, invalidate_rssi);
 	adapter->discovery_found = NULL;
 }
@@ -2234,13 +2252,31 @@ static gboolean property_get_modalias(const GDBusPropertyTable *property,
 	return TRUE;
 }
 
-static int device_path_cmp(gconstpointer a, gconstpointer b)
+/* Object paths have always been matched ignoring case */
+static guint device_path_hash(gconstpointer key)
 {
-	const struct btd_device *device = a;
-	const char *path = b;
-	const char *dev_path = device_get_path(device);
+	const char *path = key;
+	guint hash = 5381;
+
+	while (*path)
+		hash = hash * 33 + g_ascii_tolower(*path++);
+
+	return hash;
+}
+
+static gboolean device_path_equal(gconstpointer a, gconstpointer b)
+{
+	return g_ascii_strcasecmp(a, b) == 0;
+}
+
+struct btd_device *btd_adapter_find_device_by_path(
+						struct btd_adapter *adapter,
+						const char *path)
+{
+	if (!adapter || !path)
+		return NULL;
 
-	return strcasecmp(dev_path, path);
+	return g_hash_table_lookup(adapter->devices_by_path, path);
 }
 
 static DBusMessage *remove_device(DBusConnection *conn,
@@ -2249,21 +2285,18 @@ static DBusMessage *remove_device(DBusConnection *conn,
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
 	const char *path;
-	GSList *list;
 
 	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
 						DBUS_TYPE_INVALID) == FALSE)
 		return btd_error_invalid_args(msg);
 
-	list = g_slist_find_custom(adapter->devices, path, device_path_cmp);
-	if (!list)
+	device = btd_adapter_find_device_by_path(adapter, path);
+	if (!device)
 		return btd_error_does_not_exist(msg);
 
 	if (!(adapter->current_settings & MGMT_SETTING_POWERED))
 		return btd_error_not_ready(msg);
 
-	device = list->data;
-
 	btd_device_set_temporary(device, TRUE);
 
 	if (!btd_device_is_connected(device)) {
@@ -2908,7 +2941,7 @@ static void load_devices(struct btd_adapter *adapter)
 			goto free;
 
 		btd_device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
+		adapter_add_device(adapter, device);
 
 		/* TODO: register services from pre-loaded list of primaries */
 
@@ -3571,6 +3604,8 @@ static void adapter_free(gpointer user_data)
 
 	g_slist_free(adapter->connections);
 
+	g_hash_table_destroy(adapter->devices_by_path);
+
 	g_free(adapter->path);
 	g_free(adapter->name);
 	g_free(adapter->short_name);
@@ -4516,6 +4551,8 @@ static struct btd_adapter *btd_adapter_new(uint16_t index)
 	DBG("Pairable timeout: %u seconds", adapter->pairable_timeout);
 
 	adapter->auths = g_queue_new();
+	adapter->devices_by_path = g_hash_table_new(device_path_hash,
+							device_path_equal);
 
 	return btd_adapter_ref(adapter);
 }
@@ -4546,6 +4583,7 @@ static void adapter_remove(struct btd_adapter *adapter)
 
 	g_slist_free(adapter->devices);
 	adapter->devices = NULL;
+	g_hash_table_remove_all(adapter->devices_by_path);
 
 	unload_drivers(adapter);
 	btd_adapter_gatt_server_stop(adapter);
@@ -4676,6 +4714,58 @@ static void adapter_msd_notify(struct btd_adapter *adapter,
 	}
 }
 
+static uint32_t report_hash(const uint8_t *data, uint8_t data_len)
+{
+	uint32_t hash = 2166136261u;
+	uint8_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < data_len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash ^ data_len;
+}
+
+static bool filter_found_device(struct btd_adapter *adapter,
+					struct btd_device *dev,
+					uint8_t bdaddr_type, int8_t rssi,
+					const uint8_t *data, uint8_t data_len)
+{
+	if (!main_opts.dup_window)
+		return false;
+
+	if (!device_is_duplicate_report(dev, report_hash(data, data_len),
+					rssi, main_opts.dup_rssi_delta,
+					main_opts.dup_window))
+		return false;
+
+	/*
+	 * Only drop reports for devices that have already been fully
+	 * processed during the current discovery session. Passive scanning
+	 * reports still need to go through the auto-connect logic.
+	 */
+	if (!adapter->discovery_list ||
+			!g_slist_find(adapter->discovery_found, dev))
+		return false;
+
+	device_update_last_seen(dev, bdaddr_type);
+
+	return true;
+}
+
+void btd_adapter_get_report_stats(struct btd_adapter *adapter,
+					unsigned int *filtered,
+					unsigned int *passed)
+{
+	if (filtered)
+		*filtered = adapter->reports_filtered;
+
+	if (passed)
+		*passed = adapter->reports_passed;
+}
+
 static void update_found_devices(struct btd_adapter *adapter,
 					const bdaddr_t *bdaddr,
 					uint8_t bdaddr_type, int8_t rssi,
@@ -4687,6 +4777,15 @@ static void update_found_devices(struct btd_adapter *adapter,
 	bool name_known, discoverable;
 	char addr[18];
 
+	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
+	if (dev && filter_found_device(adapter, dev, bdaddr_type, rssi,
+							data, data_len)) {
+		adapter->reports_filtered++;
+		return;
+	}
+
+	adapter->reports_passed++;
+
 	memset(&eir_data, 0, sizeof(eir_data));
 	eir_parse(&eir_data, data, data_len);
 
@@ -4695,9 +4794,6 @@ static void update_found_devices(struct btd_adapter *adapter,
 	else
 		discoverable = eir_data.flags & (EIR_LIM_DISC | EIR_GEN_DISC);
 
-	ba2str(bdaddr, addr);
-
-	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
 	if (!dev) {
 		/*
 		 * If no client has requested discovery or the device is
@@ -4713,6 +4809,7 @@ static void update_found_devices(struct btd_adapter *adapter,
 	}
 
 	if (!dev) {
+		ba2str(bdaddr, addr);
 		error("Unable to create object for found device %s", addr);
 		eir_data_free(&eir_data);
 		return;
@@ -4820,6 +4917,17 @@ connect_le:
 	}
 }
 
+/*
+ * DBG() evaluates its arguments only when the call site prints, so this
+ * keeps advertising reports from formatting addresses nobody will see.
+ */
+static const char *dbg_addr(const bdaddr_t *bdaddr, char *str)
+{
+	ba2str(bdaddr, str);
+
+	return str;
+}
+
 static void device_found_callback(uint16_t index, uint16_t length,
 					const void *param, void *user_data)
 {
@@ -4851,9 +4959,9 @@ static void device_found_callback(uint16_t index, uint16_t length,
 
 	flags = btohl(ev->flags);
 
-	ba2str(&ev->addr.bdaddr, addr);
-	DBG("hci%u addr %s, rssi %d flags 0x%04x eir_len %u",
-			index, addr, ev->rssi, flags, eir_len);
+	DBG("hci%u addr %s, rssi %d flags 0x%04x eir_len %u", index,
+				dbg_addr(&ev->addr.bdaddr, addr), ev->rssi,
+				flags, eir_len);
 
 	/* Ignore non-connectable events for now */
 	if (flags & MGMT_DEV_FOUND_NOT_CONNECTABLE)
@@ -5915,7 +6023,7 @@ static void store_link_key(struct btd_adapter *adapter,
 				uint8_t type, uint8_t pin_length)
 {
 	char adapter_addr[18];
-	char device_addr[18];
+	const char *device_addr;
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
 	gsize length = 0;
@@ -5924,7 +6032,7 @@ static void store_link_key(struct btd_adapter *adapter,
 	int i;
 
 	ba2str(btd_adapter_get_address(adapter), adapter_addr);
-	ba2str(device_get_address(device), device_addr);
+	device_addr = device_get_address_str(device);
 
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/info", adapter_addr,
 								device_addr);
@@ -6835,14 +6943,14 @@ static void remove_keys(struct btd_adapter *adapter,
 					struct btd_device *device, uint8_t type)
 {
 	char adapter_addr[18];
-	char device_addr[18];
+	const char *device_addr;
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
 	gsize length = 0;
 	char *str;
 
 	ba2str(btd_adapter_get_address(adapter), adapter_addr);
-	ba2str(device_get_address(device), device_addr);
+	device_addr = device_get_address_str(device);
 
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/info", adapter_addr,
 								device_addr);
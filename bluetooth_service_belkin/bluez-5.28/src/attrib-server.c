@@ -61,7 +61,11 @@ struct gatt_server {
 	GIOChannel *le_io;
 	uint32_t gatt_sdp_handle;
 	uint32_t gap_sdp_handle;
-	GList *database;
+	GPtrArray *database;		/* struct attribute, sorted by handle */
+	GArray *free_ranges;		/* struct att_range, sorted */
+	guint min_svc128;		/* Lowest 128-bit service declaration */
+	guint max_svc16;		/* Highest 16-bit service declaration */
+	GHashTable *ccc_subs;		/* CCC handle -> channels with it set */
 	GSList *clients;
 	uint16_t name_handle;
 	uint16_t appearance_handle;
@@ -76,8 +80,13 @@ struct gatt_channel {
 	struct gatt_server *server;
 	guint cleanup_id;
 	struct btd_device *device;
+	GHashTable *ccc;		/* CCC handle -> configured value */
+	guint ccc_sync_id;
 };
 
+/* Seconds CCC writes are batched before being written to storage */
+#define CCC_SYNC_DELAY 2
+
 struct group_elem {
 	uint16_t handle;
 	uint16_t end;
@@ -115,8 +124,185 @@ static void attrib_free(void *data)
 	g_free(a);
 }
 
+static void ccc_subs_update(struct gatt_channel *channel, uint16_t handle,
+						uint16_t old, uint16_t value)
+{
+	GHashTable *subs = channel->server->ccc_subs;
+	gpointer key = GUINT_TO_POINTER(handle);
+	GSList *l;
+
+	if (!old == !value)
+		return;
+
+	l = g_hash_table_lookup(subs, key);
+
+	if (value)
+		l = g_slist_prepend(l, channel);
+	else
+		l = g_slist_remove(l, channel);
+
+	if (l)
+		g_hash_table_insert(subs, key, l);
+	else
+		g_hash_table_remove(subs, key);
+}
+
+/* Only bonded peers get their configuration back on the next connection */
+static bool ccc_persistent(struct gatt_channel *channel)
+{
+	uint8_t bdaddr_type;
+
+	if (!channel->device || device_is_temporary(channel->device))
+		return false;
+
+	if (channel->le)
+		bdaddr_type = btd_device_get_bdaddr_type(channel->device);
+	else
+		bdaddr_type = BDADDR_BREDR;
+
+	return device_is_bonded(channel->device, bdaddr_type);
+}
+
+static void ccc_store(struct gatt_channel *channel)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	char *filename;
+	GKeyFile *key_file;
+	char *data;
+	gsize length = 0;
+
+	/* Never recreate the storage of a removed or unbonded device */
+	if (!ccc_persistent(channel))
+		return;
+
+	filename = btd_device_get_storage_path(channel->device, "ccc");
+	if (!filename) {
+		warn("Unable to get ccc storage path for device");
+		return;
+	}
+
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
+
+	g_hash_table_iter_init(&iter, channel->ccc);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		char group[6], str[5];
+
+		sprintf(group, "%hu", (uint16_t) GPOINTER_TO_UINT(key));
+		sprintf(str, "%hX", (uint16_t) GPOINTER_TO_UINT(value));
+		g_key_file_set_string(key_file, group, "Value", str);
+	}
+
+	data = g_key_file_to_data(key_file, &length, NULL);
+	if (length > 0) {
+		create_file(filename, S_IRUSR | S_IWUSR);
+		g_file_set_contents(filename, data, length, NULL);
+	}
+
+	g_free(data);
+	g_free(filename);
+	g_key_file_free(key_file);
+}
+
+static gboolean ccc_sync_cb(gpointer user_data)
+{
+	struct gatt_channel *channel = user_data;
+
+	channel->ccc_sync_id = 0;
+	ccc_store(channel);
+
+	return FALSE;
+}
+
+static void ccc_load(struct gatt_channel *channel)
+{
+	char *filename;
+	GKeyFile *key_file;
+	char **groups;
+	int i;
+
+	filename = btd_device_get_storage_path(channel->device, "ccc");
+	if (!filename) {
+		warn("Unable to get ccc storage path for device");
+		return;
+	}
+
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	groups = g_key_file_get_groups(key_file, NULL);
+
+	for (i = 0; groups && groups[i]; i++) {
+		unsigned int handle, config;
+		char *str;
+
+		str = g_key_file_get_string(key_file, groups[i], "Value",
+									NULL);
+		if (str && sscanf(groups[i], "%u", &handle) == 1 &&
+				handle && handle <= 0xffff &&
+				sscanf(str, "%04X", &config) == 1) {
+			g_hash_table_insert(channel->ccc,
+						GUINT_TO_POINTER(handle),
+						GUINT_TO_POINTER(config));
+			ccc_subs_update(channel, handle, 0, config);
+		}
+
+		g_free(str);
+	}
+
+	g_strfreev(groups);
+	g_free(filename);
+	g_key_file_free(key_file);
+}
+
+static bool ccc_get(struct gatt_channel *channel, uint16_t handle,
+							uint16_t *value)
+{
+	gpointer config;
+
+	if (!g_hash_table_lookup_extended(channel->ccc,
+					GUINT_TO_POINTER(handle), NULL,
+					&config))
+		return false;
+
+	*value = GPOINTER_TO_UINT(config);
+
+	return true;
+}
+
+static void ccc_set(struct gatt_channel *channel, uint16_t handle,
+							uint16_t value)
+{
+	uint16_t old = 0;
+
+	ccc_get(channel, handle, &old);
+
+	g_hash_table_insert(channel->ccc, GUINT_TO_POINTER(handle),
+						GUINT_TO_POINTER(value));
+	ccc_subs_update(channel, handle, old, value);
+
+	/* Writes are coalesced and persisted from the mainloop */
+	if (!channel->ccc_sync_id)
+		channel->ccc_sync_id = g_timeout_add_seconds(CCC_SYNC_DELAY,
+							ccc_sync_cb, channel);
+}
+
 static void channel_free(struct gatt_channel *channel)
 {
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (channel->ccc_sync_id) {
+		g_source_remove(channel->ccc_sync_id);
+		ccc_store(channel);
+	}
+
+	g_hash_table_iter_init(&iter, channel->ccc);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		ccc_subs_update(channel, GPOINTER_TO_UINT(key),
+						GPOINTER_TO_UINT(value), 0);
+
+	g_hash_table_destroy(channel->ccc);
 
 	if (channel->cleanup_id)
 		g_source_remove(channel->cleanup_id);
@@ -130,7 +316,8 @@ static void channel_free(struct gatt_channel *channel)
 
 static void gatt_server_free(struct gatt_server *server)
 {
-	g_list_free_full(server->database, attrib_free);
+	g_ptr_array_free(server->database, TRUE);
+	g_array_free(server->free_ranges, TRUE);
 
 	if (server->l2cap_io != NULL) {
 		g_io_channel_shutdown(server->l2cap_io, FALSE, NULL);
@@ -143,6 +330,7 @@ static void gatt_server_free(struct gatt_server *server)
 	}
 
 	g_slist_free_full(server->clients, (GDestroyNotify) channel_free);
+	g_hash_table_destroy(server->ccc_subs);
 
 	if (server->gatt_sdp_handle > 0)
 		adapter_service_remove(server->adapter,
@@ -247,50 +435,165 @@ static sdp_record_t *server_record_new(uuid_t *uuid, uint16_t start, uint16_t en
 	return record;
 }
 
-static int handle_cmp(gconstpointer a, gconstpointer b)
+static bool is_service_decl(const struct attribute *a)
 {
-	const struct attribute *attrib = a;
-	uint16_t handle = GPOINTER_TO_UINT(b);
+	return bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
+					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0;
+}
 
-	return attrib->handle - handle;
+#define db_index(server, i) \
+	((struct attribute *) g_ptr_array_index((server)->database, (i)))
+
+/* Index of the first attribute whose handle is not below handle */
+static guint db_lower_bound(struct gatt_server *server, uint16_t handle)
+{
+	guint lo = 0, hi = server->database->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (db_index(server, mid)->handle < handle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static struct attribute *db_lookup(struct gatt_server *server,
+							uint16_t handle)
+{
+	guint i = db_lower_bound(server, handle);
+	struct attribute *a;
+
+	if (i == server->database->len)
+		return NULL;
+
+	a = db_index(server, i);
+
+	return a->handle == handle ? a : NULL;
+}
+
+/* Index of the first free range ending at or above handle */
+static guint free_range_find(GArray *ranges, uint16_t handle)
+{
+	guint lo = 0, hi = ranges->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (g_array_index(ranges, struct att_range, mid).end < handle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
 }
 
-static int attribute_cmp(gconstpointer a1, gconstpointer a2)
+static void free_range_take(struct gatt_server *server, uint16_t handle)
 {
-	const struct attribute *attrib1 = a1;
-	const struct attribute *attrib2 = a2;
+	GArray *ranges = server->free_ranges;
+	guint i = free_range_find(ranges, handle);
+	struct att_range *r, upper;
+
+	if (i == ranges->len)
+		return;
+
+	r = &g_array_index(ranges, struct att_range, i);
+	if (r->start > handle)
+		return;
 
-	return attrib1->handle - attrib2->handle;
+	if (r->start == r->end) {
+		g_array_remove_index(ranges, i);
+	} else if (r->start == handle) {
+		r->start++;
+	} else if (r->end == handle) {
+		r->end--;
+	} else {
+		upper.start = handle + 1;
+		upper.end = r->end;
+		r->end = handle - 1;
+		g_array_insert_val(ranges, i + 1, upper);
+	}
+}
+
+static void free_range_release(struct gatt_server *server, uint16_t handle)
+{
+	GArray *ranges = server->free_ranges;
+	guint i = free_range_find(ranges, handle);
+	struct att_range *prev = NULL, *next = NULL, r;
+
+	if (i > 0)
+		prev = &g_array_index(ranges, struct att_range, i - 1);
+
+	if (i < ranges->len)
+		next = &g_array_index(ranges, struct att_range, i);
+
+	if (prev && prev->end + 1 != handle)
+		prev = NULL;
+
+	if (next && next->start != handle + 1)
+		next = NULL;
+
+	if (prev && next) {
+		prev->end = next->end;
+		g_array_remove_index(ranges, i);
+	} else if (prev) {
+		prev->end = handle;
+	} else if (next) {
+		next->start = handle;
+	} else {
+		r.start = handle;
+		r.end = handle;
+		g_array_insert_val(ranges, i, r);
+	}
+}
+
+static void update_svc_bounds(struct gatt_server *server)
+{
+	guint i;
+
+	server->min_svc128 = 0x10000;
+	server->max_svc16 = 0;
+
+	for (i = 0; i < server->database->len; i++) {
+		struct attribute *a = db_index(server, i);
+
+		if (!is_service_decl(a))
+			continue;
+
+		if (a->len == 16 && a->handle < server->min_svc128)
+			server->min_svc128 = a->handle;
+		else if (a->len == 2 && a->handle > server->max_svc16)
+			server->max_svc16 = a->handle;
+	}
 }
 
 static struct attribute *find_svc_range(struct gatt_server *server,
 					uint16_t start, uint16_t *end)
 {
 	struct attribute *attrib;
-	guint h = start;
-	GList *l;
+	guint i;
 
 	if (end == NULL)
 		return NULL;
 
-	l = g_list_find_custom(server->database, GUINT_TO_POINTER(h),
-								handle_cmp);
-	if (!l)
+	i = db_lower_bound(server, start);
+	if (i == server->database->len)
 		return NULL;
 
-	attrib = l->data;
-
-	if (bt_uuid_cmp(&attrib->uuid, &prim_uuid) != 0 &&
-			bt_uuid_cmp(&attrib->uuid, &snd_uuid) != 0)
+	attrib = db_index(server, i);
+	if (attrib->handle != start || !is_service_decl(attrib))
 		return NULL;
 
 	*end = start;
 
-	for (l = l->next; l; l = l->next) {
-		struct attribute *a = l->data;
+	for (i++; i < server->database->len; i++) {
+		struct attribute *a = db_index(server, i);
 
-		if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
+		if (is_service_decl(a))
 			break;
 
 		*end = a->handle;
@@ -350,12 +653,13 @@ static struct attribute *attrib_db_add_new(struct gatt_server *server,
 				const uint8_t *value, size_t len)
 {
 	struct attribute *a;
-	guint h = handle;
+	GPtrArray *db = server->database;
+	guint i;
 
 	DBG("handle=0x%04x", handle);
 
-	if (g_list_find_custom(server->database, GUINT_TO_POINTER(h),
-								handle_cmp))
+	i = db_lower_bound(server, handle);
+	if (i < db->len && db_index(server, i)->handle == handle)
 		return NULL;
 
 	a = g_new0(struct attribute, 1);
@@ -366,8 +670,20 @@ static struct attribute *attrib_db_add_new(struct gatt_server *server,
 	a->read_req = read_req;
 	a->write_req = write_req;
 
-	server->database = g_list_insert_sorted(server->database, a,
-								attribute_cmp);
+	/* Shift the tail up to keep the array sorted by handle */
+	g_ptr_array_add(db, NULL);
+	memmove(&db->pdata[i + 1], &db->pdata[i],
+				(db->len - 1 - i) * sizeof(gpointer));
+	db->pdata[i] = a;
+
+	free_range_take(server, handle);
+
+	if (is_service_decl(a)) {
+		if (len == 16 && handle < server->min_svc128)
+			server->min_svc128 = handle;
+		else if (len == 2 && handle > server->max_svc16)
+			server->max_svc16 = handle;
+	}
 
 	return a;
 }
@@ -425,11 +741,12 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 	struct att_data_list *adl;
 	struct attribute *a;
 	struct group_elem *cur, *old = NULL;
+	struct gatt_server *server = channel->server;
 	GSList *l, *groups;
-	GList *dl, *database;
+	guint i;
 	uint16_t length, last_handle, last_size = 0;
 	uint8_t status;
-	int i;
+	int j;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
@@ -446,13 +763,10 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
 
 	last_handle = end;
-	database = channel->server->database;
-	for (dl = database, groups = NULL, cur = NULL; dl; dl = dl->next) {
-
-		a = dl->data;
+	i = db_lower_bound(server, start);
+	for (groups = NULL, cur = NULL; i < server->database->len; i++) {
 
-		if (a->handle < start)
-			continue;
+		a = db_index(server, i);
 
 		if (a->handle >= end)
 			break;
@@ -504,7 +818,7 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
 					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
 
-	if (dl == NULL)
+	if (i == server->database->len)
 		cur->end = a->handle;
 	else
 		cur->end = last_handle;
@@ -518,12 +832,12 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 					ATT_ECODE_UNLIKELY, pdu, len);
 	}
 
-	for (i = 0, l = groups; l; l = l->next, i++) {
+	for (j = 0, l = groups; l; l = l->next, j++) {
 		uint8_t *value;
 
 		cur = l->data;
 
-		value = (void *) adl->data[i];
+		value = (void *) adl->data[j];
 
 		put_le16(cur->handle, value);
 		put_le16(cur->end, &value[2]);
@@ -544,24 +858,22 @@ static uint16_t read_by_type(struct gatt_channel *channel, uint16_t start,
 						uint8_t *pdu, size_t len)
 {
 	struct att_data_list *adl;
+	struct gatt_server *server = channel->server;
 	GSList *l, *types;
-	GList *dl, *database;
 	struct attribute *a;
 	uint16_t num, length;
 	uint8_t status;
+	guint idx;
 	int i;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	database = channel->server->database;
-	for (dl = database, length = 0, types = NULL; dl; dl = dl->next) {
+	idx = db_lower_bound(server, start);
+	for (length = 0, types = NULL; idx < server->database->len; idx++) {
 
-		a = dl->data;
-
-		if (a->handle < start)
-			continue;
+		a = db_index(server, idx);
 
 		if (a->handle > end)
 			break;
@@ -633,22 +945,20 @@ static uint16_t find_info(struct gatt_channel *channel, uint16_t start,
 {
 	struct attribute *a;
 	struct att_data_list *adl;
+	struct gatt_server *server = channel->server;
 	GSList *l, *info;
-	GList *dl, *database;
 	uint8_t format, last_type = BT_UUID_UNSPEC;
 	uint16_t length, num;
+	guint idx;
 	int i;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	database = channel->server->database;
-	for (dl = database, info = NULL, num = 0; dl; dl = dl->next) {
-		a = dl->data;
-
-		if (a->handle < start)
-			continue;
+	idx = db_lower_bound(server, start);
+	for (info = NULL, num = 0; idx < server->database->len; idx++) {
+		a = db_index(server, idx);
 
 		if (a->handle > end)
 			break;
@@ -715,21 +1025,19 @@ static uint16_t find_by_type(struct gatt_channel *channel, uint16_t start,
 {
 	struct attribute *a;
 	struct att_range *range;
+	struct gatt_server *server = channel->server;
 	GSList *matches;
-	GList *dl, *database;
 	uint16_t len;
+	guint i;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, opdu, mtu);
 
 	/* Searching first requested handle number */
-	database = channel->server->database;
-	for (dl = database, matches = NULL, range = NULL; dl; dl = dl->next) {
-		a = dl->data;
-
-		if (a->handle < start)
-			continue;
+	i = db_lower_bound(server, start);
+	for (matches = NULL, range = NULL; i < server->database->len; i++) {
+		a = db_index(server, i);
 
 		if (a->handle > end)
 			break;
@@ -768,59 +1076,20 @@ static uint16_t find_by_type(struct gatt_channel *channel, uint16_t start,
 	return len;
 }
 
-static int read_device_ccc(struct btd_device *device, uint16_t handle,
-				uint16_t *value)
-{
-	char *filename;
-	GKeyFile *key_file;
-	char group[6];
-	char *str;
-	unsigned int config;
-	int err = 0;
-
-	filename = btd_device_get_storage_path(device, "ccc");
-	if (!filename) {
-		warn("Unable to get ccc storage path for device");
-		return -ENOENT;
-	}
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
-
-	sprintf(group, "%hu", handle);
-
-	str = g_key_file_get_string(key_file, group, "Value", NULL);
-	if (!str || sscanf(str, "%04X", &config) != 1)
-		err = -ENOENT;
-	else
-		*value = config;
-
-	g_free(str);
-	g_free(filename);
-	g_key_file_free(key_file);
-
-	return err;
-}
-
 static uint16_t read_value(struct gatt_channel *channel, uint16_t handle,
 						uint8_t *pdu, size_t len)
 {
 	struct attribute *a;
 	uint8_t status;
-	GList *l;
 	uint16_t cccval;
-	guint h = handle;
 
-	l = g_list_find_custom(channel->server->database,
-					GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = db_lookup(channel->server, handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_READ_REQ, handle,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
-		read_device_ccc(channel->device, handle, &cccval) == 0) {
+				ccc_get(channel, handle, &cccval)) {
 		uint8_t config[2];
 
 		put_le16(cccval, config);
@@ -844,24 +1113,19 @@ static uint16_t read_blob(struct gatt_channel *channel, uint16_t handle,
 {
 	struct attribute *a;
 	uint8_t status;
-	GList *l;
 	uint16_t cccval;
-	guint h = handle;
 
-	l = g_list_find_custom(channel->server->database,
-					GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = db_lookup(channel->server, handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_READ_BLOB_REQ, handle,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	if (a->len <= offset)
 		return enc_error_resp(ATT_OP_READ_BLOB_REQ, handle,
 					ATT_ECODE_INVALID_OFFSET, pdu, len);
 
 	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
-		read_device_ccc(channel->device, handle, &cccval) == 0) {
+				ccc_get(channel, handle, &cccval)) {
 		uint8_t config[2];
 
 		put_le16(cccval, config);
@@ -887,17 +1151,12 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 {
 	struct attribute *a;
 	uint8_t status;
-	GList *l;
-	guint h = handle;
 
-	l = g_list_find_custom(channel->server->database,
-					GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = db_lookup(channel->server, handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_WRITE_REQ, handle,
 				ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	status = att_check_reqs(channel, ATT_OP_WRITE_REQ, a->write_req);
 	if (status)
 		return enc_error_resp(ATT_OP_WRITE_REQ, handle, status, pdu,
@@ -916,37 +1175,7 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 							status, pdu, len);
 		}
 	} else {
-		uint16_t cccval = get_le16(value);
-		char *filename;
-		GKeyFile *key_file;
-		char group[6], value[5];
-		char *data;
-		gsize length = 0;
-
-		filename = btd_device_get_storage_path(channel->device, "ccc");
-		if (!filename) {
-			warn("Unable to get ccc storage path for device");
-			return enc_error_resp(ATT_OP_WRITE_REQ, handle,
-						ATT_ECODE_WRITE_NOT_PERM,
-						pdu, len);
-		}
-
-		key_file = g_key_file_new();
-		g_key_file_load_from_file(key_file, filename, 0, NULL);
-
-		sprintf(group, "%hu", handle);
-		sprintf(value, "%hX", cccval);
-		g_key_file_set_string(key_file, group, "Value", value);
-
-		data = g_key_file_to_data(key_file, &length, NULL);
-		if (length > 0) {
-			create_file(filename, S_IRUSR | S_IWUSR);
-			g_file_set_contents(filename, data, length, NULL);
-		}
-
-		g_free(data);
-		g_free(filename);
-		g_key_file_free(key_file);
+		ccc_set(channel, handle, get_le16(value));
 	}
 
 	return enc_write_resp(pdu);
@@ -1150,6 +1379,54 @@ GAttrib *attrib_from_device(struct btd_device *device)
 	return NULL;
 }
 
+void attrib_device_removed(struct btd_device *device)
+{
+	struct btd_adapter *adapter = device_get_adapter(device);
+	struct gatt_server *server;
+	GSList *l;
+
+	l = g_slist_find_custom(servers, adapter, adapter_cmp);
+	if (!l)
+		return;
+
+	server = l->data;
+
+	for (l = server->clients; l; l = l->next) {
+		struct gatt_channel *channel = l->data;
+
+		if (channel->device != device || !channel->ccc_sync_id)
+			continue;
+
+		g_source_remove(channel->ccc_sync_id);
+		channel->ccc_sync_id = 0;
+	}
+}
+
+guint attrib_ccc_foreach(struct btd_adapter *adapter, uint16_t handle,
+				attrib_ccc_func_t func, void *user_data)
+{
+	struct gatt_server *server;
+	GSList *l;
+	guint count = 0;
+
+	l = g_slist_find_custom(servers, adapter, adapter_cmp);
+	if (l == NULL)
+		return 0;
+
+	server = l->data;
+
+	l = g_hash_table_lookup(server->ccc_subs, GUINT_TO_POINTER(handle));
+	for (; l; l = l->next, count++) {
+		struct gatt_channel *channel = l->data;
+		uint16_t value = 0;
+
+		ccc_get(channel, handle, &value);
+		func(channel->attrib, value, user_data);
+	}
+
+	return count;
+}
+
 guint attrib_channel_attach(GAttrib *attrib)
 {
 	struct gatt_server *server;
@@ -1218,6 +1495,11 @@ guint attrib_channel_attach(GAttrib *attrib)
 
 	channel->device = btd_device_ref(device);
 
+	/* Only bonded devices keep their configuration across connections */
+	channel->ccc = g_hash_table_new(NULL, NULL);
+	if (device_is_bonded(device, bdaddr_type))
+		ccc_load(channel);
+
 	server->clients = g_slist_append(server->clients, channel);
 
 	return channel->id;
@@ -1357,6 +1639,7 @@ static gboolean register_core_services(struct gatt_server *server)
 
 int btd_adapter_gatt_server_start(struct btd_adapter *adapter)
 {
+	struct att_range all_handles = { 0x0001, 0xffff };
 	struct gatt_server *server;
 	GError *gerr = NULL;
 	const bdaddr_t *addr;
@@ -1365,6 +1648,13 @@ int btd_adapter_gatt_server_start(struct btd_adapter *adapter)
 
 	server = g_new0(struct gatt_server, 1);
 	server->adapter = btd_adapter_ref(adapter);
+	server->database = g_ptr_array_new_with_free_func(attrib_free);
+	server->free_ranges = g_array_new(FALSE, FALSE,
+						sizeof(struct att_range));
+	server->ccc_subs = g_hash_table_new_full(NULL, NULL, NULL,
+						(GDestroyNotify) g_slist_free);
+	server->min_svc128 = 0x10000;
+	g_array_append_val(server->free_ranges, all_handles);
 
 	addr = btd_adapter_get_address(server->adapter);
 
@@ -1439,91 +1729,89 @@ void attrib_free_sdp(struct btd_adapter *adapter, uint32_t sdp_handle)
 	adapter_service_remove(adapter, sdp_handle);
 }
 
+/* Only free ranges that end right below a service can hold a new one */
+static bool free_range_before_svc(struct gatt_server *server,
+						const struct att_range *r)
+{
+	struct attribute *a;
+
+	if (r->end == 0xffff)
+		return true;
+
+	a = db_lookup(server, r->end + 1);
+
+	return a && is_service_decl(a);
+}
+
 static uint16_t find_uuid16_avail(struct btd_adapter *adapter, uint16_t nitems)
 {
 	struct gatt_server *server;
-	uint16_t handle;
 	GSList *l;
-	GList *dl;
+	guint i;
 
 	l = g_slist_find_custom(servers, adapter, adapter_cmp);
 	if (l == NULL)
 		return 0;
 
 	server = l->data;
-	if (server->database == NULL)
+	if (server->database->len == 0)
 		return 0x0001;
 
-	for (dl = server->database, handle = 0x0001; dl; dl = dl->next) {
-		struct attribute *a = dl->data;
+	/* 16 bit UUID services grow upwards, below any 128 bit one */
+	for (i = 0; i < server->free_ranges->len; i++) {
+		struct att_range *r = &g_array_index(server->free_ranges,
+							struct att_range, i);
 
-		if ((bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0) &&
-				a->handle - handle >= nitems)
-			/* Note: the range above excludes the current handle */
-			return handle;
-
-		if (a->len == 16 && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
-			/* 128 bit UUID service definition */
+		if (r->start > server->min_svc128)
 			return 0;
-		}
 
-		if (a->handle == 0xffff)
-			return 0;
+		if (!free_range_before_svc(server, r))
+			continue;
 
-		handle = a->handle + 1;
+		if (r->end - r->start + 1 >= nitems)
+			return r->start;
 	}
 
-	if (0xffff - handle + 1 >= nitems)
-		return handle;
-
 	return 0;
 }
 
 static uint16_t find_uuid128_avail(struct btd_adapter *adapter, uint16_t nitems)
 {
-	uint16_t handle = 0, end = 0xffff;
 	struct gatt_server *server;
-	GList *dl;
 	GSList *l;
+	guint i;
 
 	l = g_slist_find_custom(servers, adapter, adapter_cmp);
 	if (l == NULL)
 		return 0;
 
 	server = l->data;
-	if (server->database == NULL)
+	if (server->database->len == 0)
 		return 0xffff - nitems + 1;
 
-	for (dl = g_list_last(server->database); dl; dl = dl->prev) {
-		struct attribute *a = dl->data;
+	/* 128 bit UUID services grow downwards, above any 16 bit one */
+	for (i = server->free_ranges->len; i > 0; i--) {
+		struct att_range *r = &g_array_index(server->free_ranges,
+						struct att_range, i - 1);
 
-		if (handle == 0)
-			handle = a->handle;
+		if (r->end < server->max_svc16)
+			return 0;
 
-		if (bt_uuid_cmp(&a->uuid, &prim_uuid) != 0 &&
-				bt_uuid_cmp(&a->uuid, &snd_uuid) != 0)
+		if (!free_range_before_svc(server, r))
 			continue;
 
-		if (end - handle >= nitems)
-			return end - nitems + 1;
+		/* Handle 0x0001 is never handed out from the bottom range */
+		if (r->start == 0x0001) {
+			if (r->end - 0x0001 >= nitems)
+				return r->end - nitems + 1;
 
-		if (a->len == 2) {
-			/* 16 bit UUID service definition */
 			return 0;
 		}
 
-		if (a->handle == 0x0001)
-			return 0;
-
-		end = a->handle - 1;
-		handle = 0;
+		if (r->end - r->start + 1 >= nitems)
+			return r->end - nitems + 1;
 	}
 
-	if (end - 0x0001 >= nitems)
-		return end - nitems + 1;
-
 	return 0;
 }
 
@@ -1568,8 +1856,6 @@ int attrib_db_update(struct btd_adapter *adapter, uint16_t handle,
 	struct gatt_server *server;
 	struct attribute *a;
 	GSList *l;
-	GList *dl;
-	guint h = handle;
 
 	l = g_slist_find_custom(servers, adapter, adapter_cmp);
 	if (l == NULL)
@@ -1579,13 +1865,10 @@ int attrib_db_update(struct btd_adapter *adapter, uint16_t handle,
 
 	DBG("handle=0x%04x", handle);
 
-	dl = g_list_find_custom(server->database, GUINT_TO_POINTER(h),
-								handle_cmp);
-	if (dl == NULL)
+	a = db_lookup(server, handle);
+	if (a == NULL)
 		return -ENOENT;
 
-	a = dl->data;
-
 	a->data = g_try_realloc(a->data, len);
 	if (len && a->data == NULL)
 		return -ENOMEM;
@@ -1596,6 +1879,9 @@ int attrib_db_update(struct btd_adapter *adapter, uint16_t handle,
 	if (uuid != NULL)
 		a->uuid = *uuid;
 
+	if (uuid != NULL || is_service_decl(a))
+		update_svc_bounds(server);
+
 	if (attr)
 		*attr = a;
 
@@ -1605,10 +1891,9 @@ int attrib_db_update(struct btd_adapter *adapter, uint16_t handle,
 int attrib_db_del(struct btd_adapter *adapter, uint16_t handle)
 {
 	struct gatt_server *server;
-	struct attribute *a;
 	GSList *l;
-	GList *dl;
-	guint h = handle;
+	bool svc;
+	guint i;
 
 	l = g_slist_find_custom(servers, adapter, adapter_cmp);
 	if (l == NULL)
@@ -1618,15 +1903,19 @@ int attrib_db_del(struct btd_adapter *adapter, uint16_t handle)
 
 	DBG("handle=0x%04x", handle);
 
-	dl = g_list_find_custom(server->database, GUINT_TO_POINTER(h),
-								handle_cmp);
-	if (dl == NULL)
+	i = db_lower_bound(server, handle);
+	if (i == server->database->len ||
+				db_index(server, i)->handle != handle)
 		return -ENOENT;
 
-	a = dl->data;
-	server->database = g_list_remove(server->database, a);
-	g_free(a->data);
-	g_free(a);
+	svc = is_service_decl(db_index(server, i));
+
+	/* Frees the attribute through attrib_free() */
+	g_ptr_array_remove_index(server->database, i);
+	free_range_release(server, handle);
+
+	if (svc)
+		update_svc_bounds(server);
 
 	return 0;
 }
@@ -38,5 +38,14 @@ uint32_t attrib_create_sdp(struct btd_adapter *adapter, uint16_t handle,
 							const char *name);
 void attrib_free_sdp(struct btd_adapter *adapter, uint32_t sdp_handle);
 GAttrib *attrib_from_device(struct btd_device *device);
+/* Drops pending CCC writes so removed devices leave no storage behind */
+void attrib_device_removed(struct btd_device *device);
+
+/* Calls func for every channel with a non-zero value in CCC handle */
+typedef void (*attrib_ccc_func_t)(GAttrib *attrib, uint16_t value,
+							void *user_data);
+guint attrib_ccc_foreach(struct btd_adapter *adapter, uint16_t handle,
+				attrib_ccc_func_t func, void *user_data);
+
 guint attrib_channel_attach(GAttrib *attrib);
 gboolean attrib_channel_detach(GAttrib *attrib, guint id);
@@ -176,6 +176,7 @@ struct btd_device {
 
 	bdaddr_t	bdaddr;
 	uint8_t		bdaddr_type;
+	char		addr_str[18];		/* bdaddr as from ba2str() */
 	char		*path;
 	bool		bredr;
 	bool		le;
@@ -243,8 +244,34 @@ struct btd_device {
 	bool		legacy;
 	int8_t		rssi;
 
+	uint32_t	adv_hash;	/* Last processed advertising data */
+	int8_t		adv_rssi;
+	gint64		adv_time;
+
 	GIOChannel	*att_io;
 	guint		store_id;
+
+	guint		props_id;	/* Batched property changes timer */
+	uint8_t		props_dirty;
+};
+
+/* Properties updated from discovery whose changes get batched */
+enum {
+	BATCHED_RSSI,
+	BATCHED_NAME,
+	BATCHED_ALIAS,
+	BATCHED_APPEARANCE,
+	BATCHED_ICON,
+	BATCHED_UUIDS,
+};
+
+static const char * const batched_props[] = {
+	"RSSI",
+	"Name",
+	"Alias",
+	"Appearance",
+	"Icon",
+	"UUIDs",
 };
 
 static const uint16_t uuid_list[] = {
@@ -341,7 +368,6 @@ static gboolean store_device_info_cb(gpointer user_data)
 	GKeyFile *key_file;
 	char filename[PATH_MAX];
 	char adapter_addr[18];
-	char device_addr[18];
 	char *str;
 	char class[9];
 	char **uuids = NULL;
@@ -350,9 +376,8 @@ static gboolean store_device_info_cb(gpointer user_data)
 	device->store_id = 0;
 
 	ba2str(btd_adapter_get_address(device->adapter), adapter_addr);
-	ba2str(&device->bdaddr, device_addr);
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/info", adapter_addr,
-			device_addr);
+			device->addr_str);
 
 	key_file = g_key_file_new();
 	g_key_file_load_from_file(key_file, filename, 0, NULL);
@@ -439,6 +464,47 @@ static bool device_address_is_private(struct btd_device *dev)
 	}
 }
 
+static gboolean emit_batched_props(gpointer user_data)
+{
+	struct btd_device *device = user_data;
+	unsigned int i;
+
+	device->props_id = 0;
+
+	/*
+	 * gdbus merges all changes queued here into a single
+	 * PropertiesChanged signal for the device interface.
+	 */
+	for (i = 0; i < G_N_ELEMENTS(batched_props); i++) {
+		if (device->props_dirty & (1 << i))
+			g_dbus_emit_property_changed(dbus_conn, device->path,
+						DEVICE_INTERFACE,
+						batched_props[i]);
+	}
+
+	device->props_dirty = 0;
+
+	return FALSE;
+}
+
+static void emit_property_batched(struct btd_device *device,
+							unsigned int prop)
+{
+	if (!main_opts.prop_batch) {
+		g_dbus_emit_property_changed(dbus_conn, device->path,
+					DEVICE_INTERFACE, batched_props[prop]);
+		return;
+	}
+
+	device->props_dirty |= 1 << prop;
+
+	if (device->props_id > 0)
+		return;
+
+	device->props_id = g_timeout_add(main_opts.prop_batch,
+						emit_batched_props, device);
+}
+
 static void store_device_info(struct btd_device *device)
 {
 	if (device->temporary || device->store_id > 0)
@@ -456,7 +522,7 @@ static void store_device_info(struct btd_device *device)
 void device_store_cached_name(struct btd_device *dev, const char *name)
 {
 	char filename[PATH_MAX];
-	char s_addr[18], d_addr[18];
+	char s_addr[18];
 	GKeyFile *key_file;
 	char *data;
 	gsize length = 0;
@@ -468,8 +534,8 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 	}
 
 	ba2str(btd_adapter_get_address(dev->adapter), s_addr);
-	ba2str(&dev->bdaddr, d_addr);
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", s_addr, d_addr);
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", s_addr,
+							dev->addr_str);
 	create_file(filename, S_IRUSR | S_IWUSR);
 
 	key_file = g_key_file_new();
@@ -600,6 +666,9 @@ static void device_free(gpointer user_data)
 	if (device->discov_timer)
 		g_source_remove(device->discov_timer);
 
+	if (device->props_id)
+		g_source_remove(device->props_id);
+
 	if (device->connect)
 		dbus_message_unref(device->connect);
 
@@ -647,10 +716,8 @@ static gboolean dev_property_get_address(const GDBusPropertyTable *property,
 					DBusMessageIter *iter, void *data)
 {
 	struct btd_device *device = data;
-	char dstaddr[18];
-	const char *ptr = dstaddr;
+	const char *ptr = device->addr_str;
 
-	ba2str(&device->bdaddr, dstaddr);
 	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &ptr);
 
 	return TRUE;
@@ -688,7 +755,7 @@ static gboolean dev_property_get_alias(const GDBusPropertyTable *property,
 	else if (strlen(device->name) > 0) {
 		ptr = device->name;
 	} else {
-		ba2str(&device->bdaddr, dstaddr);
+		strcpy(dstaddr, device->addr_str);
 		g_strdelimit(dstaddr, ":", '-');
 		ptr = dstaddr;
 	}
@@ -1221,14 +1288,10 @@ void device_request_disconnect(struct btd_device *device, DBusMessage *msg)
 
 static void device_set_auto_connect(struct btd_device *device, gboolean enable)
 {
-	char addr[18];
-
 	if (!device || !device->le)
 		return;
 
-	ba2str(&device->bdaddr, addr);
-
-	DBG("%s auto connect: %d", addr, enable);
+	DBG("%s auto connect: %d", device->addr_str, enable);
 
 	if (device->auto_connect == enable)
 		return;
@@ -1374,8 +1437,7 @@ void device_add_eir_uuids(struct btd_device *dev, GSList *uuids)
 	}
 
 	if (added)
-		g_dbus_emit_property_changed(dbus_conn, dev->path,
-						DEVICE_INTERFACE, "UUIDs");
+		emit_property_batched(dev, BATCHED_UUIDS);
 }
 
 static struct btd_service *find_connectable_service(struct btd_device *dev,
@@ -1672,7 +1734,7 @@ static void store_services(struct btd_device *device)
 {
 	struct btd_adapter *adapter = device->adapter;
 	char filename[PATH_MAX];
-	char src_addr[18], dst_addr[18];
+	char src_addr[18];
 	uuid_t uuid;
 	char *prim_uuid;
 	GKeyFile *key_file;
@@ -1692,10 +1754,9 @@ static void store_services(struct btd_device *device)
 		return;
 
 	ba2str(btd_adapter_get_address(adapter), src_addr);
-	ba2str(&device->bdaddr, dst_addr);
 
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/attributes", src_addr,
-								dst_addr);
+							device->addr_str);
 	key_file = g_key_file_new();
 
 	for (l = device->primaries; l; l = l->next) {
@@ -1845,10 +1906,8 @@ static struct bonding_req *bonding_request_new(DBusMessage *msg,
 						struct agent *agent)
 {
 	struct bonding_req *bonding;
-	char addr[18];
 
-	ba2str(&device->bdaddr, addr);
-	DBG("Requesting bonding for %s", addr);
+	DBG("Requesting bonding for %s", device->addr_str);
 
 	bonding = g_new0(struct bonding_req, 1);
 
@@ -1910,10 +1969,9 @@ long device_bonding_last_duration(struct btd_device *device)
 static void create_bond_req_exit(DBusConnection *conn, void *user_data)
 {
 	struct btd_device *device = user_data;
-	char addr[18];
 
-	ba2str(&device->bdaddr, addr);
-	DBG("%s: requestor exited before bonding was completed", addr);
+	DBG("%s: requestor exited before bonding was completed",
+							device->addr_str);
 
 	if (device->authr)
 		device_cancel_authentication(device, FALSE);
@@ -2065,13 +2123,11 @@ static void device_cancel_bonding(struct btd_device *device, uint8_t status)
 {
 	struct bonding_req *bonding = device->bonding;
 	DBusMessage *reply;
-	char addr[18];
 
 	if (!bonding)
 		return;
 
-	ba2str(&device->bdaddr, addr);
-	DBG("Canceling bonding request for %s", addr);
+	DBG("Canceling bonding request for %s", device->addr_str);
 
 	if (device->authr)
 		device_cancel_authentication(device, FALSE);
@@ -2151,9 +2207,7 @@ void device_add_connection(struct btd_device *dev, uint8_t bdaddr_type)
 	device_update_last_seen(dev, bdaddr_type);
 
 	if (state->connected) {
-		char addr[18];
-		ba2str(&dev->bdaddr, addr);
-		error("Device %s is already connected", addr);
+		error("Device %s is already connected", dev->addr_str);
 		return;
 	}
 
@@ -2639,12 +2693,10 @@ static void device_probe_gatt_profile(struct btd_device *device,
 static void device_probe_gatt_profiles(struct btd_device *device)
 {
 	struct gatt_probe_data data;
-	char addr[18];
-
-	ba2str(&device->bdaddr, addr);
 
 	if (device->blocked) {
-		DBG("Skipping profiles for blocked device %s", addr);
+		DBG("Skipping profiles for blocked device %s",
+							device->addr_str);
 		return;
 	}
 
@@ -2810,30 +2862,30 @@ static void gatt_service_removed(struct gatt_db_attribute *attr,
 }
 
 static struct btd_device *device_new(struct btd_adapter *adapter,
-				const char *address)
+						const bdaddr_t *bdaddr)
 {
-	char *address_up;
 	struct btd_device *device;
 	const char *adapter_path = adapter_get_path(adapter);
 
-	DBG("address %s", address);
-
 	device = g_try_malloc0(sizeof(struct btd_device));
 	if (device == NULL)
 		return NULL;
 
+	/* Formatted once, device_update_addr() redoes it on address changes */
+	bacpy(&device->bdaddr, bdaddr);
+	ba2str(&device->bdaddr, device->addr_str);
+
+	DBG("address %s", device->addr_str);
+
 	device->db = gatt_db_new();
 	if (!device->db) {
 		g_free(device);
 		return NULL;
 	}
 
-	address_up = g_ascii_strup(address, -1);
-	device->path = g_strdup_printf("%s/dev_%s", adapter_path, address_up);
+	device->path = g_strdup_printf("%s/dev_%s", adapter_path,
+							device->addr_str);
 	g_strdelimit(device->path, ":", '_');
-	g_free(address_up);
-
-	str2ba(address, &device->bdaddr);
 
 	device->client_dbus = btd_gatt_client_new(device);
 	if (!device->client_dbus) {
@@ -2849,7 +2901,8 @@ static struct btd_device *device_new(struct btd_adapter *adapter,
 					device_methods, NULL,
 					device_properties, device,
 					device_free) == FALSE) {
-		error("Unable to register device interface for %s", address);
+		error("Unable to register device interface for %s",
+							device->addr_str);
 		device_free(device);
 		return NULL;
 	}
@@ -2869,10 +2922,11 @@ struct btd_device *device_create_from_storage(struct btd_adapter *adapter,
 	struct btd_device *device;
 	const bdaddr_t *src;
 	char srcaddr[18];
+	bdaddr_t bdaddr;
 
-	DBG("address %s", address);
+	str2ba(address, &bdaddr);
 
-	device = device_new(adapter, address);
+	device = device_new(adapter, &bdaddr);
 	if (device == NULL)
 		return NULL;
 
@@ -2890,13 +2944,10 @@ struct btd_device *device_create(struct btd_adapter *adapter,
 {
 	struct btd_device *device;
 	const bdaddr_t *sba;
-	char src[18], dst[18];
+	char src[18];
 	char *str;
 
-	ba2str(bdaddr, dst);
-	DBG("dst %s", dst);
-
-	device = device_new(adapter, dst);
+	device = device_new(adapter, bdaddr);
 	if (device == NULL)
 		return NULL;
 
@@ -2910,7 +2961,7 @@ struct btd_device *device_create(struct btd_adapter *adapter,
 	sba = btd_adapter_get_address(adapter);
 	ba2str(sba, src);
 
-	str = load_cached_name(device, src, dst);
+	str = load_cached_name(device, src, device->addr_str);
 	if (str) {
 		strcpy(device->name, str);
 		g_free(str);
@@ -2922,7 +2973,7 @@ struct btd_device *device_create(struct btd_adapter *adapter,
 char *btd_device_get_storage_path(struct btd_device *device,
 				const char *filename)
 {
-	char srcaddr[18], dstaddr[18];
+	char srcaddr[18];
 
 	if (device_address_is_private(device)) {
 		warn("Refusing storage path for private addressed device %s",
@@ -2931,13 +2982,13 @@ char *btd_device_get_storage_path(struct btd_device *device,
 	}
 
 	ba2str(btd_adapter_get_address(device->adapter), srcaddr);
-	ba2str(&device->bdaddr, dstaddr);
 
 	if (!filename)
-		return g_strdup_printf(STORAGEDIR "/%s/%s", srcaddr, dstaddr);
+		return g_strdup_printf(STORAGEDIR "/%s/%s", srcaddr,
+							device->addr_str);
 
-	return g_strdup_printf(STORAGEDIR "/%s/%s/%s", srcaddr, dstaddr,
-							filename);
+	return g_strdup_printf(STORAGEDIR "/%s/%s/%s", srcaddr,
+						device->addr_str, filename);
 }
 
 void btd_device_device_set_name(struct btd_device *device, const char *name)
@@ -2951,14 +3002,12 @@ void btd_device_device_set_name(struct btd_device *device, const char *name)
 
 	store_device_info(device);
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "Name");
+	emit_property_batched(device, BATCHED_NAME);
 
 	if (device->alias != NULL)
 		return;
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "Alias");
+	emit_property_batched(device, BATCHED_ALIAS);
 }
 
 void device_get_name(struct btd_device *device, char *name, size_t len)
@@ -3004,6 +3053,7 @@ void device_update_addr(struct btd_device *device, const bdaddr_t *bdaddr,
 	device->le = true;
 
 	bacpy(&device->bdaddr, bdaddr);
+	ba2str(&device->bdaddr, device->addr_str);
 	device->bdaddr_type = bdaddr_type;
 
 	store_device_info(device);
@@ -3040,6 +3090,25 @@ void device_update_last_seen(struct btd_device *device, uint8_t bdaddr_type)
 		device->le_seen = time(NULL);
 }
 
+bool device_is_duplicate_report(struct btd_device *device, uint32_t hash,
+					int8_t rssi, uint8_t rssi_delta,
+					uint32_t window)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 age = now - device->adv_time;
+
+	if (device->adv_time && device->adv_hash == hash &&
+			age < (gint64) window * G_USEC_PER_SEC &&
+			abs(device->adv_rssi - rssi) < rssi_delta)
+		return true;
+
+	device->adv_hash = hash;
+	device->adv_rssi = rssi;
+	device->adv_time = now;
+
+	return false;
+}
+
 /* It is possible that we have two device objects for the same device in
  * case it has first been discovered over BR/EDR and has a private
  * address when discovered over LE for the first time. In such a case we
@@ -3134,7 +3203,6 @@ static void device_remove_stored(struct btd_device *device)
 {
 	const bdaddr_t *src = btd_adapter_get_address(device->adapter);
 	char adapter_addr[18];
-	char device_addr[18];
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
 	char *data;
@@ -3159,14 +3227,17 @@ static void device_remove_stored(struct btd_device *device)
 		device_unblock(device, TRUE, FALSE);
 
 	ba2str(src, adapter_addr);
-	ba2str(&device->bdaddr, device_addr);
 
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", adapter_addr,
-			device_addr);
+			device->addr_str);
 	delete_folder_tree(filename);
 
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s.sdp",
+					adapter_addr, device->addr_str);
+	unlink(filename);
+
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", adapter_addr,
-			device_addr);
+			device->addr_str);
 
 	key_file = g_key_file_new();
 	g_key_file_load_from_file(key_file, filename, 0, NULL);
@@ -3221,8 +3292,10 @@ void device_remove(struct btd_device *device, gboolean remove_stored)
 			store_device_info_cb(device);
 	}
 
-	if (remove_stored)
+	if (remove_stored) {
+		attrib_device_removed(device);
 		device_remove_stored(device);
+	}
 
 	btd_device_unref(device);
 }
@@ -3231,10 +3304,8 @@ int device_address_cmp(gconstpointer a, gconstpointer b)
 {
 	const struct btd_device *device = a;
 	const char *address = b;
-	char addr[18];
 
-	ba2str(&device->bdaddr, addr);
-	return strcasecmp(addr, address);
+	return strcasecmp(device->addr_str, address);
 }
 
 int device_bdaddr_cmp(gconstpointer a, gconstpointer b)
@@ -3391,16 +3462,14 @@ void device_remove_profile(gpointer a, gpointer b)
 void device_probe_profiles(struct btd_device *device, GSList *uuids)
 {
 	struct probe_data d = { device, uuids };
-	char addr[18];
-
-	ba2str(&device->bdaddr, addr);
 
 	if (device->blocked) {
-		DBG("Skipping profiles for blocked device %s", addr);
+		DBG("Skipping profiles for blocked device %s",
+							device->addr_str);
 		goto add_uuids;
 	}
 
-	DBG("Probing profiles for device %s", addr);
+	DBG("Probing profiles for device %s", device->addr_str);
 
 	btd_profile_foreach(dev_probe, &d);
 
@@ -3408,38 +3477,14 @@ add_uuids:
 	device_add_uuids(device, uuids);
 }
 
-static void store_sdp_record(GKeyFile *key_file, sdp_record_t *rec)
-{
-	char handle_str[11];
-	sdp_buf_t buf;
-	int size, i;
-	char *str;
-
-	sprintf(handle_str, "0x%8.8X", rec->handle);
-
-	if (sdp_gen_record_pdu(rec, &buf) < 0)
-		return;
-
-	size = buf.data_size;
-
-	str = g_malloc0(size*2+1);
-
-	for (i = 0; i < size; i++)
-		sprintf(str + (i * 2), "%02X", buf.data[i]);
-
-	g_key_file_set_string(key_file, "ServiceRecords", handle_str, str);
-
-	free(buf.data);
-	g_free(str);
-}
-
-static void store_primaries_from_sdp_record(GKeyFile *key_file,
+static bool store_primaries_from_sdp_record(GKeyFile *key_file,
 						sdp_record_t *rec)
 {
 	uuid_t uuid;
 	char *att_uuid, *prim_uuid;
 	uint16_t start = 0, end = 0, psm = 0;
 	char handle[6], uuid_str[33];
+	bool stored = false;
 	int i;
 
 	sdp_uuid16_create(&uuid, ATT_UUID);
@@ -3474,10 +3519,13 @@ static void store_primaries_from_sdp_record(GKeyFile *key_file,
 	g_key_file_set_string(key_file, handle, "UUID", prim_uuid);
 	g_key_file_set_string(key_file, handle, "Value", uuid_str);
 	g_key_file_set_integer(key_file, handle, "EndGroupHandle", end);
+	stored = true;
 
 done:
 	free(prim_uuid);
 	free(att_uuid);
+
+	return stored;
 }
 
 static int rec_cmp(const void *a, const void *b)
@@ -3517,27 +3565,20 @@ static int update_record(struct browse_req *req, const char *uuid,
 static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 {
 	struct btd_device *device = req->device;
-	sdp_list_t *seq;
-	char srcaddr[18], dstaddr[18];
+	sdp_list_t *seq, *store = NULL;
+	char srcaddr[18];
 	char sdp_file[PATH_MAX];
 	char att_file[PATH_MAX];
-	GKeyFile *sdp_key_file = NULL;
 	GKeyFile *att_key_file = NULL;
+	bool att_changed = false;
 	char *data;
 	gsize length = 0;
 
 	ba2str(btd_adapter_get_address(device->adapter), srcaddr);
-	ba2str(&device->bdaddr, dstaddr);
 
 	if (!device->temporary) {
-		snprintf(sdp_file, PATH_MAX, STORAGEDIR "/%s/cache/%s",
-							srcaddr, dstaddr);
-
-		sdp_key_file = g_key_file_new();
-		g_key_file_load_from_file(sdp_key_file, sdp_file, 0, NULL);
-
 		snprintf(att_file, PATH_MAX, STORAGEDIR "/%s/%s/attributes",
-							srcaddr, dstaddr);
+						srcaddr, device->addr_str);
 
 		att_key_file = g_key_file_new();
 		g_key_file_load_from_file(att_key_file, att_file, 0, NULL);
@@ -3591,29 +3632,30 @@ static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 		if (update_record(req, profile_uuid, rec) < 0)
 			goto next;
 
-		if (sdp_key_file)
-			store_sdp_record(sdp_key_file, rec);
+		if (!device->temporary)
+			store = sdp_list_append(store, rec);
 
-		if (att_key_file)
-			store_primaries_from_sdp_record(att_key_file, rec);
+		if (att_key_file &&
+			store_primaries_from_sdp_record(att_key_file, rec))
+			att_changed = true;
 
 next:
 		free(profile_uuid);
 		sdp_list_free(svcclass, free);
 	}
 
-	if (sdp_key_file) {
-		data = g_key_file_to_data(sdp_key_file, &length, NULL);
-		if (length > 0) {
-			create_file(sdp_file, S_IRUSR | S_IWUSR);
-			g_file_set_contents(sdp_file, data, length, NULL);
-		}
-
-		g_free(data);
-		g_key_file_free(sdp_key_file);
+	if (store) {
+		snprintf(sdp_file, PATH_MAX, STORAGEDIR "/%s/cache/%s.sdp",
+						srcaddr, device->addr_str);
+		update_sdp_cache(sdp_file, store);
+		sdp_list_free(store, NULL);
 	}
 
-	if (att_key_file) {
+	if (!att_key_file)
+		return;
+
+	/* Only rewrite attributes when a record carried a GATT service */
+	if (att_changed) {
 		data = g_key_file_to_data(att_key_file, &length, NULL);
 		if (length > 0) {
 			create_file(att_file, S_IRUSR | S_IWUSR);
@@ -3621,8 +3663,9 @@ next:
 		}
 
 		g_free(data);
-		g_key_file_free(att_key_file);
 	}
+
+	g_key_file_free(att_key_file);
 }
 
 static int primary_cmp(gconstpointer a, gconstpointer b)
@@ -3697,13 +3740,10 @@ static void search_cb(sdp_list_t *recs, int err, gpointer user_data)
 	struct browse_req *req = user_data;
 	struct btd_device *device = req->device;
 	GSList *primaries;
-	char addr[18];
-
-	ba2str(&device->bdaddr, addr);
 
 	if (err < 0) {
 		error("%s: error updating services: %s (%d)",
-				addr, strerror(-err), -err);
+				device->addr_str, strerror(-err), -err);
 		goto send_reply;
 	}
 
@@ -3717,7 +3757,7 @@ static void search_cb(sdp_list_t *recs, int err, gpointer user_data)
 	req->records = NULL;
 
 	if (!req->profiles_added) {
-		DBG("%s: No service update", addr);
+		DBG("%s: No service update", device->addr_str);
 		goto send_reply;
 	}
 
@@ -4083,15 +4123,12 @@ int device_connect_le(struct btd_device *dev)
 	BtIOSecLevel sec_level;
 	GIOChannel *io;
 	GError *gerr = NULL;
-	char addr[18];
 
 	/* There is one connection attempt going on */
 	if (dev->att_io)
 		return -EALREADY;
 
-	ba2str(&dev->bdaddr, addr);
-
-	DBG("Connection attempt to: %s", addr);
+	DBG("Connection attempt to: %s", dev->addr_str);
 
 	attcb = g_new0(struct att_callbacks, 1);
 	attcb->err = att_error_cb;
@@ -4126,7 +4163,8 @@ int device_connect_le(struct btd_device *dev)
 			bonding_request_free(dev->bonding);
 		}
 
-		error("ATT bt_io_connect(%s): %s", addr, gerr->message);
+		error("ATT bt_io_connect(%s): %s", dev->addr_str,
+							gerr->message);
 		g_error_free(gerr);
 		g_free(attcb);
 		return -EIO;
@@ -4316,6 +4354,11 @@ const bdaddr_t *device_get_address(struct btd_device *device)
 	return &device->bdaddr;
 }
 
+const char *device_get_address_str(struct btd_device *device)
+{
+	return device->addr_str;
+}
+
 const char *device_get_path(const struct btd_device *device)
 {
 	if (!device)
@@ -4324,6 +4367,58 @@ const char *device_get_path(const struct btd_device *device)
 	return device->path;
 }
 
+static void append_hist(GString *str, const char *name,
+					const struct bt_att_hist *hist)
+{
+	if (!hist->count)
+		return;
+
+	g_string_append_printf(str, "  %-15s count %" G_GUINT64_FORMAT
+				" avg %" G_GUINT64_FORMAT " p50 %u p90 %u"
+				" p99 %u max %u usec\n", name, hist->count,
+				hist->total / hist->count,
+				bt_att_hist_percentile(hist, 50),
+				bt_att_hist_percentile(hist, 90),
+				bt_att_hist_percentile(hist, 99), hist->max);
+}
+
+void device_append_att_stats(struct btd_device *device, GString *str)
+{
+	struct bt_att_stats stats;
+	int i;
+
+	if (!bt_att_get_stats(device->att, &stats))
+		return;
+
+	g_string_append_printf(str, "%s mtu %u\n", device->addr_str,
+							device->att_mtu);
+	g_string_append_printf(str, "  TX %" G_GUINT64_FORMAT " PDUs %"
+				G_GUINT64_FORMAT " bytes, RX %" G_GUINT64_FORMAT
+				" PDUs %" G_GUINT64_FORMAT " bytes, %u timeouts\n",
+				stats.tx_pdus, stats.tx_bytes, stats.rx_pdus,
+				stats.rx_bytes, stats.timeouts);
+	g_string_append_printf(str, "  Queue depth max: req %u ind %u"
+				" write %u\n", stats.req_queue_max,
+				stats.ind_queue_max, stats.write_queue_max);
+
+	append_hist(str, "Request RTT", &stats.req_rtt);
+	append_hist(str, "Indication RTT", &stats.ind_rtt);
+	append_hist(str, "Queued", &stats.queue_time);
+
+	for (i = 0; i < BT_ATT_STATS_OPCODES; i++) {
+		struct bt_att_op_stats *op = &stats.req[i];
+
+		if (!op->count && !op->timeouts)
+			continue;
+
+		g_string_append_printf(str, "  Opcode 0x%02x   count %u avg %"
+					G_GUINT64_FORMAT " max %u usec,"
+					" %u timeouts\n", i, op->count,
+					op->count ? op->total / op->count : 0,
+					op->max, op->timeouts);
+	}
+}
+
 gboolean device_is_temporary(struct btd_device *device)
 {
 	return device->temporary;
@@ -4428,8 +4523,7 @@ void device_set_rssi(struct btd_device *device, int8_t rssi)
 		device->rssi = rssi;
 	}
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "RSSI");
+	emit_property_batched(device, BATCHED_RSSI);
 }
 
 static gboolean start_discovery(gpointer user_data)
@@ -4826,13 +4920,12 @@ static struct authentication_req *new_auth(struct btd_device *device,
 {
 	struct authentication_req *auth;
 	struct agent *agent;
-	char addr[18];
 
-	ba2str(&device->bdaddr, addr);
-	DBG("Requesting agent authentication for %s", addr);
+	DBG("Requesting agent authentication for %s", device->addr_str);
 
 	if (device->authr) {
-		error("Authentication already requested for %s", addr);
+		error("Authentication already requested for %s",
+							device->addr_str);
 		return NULL;
 	}
 
@@ -5007,13 +5100,11 @@ static void cancel_authentication(struct authentication_req *auth)
 void device_cancel_authentication(struct btd_device *device, gboolean aborted)
 {
 	struct authentication_req *auth = device->authr;
-	char addr[18];
 
 	if (!auth)
 		return;
 
-	ba2str(&device->bdaddr, addr);
-	DBG("Canceling authentication request for %s", addr);
+	DBG("Canceling authentication request for %s", device->addr_str);
 
 	if (auth->agent)
 		agent_cancel(auth->agent);
@@ -5095,7 +5186,7 @@ void btd_device_add_uuid(struct btd_device *device, const char *uuid)
 
 static sdp_list_t *read_device_records(struct btd_device *device)
 {
-	char local[18], peer[18];
+	char local[18];
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
 	char **keys, **handle;
@@ -5104,9 +5195,17 @@ static sdp_list_t *read_device_records(struct btd_device *device)
 	sdp_record_t *rec;
 
 	ba2str(btd_adapter_get_address(device->adapter), local);
-	ba2str(&device->bdaddr, peer);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", local, peer);
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s.sdp", local,
+							device->addr_str);
+
+	recs = read_sdp_cache(filename);
+	if (recs)
+		return recs;
+
+	/* Fall back to records stored as hex by older versions */
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", local,
+							device->addr_str);
 
 	key_file = g_key_file_new();
 	g_key_file_load_from_file(key_file, filename, 0, NULL);
@@ -5191,12 +5290,10 @@ void device_set_appearance(struct btd_device *device, uint16_t value)
 	if (device->appearance == value)
 		return;
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-					DEVICE_INTERFACE, "Appearance");
+	emit_property_batched(device, BATCHED_APPEARANCE);
 
 	if (icon)
-		g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "Icon");
+		emit_property_batched(device, BATCHED_ICON);
 
 	device->appearance = value;
 	store_device_info(device);
@@ -53,7 +53,6 @@
 struct btd_gatt_client {
 	struct btd_device *device;
 	bool ready;
-	char devaddr[18];
 	struct gatt_db *db;
 	struct bt_gatt_client *gatt;
 
@@ -1195,9 +1194,8 @@ static struct service *service_create(struct gatt_db_attribute *attr,
 						service_properties,
 						service, service_free)) {
 		error("Unable to register GATT service with handle 0x%04x for "
-							"device %s:",
-							service->start_handle,
-							client->devaddr);
+				"device %s:", service->start_handle,
+				device_get_address_str(client->device));
 		service_free(service);
 
 		return NULL;
@@ -1400,7 +1398,8 @@ static void export_service(struct gatt_db_attribute *attr, void *user_data)
 
 static void create_services(struct btd_gatt_client *client)
 {
-	DBG("Exporting objects for GATT services: %s", client->devaddr);
+	DBG("Exporting objects for GATT services: %s",
+					device_get_address_str(client->device));
 
 	gatt_db_foreach_service(client->db, NULL, export_service, client);
 }
@@ -1428,8 +1427,6 @@ struct btd_gatt_client *btd_gatt_client_new(struct btd_device *device)
 	}
 
 	client->device = device;
-	ba2str(device_get_address(device), client->devaddr);
-
 	client->db = gatt_db_ref(db);
 
 	return client;
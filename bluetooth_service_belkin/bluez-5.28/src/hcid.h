@@ -38,6 +38,9 @@ struct main_opts {
 	gboolean	reverse_sdp;
 	gboolean	name_resolv;
 	gboolean	debug_keys;
+	uint32_t	dup_window;
+	uint8_t		dup_rssi_delta;
+	uint32_t	prop_batch;
 
 	uint16_t	did_source;
 	uint16_t	did_vendor;
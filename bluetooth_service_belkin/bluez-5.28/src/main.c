@@ -57,17 +57,31 @@
 #include "profile.h"
 #include "gatt.h"
 #include "systemd.h"
+#include "src/shared/trace.h"
 
 #define BLUEZ_NAME "org.bluez"
 
 #define DEFAULT_PAIRABLE_TIMEOUT       0 /* disabled */
 #define DEFAULT_DISCOVERABLE_TIMEOUT 180 /* 3 minutes */
+#define DEFAULT_DUPLICATE_WINDOW      10 /* seconds */
+#define DEFAULT_DUPLICATE_RSSI_DELTA   8 /* dBm */
+#define DEFAULT_PROPERTY_BATCH       100 /* milliseconds */
+
+#define MAX_DUPLICATE_WINDOW        3600 /* seconds */
+#define MAX_DUPLICATE_RSSI_DELTA     127 /* dBm */
+#define MAX_PROPERTY_BATCH         10000 /* milliseconds */
+
+#define TRACE_EVENTS 65536
+#define ATT_STATS_FILE STORAGEDIR "/att-stats"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
 struct main_opts main_opts;
 static GKeyFile *main_conf;
 
+/* Kept past free_options(), dumps may be requested until exit */
+static char *option_trace = NULL;
+
 static const char * const supported_options[] = {
 	"Name",
 	"Class",
@@ -80,6 +94,9 @@ static const char * const supported_options[] = {
 	"NameResolving",
 	"DebugKeys",
 	"ControllerMode",
+	"DuplicateFilterWindow",
+	"DuplicateFilterRSSIDelta",
+	"PropertyBatchInterval",
 };
 
 GKeyFile *btd_get_main_conf(void)
@@ -306,6 +323,45 @@ static void parse_config(GKeyFile *config)
 		main_opts.mode = get_mode(str);
 		g_free(str);
 	}
+
+	val = g_key_file_get_integer(config, "General",
+						"DuplicateFilterWindow", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else if (val < 0 || val > MAX_DUPLICATE_WINDOW) {
+		error("DuplicateFilterWindow %d out of range 0-%d", val,
+						MAX_DUPLICATE_WINDOW);
+	} else {
+		DBG("dup_window=%d", val);
+		main_opts.dup_window = val;
+	}
+
+	val = g_key_file_get_integer(config, "General",
+						"DuplicateFilterRSSIDelta", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else if (val < 0 || val > MAX_DUPLICATE_RSSI_DELTA) {
+		error("DuplicateFilterRSSIDelta %d out of range 0-%d", val,
+						MAX_DUPLICATE_RSSI_DELTA);
+	} else {
+		DBG("dup_rssi_delta=%d", val);
+		main_opts.dup_rssi_delta = val;
+	}
+
+	val = g_key_file_get_integer(config, "General",
+						"PropertyBatchInterval", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else if (val < 0 || val > MAX_PROPERTY_BATCH) {
+		error("PropertyBatchInterval %d out of range 0-%d", val,
+						MAX_PROPERTY_BATCH);
+	} else {
+		DBG("prop_batch=%d", val);
+		main_opts.prop_batch = val;
+	}
 }
 
 static void init_defaults(void)
@@ -321,6 +377,9 @@ static void init_defaults(void)
 	main_opts.reverse_sdp = TRUE;
 	main_opts.name_resolv = TRUE;
 	main_opts.debug_keys = FALSE;
+	main_opts.dup_window = DEFAULT_DUPLICATE_WINDOW;
+	main_opts.dup_rssi_delta = DEFAULT_DUPLICATE_RSSI_DELTA;
+	main_opts.prop_batch = DEFAULT_PROPERTY_BATCH;
 
 	if (sscanf(VERSION, "%hhu.%hhu", &major, &minor) != 2)
 		return;
@@ -344,6 +403,40 @@ static gboolean quit_eventloop(gpointer user_data)
 	return FALSE;
 }
 
+static void dump_trace(void)
+{
+	if (!option_trace)
+		return;
+
+	if (!trace_dump(option_trace))
+		error("Unable to write trace to %s", option_trace);
+	else
+		info("Trace written to %s", option_trace);
+}
+
+static void append_device_stats(struct btd_device *device, void *data)
+{
+	device_append_att_stats(device, data);
+}
+
+static void append_adapter_stats(struct btd_adapter *adapter,
+							gpointer user_data)
+{
+	btd_adapter_for_each_device(adapter, append_device_stats, user_data);
+}
+
+static void dump_att_stats(void)
+{
+	GString *str = g_string_new(NULL);
+
+	adapter_foreach(append_adapter_stats, str);
+
+	if (!g_file_set_contents(ATT_STATS_FILE, str->str, str->len, NULL))
+		error("Unable to write ATT statistics to %s", ATT_STATS_FILE);
+
+	g_string_free(str, TRUE);
+}
+
 static gboolean signal_handler(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
@@ -375,6 +468,10 @@ static gboolean signal_handler(GIOChannel *channel, GIOCondition cond,
 
 		__terminated = 1;
 		break;
+	case SIGUSR1:
+		dump_trace();
+		dump_att_stats();
+		break;
 	case SIGUSR2:
 		__btd_toggle_debug();
 		break;
@@ -393,6 +490,7 @@ static guint setup_signalfd(void)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
 	sigaddset(&mask, SIGUSR2);
 
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
@@ -511,6 +609,8 @@ static GOptionEntry options[] = {
 				"Specify plugins to load", "NAME,..," },
 	{ "noplugin", 'P', 0, G_OPTION_ARG_STRING, &option_noplugin,
 				"Specify plugins not to load", "NAME,..." },
+	{ "trace", 'T', 0, G_OPTION_ARG_STRING, &option_trace,
+				"Record binary event trace to FILE", "FILE" },
 	{ "compat", 'C', 0, G_OPTION_ARG_NONE, &option_compat,
 				"Provide deprecated command line interfaces" },
 	{ "experimental", 'E', 0, G_OPTION_ARG_NONE, &option_experimental,
@@ -562,6 +662,9 @@ int main(int argc, char *argv[])
 
 	__btd_log_init(option_debug, option_detach);
 
+	if (option_trace)
+		trace_enable(TRACE_EVENTS);
+
 	sd_notify(0, "STATUS=Starting up");
 
 	main_conf = load_config(CONFIGDIR "/main.conf");
@@ -632,6 +735,9 @@ int main(int argc, char *argv[])
 
 	sd_notify(0, "STATUS=Quitting");
 
+	dump_trace();
+	g_free(option_trace);
+
 	g_source_remove(signal);
 
 	plugin_cleanup();
@@ -606,6 +606,12 @@
 
 struct ext_io;
 
+struct ext_template {
+	sdp_record_t *rec;
+	uint16_t psm;
+	uint8_t chan;
+};
+
 struct ext_profile {
 	struct btd_profile p;
 
@@ -620,6 +626,13 @@ struct ext_profile {
 	char *(*get_record)(struct ext_profile *ext, struct ext_io *l2cap,
 							struct ext_io *rfcomm);
 
+	/*
+	 * Parsed once, cloned and patched for every adapter. Whether the
+	 * L2CAP and RFCOMM servers came up changes the generated record, so
+	 * there is one template per combination.
+	 */
+	struct ext_template templates[4];
+
 	char *remote_uuid;
 
 	guint id;
@@ -1204,22 +1217,78 @@ static void ext_direct_connect(GIOChannel *io, GError *err, gpointer user_data)
 	ext_connect(io, err, conn);
 }
 
-static uint32_t ext_register_record(struct ext_profile *ext,
+static void patch_proto_list(sdp_data_t *list, uint16_t psm, uint8_t chan)
+{
+	sdp_data_t *seq;
+
+	if (!list || !SDP_IS_SEQ(list->dtd))
+		return;
+
+	for (seq = list->val.dataseq; seq; seq = seq->next) {
+		sdp_data_t *uuid, *param;
+
+		if (!SDP_IS_SEQ(seq->dtd))
+			continue;
+
+		uuid = seq->val.dataseq;
+		if (!uuid || !SDP_IS_UUID(uuid->dtd))
+			continue;
+
+		param = uuid->next;
+		if (!param)
+			continue;
+
+		switch (sdp_uuid_to_proto(&uuid->val.uuid)) {
+		case L2CAP_UUID:
+			if (psm && param->dtd == SDP_UINT16)
+				param->val.uint16 = psm;
+			break;
+		case RFCOMM_UUID:
+			if (chan && param->dtd == SDP_UINT8)
+				param->val.uint8 = chan;
+			break;
+		}
+	}
+}
+
+/*
+ * Only the PSM and RFCOMM channel of a generated record differ between
+ * adapters, everything else comes from the profile itself. Templates are
+ * kept per server combination, so a zero PSM or channel is a server the
+ * template was built without too and there is nothing to patch.
+ */
+static void patch_record(sdp_record_t *rec, uint16_t psm, uint8_t chan)
+{
+	sdp_data_t *data;
+
+	patch_proto_list(sdp_data_get(rec, SDP_ATTR_PROTO_DESC_LIST), psm,
+									chan);
+
+	data = sdp_data_get(rec, SDP_ATTR_GOEP_L2CAP_PSM);
+	if (psm && data && data->dtd == SDP_UINT16)
+		data->val.uint16 = psm;
+}
+
+static struct ext_template *ext_get_template(struct ext_profile *ext,
 							struct ext_io *l2cap,
-							struct ext_io *rfcomm,
-							struct btd_adapter *a)
+							struct ext_io *rfcomm)
 {
+	struct ext_template *tmpl;
 	sdp_record_t *rec;
 	char *dyn_record = NULL;
 	const char *record = ext->record;
 
+	tmpl = &ext->templates[(l2cap ? 1 : 0) | (rfcomm ? 2 : 0)];
+	if (tmpl->rec)
+		return tmpl;
+
 	if (!record && ext->get_record) {
 		dyn_record = ext->get_record(ext, l2cap, rfcomm);
 		record = dyn_record;
 	}
 
 	if (!record)
-		return 0;
+		return NULL;
 
 	rec = sdp_xml_parse_record(record, strlen(record));
 
@@ -1227,9 +1296,40 @@ static uint32_t ext_register_record(struct ext_profile *ext,
 
 	if (!rec) {
 		error("Unable to parse record for %s", ext->name);
+		return NULL;
+	}
+
+	tmpl->rec = rec;
+	tmpl->psm = l2cap ? l2cap->psm : 0;
+	tmpl->chan = rfcomm ? rfcomm->chan : 0;
+
+	return tmpl;
+}
+
+static uint32_t ext_register_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
+							struct ext_io *rfcomm,
+							struct btd_adapter *a)
+{
+	struct ext_template *tmpl;
+	sdp_record_t *rec;
+	uint16_t psm = l2cap ? l2cap->psm : 0;
+	uint8_t chan = rfcomm ? rfcomm->chan : 0;
+
+	tmpl = ext_get_template(ext, l2cap, rfcomm);
+	if (!tmpl)
+		return 0;
+
+	rec = sdp_copy_record(tmpl->rec);
+	if (!rec) {
+		error("Unable to copy record for %s", ext->name);
 		return 0;
 	}
 
+	/* A record given by the profile itself is registered verbatim */
+	if (!ext->record && (psm != tmpl->psm || chan != tmpl->chan))
+		patch_record(rec, psm, chan);
+
 	if (adapter_service_add(a, rec) < 0) {
 		error("Failed to register service record");
 		sdp_record_free(rec);
@@ -2283,6 +2383,8 @@ static struct ext_profile *create_ext(const char *owner, const char *path,
 
 static void remove_ext(struct ext_profile *ext)
 {
+	unsigned int i;
+
 	adapter_foreach(adapter_remove_profile, &ext->p);
 
 	ext_profiles = g_slist_remove(ext_profiles, ext);
@@ -2303,6 +2405,11 @@ static void remove_ext(struct ext_profile *ext)
 	g_free(ext->path);
 	g_free(ext->record);
 
+	for (i = 0; i < G_N_ELEMENTS(ext->templates); i++) {
+		if (ext->templates[i].rec)
+			sdp_record_free(ext->templates[i].rec);
+	}
+
 	g_free(ext);
 }
 
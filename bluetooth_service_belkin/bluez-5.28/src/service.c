@@ -85,7 +85,7 @@ static void change_state(struct btd_service *service, btd_service_state_t state,
 									int err)
 {
 	btd_service_state_t old = service->state;
-	char addr[18];
+	const char *addr;
 	GSList *l;
 
 	if (state == old)
@@ -97,7 +97,7 @@ static void change_state(struct btd_service *service, btd_service_state_t state,
 	service->state = state;
 	service->err = err;
 
-	ba2str(device_get_address(service->device), addr);
+	addr = device_get_address_str(service->device);
 	DBG("%p: device %s profile %s state changed: %s -> %s (%d)", service,
 					addr, service->profile->name,
 					state2str(old), state2str(state), err);
@@ -151,7 +151,7 @@ struct btd_service *service_create(struct btd_device *device,
 
 int service_probe(struct btd_service *service)
 {
-	char addr[18];
+	const char *addr;
 	int err;
 
 	assert(service->state == BTD_SERVICE_STATE_UNAVAILABLE);
@@ -162,7 +162,7 @@ int service_probe(struct btd_service *service)
 		return 0;
 	}
 
-	ba2str(device_get_address(service->device), addr);
+	addr = device_get_address_str(service->device);
 	error("%s profile probe failed for %s", service->profile->name, addr);
 
 	return err;
@@ -180,7 +180,7 @@ void service_remove(struct btd_service *service)
 
 int service_accept(struct btd_service *service)
 {
-	char addr[18];
+	const char *addr;
 	int err;
 
 	if (!service->profile->accept)
@@ -190,7 +190,7 @@ int service_accept(struct btd_service *service)
 	if (!err)
 		return 0;
 
-	ba2str(device_get_address(service->device), addr);
+	addr = device_get_address_str(service->device);
 	error("%s profile accept failed for %s", service->profile->name, addr);
 
 	return err;
@@ -199,7 +199,7 @@ int service_accept(struct btd_service *service)
 int btd_service_connect(struct btd_service *service)
 {
 	struct btd_profile *profile = service->profile;
-	char addr[18];
+	const char *addr;
 	int err;
 
 	if (!profile->connect)
@@ -223,7 +223,7 @@ int btd_service_connect(struct btd_service *service)
 		return 0;
 	}
 
-	ba2str(device_get_address(service->device), addr);
+	addr = device_get_address_str(service->device);
 	error("%s profile connect failed for %s: %s", profile->name, addr,
 								strerror(-err));
 
@@ -233,7 +233,7 @@ int btd_service_connect(struct btd_service *service)
 int btd_service_disconnect(struct btd_service *service)
 {
 	struct btd_profile *profile = service->profile;
-	char addr[18];
+	const char *addr;
 	int err;
 
 	if (!profile->disconnect)
@@ -261,7 +261,7 @@ int btd_service_disconnect(struct btd_service *service)
 		return 0;
 	}
 
-	ba2str(device_get_address(service->device), addr);
+	addr = device_get_address_str(service->device);
 	error("%s profile disconnect failed for %s: %s", profile->name, addr,
 								strerror(-err));
 
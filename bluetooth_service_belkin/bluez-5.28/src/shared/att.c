@@ -28,11 +28,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
 #include "src/shared/util.h"
 #include "src/shared/timeout.h"
+#include "src/shared/trace.h"
 #include "lib/uuid.h"
 #include "src/shared/att.h"
 
@@ -83,6 +85,8 @@ struct bt_att {
 	bt_att_debug_func_t debug_callback;
 	bt_att_destroy_func_t debug_destroy;
 	void *debug_data;
+
+	struct bt_att_stats stats;
 };
 
 enum att_op_type {
@@ -172,6 +176,12 @@ static uint8_t get_req_opcode(uint8_t rsp_opcode)
 	return 0;
 }
 
+struct bt_att_pdu {
+	int ref_count;
+	uint16_t len;
+	uint8_t data[0];
+};
+
 struct att_send_op {
 	unsigned int id;
 	unsigned int timeout_id;
@@ -179,6 +189,9 @@ struct att_send_op {
 	uint16_t opcode;
 	void *pdu;
 	uint16_t len;
+	struct bt_att_pdu *shared;	/* Set if pdu points into shared */
+	uint64_t queued;		/* Timestamps in microseconds */
+	uint64_t sent;
 	bt_att_response_func_t callback;
 	bt_att_destroy_func_t destroy;
 	void *user_data;
@@ -194,7 +207,11 @@ static void destroy_att_send_op(void *data)
 	if (op->destroy)
 		op->destroy(op->user_data);
 
-	free(op->pdu);
+	if (op->shared)
+		bt_att_pdu_unref(op->shared);
+	else
+		free(op->pdu);
+
 	free(op);
 }
 
@@ -260,6 +277,48 @@ static bool match_disconn_id(const void *a, const void *b)
 	return disconn->id == id;
 }
 
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static unsigned int hist_index(uint32_t value)
+{
+	unsigned int exp;
+
+	if (value < 4)
+		return value;
+
+	exp = 31 - __builtin_clz(value);
+
+	return ((exp - 1) << 2) | ((value >> (exp - 2)) & 3);
+}
+
+static void hist_add(struct bt_att_hist *hist, uint64_t start, uint64_t now)
+{
+	uint32_t value = now - start > UINT32_MAX ? UINT32_MAX : now - start;
+
+	hist->count++;
+	hist->total += value;
+
+	if (value > hist->max)
+		hist->max = value;
+
+	hist->buckets[hist_index(value)]++;
+}
+
+static void update_depth(uint32_t *max, struct queue *queue)
+{
+	unsigned int depth = queue_length(queue);
+
+	if (depth > *max)
+		*max = depth;
+}
+
 static bool encode_pdu(struct att_send_op *op, const void *pdu,
 						uint16_t length, uint16_t mtu)
 {
@@ -385,6 +444,13 @@ static bool timeout_cb(void *user_data)
 	util_debug(att->debug_callback, att->debug_data,
 				"Operation timed out: 0x%02x", op->opcode);
 
+	TRACE(TRACE_ATT_TIMEOUT, 0, op->opcode, op->id, att->fd);
+
+	att->stats.timeouts++;
+
+	if (op->type == ATT_OP_TYPE_REQ)
+		att->stats.req[op->opcode & 0x3f].timeouts++;
+
 	if (att->timeout_callback)
 		att->timeout_callback(op->id, op->opcode, att->timeout_data);
 
@@ -401,6 +467,15 @@ static bool timeout_cb(void *user_data)
 	return false;
 }
 
+/* First 16-bit parameter of a PDU, the attribute handle for most opcodes */
+static uint16_t pdu_param(const uint8_t *pdu, ssize_t len)
+{
+	if (len < 3)
+		return 0;
+
+	return get_le16(pdu + 1);
+}
+
 static void write_watch_destroy(void *user_data)
 {
 	struct bt_att *att = user_data;
@@ -415,6 +490,7 @@ static bool can_write_data(struct io *io, void *user_data)
 	struct timeout_data *timeout;
 	ssize_t ret;
 	struct iovec iov;
+	uint64_t now;
 
 	op = pick_next_send_op(att);
 	if (!op)
@@ -435,8 +511,16 @@ static bool can_write_data(struct io *io, void *user_data)
 		return true;
 	}
 
-	util_debug(att->debug_callback, att->debug_data,
-					"ATT op 0x%02x", op->opcode);
+	TRACE(TRACE_ATT_TX, ret, op->opcode, pdu_param(op->pdu, ret),
+								att->fd);
+
+	now = get_usec();
+
+	att->stats.tx_pdus++;
+	att->stats.tx_bytes += ret;
+	hist_add(&att->stats.queue_time, op->queued, now);
+
+	op->sent = now;
 
 	util_hexdump('<', op->pdu, ret, att->debug_callback, att->debug_data);
 
@@ -530,6 +614,8 @@ static bool disconnect_cb(struct io *io, void *user_data)
 					"Physical link disconnected: %s",
 					strerror(err));
 
+	TRACE(TRACE_ATT_DISCONNECT, 0, err, 0, att->fd);
+
 	io_destroy(att->io);
 	att->io = NULL;
 
@@ -545,6 +631,23 @@ static bool disconnect_cb(struct io *io, void *user_data)
 	return false;
 }
 
+static void record_rsp(struct bt_att *att, struct att_send_op *op)
+{
+	struct bt_att_op_stats *op_stats = &att->stats.req[op->opcode & 0x3f];
+	uint64_t now = get_usec();
+	uint32_t rtt;
+
+	hist_add(&att->stats.req_rtt, op->sent, now);
+
+	rtt = now - op->sent > UINT32_MAX ? UINT32_MAX : now - op->sent;
+
+	op_stats->count++;
+	op_stats->total += rtt;
+
+	if (rtt > op_stats->max)
+		op_stats->max = rtt;
+}
+
 static void handle_rsp(struct bt_att *att, uint8_t opcode, uint8_t *pdu,
 								ssize_t pdu_len)
 {
@@ -565,6 +668,8 @@ static void handle_rsp(struct bt_att *att, uint8_t opcode, uint8_t *pdu,
 		return;
 	}
 
+	record_rsp(att, op);
+
 	/*
 	 * If the received response doesn't match the pending request, or if
 	 * the request is malformed, end the current request with failure.
@@ -620,6 +725,8 @@ static void handle_conf(struct bt_att *att, uint8_t *pdu, ssize_t pdu_len)
 		return;
 	}
 
+	hist_add(&att->stats.ind_rtt, op->sent, get_usec());
+
 	if (op->callback)
 		op->callback(BT_ATT_OP_HANDLE_VAL_CONF, NULL, 0, op->user_data);
 
@@ -713,6 +820,9 @@ static bool can_read_data(struct io *io, void *user_data)
 	if (bytes_read < 0)
 		return false;
 
+	att->stats.rx_pdus++;
+	att->stats.rx_bytes += bytes_read;
+
 	util_hexdump('>', att->buf, bytes_read,
 					att->debug_callback, att->debug_data);
 
@@ -722,18 +832,17 @@ static bool can_read_data(struct io *io, void *user_data)
 	pdu = att->buf;
 	opcode = pdu[0];
 
+	TRACE(TRACE_ATT_RX, bytes_read, opcode, pdu_param(pdu, bytes_read),
+								att->fd);
+
 	bt_att_ref(att);
 
 	/* Act on the received PDU based on the opcode type */
 	switch (get_op_type(opcode)) {
 	case ATT_OP_TYPE_RSP:
-		util_debug(att->debug_callback, att->debug_data,
-				"ATT response received: 0x%02x", opcode);
 		handle_rsp(att, opcode, pdu + 1, bytes_read - 1);
 		break;
 	case ATT_OP_TYPE_CONF:
-		util_debug(att->debug_callback, att->debug_data,
-				"ATT confirmation received: 0x%02x", opcode);
 		handle_conf(att, pdu + 1, bytes_read - 1);
 		break;
 	case ATT_OP_TYPE_REQ:
@@ -763,8 +872,6 @@ static bool can_read_data(struct io *io, void *user_data)
 		/* For all other opcodes notify the upper layer of the PDU and
 		 * let them act on it.
 		 */
-		util_debug(att->debug_callback, att->debug_data,
-					"ATT PDU received: 0x%02x", opcode);
 		handle_notify(att, opcode, pdu + 1, bytes_read - 1);
 		break;
 	}
@@ -1019,14 +1126,17 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 		att->next_send_id = 1;
 
 	op->id = att->next_send_id++;
+	op->queued = get_usec();
 
 	/* Add the op to the correct queue based on its type */
 	switch (op->type) {
 	case ATT_OP_TYPE_REQ:
 		result = queue_push_tail(att->req_queue, op);
+		update_depth(&att->stats.req_queue_max, att->req_queue);
 		break;
 	case ATT_OP_TYPE_IND:
 		result = queue_push_tail(att->ind_queue, op);
+		update_depth(&att->stats.ind_queue_max, att->ind_queue);
 		break;
 	case ATT_OP_TYPE_CMD:
 	case ATT_OP_TYPE_NOT:
@@ -1035,6 +1145,7 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	case ATT_OP_TYPE_CONF:
 	default:
 		result = queue_push_tail(att->write_queue, op);
+		update_depth(&att->stats.write_queue_max, att->write_queue);
 		break;
 	}
 
@@ -1049,6 +1160,114 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	return op->id;
 }
 
+struct bt_att_pdu *bt_att_pdu_alloc(uint8_t opcode, uint16_t length,
+							uint8_t **params)
+{
+	struct bt_att_pdu *shared;
+
+	if (length == UINT16_MAX)
+		return NULL;
+
+	shared = malloc(sizeof(*shared) + length + 1);
+	if (!shared)
+		return NULL;
+
+	shared->ref_count = 0;
+	shared->len = length + 1;
+	shared->data[0] = opcode;
+
+	if (params)
+		*params = shared->data + 1;
+
+	return bt_att_pdu_ref(shared);
+}
+
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, const void *pdu,
+							uint16_t length)
+{
+	struct bt_att_pdu *shared;
+	uint8_t *params;
+
+	if (length && !pdu)
+		return NULL;
+
+	shared = bt_att_pdu_alloc(opcode, length, &params);
+	if (shared && length)
+		memcpy(params, pdu, length);
+
+	return shared;
+}
+
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return NULL;
+
+	__sync_fetch_and_add(&pdu->ref_count, 1);
+
+	return pdu;
+}
+
+void bt_att_pdu_unref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return;
+
+	if (__sync_sub_and_fetch(&pdu->ref_count, 1))
+		return;
+
+	free(pdu);
+}
+
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu)
+{
+	struct att_send_op *op;
+	enum att_op_type op_type;
+
+	if (!att || !att->io || !pdu)
+		return 0;
+
+	/* Only PDUs that do not expect a response can be shared */
+	op_type = get_op_type(pdu->data[0]);
+	if (op_type != ATT_OP_TYPE_NOT && op_type != ATT_OP_TYPE_CMD)
+		return 0;
+
+	/*
+	 * A notification value may be truncated to fit the MTU of this
+	 * particular link; anything else has to fit as a whole.
+	 */
+	if (pdu->len > att->mtu && op_type != ATT_OP_TYPE_NOT)
+		return 0;
+
+	op = new0(struct att_send_op, 1);
+	if (!op)
+		return 0;
+
+	op->type = op_type;
+	op->opcode = pdu->data[0];
+	op->shared = bt_att_pdu_ref(pdu);
+	op->pdu = pdu->data;
+	op->len = pdu->len > att->mtu ? att->mtu : pdu->len;
+
+	if (att->next_send_id < 1)
+		att->next_send_id = 1;
+
+	op->id = att->next_send_id++;
+	op->queued = get_usec();
+
+	if (!queue_push_tail(att->write_queue, op)) {
+		bt_att_pdu_unref(op->shared);
+		free(op);
+		return 0;
+	}
+
+	update_depth(&att->stats.write_queue_max, att->write_queue);
+
+	wakeup_writer(att);
+
+	return op->id;
+}
+
 static bool match_op_id(const void *a, const void *b)
 {
 	const struct att_send_op *op = a;
@@ -1226,3 +1445,53 @@ bool bt_att_unregister_all(struct bt_att *att)
 
 	return true;
 }
+
+uint32_t bt_att_hist_percentile(const struct bt_att_hist *hist,
+							unsigned int percent)
+{
+	uint64_t target, seen = 0;
+	unsigned int i, exp;
+
+	if (!hist || !hist->count || percent > 100)
+		return 0;
+
+	target = (hist->count * percent + 99) / 100;
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < BT_ATT_HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target)
+			break;
+	}
+
+	if (i < 4)
+		return i;
+
+	/* Inverse of hist_index(), the largest value of bucket i */
+	exp = (i >> 2) + 1;
+	if (exp > 31)
+		return UINT32_MAX;
+
+	return (((uint64_t) (4 | (i & 3)) + 1) << (exp - 2)) - 1;
+}
+
+bool bt_att_get_stats(struct bt_att *att, struct bt_att_stats *stats)
+{
+	if (!att || !stats)
+		return false;
+
+	memcpy(stats, &att->stats, sizeof(*stats));
+
+	return true;
+}
+
+bool bt_att_reset_stats(struct bt_att *att)
+{
+	if (!att)
+		return false;
+
+	memset(&att->stats, 0, sizeof(att->stats));
+
+	return true;
+}
@@ -63,6 +63,18 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 bool bt_att_cancel(struct bt_att *att, unsigned int id);
 bool bt_att_cancel_all(struct bt_att *att);
 
+struct bt_att_pdu;
+
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, const void *pdu,
+							uint16_t length);
+/* Leaves the length bytes at *params for the caller to fill in */
+struct bt_att_pdu *bt_att_pdu_alloc(uint8_t opcode, uint16_t length,
+							uint8_t **params);
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu);
+void bt_att_pdu_unref(struct bt_att_pdu *pdu);
+
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu);
+
 unsigned int bt_att_send_error_rsp(struct bt_att *att, uint8_t opcode,
 						uint16_t handle, int error);
 
@@ -79,3 +91,52 @@ unsigned int bt_att_register_disconnect(struct bt_att *att,
 bool bt_att_unregister_disconnect(struct bt_att *att, unsigned int id);
 
 bool bt_att_unregister_all(struct bt_att *att);
+
+/*
+ * Log-linear latency histogram in microseconds: every power of two is
+ * split into four linear sub-buckets, which bounds the error of a
+ * reported percentile to 25% while covering the whole uint32_t range.
+ */
+#define BT_ATT_HIST_BUCKETS		128
+
+struct bt_att_hist {
+	uint64_t count;
+	uint64_t total;
+	uint32_t max;
+	uint32_t buckets[BT_ATT_HIST_BUCKETS];
+};
+
+/* Upper bound in microseconds below which percent of the samples fall */
+uint32_t bt_att_hist_percentile(const struct bt_att_hist *hist,
+							unsigned int percent);
+
+struct bt_att_op_stats {
+	uint32_t count;
+	uint32_t timeouts;
+	uint64_t total;			/* Summed RTT in microseconds */
+	uint32_t max;
+};
+
+/* Requests are indexed by opcode, their method bits never exceed 0x3f */
+#define BT_ATT_STATS_OPCODES		64
+
+struct bt_att_stats {
+	uint64_t tx_pdus;
+	uint64_t tx_bytes;
+	uint64_t rx_pdus;
+	uint64_t rx_bytes;
+	uint32_t timeouts;
+
+	uint32_t req_queue_max;		/* Queue depth high-water marks */
+	uint32_t ind_queue_max;
+	uint32_t write_queue_max;
+
+	struct bt_att_hist req_rtt;	/* Request to response */
+	struct bt_att_hist ind_rtt;	/* Indication to confirmation */
+	struct bt_att_hist queue_time;	/* bt_att_send() to write */
+
+	struct bt_att_op_stats req[BT_ATT_STATS_OPCODES];
+};
+
+bool bt_att_get_stats(struct bt_att *att, struct bt_att_stats *stats);
+bool bt_att_reset_stats(struct bt_att *att);
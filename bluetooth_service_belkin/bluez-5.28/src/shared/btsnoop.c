@@ -28,10 +28,16 @@
 #include <endian.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include "src/shared/btsnoop.h"
 
@@ -64,6 +70,61 @@ struct pklg_pkt {
 } __attribute__ ((packed));
 #define PKLG_PKT_SIZE (sizeof(struct pklg_pkt))
 
+struct btsnoop_ring {
+	/*
+	 * Single producer (btsnoop_write) single consumer (writer thread)
+	 * ring of complete btsnoop records. head and tail are free running
+	 * byte counters, only the producer moves head and only the consumer
+	 * moves tail. In flight recorder mode there is no consumer and the
+	 * producer drops the oldest records itself.
+	 *
+	 * drops counts records refused because the ring was full and is
+	 * only touched by the producer, write_drops counts records the
+	 * writer thread failed to get to disk.
+	 */
+	uint8_t *buf;
+	uint64_t mask;
+	uint64_t head;
+	uint64_t tail;
+	uint32_t drops;
+	uint32_t write_drops;
+
+	struct btsnoop_ring_config config;
+	char *path;
+	size_t file_size;
+	time_t file_start;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool shutdown;
+	uint8_t *dump;
+	size_t dump_len;
+};
+
+/* Only the monitor opcodes up to SCO RX get posting lists */
+#define INDEX_OPCODES		(BTSNOOP_OPCODE_SCO_RX_PKT + 1)
+#define INDEX_HANDLES		0x1000
+
+struct btsnoop_mark {
+	uint64_t ts;
+	size_t offset;
+};
+
+struct btsnoop_postings {
+	size_t *offsets;
+	size_t len;
+	size_t size;
+};
+
+struct btsnoop_index {
+	unsigned int interval;
+	struct btsnoop_mark *marks;
+	size_t num_marks;
+	struct btsnoop_postings opcodes[INDEX_OPCODES];
+	struct btsnoop_postings *handles[INDEX_HANDLES];
+};
+
 struct btsnoop {
 	int ref_count;
 	int fd;
@@ -72,8 +133,109 @@ struct btsnoop {
 	uint16_t index;
 	bool aborted;
 	bool pklg_format;
+	struct btsnoop_ring *ring;
+	const uint8_t *map;
+	size_t map_size;
+	size_t map_pos;
+	struct btsnoop_index *idx;
+	uint16_t filter_opcode;
+	uint16_t filter_handle;
 };
 
+static void index_free(struct btsnoop_index *idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < INDEX_OPCODES; i++)
+		free(idx->opcodes[i].offsets);
+
+	for (i = 0; i < INDEX_HANDLES; i++) {
+		if (!idx->handles[i])
+			continue;
+
+		free(idx->handles[i]->offsets);
+		free(idx->handles[i]);
+	}
+
+	free(idx->marks);
+	free(idx);
+}
+
+/* Map a readable capture so packets can be walked without syscalls */
+static void map_file(struct btsnoop *btsnoop)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(btsnoop->fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+
+	if (st.st_size < (off_t) BTSNOOP_HDR_SIZE ||
+				(uint64_t) st.st_size > SIZE_MAX)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, btsnoop->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	btsnoop->map = map;
+	btsnoop->map_size = st.st_size;
+	btsnoop->map_pos = BTSNOOP_HDR_SIZE;
+}
+
+/*
+ * Called at the end of the map. Returns 0 if the capture grew and was
+ * mapped again, -ENOENT if it did not change and -EIO if it shrank. A
+ * shrunk capture is mapped at its new size, so nothing past its end is
+ * touched, and its index is dropped.
+ */
+static int map_refresh(struct btsnoop *btsnoop)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(btsnoop->fd, &st) < 0)
+		return -EIO;
+
+	if ((uint64_t) st.st_size == btsnoop->map_size ||
+				(uint64_t) st.st_size > SIZE_MAX)
+		return -ENOENT;
+
+	if (st.st_size < (off_t) BTSNOOP_HDR_SIZE) {
+		munmap((void *) btsnoop->map, btsnoop->map_size);
+		btsnoop->map = NULL;
+		btsnoop->map_size = 0;
+		btsnoop->map_pos = 0;
+		return -EIO;
+	}
+
+	map = mremap((void *) btsnoop->map, btsnoop->map_size, st.st_size,
+							MREMAP_MAYMOVE);
+	if (map == MAP_FAILED)
+		return -ENOENT;
+
+	btsnoop->map = map;
+
+	if ((uint64_t) st.st_size < btsnoop->map_size) {
+		btsnoop->map_size = st.st_size;
+
+		if (btsnoop->idx) {
+			index_free(btsnoop->idx);
+			btsnoop->idx = NULL;
+		}
+
+		return -EIO;
+	}
+
+	btsnoop->map_size = st.st_size;
+
+	/* Indexed reads hop around the file, see btsnoop_build_index */
+	if (btsnoop->idx)
+		madvise(map, st.st_size, MADV_RANDOM);
+
+	return 0;
+}
+
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 {
 	struct btsnoop *btsnoop;
@@ -103,6 +265,11 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 
 		btsnoop->type = be32toh(hdr.type);
 		btsnoop->index = 0xffff;
+		btsnoop->filter_opcode = 0xffff;
+		btsnoop->filter_handle = 0xffff;
+
+		if (btsnoop->flags & BTSNOOP_FLAG_MAP)
+			map_file(btsnoop);
 	} else {
 		if (!(btsnoop->flags & BTSNOOP_FLAG_PKLG_SUPPORT))
 			goto failed;
@@ -128,18 +295,39 @@ failed:
 	return NULL;
 }
 
-struct btsnoop *btsnoop_create(const char *path, uint32_t type)
+static int create_file(const char *path, uint32_t type)
 {
-	struct btsnoop *btsnoop;
 	struct btsnoop_hdr hdr;
 	ssize_t written;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0)
+		return -1;
+
+	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+	hdr.version = htobe32(btsnoop_version);
+	hdr.type = htobe32(type);
+
+	written = write(fd, &hdr, BTSNOOP_HDR_SIZE);
+	if (written < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+struct btsnoop *btsnoop_create(const char *path, uint32_t type)
+{
+	struct btsnoop *btsnoop;
 
 	btsnoop = calloc(1, sizeof(*btsnoop));
 	if (!btsnoop)
 		return NULL;
 
-	btsnoop->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
-					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	btsnoop->fd = create_file(path, type);
 	if (btsnoop->fd < 0) {
 		free(btsnoop);
 		return NULL;
@@ -148,13 +336,368 @@ struct btsnoop *btsnoop_create(const char *path, uint32_t type)
 	btsnoop->type = type;
 	btsnoop->index = 0xffff;
 
-	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
-	hdr.version = htobe32(btsnoop_version);
-	hdr.type = htobe32(btsnoop->type);
+	return btsnoop_ref(btsnoop);
+}
+
+static void ring_copy_in(struct btsnoop_ring *ring, uint64_t pos,
+					const void *data, size_t len)
+{
+	size_t start = pos & ring->mask;
+	size_t first = ring->mask + 1 - start;
+
+	if (first >= len) {
+		memcpy(ring->buf + start, data, len);
+		return;
+	}
+
+	memcpy(ring->buf + start, data, first);
+	memcpy(ring->buf, (const uint8_t *) data + first, len - first);
+}
+
+static void ring_copy_out(struct btsnoop_ring *ring, uint64_t pos,
+						void *data, size_t len)
+{
+	size_t start = pos & ring->mask;
+	size_t first = ring->mask + 1 - start;
+
+	if (first >= len) {
+		memcpy(data, ring->buf + start, len);
+		return;
+	}
+
+	memcpy(data, ring->buf + start, first);
+	memcpy((uint8_t *) data + first, ring->buf, len - first);
+}
+
+/* Shift path.N-1 to path.N, ..., path to path.1 and drop the oldest */
+static void rotate_files(struct btsnoop_ring *ring)
+{
+	unsigned int keep = ring->config.keep_files;
+	size_t len = strlen(ring->path) + 12;
+	char *from, *to;
+	unsigned int i;
+
+	if (!keep) {
+		unlink(ring->path);
+		return;
+	}
+
+	from = malloc(len);
+	to = malloc(len);
+	if (!from || !to)
+		goto done;
+
+	snprintf(to, len, "%s.%u", ring->path, keep);
+	unlink(to);
+
+	for (i = keep; i > 1; i--) {
+		snprintf(from, len, "%s.%u", ring->path, i - 1);
+		snprintf(to, len, "%s.%u", ring->path, i);
+		rename(from, to);
+	}
+
+	snprintf(to, len, "%s.1", ring->path);
+	rename(ring->path, to);
+
+done:
+	free(from);
+	free(to);
+}
+
+static bool open_ring_file(struct btsnoop *btsnoop)
+{
+	struct btsnoop_ring *ring = btsnoop->ring;
+
+	if (btsnoop->fd >= 0) {
+		close(btsnoop->fd);
+		btsnoop->fd = -1;
+	}
+
+	rotate_files(ring);
+
+	btsnoop->fd = create_file(ring->path, btsnoop->type);
+	if (btsnoop->fd < 0)
+		return false;
+
+	ring->file_size = BTSNOOP_HDR_SIZE;
+	ring->file_start = time(NULL);
+
+	return true;
+}
+
+/* Returns the number of bytes written, short only on a write error */
+static size_t write_iov(struct btsnoop *btsnoop, struct iovec *iov,
+								int iovcnt)
+{
+	struct btsnoop_ring *ring = btsnoop->ring;
+	size_t total = 0;
+	ssize_t written;
+
+	while (iovcnt > 0) {
+		written = writev(btsnoop->fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		ring->file_size += written;
+		total += written;
+
+		while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return total;
+}
+
+/*
+ * Account the records between pos and end that did not make it to disk,
+ * skipping the first written bytes. A record cut in half counts as lost,
+ * the file is closed so the next flush starts a clean one.
+ */
+static void ring_lost(struct btsnoop *btsnoop, uint64_t pos, uint64_t end,
+								size_t written)
+{
+	struct btsnoop_ring *ring = btsnoop->ring;
+	uint32_t lost = 0;
+
+	while (pos < end) {
+		struct btsnoop_pkt pkt;
+		uint64_t len;
+
+		ring_copy_out(ring, pos, &pkt, BTSNOOP_PKT_SIZE);
+		len = BTSNOOP_PKT_SIZE + be32toh(pkt.len);
+
+		if (len > written) {
+			written = 0;
+			lost++;
+		} else
+			written -= len;
+
+		pos += len;
+	}
+
+	if (!lost)
+		return;
+
+	__atomic_add_fetch(&ring->write_drops, lost, __ATOMIC_RELAXED);
+
+	if (btsnoop->fd >= 0) {
+		close(btsnoop->fd);
+		btsnoop->fd = -1;
+	}
+}
+
+static bool need_rotation(struct btsnoop_ring *ring, size_t pending)
+{
+	if (ring->file_size <= BTSNOOP_HDR_SIZE)
+		return false;
+
+	if (ring->config.max_file_size &&
+			ring->file_size + pending > ring->config.max_file_size)
+		return true;
+
+	if (ring->config.max_file_age &&
+			time(NULL) - ring->file_start >=
+					(time_t) ring->config.max_file_age)
+		return true;
+
+	return false;
+}
+
+static void ring_flush(struct btsnoop *btsnoop)
+{
+	struct btsnoop_ring *ring = btsnoop->ring;
+	struct iovec iov[2];
+	uint64_t head, tail, start, len;
+	size_t written = 0;
+	int iovcnt = 1;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+
+	if (head == tail)
+		return;
+
+	len = head - tail;
+
+	if (btsnoop->fd < 0 || need_rotation(ring, len)) {
+		if (!open_ring_file(btsnoop))
+			goto done;
+	}
+
+	start = tail & ring->mask;
+
+	iov[0].iov_base = ring->buf + start;
+	iov[0].iov_len = len;
+
+	if (start + len > ring->mask + 1) {
+		iov[0].iov_len = ring->mask + 1 - start;
+		iov[1].iov_base = ring->buf;
+		iov[1].iov_len = len - iov[0].iov_len;
+		iovcnt = 2;
+	}
+
+	written = write_iov(btsnoop, iov, iovcnt);
+
+done:
+	if (written < len)
+		ring_lost(btsnoop, tail, head, written);
+
+	__atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+}
+
+static void ring_dump(struct btsnoop *btsnoop, uint8_t *data, size_t len)
+{
+	struct btsnoop_ring *ring = btsnoop->ring;
+	struct iovec iov;
+	size_t written = 0;
+	uint32_t lost = 0;
+	size_t pos;
+
+	if (open_ring_file(btsnoop)) {
+		iov.iov_base = data;
+		iov.iov_len = len;
+
+		written = write_iov(btsnoop, &iov, 1);
 
-	written = write(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE);
-	if (written < 0) {
 		close(btsnoop->fd);
+		btsnoop->fd = -1;
+	}
+
+	/* The snapshot is flat, so count its lost records in place */
+	for (pos = 0; pos < len;) {
+		const struct btsnoop_pkt *pkt = (void *) (data + pos);
+
+		pos += BTSNOOP_PKT_SIZE + be32toh(pkt->len);
+		if (pos > written)
+			lost++;
+	}
+
+	if (lost)
+		__atomic_add_fetch(&ring->write_drops, lost, __ATOMIC_RELAXED);
+}
+
+static void *ring_thread(void *user_data)
+{
+	struct btsnoop *btsnoop = user_data;
+	struct btsnoop_ring *ring = btsnoop->ring;
+	unsigned int interval = ring->config.flush_interval;
+	struct timespec ts;
+	uint8_t *dump;
+	size_t dump_len;
+	bool stop;
+
+	while (1) {
+		pthread_mutex_lock(&ring->lock);
+
+		if (!ring->shutdown && !ring->dump) {
+			if (ring->config.flight_recorder) {
+				pthread_cond_wait(&ring->cond, &ring->lock);
+			} else {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += interval / 1000;
+				ts.tv_nsec += (interval % 1000) * 1000000;
+				if (ts.tv_nsec >= 1000000000) {
+					ts.tv_sec++;
+					ts.tv_nsec -= 1000000000;
+				}
+
+				pthread_cond_timedwait(&ring->cond,
+							&ring->lock, &ts);
+			}
+		}
+
+		stop = ring->shutdown;
+		dump = ring->dump;
+		dump_len = ring->dump_len;
+		ring->dump = NULL;
+
+		pthread_mutex_unlock(&ring->lock);
+
+		if (dump) {
+			ring_dump(btsnoop, dump, dump_len);
+			free(dump);
+		}
+
+		if (!ring->config.flight_recorder)
+			ring_flush(btsnoop);
+
+		if (stop)
+			break;
+	}
+
+	return NULL;
+}
+
+static void ring_free(struct btsnoop_ring *ring)
+{
+	pthread_cond_destroy(&ring->cond);
+	pthread_mutex_destroy(&ring->lock);
+	free(ring->dump);
+	free(ring->path);
+	free(ring->buf);
+	free(ring);
+}
+
+struct btsnoop *btsnoop_create_ring(const char *path, uint32_t type,
+				const struct btsnoop_ring_config *config)
+{
+	struct btsnoop *btsnoop;
+	struct btsnoop_ring *ring;
+	size_t size;
+
+	if (!path || !config || config->ring_size < BTSNOOP_PKT_SIZE +
+						BTSNOOP_MAX_PACKET_SIZE)
+		return NULL;
+
+	btsnoop = calloc(1, sizeof(*btsnoop));
+	if (!btsnoop)
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		free(btsnoop);
+		return NULL;
+	}
+
+	/* Round up to a power of two so positions can be masked */
+	for (size = 1; size < config->ring_size; size <<= 1);
+
+	ring->buf = malloc(size);
+	ring->path = strdup(path);
+	if (!ring->buf || !ring->path) {
+		free(ring->buf);
+		free(ring->path);
+		free(ring);
+		free(btsnoop);
+		return NULL;
+	}
+
+	ring->mask = size - 1;
+	ring->config = *config;
+	if (!ring->config.flush_interval)
+		ring->config.flush_interval = 1000;
+
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+
+	btsnoop->fd = -1;
+	btsnoop->type = type;
+	btsnoop->index = 0xffff;
+	btsnoop->ring = ring;
+
+	if (pthread_create(&ring->thread, NULL, ring_thread, btsnoop)) {
+		ring_free(ring);
 		free(btsnoop);
 		return NULL;
 	}
@@ -162,6 +705,83 @@ struct btsnoop *btsnoop_create(const char *path, uint32_t type)
 	return btsnoop_ref(btsnoop);
 }
 
+static bool ring_write(struct btsnoop_ring *ring, struct btsnoop_pkt *pkt,
+					const void *data, uint16_t size)
+{
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint64_t len = BTSNOOP_PKT_SIZE + size;
+
+	if (head + len - tail > ring->mask + 1) {
+		struct btsnoop_pkt old;
+
+		if (!ring->config.flight_recorder) {
+			ring->drops++;
+			return false;
+		}
+
+		/* Make room by forgetting the oldest records */
+		while (head + len - tail > ring->mask + 1) {
+			ring_copy_out(ring, tail, &old, BTSNOOP_PKT_SIZE);
+			tail += BTSNOOP_PKT_SIZE + be32toh(old.len);
+		}
+
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	pkt->drops = htobe32(ring->drops + __atomic_load_n(&ring->write_drops,
+							__ATOMIC_RELAXED));
+
+	ring_copy_in(ring, head, pkt, BTSNOOP_PKT_SIZE);
+	if (data && size > 0)
+		ring_copy_in(ring, head + BTSNOOP_PKT_SIZE, data, size);
+
+	__atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+bool btsnoop_trigger(struct btsnoop *btsnoop)
+{
+	struct btsnoop_ring *ring;
+	uint64_t head, tail;
+	uint8_t *dump;
+
+	if (!btsnoop || !btsnoop->ring)
+		return false;
+
+	ring = btsnoop->ring;
+
+	if (!ring->config.flight_recorder) {
+		pthread_mutex_lock(&ring->lock);
+		pthread_cond_signal(&ring->cond);
+		pthread_mutex_unlock(&ring->lock);
+		return true;
+	}
+
+	head = ring->head;
+	tail = ring->tail;
+
+	if (head == tail)
+		return false;
+
+	/* Snapshot here, the disk write happens on the writer thread */
+	dump = malloc(head - tail);
+	if (!dump)
+		return false;
+
+	ring_copy_out(ring, tail, dump, head - tail);
+
+	pthread_mutex_lock(&ring->lock);
+	free(ring->dump);
+	ring->dump = dump;
+	ring->dump_len = head - tail;
+	pthread_cond_signal(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	return true;
+}
+
 struct btsnoop *btsnoop_ref(struct btsnoop *btsnoop)
 {
 	if (!btsnoop)
@@ -180,6 +800,22 @@ void btsnoop_unref(struct btsnoop *btsnoop)
 	if (__sync_sub_and_fetch(&btsnoop->ref_count, 1))
 		return;
 
+	if (btsnoop->ring) {
+		pthread_mutex_lock(&btsnoop->ring->lock);
+		btsnoop->ring->shutdown = true;
+		pthread_cond_signal(&btsnoop->ring->cond);
+		pthread_mutex_unlock(&btsnoop->ring->lock);
+
+		pthread_join(btsnoop->ring->thread, NULL);
+		ring_free(btsnoop->ring);
+	}
+
+	if (btsnoop->idx)
+		index_free(btsnoop->idx);
+
+	if (btsnoop->map)
+		munmap((void *) btsnoop->map, btsnoop->map_size);
+
 	if (btsnoop->fd >= 0)
 		close(btsnoop->fd);
 
@@ -194,6 +830,19 @@ uint32_t btsnoop_get_type(struct btsnoop *btsnoop)
 	return btsnoop->type;
 }
 
+/*
+ * Records lost by a ring so far, refused while the ring was full or
+ * failed on the way to disk. Call it from the thread that writes.
+ */
+uint32_t btsnoop_get_drops(struct btsnoop *btsnoop)
+{
+	if (!btsnoop || !btsnoop->ring)
+		return 0;
+
+	return btsnoop->ring->drops +
+		__atomic_load_n(&btsnoop->ring->write_drops, __ATOMIC_RELAXED);
+}
+
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 			uint32_t flags, const void *data, uint16_t size)
 {
@@ -212,6 +861,9 @@ bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 	pkt.drops = htobe32(0);
 	pkt.ts    = htobe64(ts + 0x00E03AB44A676000ll);
 
+	if (btsnoop->ring)
+		return ring_write(btsnoop->ring, &pkt, data, size);
+
 	written = write(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
 	if (written < 0)
 		return false;
@@ -405,6 +1057,16 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	if (btsnoop->pklg_format)
 		return pklg_read_hci(btsnoop, tv, index, opcode, data, size);
 
+	if (btsnoop->map) {
+		const void *ptr;
+
+		if (!btsnoop_next_hci(btsnoop, tv, index, opcode, &ptr, size))
+			return false;
+
+		memcpy(data, ptr, *size);
+		return true;
+	}
+
 	len = read(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return false;
@@ -465,6 +1127,374 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	return true;
 }
 
+struct map_pkt {
+	uint64_t ts;
+	uint16_t index;
+	uint16_t opcode;
+	const uint8_t *data;
+	uint16_t size;
+	size_t next;
+};
+
+/*
+ * Decode the record at offset of a mapped capture. Returns 0 on
+ * success, -ENOENT at the clean end of the map, -EAGAIN on a record
+ * cut short by it and -EILSEQ on a malformed record.
+ */
+static int map_decode(struct btsnoop *btsnoop, size_t offset,
+						struct map_pkt *out)
+{
+	const struct btsnoop_pkt *pkt;
+	uint32_t size, flags;
+
+	if (offset >= btsnoop->map_size)
+		return -ENOENT;
+
+	if (btsnoop->map_size - offset < BTSNOOP_PKT_SIZE)
+		return -EAGAIN;
+
+	pkt = (const struct btsnoop_pkt *) (btsnoop->map + offset);
+	offset += BTSNOOP_PKT_SIZE;
+
+	size = be32toh(pkt->size);
+	if (size > BTSNOOP_MAX_PACKET_SIZE)
+		return -EILSEQ;
+
+	if (btsnoop->map_size - offset < size)
+		return -EAGAIN;
+
+	flags = be32toh(pkt->flags);
+
+	out->ts = be64toh(pkt->ts);
+	out->data = btsnoop->map + offset;
+	out->size = size;
+	out->next = offset + size;
+
+	switch (btsnoop->type) {
+	case BTSNOOP_TYPE_HCI:
+		out->index = 0;
+		out->opcode = get_opcode_from_flags(0xff, flags);
+		break;
+
+	case BTSNOOP_TYPE_UART:
+		if (!size)
+			return -EILSEQ;
+
+		out->index = 0;
+		out->opcode = get_opcode_from_flags(out->data[0], flags);
+		out->data++;
+		out->size--;
+		break;
+
+	case BTSNOOP_TYPE_MONITOR:
+		out->index = flags >> 16;
+		out->opcode = flags & 0xffff;
+		break;
+
+	default:
+		return -EILSEQ;
+	}
+
+	return 0;
+}
+
+/* Connection handle of an ACL or SCO data packet, 0xffff otherwise */
+static uint16_t pkt_handle(const struct map_pkt *pkt)
+{
+	switch (pkt->opcode) {
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		if (pkt->size < 2)
+			break;
+
+		return (pkt->data[0] | (pkt->data[1] << 8)) & 0x0fff;
+	}
+
+	return 0xffff;
+}
+
+static bool pkt_match(struct btsnoop *btsnoop, const struct map_pkt *pkt)
+{
+	if (btsnoop->filter_opcode != 0xffff &&
+				pkt->opcode != btsnoop->filter_opcode)
+		return false;
+
+	if (btsnoop->filter_handle != 0xffff &&
+				pkt_handle(pkt) != btsnoop->filter_handle)
+		return false;
+
+	return true;
+}
+
+static uint64_t tv_to_ts(const struct timeval *tv)
+{
+	return (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec +
+							0x00E03AB44A676000ll;
+}
+
+static void ts_to_tv(uint64_t ts, struct timeval *tv)
+{
+	ts -= 0x00E03AB44A676000ll;
+	tv->tv_sec = (ts / 1000000ll) + 946684800ll;
+	tv->tv_usec = ts % 1000000ll;
+}
+
+/* Posting list to walk for the current filter, if the index has one */
+static const struct btsnoop_postings *filter_postings(struct btsnoop *btsnoop)
+{
+	struct btsnoop_index *idx = btsnoop->idx;
+
+	if (!idx)
+		return NULL;
+
+	if (btsnoop->filter_handle < INDEX_HANDLES)
+		return idx->handles[btsnoop->filter_handle];
+
+	if (btsnoop->filter_opcode < INDEX_OPCODES)
+		return &idx->opcodes[btsnoop->filter_opcode];
+
+	return NULL;
+}
+
+/* First entry of a posting list at or after offset */
+static size_t postings_lower_bound(const struct btsnoop_postings *list,
+								size_t offset)
+{
+	size_t lo = 0, hi = list->len;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (list->offsets[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+bool btsnoop_next_hci(struct btsnoop *btsnoop, struct timeval *tv,
+					uint16_t *index, uint16_t *opcode,
+					const void **data, uint16_t *size)
+{
+	const struct btsnoop_postings *list;
+	struct map_pkt pkt;
+	size_t i = 0;
+	int err;
+
+	if (!btsnoop || !btsnoop->map || btsnoop->aborted)
+		return false;
+
+	list = filter_postings(btsnoop);
+	if (list)
+		i = postings_lower_bound(list, btsnoop->map_pos);
+
+	while (1) {
+		size_t offset = btsnoop->map_pos;
+
+		if (list) {
+			/* Filtered by the index, hop between matches */
+			if (i == list->len) {
+				btsnoop->map_pos = btsnoop->map_size;
+				return false;
+			}
+
+			offset = list->offsets[i++];
+		}
+
+		err = map_decode(btsnoop, offset, &pkt);
+		if (!list && (err == -ENOENT || err == -EAGAIN)) {
+			/* The writer may have added to the file meanwhile */
+			err = map_refresh(btsnoop);
+			if (!err)
+				continue;
+
+			if (err == -EIO)
+				btsnoop->aborted = true;
+
+			/* Keep the position, a later call retries */
+			return false;
+		}
+
+		if (err < 0) {
+			if (err != -ENOENT)
+				btsnoop->aborted = true;
+			return false;
+		}
+
+		btsnoop->map_pos = pkt.next;
+
+		if (pkt_match(btsnoop, &pkt))
+			break;
+	}
+
+	ts_to_tv(pkt.ts, tv);
+	*index = pkt.index;
+	*opcode = pkt.opcode;
+	*data = pkt.data;
+	*size = pkt.size;
+
+	return true;
+}
+
+static bool postings_add(struct btsnoop_postings *list, size_t offset)
+{
+	if (list->len == list->size) {
+		size_t size = list->size ? list->size * 2 : 64;
+		size_t *offsets;
+
+		offsets = realloc(list->offsets, size * sizeof(*offsets));
+		if (!offsets)
+			return false;
+
+		list->offsets = offsets;
+		list->size = size;
+	}
+
+	list->offsets[list->len++] = offset;
+
+	return true;
+}
+
+bool btsnoop_build_index(struct btsnoop *btsnoop, unsigned int interval)
+{
+	struct btsnoop_index *idx;
+	struct map_pkt pkt;
+	size_t offset, count = 0, marks_size = 0;
+	int err;
+
+	if (!btsnoop || !btsnoop->map || !interval)
+		return false;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return false;
+
+	idx->interval = interval;
+
+	for (offset = BTSNOOP_HDR_SIZE;
+			!(err = map_decode(btsnoop, offset, &pkt));
+			offset = pkt.next, count++) {
+		uint16_t handle;
+
+		if (!(count % interval)) {
+			if (idx->num_marks == marks_size) {
+				struct btsnoop_mark *marks;
+
+				marks_size = marks_size ? marks_size * 2 : 64;
+				marks = realloc(idx->marks, marks_size *
+							sizeof(*marks));
+				if (!marks)
+					goto failed;
+
+				idx->marks = marks;
+			}
+
+			idx->marks[idx->num_marks].ts = pkt.ts;
+			idx->marks[idx->num_marks].offset = offset;
+			idx->num_marks++;
+		}
+
+		if (pkt.opcode < INDEX_OPCODES &&
+			!postings_add(&idx->opcodes[pkt.opcode], offset))
+			goto failed;
+
+		handle = pkt_handle(&pkt);
+		if (handle >= INDEX_HANDLES)
+			continue;
+
+		if (!idx->handles[handle]) {
+			idx->handles[handle] = calloc(1,
+					sizeof(struct btsnoop_postings));
+			if (!idx->handles[handle])
+				goto failed;
+		}
+
+		if (!postings_add(idx->handles[handle], offset))
+			goto failed;
+	}
+
+	/* Index what is readable even if the capture was cut short */
+	if (btsnoop->idx)
+		index_free(btsnoop->idx);
+
+	btsnoop->idx = idx;
+
+	/* From here on reads hop between marks and postings */
+	madvise((void *) btsnoop->map, btsnoop->map_size, MADV_RANDOM);
+
+	return true;
+
+failed:
+	index_free(idx);
+	return false;
+}
+
+bool btsnoop_seek_time(struct btsnoop *btsnoop, const struct timeval *tv)
+{
+	struct btsnoop_index *idx;
+	struct map_pkt pkt;
+	uint64_t ts;
+	size_t offset = BTSNOOP_HDR_SIZE;
+
+	if (!btsnoop || !btsnoop->map || !tv)
+		return false;
+
+	ts = tv_to_ts(tv);
+	idx = btsnoop->idx;
+
+	if (idx && idx->num_marks) {
+		size_t lo = 0, hi = idx->num_marks;
+
+		/* Last mark before the requested time */
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (idx->marks[mid].ts < ts)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo)
+			offset = idx->marks[lo - 1].offset;
+	}
+
+	while (!map_decode(btsnoop, offset, &pkt) && pkt.ts < ts)
+		offset = pkt.next;
+
+	btsnoop->map_pos = offset;
+	btsnoop->aborted = false;
+
+	return true;
+}
+
+bool btsnoop_set_filter(struct btsnoop *btsnoop, uint16_t opcode,
+							uint16_t handle)
+{
+	if (!btsnoop || !btsnoop->map)
+		return false;
+
+	btsnoop->filter_opcode = opcode;
+	btsnoop->filter_handle = handle;
+
+	return true;
+}
+
+bool btsnoop_rewind(struct btsnoop *btsnoop)
+{
+	if (!btsnoop || !btsnoop->map)
+		return false;
+
+	btsnoop->map_pos = BTSNOOP_HDR_SIZE;
+	btsnoop->aborted = false;
+
+	return true;
+}
+
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size)
 {
@@ -34,6 +34,13 @@
 #define BTSNOOP_TYPE_SIMULATOR		2002
 
 #define BTSNOOP_FLAG_PKLG_SUPPORT	(1 << 0)
+/*
+ * Map the capture for btsnoop_next_hci() and the index. Growth and
+ * truncation are picked up at the end of the map, but truncating the
+ * file under a reader still inside it raises SIGBUS, so live captures
+ * should be read without it through btsnoop_read_hci().
+ */
+#define BTSNOOP_FLAG_MAP		(1 << 1)
 
 #define BTSNOOP_OPCODE_NEW_INDEX	0
 #define BTSNOOP_OPCODE_DEL_INDEX	1
@@ -53,15 +60,28 @@ struct btsnoop_opcode_new_index {
 	char     name[8];
 } __attribute__((packed));
 
+struct btsnoop_ring_config {
+	size_t ring_size;		/* In-memory ring size in bytes */
+	size_t max_file_size;		/* Rotate above this size, 0 = never */
+	unsigned int max_file_age;	/* Rotate after seconds, 0 = never */
+	unsigned int keep_files;	/* Number of rotated files to keep */
+	unsigned int flush_interval;	/* Writer period in ms, 0 = 1000 */
+	bool flight_recorder;		/* Only write on btsnoop_trigger() */
+};
+
 struct btsnoop;
 
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags);
 struct btsnoop *btsnoop_create(const char *path, uint32_t type);
+struct btsnoop *btsnoop_create_ring(const char *path, uint32_t type,
+				const struct btsnoop_ring_config *config);
+bool btsnoop_trigger(struct btsnoop *btsnoop);
 
 struct btsnoop *btsnoop_ref(struct btsnoop *btsnoop);
 void btsnoop_unref(struct btsnoop *btsnoop);
 
 uint32_t btsnoop_get_type(struct btsnoop *btsnoop);
+uint32_t btsnoop_get_drops(struct btsnoop *btsnoop);
 
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 			uint32_t flags, const void *data, uint16_t size);
@@ -74,5 +94,13 @@ bool btsnoop_write_phy(struct btsnoop *btsnoop, struct timeval *tv,
 bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					uint16_t *index, uint16_t *opcode,
 					void *data, uint16_t *size);
+bool btsnoop_next_hci(struct btsnoop *btsnoop, struct timeval *tv,
+					uint16_t *index, uint16_t *opcode,
+					const void **data, uint16_t *size);
+bool btsnoop_build_index(struct btsnoop *btsnoop, unsigned int interval);
+bool btsnoop_seek_time(struct btsnoop *btsnoop, const struct timeval *tv);
+bool btsnoop_set_filter(struct btsnoop *btsnoop, uint16_t opcode,
+							uint16_t handle);
+bool btsnoop_rewind(struct btsnoop *btsnoop);
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size);
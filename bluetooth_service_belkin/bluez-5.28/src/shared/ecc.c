@@ -30,6 +30,9 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
 #include <string.h>
 
@@ -859,3 +862,213 @@ bool ecdh_shared_secret(const uint8_t public_key[64],
 
 	return !ecc_point_is_zero(&product);
 }
+
+/* Refill retry delay after a failed key generation, doubled up to max */
+#define KEYPOOL_RETRY_MIN	100	/* msec */
+#define KEYPOOL_RETRY_MAX	5000
+
+struct ecc_keypair {
+	uint8_t public_key[64];
+	uint8_t private_key[32];
+};
+
+struct ecc_keypool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool shutdown;
+	unsigned int size;
+	unsigned int head;
+	unsigned int count;
+	unsigned int failures;
+	struct ecc_keypair *keys;
+};
+
+/* Called with the lock held, returns early when the pool shuts down */
+static void keypool_backoff(struct ecc_keypool *pool, unsigned int msec)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	ts.tv_sec += msec / 1000;
+	ts.tv_nsec += (msec % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	while (!pool->shutdown) {
+		if (pthread_cond_timedwait(&pool->cond, &pool->lock, &ts))
+			break;
+	}
+}
+
+static void *keypool_refill(void *user_data)
+{
+	struct ecc_keypool *pool = user_data;
+	struct ecc_keypair key;
+	unsigned int delay = 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (!pool->shutdown) {
+		unsigned int tail;
+
+		if (pool->count == pool->size) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+
+		/*
+		 * Generate outside of the lock so that taking a key from
+		 * the pool never waits for a point multiplication.
+		 */
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!ecc_make_key(key.public_key, key.private_key)) {
+			/*
+			 * Only the random source can fail here. Keep retrying,
+			 * takers fall back to ecc_make_key() meanwhile and the
+			 * failure count tells them why.
+			 */
+			pthread_mutex_lock(&pool->lock);
+			pool->failures++;
+
+			delay = delay ? delay * 2 : KEYPOOL_RETRY_MIN;
+			if (delay > KEYPOOL_RETRY_MAX)
+				delay = KEYPOOL_RETRY_MAX;
+
+			keypool_backoff(pool, delay);
+			continue;
+		}
+
+		delay = 0;
+
+		pthread_mutex_lock(&pool->lock);
+
+		if (pool->shutdown)
+			break;
+
+		tail = (pool->head + pool->count) % pool->size;
+		memcpy(&pool->keys[tail], &key, sizeof(key));
+		pool->count++;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	memset(&key, 0, sizeof(key));
+
+	return NULL;
+}
+
+struct ecc_keypool *ecc_keypool_new(unsigned int size)
+{
+	struct ecc_keypool *pool;
+
+	if (!size)
+		return NULL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->keys = calloc(size, sizeof(*pool->keys));
+	if (!pool->keys) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->size = size;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	if (pthread_create(&pool->thread, NULL, keypool_refill, pool)) {
+		pthread_cond_destroy(&pool->cond);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->keys);
+		free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void ecc_keypool_free(struct ecc_keypool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_join(pool->thread, NULL);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+
+	/* Never leave unused private keys behind in freed memory */
+	memset(pool->keys, 0, pool->size * sizeof(*pool->keys));
+	free(pool->keys);
+	free(pool);
+}
+
+bool ecc_keypool_take(struct ecc_keypool *pool, uint8_t public_key[64],
+						uint8_t private_key[32])
+{
+	struct ecc_keypair *key;
+
+	if (!pool)
+		return ecc_make_key(public_key, private_key);
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (!pool->count) {
+		pthread_mutex_unlock(&pool->lock);
+		return ecc_make_key(public_key, private_key);
+	}
+
+	key = &pool->keys[pool->head];
+	memcpy(public_key, key->public_key, sizeof(key->public_key));
+	memcpy(private_key, key->private_key, sizeof(key->private_key));
+	memset(key, 0, sizeof(*key));
+
+	pool->head = (pool->head + 1) % pool->size;
+	pool->count--;
+
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return true;
+}
+
+unsigned int ecc_keypool_count(struct ecc_keypool *pool)
+{
+	unsigned int count;
+
+	if (!pool)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+	count = pool->count;
+	pthread_mutex_unlock(&pool->lock);
+
+	return count;
+}
+
+unsigned int ecc_keypool_get_failures(struct ecc_keypool *pool)
+{
+	unsigned int failures;
+
+	if (!pool)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+	failures = pool->failures;
+	pthread_mutex_unlock(&pool->lock);
+
+	return failures;
+}
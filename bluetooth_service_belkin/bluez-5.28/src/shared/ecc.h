@@ -56,3 +56,36 @@ bool ecc_make_key(uint8_t public_key[64], uint8_t private_key[32]);
 bool ecdh_shared_secret(const uint8_t public_key[64],
 				const uint8_t private_key[32],
 				uint8_t secret[32]);
+
+struct ecc_keypool;
+
+/* Create a pool of single-use key pairs that is kept topped up to size
+ * entries by a background thread, so that callers on a latency critical
+ * path (LE Secure Connections public key exchange) do not pay for the
+ * point multiplication.
+ *
+ * Returns NULL if the pool or its refill thread could not be created.
+ */
+struct ecc_keypool *ecc_keypool_new(unsigned int size);
+
+/* Stop the refill thread, wipe all unused keys and free the pool. */
+void ecc_keypool_free(struct ecc_keypool *pool);
+
+/* Take a key pair out of the pool. Each key pair is handed out only once
+ * and is wiped from the pool as it is taken. If the pool is empty (or
+ * pool is NULL) the key pair is generated synchronously with
+ * ecc_make_key().
+ *
+ * Returns true if a key pair was provided, false if an error occurred.
+ */
+bool ecc_keypool_take(struct ecc_keypool *pool, uint8_t public_key[64],
+						uint8_t private_key[32]);
+
+/* Number of key pairs currently ready in the pool. */
+unsigned int ecc_keypool_count(struct ecc_keypool *pool);
+
+/* Number of failed key generations in the refill thread. The thread keeps
+ * retrying with a growing delay, so a rising count means the pool stays
+ * empty and takers are paying for ecc_make_key() themselves.
+ */
+unsigned int ecc_keypool_get_failures(struct ecc_keypool *pool);
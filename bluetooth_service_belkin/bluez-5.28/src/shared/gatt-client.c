@@ -25,12 +25,14 @@
 #include "lib/uuid.h"
 #include "src/shared/gatt-helpers.h"
 #include "src/shared/util.h"
+#include "src/shared/trace.h"
 #include "src/shared/queue.h"
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-client.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <time.h>
 
 #ifndef MAX
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -45,6 +47,11 @@
 #define GATT_SVC_UUID	0x1801
 #define SVC_CHNGD_UUID	0x2a05
 
+struct xfer_stats {
+	uint64_t bytes;
+	uint64_t usec;
+};
+
 struct bt_gatt_client {
 	struct bt_att *att;
 	int ref_count;
@@ -97,6 +104,10 @@ struct bt_gatt_client {
 	 */
 	struct queue *pending_requests;
 	unsigned int next_request_id;
+
+	/* Payload and wall time of completed long reads and writes */
+	struct xfer_stats read_long_stats;
+	struct xfer_stats write_long_stats;
 };
 
 struct request {
@@ -413,6 +424,12 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data);
 
+/* Leading 32 bits of a UUID, the 16-bit value for SIG assigned ones */
+static uint32_t trace_uuid(const uint128_t *u128)
+{
+	return get_be32(u128->data);
+}
+
 static void discover_incl_cb(bool success, uint8_t att_ecode,
 				struct bt_gatt_result *result, void *user_data)
 {
@@ -422,8 +439,6 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 	struct gatt_db_attribute *attr, *tmp;
 	uint16_t handle, start, end;
 	uint128_t u128;
-	bt_uuid_t uuid;
-	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int includes_count, i;
 
 	if (!success) {
@@ -445,22 +460,12 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 	if (includes_count == 0)
 		goto failed;
 
-	util_debug(client->debug_callback, client->debug_data,
-						"Included services found: %u",
-						includes_count);
-
 	for (i = 0; i < includes_count; i++) {
 		if (!bt_gatt_iter_next_included_service(&iter, &handle, &start,
 							&end, u128.data))
 			break;
 
-		bt_uuid128_create(&uuid, u128);
-
-		/* Log debug message */
-		bt_uuid_to_string(&uuid, uuid_str, sizeof(uuid_str));
-		util_debug(client->debug_callback, client->debug_data,
-				"handle: 0x%04x, start: 0x%04x, end: 0x%04x,"
-				"uuid: %s", handle, start, end, uuid_str);
+		TRACE(TRACE_GATT_INCLUDE, 0, handle, start, end);
 
 		tmp = gatt_db_get_attribute(client->db, start);
 		if (!tmp)
@@ -612,7 +617,6 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 	uint16_t handle, start, end;
 	uint128_t u128;
 	bt_uuid_t uuid;
-	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int desc_count;
 	bool discovering;
 
@@ -632,17 +636,10 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 	if (desc_count == 0)
 		goto failed;
 
-	util_debug(client->debug_callback, client->debug_data,
-					"Descriptors found: %u", desc_count);
-
 	while (bt_gatt_iter_next_descriptor(&iter, &handle, u128.data)) {
 		bt_uuid128_create(&uuid, u128);
 
-		/* Log debug message */
-		bt_uuid_to_string(&uuid, uuid_str, sizeof(uuid_str));
-		util_debug(client->debug_callback, client->debug_data,
-						"handle: 0x%04x, uuid: %s",
-						handle, uuid_str);
+		TRACE(TRACE_GATT_DESC, 0, handle, 0, trace_uuid(&u128));
 
 		attr = gatt_db_service_add_descriptor(op->cur_svc, &uuid, 0,
 							NULL, NULL, NULL);
@@ -703,7 +700,6 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 	uint8_t properties;
 	uint128_t u128;
 	bt_uuid_t uuid;
-	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int chrc_count;
 	bool discovering;
 
@@ -720,9 +716,6 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 		goto failed;
 
 	chrc_count = bt_gatt_result_characteristic_count(result);
-	util_debug(client->debug_callback, client->debug_data,
-				"Characteristics found: %u", chrc_count);
-
 	if (chrc_count == 0)
 		goto failed;
 
@@ -730,12 +723,8 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 						&properties, u128.data)) {
 		bt_uuid128_create(&uuid, u128);
 
-		/* Log debug message */
-		bt_uuid_to_string(&uuid, uuid_str, sizeof(uuid_str));
-		util_debug(client->debug_callback, client->debug_data,
-				"start: 0x%04x, end: 0x%04x, value: 0x%04x, "
-				"props: 0x%02x, uuid: %s",
-				start, end, value, properties, uuid_str);
+		TRACE(TRACE_GATT_CHRC, 0, value, properties,
+							trace_uuid(&u128));
 
 		chrc_data = new0(struct chrc, 1);
 		if (!chrc_data)
@@ -802,7 +791,6 @@ static void discover_secondary_cb(bool success, uint8_t att_ecode,
 	uint16_t start, end;
 	uint128_t u128;
 	bt_uuid_t uuid;
-	char uuid_str[MAX_LEN_UUID_STR];
 
 	if (!success) {
 		util_debug(client->debug_callback, client->debug_data,
@@ -822,18 +810,10 @@ static void discover_secondary_cb(bool success, uint8_t att_ecode,
 		goto done;
 	}
 
-	util_debug(client->debug_callback, client->debug_data,
-					"Secondary services found: %u",
-					bt_gatt_result_service_count(result));
-
 	while (bt_gatt_iter_next_service(&iter, &start, &end, u128.data)) {
 		bt_uuid128_create(&uuid, u128);
 
-		/* Log debug message */
-		bt_uuid_to_string(&uuid, uuid_str, sizeof(uuid_str));
-		util_debug(client->debug_callback, client->debug_data,
-				"start: 0x%04x, end: 0x%04x, uuid: %s",
-				start, end, uuid_str);
+		TRACE(TRACE_GATT_SECONDARY, 0, start, end, trace_uuid(&u128));
 
 		/* Store the service */
 		attr = gatt_db_insert_service(client->db, start, &uuid, false,
@@ -894,7 +874,6 @@ static void discover_primary_cb(bool success, uint8_t att_ecode,
 	uint16_t start, end;
 	uint128_t u128;
 	bt_uuid_t uuid;
-	char uuid_str[MAX_LEN_UUID_STR];
 
 	if (!success) {
 		util_debug(client->debug_callback, client->debug_data,
@@ -908,18 +887,10 @@ static void discover_primary_cb(bool success, uint8_t att_ecode,
 		goto done;
 	}
 
-	util_debug(client->debug_callback, client->debug_data,
-					"Primary services found: %u",
-					bt_gatt_result_service_count(result));
-
 	while (bt_gatt_iter_next_service(&iter, &start, &end, u128.data)) {
 		bt_uuid128_create(&uuid, u128);
 
-		/* Log debug message. */
-		bt_uuid_to_string(&uuid, uuid_str, sizeof(uuid_str));
-		util_debug(client->debug_callback, client->debug_data,
-				"start: 0x%04x, end: 0x%04x, uuid: %s",
-				start, end, uuid_str);
+		TRACE(TRACE_GATT_PRIMARY, 0, start, end, trace_uuid(&u128));
 
 		attr = gatt_db_insert_service(client->db, start, &uuid, true,
 							end - start + 1);
@@ -1165,9 +1136,7 @@ static void service_changed_cb(uint16_t value_handle, const uint8_t *value,
 		return;
 	}
 
-	util_debug(client->debug_callback, client->debug_data,
-			"Service Changed received - start: 0x%04x end: 0x%04x",
-			start, end);
+	TRACE(TRACE_GATT_SVC_CHANGED, 0, start, end, 0);
 
 	if (!client->in_svc_chngd) {
 		process_service_changed(client, start, end);
@@ -1668,6 +1637,15 @@ uint16_t bt_gatt_client_get_mtu(struct bt_gatt_client *client)
 	return bt_att_get_mtu(client->att);
 }
 
+bool bt_gatt_client_get_att_stats(struct bt_gatt_client *client,
+						struct bt_att_stats *stats)
+{
+	if (!client || !client->att)
+		return false;
+
+	return bt_att_get_stats(client->att, stats);
+}
+
 static bool match_req_id(const void *a, const void *b)
 {
 	const struct request *req = a;
@@ -1721,21 +1699,25 @@ bool bt_gatt_client_cancel(struct bt_gatt_client *client, unsigned int id)
 static void cancel_request(void *data)
 {
 	struct request *req = data;
+	struct bt_gatt_client *client = req->client;
+	unsigned int att_id = req->att_id;
+	bool long_write = req->long_write;
 	uint8_t pdu = 0x00;
 
+	/* Cancelling drops the reference held by the operation, req may go */
 	req->removed = true;
-	bt_att_cancel(req->client->att, req->att_id);
+	bt_att_cancel(client->att, att_id);
 
-	if (!req->long_write)
+	if (!long_write)
 		return;
 
-	if (!req->att_id)
-		queue_remove(req->client->long_write_queue, req);
+	if (!att_id)
+		queue_remove(client->long_write_queue, req);
 
-	if (queue_isempty(req->client->long_write_queue))
-		req->client->in_long_write = false;
+	if (queue_isempty(client->long_write_queue))
+		client->in_long_write = false;
 
-	bt_att_send(req->client->att, BT_ATT_OP_EXEC_WRITE_REQ,
+	bt_att_send(client->att, BT_ATT_OP_EXEC_WRITE_REQ,
 							&pdu, sizeof(pdu),
 							cancel_long_write_cb,
 							NULL, NULL);
@@ -1923,58 +1905,65 @@ unsigned int bt_gatt_client_read_multiple(struct bt_gatt_client *client,
 	return req->id;
 }
 
-struct read_long_op {
-	struct bt_gatt_client *client;
-	int ref_count;
-	uint16_t value_handle;
-	uint16_t orig_offset;
-	uint16_t offset;
-	struct queue *blobs;
-	bt_gatt_client_read_callback_t callback;
-	void *user_data;
-	bt_gatt_client_destroy_func_t destroy;
-};
+static uint64_t xfer_time_usec(void)
+{
+	struct timespec ts;
 
-struct blob {
-	uint8_t *data;
-	uint16_t offset;
-	uint16_t length;
-};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-static struct blob *create_blob(const uint8_t *data, uint16_t len,
-								uint16_t offset)
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void update_xfer_stats(struct bt_gatt_client *client,
+					struct xfer_stats *stats,
+					uint16_t length, uint64_t start)
 {
-	struct blob *blob;
+	uint64_t usec = xfer_time_usec() - start;
 
-	blob = new0(struct blob, 1);
-	if (!blob)
-		return NULL;
+	stats->bytes += length;
+	stats->usec += usec;
 
-	/* Truncate if the data would exceed maximum length */
-	if (offset + len > BT_ATT_MAX_VALUE_LEN)
-		len = BT_ATT_MAX_VALUE_LEN - offset;
+	TRACE(stats == &client->read_long_stats ? TRACE_GATT_READ_LONG :
+				TRACE_GATT_WRITE_LONG, length, usec, 0, 0);
+}
 
-	blob->data = malloc(len);
-	if (!blob->data) {
-		free(blob);
-		return NULL;
-	}
+static uint32_t xfer_rate(const struct xfer_stats *stats)
+{
+	if (!stats->usec)
+		return 0;
 
-	memcpy(blob->data, data, len);
-	blob->length = len;
-	blob->offset = offset;
+	return stats->bytes * 1000000 / stats->usec;
+}
+
+uint32_t bt_gatt_client_get_read_long_rate(struct bt_gatt_client *client)
+{
+	if (!client)
+		return 0;
 
-	return blob;
+	return xfer_rate(&client->read_long_stats);
 }
 
-static void destroy_blob(void *data)
+uint32_t bt_gatt_client_get_write_long_rate(struct bt_gatt_client *client)
 {
-	struct blob *blob = data;
+	if (!client)
+		return 0;
 
-	free(blob->data);
-	free(blob);
+	return xfer_rate(&client->write_long_stats);
 }
 
+struct read_long_op {
+	struct bt_gatt_client *client;
+	int ref_count;
+	uint16_t value_handle;
+	uint16_t orig_offset;
+	uint16_t offset;
+	uint8_t *value;
+	uint64_t start;
+	bt_gatt_client_read_callback_t callback;
+	void *user_data;
+	bt_gatt_client_destroy_func_t destroy;
+};
+
 static void destroy_read_long_op(void *data)
 {
 	struct read_long_op *op = data;
@@ -1982,46 +1971,24 @@ static void destroy_read_long_op(void *data)
 	if (op->destroy)
 		op->destroy(op->user_data);
 
-	queue_destroy(op->blobs, destroy_blob);
-
+	free(op->value);
 	free(op);
 }
 
-static void append_blob(void *data, void *user_data)
-{
-	struct blob *blob = data;
-	uint8_t *value = user_data;
-
-	memcpy(value + blob->offset, blob->data, blob->length);
-}
-
 static void complete_read_long_op(struct read_long_op *op, bool success,
 							uint8_t att_ecode)
 {
-	uint8_t *value = NULL;
 	uint16_t length = 0;
 
-	if (!success)
-		goto done;
-
-	length = op->offset - op->orig_offset;
-
-	if (!length)
-		goto done;
-
-	value = malloc(length);
-	if (!value) {
-		success = false;
-		goto done;
+	if (success) {
+		length = op->offset - op->orig_offset;
+		update_xfer_stats(op->client, &op->client->read_long_stats,
+							length, op->start);
 	}
 
-	queue_foreach(op->blobs, append_blob, value - op->orig_offset);
-
-done:
 	if (op->callback)
-		op->callback(success, att_ecode, value, length, op->user_data);
-
-	free(value);
+		op->callback(success, att_ecode, length ? op->value : NULL,
+						length, op->user_data);
 }
 
 static void read_long_cb(uint8_t opcode, const void *pdu,
@@ -2029,7 +1996,7 @@ static void read_long_cb(uint8_t opcode, const void *pdu,
 {
 	struct request *req = user_data;
 	struct read_long_op *op = req->data;
-	struct blob *blob;
+	uint16_t filled;
 	bool success;
 	uint8_t att_ecode = 0;
 
@@ -2047,14 +2014,11 @@ static void read_long_cb(uint8_t opcode, const void *pdu,
 	if (!length)
 		goto success;
 
-	blob = create_blob(pdu, length, op->offset);
-	if (!blob) {
-		success = false;
-		goto done;
-	}
-
-	queue_push_tail(op->blobs, blob);
-	op->offset += blob->length;
+	/* Fragments land directly in the preallocated value buffer */
+	filled = op->offset - op->orig_offset;
+	memcpy(op->value + filled, pdu,
+			MIN(length, BT_ATT_MAX_VALUE_LEN - filled));
+	op->offset += MIN(length, BT_ATT_MAX_VALUE_LEN - filled);
 	if (op->offset >= BT_ATT_MAX_VALUE_LEN)
 		goto success;
 
@@ -2102,15 +2066,16 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 	if (!op)
 		return 0;
 
-	op->blobs = queue_new();
-	if (!op->blobs) {
+	/* No attribute value can be longer, so a single buffer is enough */
+	op->value = malloc(BT_ATT_MAX_VALUE_LEN);
+	if (!op->value) {
 		free(op);
 		return 0;
 	}
 
 	req = request_create(client);
 	if (!req) {
-		queue_destroy(op->blobs, free);
+		free(op->value);
 		free(op);
 		return 0;
 	}
@@ -2119,6 +2084,7 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 	op->value_handle = value_handle;
 	op->orig_offset = offset;
 	op->offset = offset;
+	op->start = xfer_time_usec();
 	op->callback = callback;
 	op->user_data = user_data;
 	op->destroy = destroy;
@@ -2272,6 +2238,7 @@ struct long_write_op {
 	uint16_t offset;
 	uint16_t index;
 	uint16_t cur_length;
+	uint64_t start;
 	bt_gatt_client_write_long_callback_t callback;
 	void *user_data;
 	bt_gatt_client_destroy_func_t destroy;
@@ -2293,17 +2260,19 @@ static void prepare_write_cb(uint8_t opcode, const void *pdu, uint16_t length,
 static void complete_write_long_op(struct request *req, bool success,
 					uint8_t att_ecode, bool reliable_error);
 
+/*
+ * Fragments are built in a BT_ATT_MAX_LE_MTU buffer on the stack, so they
+ * stay within it even on a bearer that negotiated a larger MTU.
+ */
+static uint16_t prep_write_max_len(struct bt_att *att)
+{
+	return MIN(bt_att_get_mtu(att), BT_ATT_MAX_LE_MTU) - 5;
+}
+
 static void handle_next_prep_write(struct request *req)
 {
 	struct long_write_op *op = req->data;
-	bool success = true;
-	uint8_t *pdu;
-
-	pdu = malloc(op->cur_length + 4);
-	if (!pdu) {
-		success = false;
-		goto done;
-	}
+	uint8_t pdu[BT_ATT_MAX_LE_MTU];
 
 	put_le16(op->value_handle, pdu);
 	put_le16(op->offset + op->index, pdu + 2);
@@ -2314,27 +2283,17 @@ static void handle_next_prep_write(struct request *req)
 							prepare_write_cb,
 							request_ref(req),
 							request_unref);
-	if (!req->att_id) {
-		request_unref(req);
-		success = false;
-	}
-
-	free(pdu);
-
-	/* If so far successful, then the operation should continue.
-	 * Otherwise, there was an error and the procedure should be
-	 * completed.
-	 */
-	if (success)
+	if (req->att_id)
 		return;
 
-done:
-	complete_write_long_op(req, success, 0, false);
+	request_unref(req);
+	complete_write_long_op(req, false, 0, false);
 }
 
 static void start_next_long_write(struct bt_gatt_client *client)
 {
 	struct request *req;
+	struct long_write_op *op;
 
 	if (queue_isempty(client->long_write_queue)) {
 		client->in_long_write = false;
@@ -2345,6 +2304,10 @@ static void start_next_long_write(struct bt_gatt_client *client)
 	if (!req)
 		return;
 
+	/* Queued writes are timed from when they reach the bearer */
+	op = req->data;
+	op->start = xfer_time_usec();
+
 	handle_next_prep_write(req);
 
 	/*
@@ -2368,6 +2331,10 @@ static void execute_write_cb(uint8_t opcode, const void *pdu, uint16_t length,
 	} else if (opcode != BT_ATT_OP_EXEC_WRITE_RSP || pdu || length)
 		success = false;
 
+	if (success)
+		update_xfer_stats(op->client, &op->client->write_long_stats,
+							op->length, op->start);
+
 	if (op->callback)
 		op->callback(success, op->reliable_error, att_ecode,
 								op->user_data);
@@ -2459,10 +2426,10 @@ static void prepare_write_cb(uint8_t opcode, const void *pdu, uint16_t length,
 	/* If the last written length was greater than or equal to what can fit
 	 * inside a PDU, then there is more data to send.
 	 */
-	if (op->cur_length >= bt_att_get_mtu(op->client->att) - 5) {
+	if (op->cur_length >= prep_write_max_len(op->client->att)) {
 		op->index = next_index;
 		op->cur_length = MIN(op->length - op->index,
-					bt_att_get_mtu(op->client->att) - 5);
+					prep_write_max_len(op->client->att));
 		handle_next_prep_write(req);
 		return;
 	}
@@ -2481,7 +2448,7 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 {
 	struct request *req;
 	struct long_write_op *op;
-	uint8_t *pdu;
+	uint8_t pdu[BT_ATT_MAX_LE_MTU];
 
 	if (!client)
 		return 0;
@@ -2519,7 +2486,7 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 	op->value_handle = value_handle;
 	op->length = length;
 	op->offset = offset;
-	op->cur_length = MIN(length, bt_att_get_mtu(client->att) - 5);
+	op->cur_length = MIN(length, prep_write_max_len(client->att));
 	op->callback = callback;
 	op->user_data = user_data;
 	op->destroy = destroy;
@@ -2533,12 +2500,7 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 		return req->id;
 	}
 
-	pdu = malloc(op->cur_length + 4);
-	if (!pdu) {
-		free(op->value);
-		free(op);
-		return 0;
-	}
+	op->start = xfer_time_usec();
 
 	put_le16(value_handle, pdu);
 	put_le16(offset, pdu + 2);
@@ -2548,8 +2510,6 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 							pdu, op->cur_length + 4,
 							prepare_write_cb, req,
 							request_unref);
-	free(pdu);
-
 	if (!req->att_id) {
 		op->destroy = NULL;
 		request_unref(req);
@@ -72,6 +72,11 @@ bool bt_gatt_client_set_debug(struct bt_gatt_client *client,
 
 uint16_t bt_gatt_client_get_mtu(struct bt_gatt_client *client);
 
+struct bt_att_stats;
+
+bool bt_gatt_client_get_att_stats(struct bt_gatt_client *client,
+						struct bt_att_stats *stats);
+
 bool bt_gatt_client_cancel(struct bt_gatt_client *client, unsigned int id);
 bool bt_gatt_client_cancel_all(struct bt_gatt_client *client);
 
@@ -110,6 +115,10 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 				void *user_data,
 				bt_gatt_client_destroy_func_t destroy);
 
+/* Effective long read/write throughput of this link in bytes per second */
+uint32_t bt_gatt_client_get_read_long_rate(struct bt_gatt_client *client);
+uint32_t bt_gatt_client_get_write_long_rate(struct bt_gatt_client *client);
+
 bool bt_gatt_client_register_notify(struct bt_gatt_client *client,
 				uint16_t chrc_value_handle,
 				bt_gatt_client_notify_id_callback_t callback,
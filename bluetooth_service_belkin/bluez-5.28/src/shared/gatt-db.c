@@ -98,6 +98,9 @@ struct gatt_db_attribute {
 
 	unsigned int write_id;
 	struct queue *pending_writes;
+
+	bool cached;
+	unsigned int cache_version;
 };
 
 struct gatt_db_service {
@@ -1436,7 +1439,7 @@ bool gatt_db_attribute_read(struct gatt_db_attribute *attrib, uint16_t offset,
 	if (!attrib || !func)
 		return false;
 
-	if (attrib->read_func) {
+	if (attrib->read_func && !attrib->cached) {
 		struct pending_read *p;
 
 		p = new0(struct pending_read, 1);
@@ -1533,6 +1536,12 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 	if (attrib->write_func) {
 		struct pending_write *p;
 
+		/*
+		 * The owner is expected to republish the value once the
+		 * write has been applied, until then reads go to read_func.
+		 */
+		gatt_db_attribute_invalidate_cache(attrib);
+
 		p = new0(struct pending_write, 1);
 		if (!p)
 			return false;
@@ -1570,6 +1579,7 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 	}
 
 	memcpy(&attrib->value[offset], value, len);
+	attrib->cache_version++;
 
 	func(attrib, 0, user_data);
 
@@ -1605,6 +1615,83 @@ bool gatt_db_attribute_reset(struct gatt_db_attribute *attrib)
 	free(attrib->value);
 	attrib->value = NULL;
 	attrib->value_len = 0;
+	attrib->cached = false;
+	attrib->cache_version++;
+
+	return true;
+}
+
+bool gatt_db_attribute_set_cache(struct gatt_db_attribute *attrib,
+					const uint8_t *value, size_t len)
+{
+	uint8_t *buf = NULL;
+
+	if (!attrib || len > UINT16_MAX || (len && !value))
+		return false;
+
+	if (len) {
+		buf = malloc(len);
+		if (!buf)
+			return false;
+
+		memcpy(buf, value, len);
+	}
+
+	free(attrib->value);
+	attrib->value = buf;
+	attrib->value_len = len;
+	attrib->cached = true;
+	attrib->cache_version++;
+
+	return true;
+}
+
+bool gatt_db_attribute_invalidate_cache(struct gatt_db_attribute *attrib)
+{
+	if (!attrib)
+		return false;
+
+	if (!attrib->cached)
+		return true;
+
+	attrib->cached = false;
+	attrib->cache_version++;
+
+	/* Values of read_func attributes only live here while cached */
+	if (attrib->read_func) {
+		free(attrib->value);
+		attrib->value = NULL;
+		attrib->value_len = 0;
+	}
+
+	return true;
+}
+
+unsigned int
+gatt_db_attribute_get_cache_version(const struct gatt_db_attribute *attrib)
+{
+	if (!attrib)
+		return 0;
+
+	return attrib->cache_version;
+}
+
+bool gatt_db_attribute_read_cached(const struct gatt_db_attribute *attrib,
+					uint16_t offset, const uint8_t **value,
+					size_t *len)
+{
+	if (!attrib || !value || !len)
+		return false;
+
+	if (attrib->read_func && !attrib->cached)
+		return false;
+
+	/* Let the regular read path report invalid offsets */
+	if (offset > attrib->value_len)
+		return false;
+
+	*value = offset == attrib->value_len ? NULL : &attrib->value[offset];
+	*len = attrib->value_len - offset;
 
 	return true;
 }
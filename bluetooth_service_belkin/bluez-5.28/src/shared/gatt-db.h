@@ -216,3 +216,17 @@ bool gatt_db_attribute_write_result(struct gatt_db_attribute *attrib,
 						unsigned int id, int err);
 
 bool gatt_db_attribute_reset(struct gatt_db_attribute *attrib);
+
+/*
+ * Cached values let an attribute with a read_func publish its current value
+ * so reads are served synchronously without calling read_func. The version is
+ * bumped on every change so callers can detect stale copies.
+ */
+bool gatt_db_attribute_set_cache(struct gatt_db_attribute *attrib,
+					const uint8_t *value, size_t len);
+bool gatt_db_attribute_invalidate_cache(struct gatt_db_attribute *attrib);
+unsigned int
+gatt_db_attribute_get_cache_version(const struct gatt_db_attribute *attrib);
+bool gatt_db_attribute_read_cached(const struct gatt_db_attribute *attrib,
+					uint16_t offset, const uint8_t **value,
+					size_t *len);
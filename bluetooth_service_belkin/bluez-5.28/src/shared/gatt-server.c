@@ -31,6 +31,7 @@
 #include "src/shared/gatt-server.h"
 #include "src/shared/gatt-helpers.h"
 #include "src/shared/util.h"
+#include "src/shared/trace.h"
 
 #ifndef MAX
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -46,6 +47,13 @@
  */
 #define DEFAULT_MAX_PREP_QUEUE_LEN 30
 
+/*
+ * Prepared values are appended to a per-server arena which is kept between
+ * transactions, so only the first long write (or a larger one) allocates.
+ */
+#define PREP_ARENA_MIN_SIZE 256
+#define PREP_ARENA_MAX_SIZE (DEFAULT_MAX_PREP_QUEUE_LEN * BT_ATT_MAX_VALUE_LEN)
+
 struct async_read_op {
 	struct bt_gatt_server *server;
 	uint8_t opcode;
@@ -61,22 +69,17 @@ struct async_write_op {
 	uint8_t opcode;
 };
 
+/*
+ * A run of contiguous prepared fragments for the same handle, the value lives
+ * in the server arena at arena_off.
+ */
 struct prep_write_data {
-	struct bt_gatt_server *server;
-	uint8_t *value;
 	uint16_t handle;
 	uint16_t offset;
-	uint16_t length;
+	size_t length;
+	size_t arena_off;
 };
 
-static void prep_write_data_destroy(void *user_data)
-{
-	struct prep_write_data *data = user_data;
-
-	free(data->value);
-	free(data);
-}
-
 struct bt_gatt_server {
 	struct gatt_db *db;
 	struct bt_att *att;
@@ -96,8 +99,13 @@ struct bt_gatt_server {
 	unsigned int prep_write_id;
 	unsigned int exec_write_id;
 
-	struct queue *prep_queue;
+	struct prep_write_data *prep_runs;
+	unsigned int prep_run_count;
+	unsigned int prep_exec_idx;
 	unsigned int max_prep_queue_len;
+	uint8_t *prep_arena;
+	size_t prep_arena_len;
+	size_t prep_arena_size;
 
 	struct async_read_op *pending_read_op;
 	struct async_write_op *pending_write_op;
@@ -131,7 +139,8 @@ static void bt_gatt_server_free(struct bt_gatt_server *server)
 	if (server->pending_write_op)
 		server->pending_write_op->server = NULL;
 
-	queue_destroy(server->prep_queue, prep_write_data_destroy);
+	free(server->prep_runs);
+	free(server->prep_arena);
 
 	gatt_db_unref(server->db);
 	bt_att_unref(server->att);
@@ -255,9 +264,7 @@ static void read_by_grp_type_cb(uint8_t opcode, const void *pdu,
 	end = get_le16(pdu + 2);
 	get_uuid_le(pdu + 4, length - 4, &type);
 
-	util_debug(server->debug_callback, server->debug_data,
-				"Read By Grp Type - start: 0x%04x end: 0x%04x",
-				start, end);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, start, end);
 
 	if (!start || !end) {
 		ecode = BT_ATT_ERROR_INVALID_HANDLE;
@@ -322,6 +329,32 @@ static void async_read_op_destroy(struct async_read_op *op)
 
 static void process_read_by_type(struct async_read_op *op);
 
+/* Returns false once the response PDU can't take any more attributes */
+static bool read_by_type_encode(struct async_read_op *op, uint16_t mtu,
+					uint16_t handle, const uint8_t *value,
+					size_t len)
+{
+	if (op->pdu_len == 0) {
+		op->value_len = MIN(MIN((unsigned) mtu - 4, 253), len);
+		op->pdu[0] = op->value_len + 2;
+		op->pdu_len++;
+	} else if (len != op->value_len) {
+		return false;
+	}
+
+	/* Stop if this would surpass the MTU */
+	if (op->pdu_len + op->value_len + 2 > (unsigned) mtu - 1)
+		return false;
+
+	/* Encode the current value */
+	put_le16(handle, op->pdu + op->pdu_len);
+	memcpy(op->pdu + op->pdu_len + 2, value, op->value_len);
+
+	op->pdu_len += op->value_len + 2;
+
+	return op->pdu_len != (unsigned) mtu - 1;
+}
+
 static void read_by_type_read_complete_cb(struct gatt_db_attribute *attr,
 						int err, const uint8_t *value,
 						size_t len, void *user_data)
@@ -347,70 +380,61 @@ static void read_by_type_read_complete_cb(struct gatt_db_attribute *attr,
 		return;
 	}
 
-	if (op->pdu_len == 0) {
-		op->value_len = MIN(MIN((unsigned) mtu - 4, 253), len);
-		op->pdu[0] = op->value_len + 2;
-		op->pdu_len++;
-	} else if (len != op->value_len) {
-		op->done = true;
-		goto done;
-	}
-
-	/* Stop if this would surpass the MTU */
-	if (op->pdu_len + op->value_len + 2 > (unsigned) mtu - 1) {
-		op->done = true;
-		goto done;
-	}
-
-	/* Encode the current value */
-	put_le16(handle, op->pdu + op->pdu_len);
-	memcpy(op->pdu + op->pdu_len + 2, value, op->value_len);
-
-	op->pdu_len += op->value_len + 2;
-
-	if (op->pdu_len == (unsigned) mtu - 1)
+	if (!read_by_type_encode(op, mtu, handle, value, len))
 		op->done = true;
 
-done:
 	process_read_by_type(op);
 }
 
 static void process_read_by_type(struct async_read_op *op)
 {
 	struct bt_gatt_server *server = op->server;
+	uint16_t mtu = bt_att_get_mtu(server->att);
 	uint8_t ecode;
 	struct gatt_db_attribute *attr;
+	const uint8_t *value;
+	size_t len;
 	uint32_t perm;
 
-	attr = queue_pop_head(op->db_data);
+	/*
+	 * Attributes with a cached value are encoded in place, only the
+	 * first one that needs its read_func breaks out to the async path.
+	 */
+	while (!op->done && (attr = queue_pop_head(op->db_data))) {
+		perm = gatt_db_attribute_get_permissions(attr);
 
-	if (op->done || !attr) {
-		bt_att_send(server->att, BT_ATT_OP_READ_BY_TYPE_RSP, op->pdu,
-								op->pdu_len,
-								NULL, NULL,
-								NULL);
-		async_read_op_destroy(op);
-		return;
-	}
+		/*
+		 * Check for the READ access permission. Encryption,
+		 * authentication, and authorization permissions need to be
+		 * checked by the read handler, since bt_att is agnostic to
+		 * connection type and doesn't have security information on it.
+		 */
+		if (perm && !(perm & BT_ATT_PERM_READ)) {
+			ecode = BT_ATT_ERROR_READ_NOT_PERMITTED;
+			goto error;
+		}
 
-	perm = gatt_db_attribute_get_permissions(attr);
+		if (gatt_db_attribute_read_cached(attr, 0, &value, &len)) {
+			if (!read_by_type_encode(op, mtu,
+					gatt_db_attribute_get_handle(attr),
+					value, len))
+				op->done = true;
+			continue;
+		}
 
-	/*
-	 * Check for the READ access permission. Encryption,
-	 * authentication, and authorization permissions need to be
-	 * checked by the read handler, since bt_att is agnostic to
-	 * connection type and doesn't have security information on it.
-	 */
-	if (perm && !(perm & BT_ATT_PERM_READ)) {
-		ecode = BT_ATT_ERROR_READ_NOT_PERMITTED;
+		if (gatt_db_attribute_read(attr, 0, op->opcode, NULL,
+					read_by_type_read_complete_cb, op))
+			return;
+
+		ecode = BT_ATT_ERROR_UNLIKELY;
 		goto error;
 	}
 
-	if (gatt_db_attribute_read(attr, 0, op->opcode, NULL,
-				read_by_type_read_complete_cb, op))
-		return;
-
-	ecode = BT_ATT_ERROR_UNLIKELY;
+	bt_att_send(server->att, BT_ATT_OP_READ_BY_TYPE_RSP, op->pdu,
+							op->pdu_len,
+							NULL, NULL, NULL);
+	async_read_op_destroy(op);
+	return;
 
 error:
 	bt_att_send_error_rsp(server->att, BT_ATT_OP_READ_BY_TYPE_REQ,
@@ -444,9 +468,7 @@ static void read_by_type_cb(uint8_t opcode, const void *pdu,
 	end = get_le16(pdu + 2);
 	get_uuid_le(pdu + 4, length - 4, &type);
 
-	util_debug(server->debug_callback, server->debug_data,
-				"Read By Type - start: 0x%04x end: 0x%04x",
-				start, end);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, start, end);
 
 	if (!start || !end) {
 		ecode = BT_ATT_ERROR_INVALID_HANDLE;
@@ -600,9 +622,7 @@ static void find_info_cb(uint8_t opcode, const void *pdu,
 	start = get_le16(pdu);
 	end = get_le16(pdu + 2);
 
-	util_debug(server->debug_callback, server->debug_data,
-					"Find Info - start: 0x%04x end: 0x%04x",
-					start, end);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, start, end);
 
 	if (!start || !end) {
 		ecode = BT_ATT_ERROR_INVALID_HANDLE;
@@ -702,9 +722,8 @@ static void find_by_type_val_cb(uint8_t opcode, const void *pdu,
 	end = get_le16(pdu + 2);
 	uuid16 = get_le16(pdu + 4);
 
-	util_debug(server->debug_callback, server->debug_data,
-			"Find By Type Value - start: 0x%04x end: 0x%04x uuid: 0x%04x",
-			start, end, uuid16);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, start, end);
+
 	ehandle = start;
 	if (start > end) {
 		data.ecode = BT_ATT_ERROR_INVALID_HANDLE;
@@ -785,10 +804,7 @@ static void write_cb(uint8_t opcode, const void *pdu,
 		goto error;
 	}
 
-	util_debug(server->debug_callback, server->debug_data,
-				"Write %s - handle: 0x%04x",
-				(opcode == BT_ATT_OP_WRITE_REQ) ? "Req" : "Cmd",
-				handle);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, handle, 0);
 
 	perm = gatt_db_attribute_get_permissions(attr);
 
@@ -891,6 +907,8 @@ static void handle_read_req(struct bt_gatt_server *server, uint8_t opcode,
 	uint8_t ecode;
 	uint32_t perm;
 	struct async_read_op *op = NULL;
+	const uint8_t *value;
+	size_t len;
 
 	attr = gatt_db_get_attribute(server->db, handle);
 	if (!attr) {
@@ -898,10 +916,7 @@ static void handle_read_req(struct bt_gatt_server *server, uint8_t opcode,
 		goto error;
 	}
 
-	util_debug(server->debug_callback, server->debug_data,
-			"Read %sReq - handle: 0x%04x",
-			opcode == BT_ATT_OP_READ_BLOB_REQ ? "Blob " : "",
-			handle);
+	TRACE(TRACE_GATT_SERVER_REQ, 0, opcode, handle, offset);
 
 	perm = gatt_db_attribute_get_permissions(attr);
 
@@ -910,6 +925,14 @@ static void handle_read_req(struct bt_gatt_server *server, uint8_t opcode,
 		goto error;
 	}
 
+	if (gatt_db_attribute_read_cached(attr, offset, &value, &len)) {
+		len = MIN((unsigned) bt_att_get_mtu(server->att) - 1, len);
+		bt_att_send(server->att, get_read_rsp_opcode(opcode),
+						len ? value : NULL, len,
+						NULL, NULL, NULL);
+		return;
+	}
+
 	if (server->pending_read_op) {
 		ecode = BT_ATT_ERROR_UNLIKELY;
 		goto error;
@@ -1034,10 +1057,9 @@ static void read_multiple_complete_cb(struct gatt_db_attribute *attr, int err,
 		return;
 	}
 
-	util_debug(data->server->debug_callback, data->server->debug_data,
-				"Read Multiple Req - #%zu of %zu: 0x%04x",
-				data->cur_handle + 1, data->num_handles,
-				data->handles[data->cur_handle]);
+	TRACE(TRACE_GATT_SERVER_READ_MULT, 0,
+				data->handles[data->cur_handle],
+				data->cur_handle + 1, data->num_handles);
 
 	next_attr = gatt_db_get_attribute(data->server->db,
 					data->handles[data->cur_handle]);
@@ -1065,9 +1087,13 @@ static void read_multiple_cb(uint8_t opcode, const void *pdu,
 					uint16_t length, void *user_data)
 {
 	struct bt_gatt_server *server = user_data;
-	struct gatt_db_attribute *attr;
+	struct gatt_db_attribute *attr = NULL;
 	struct read_multiple_resp_data data;
 	uint8_t ecode = BT_ATT_ERROR_UNLIKELY;
+	uint16_t handle = 0;
+	const uint8_t *value;
+	size_t len;
+	uint32_t perm;
 	size_t i = 0;
 
 	data.handles = NULL;
@@ -1096,15 +1122,42 @@ static void read_multiple_cb(uint8_t opcode, const void *pdu,
 	for (i = 0; i < data.num_handles; i++)
 		data.handles[i] = get_le16(pdu + i * 2);
 
-	util_debug(server->debug_callback, server->debug_data,
-			"Read Multiple Req - %zu handles, 1st: 0x%04x",
-			data.num_handles, data.handles[0]);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, data.handles[0],
+							data.num_handles);
 
-	attr = gatt_db_get_attribute(server->db, data.handles[0]);
+	/* Serve the leading run of cached values without going async */
+	for (; data.cur_handle < data.num_handles; data.cur_handle++) {
+		handle = data.handles[data.cur_handle];
 
-	if (!attr) {
-		ecode = BT_ATT_ERROR_INVALID_HANDLE;
-		goto error;
+		attr = gatt_db_get_attribute(server->db, handle);
+		if (!attr) {
+			ecode = BT_ATT_ERROR_INVALID_HANDLE;
+			goto error;
+		}
+
+		if (!gatt_db_attribute_read_cached(attr, 0, &value, &len))
+			break;
+
+		perm = gatt_db_attribute_get_permissions(attr);
+		if (perm && !(perm & BT_ATT_PERM_READ)) {
+			ecode = BT_ATT_ERROR_READ_NOT_PERMITTED;
+			goto error;
+		}
+
+		len = MIN(len, data.mtu - data.length - 1);
+		memcpy(data.rsp_data + data.length, value, len);
+		data.length += len;
+
+		if (data.length >= data.mtu - 1)
+			break;
+	}
+
+	if (data.cur_handle == data.num_handles ||
+					data.length >= data.mtu - 1) {
+		bt_att_send(server->att, BT_ATT_OP_READ_MULT_RSP,
+				data.rsp_data, data.length, NULL, NULL, NULL);
+		read_multiple_resp_data_free(&data);
+		return;
 	}
 
 	if (gatt_db_attribute_read(attr, 0, opcode, NULL,
@@ -1113,16 +1166,49 @@ static void read_multiple_cb(uint8_t opcode, const void *pdu,
 
 error:
 	read_multiple_resp_data_free(&data);
-	bt_att_send_error_rsp(server->att, opcode, 0, ecode);
+	bt_att_send_error_rsp(server->att, opcode, handle, ecode);
+}
+
+static void prep_write_reset(struct bt_gatt_server *server)
+{
+	server->prep_run_count = 0;
+	server->prep_exec_idx = 0;
+	server->prep_arena_len = 0;
+}
+
+static bool prep_arena_reserve(struct bt_gatt_server *server, size_t len)
+{
+	size_t needed = server->prep_arena_len + len;
+	size_t size;
+	uint8_t *buf;
+
+	if (needed <= server->prep_arena_size)
+		return true;
+
+	size = MAX(server->prep_arena_size, PREP_ARENA_MIN_SIZE);
+	while (size < needed)
+		size *= 2;
+
+	size = MIN(size, PREP_ARENA_MAX_SIZE);
+
+	buf = realloc(server->prep_arena, size);
+	if (!buf)
+		return false;
+
+	server->prep_arena = buf;
+	server->prep_arena_size = size;
+
+	return true;
 }
 
 static void prep_write_cb(uint8_t opcode, const void *pdu,
 					uint16_t length, void *user_data)
 {
 	struct bt_gatt_server *server = user_data;
-	struct prep_write_data *prep_data = NULL;
+	struct prep_write_data *run;
 	uint16_t handle = 0;
 	uint16_t offset;
+	uint16_t len;
 	struct gatt_db_attribute *attr;
 	uint8_t ecode;
 	uint32_t perm;
@@ -1132,13 +1218,9 @@ static void prep_write_cb(uint8_t opcode, const void *pdu,
 		goto error;
 	}
 
-	if (queue_length(server->prep_queue) >= server->max_prep_queue_len) {
-		ecode = BT_ATT_ERROR_PREPARE_QUEUE_FULL;
-		goto error;
-	}
-
 	handle = get_le16(pdu);
 	offset = get_le16(pdu + 2);
+	len = length - 4;
 
 	attr = gatt_db_get_attribute(server->db, handle);
 	if (!attr) {
@@ -1146,8 +1228,7 @@ static void prep_write_cb(uint8_t opcode, const void *pdu,
 		goto error;
 	}
 
-	util_debug(server->debug_callback, server->debug_data,
-				"Prep Write Req - handle: 0x%04x", handle);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, handle, offset);
 
 	perm = gatt_db_attribute_get_permissions(attr);
 
@@ -1163,36 +1244,49 @@ static void prep_write_cb(uint8_t opcode, const void *pdu,
 		goto error;
 	}
 
-	prep_data = new0(struct prep_write_data, 1);
-	if (!prep_data) {
+	/*
+	 * A fragment continuing the last run is appended to it in place since
+	 * that run always ends at the tail of the arena.
+	 */
+	run = NULL;
+	if (server->prep_run_count) {
+		run = &server->prep_runs[server->prep_run_count - 1];
+		if (run->handle != handle ||
+				run->offset + run->length != offset)
+			run = NULL;
+	}
+
+	if ((!run && server->prep_run_count >= server->max_prep_queue_len) ||
+			server->prep_arena_len + len > PREP_ARENA_MAX_SIZE) {
+		ecode = BT_ATT_ERROR_PREPARE_QUEUE_FULL;
+		goto error;
+	}
+
+	if (!prep_arena_reserve(server, len)) {
 		ecode = BT_ATT_ERROR_INSUFFICIENT_RESOURCES;
 		goto error;
 	}
 
-	prep_data->length = length - 4;
-	if (prep_data->length) {
-		prep_data->value = malloc(prep_data->length);
-		if (!prep_data->value) {
-			ecode = BT_ATT_ERROR_INSUFFICIENT_RESOURCES;
-			goto error;
-		}
+	if (!run) {
+		run = &server->prep_runs[server->prep_run_count++];
+		run->handle = handle;
+		run->offset = offset;
+		run->length = 0;
+		run->arena_off = server->prep_arena_len;
 	}
 
-	prep_data->server = server;
-	prep_data->handle = handle;
-	prep_data->offset = offset;
-	memcpy(prep_data->value, pdu + 4, prep_data->length);
+	if (len)
+		memcpy(server->prep_arena + server->prep_arena_len, pdu + 4,
+									len);
 
-	queue_push_tail(server->prep_queue, prep_data);
+	server->prep_arena_len += len;
+	run->length += len;
 
 	bt_att_send(server->att, BT_ATT_OP_PREP_WRITE_RSP, pdu, length, NULL,
 								NULL, NULL);
 	return;
 
 error:
-	if (prep_data)
-		prep_write_data_destroy(prep_data);
-
 	bt_att_send_error_rsp(server->att, opcode, handle, ecode);
 
 }
@@ -1212,39 +1306,39 @@ static void exec_write_complete_cb(struct gatt_db_attribute *attr, int err,
 static void exec_next_prep_write(struct bt_gatt_server *server,
 						uint16_t ehandle, int err)
 {
-	struct prep_write_data *next = NULL;
+	struct prep_write_data *next;
 	struct gatt_db_attribute *attr;
-	bool status;
 
 	if (err)
 		goto error;
 
-	next = queue_pop_head(server->prep_queue);
-	if (!next) {
+	if (server->prep_exec_idx == server->prep_run_count) {
+		prep_write_reset(server);
 		bt_att_send(server->att, BT_ATT_OP_EXEC_WRITE_RSP, NULL, 0,
 							NULL, NULL, NULL);
 		return;
 	}
 
+	next = &server->prep_runs[server->prep_exec_idx++];
+	ehandle = next->handle;
+
 	attr = gatt_db_get_attribute(server->db, next->handle);
 	if (!attr) {
 		err = BT_ATT_ERROR_UNLIKELY;
 		goto error;
 	}
 
-	status = gatt_db_attribute_write(attr, next->offset,
-						next->value, next->length,
-						BT_ATT_OP_EXEC_WRITE_REQ, NULL,
-						exec_write_complete_cb, server);
-
-	prep_write_data_destroy(next);
-
-	if (status)
+	if (gatt_db_attribute_write(attr, next->offset,
+					server->prep_arena + next->arena_off,
+					next->length,
+					BT_ATT_OP_EXEC_WRITE_REQ, NULL,
+					exec_write_complete_cb, server))
 		return;
 
 	err = BT_ATT_ERROR_UNLIKELY;
 
 error:
+	prep_write_reset(server);
 	bt_att_send_error_rsp(server->att, BT_ATT_OP_EXEC_WRITE_REQ,
 								ehandle, err);
 }
@@ -1264,8 +1358,7 @@ static void exec_write_cb(uint8_t opcode, const void *pdu,
 
 	flags = ((uint8_t *) pdu)[0];
 
-	util_debug(server->debug_callback, server->debug_data,
-				"Exec Write Req - flags: 0x%02x", flags);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, flags, 0);
 
 	if (flags == 0x00)
 		write = false;
@@ -1277,13 +1370,15 @@ static void exec_write_cb(uint8_t opcode, const void *pdu,
 	}
 
 	if (!write) {
-		queue_remove_all(server->prep_queue, NULL, NULL,
-						prep_write_data_destroy);
+		prep_write_reset(server);
 		bt_att_send(server->att, BT_ATT_OP_EXEC_WRITE_RSP, NULL, 0,
 							NULL, NULL, NULL);
 		return;
 	}
 
+	TRACE(TRACE_GATT_SERVER_EXEC, 0, server->prep_run_count,
+						server->prep_arena_len, 0);
+
 	exec_next_prep_write(server, 0, 0);
 
 	return;
@@ -1318,8 +1413,8 @@ static void exchange_mtu_cb(uint8_t opcode, const void *pdu,
 	server->mtu = final_mtu;
 	bt_att_set_mtu(server->att, final_mtu);
 
-	util_debug(server->debug_callback, server->debug_data,
-			"MTU exchange complete, with MTU: %u", final_mtu);
+	TRACE(TRACE_GATT_SERVER_REQ, length, opcode, client_rx_mtu,
+								final_mtu);
 }
 
 static bool gatt_server_register_att_handlers(struct bt_gatt_server *server)
@@ -1436,8 +1531,9 @@ struct bt_gatt_server *bt_gatt_server_new(struct gatt_db *db,
 	server->mtu = MAX(mtu, BT_ATT_DEFAULT_LE_MTU);
 	server->max_prep_queue_len = DEFAULT_MAX_PREP_QUEUE_LEN;
 
-	server->prep_queue = queue_new();
-	if (!server->prep_queue) {
+	server->prep_runs = new0(struct prep_write_data,
+						server->max_prep_queue_len);
+	if (!server->prep_runs) {
 		bt_gatt_server_free(server);
 		return NULL;
 	}
@@ -1489,6 +1585,15 @@ bool bt_gatt_server_set_debug(struct bt_gatt_server *server,
 	return true;
 }
 
+bool bt_gatt_server_get_att_stats(struct bt_gatt_server *server,
+						struct bt_att_stats *stats)
+{
+	if (!server || !server->att)
+		return false;
+
+	return bt_att_get_stats(server->att, stats);
+}
+
 bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length)
@@ -1515,6 +1620,40 @@ bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 	return result;
 }
 
+unsigned int bt_gatt_server_send_notification_multi(
+					struct bt_gatt_server **servers,
+					unsigned int count, uint16_t handle,
+					const uint8_t *value, uint16_t length)
+{
+	struct bt_att_pdu *pdu;
+	uint8_t *buf;
+	unsigned int i, sent = 0;
+
+	if (!servers || (length && !value) || length > UINT16_MAX - 3)
+		return 0;
+
+	/* Encode once, every link gets a reference to the same buffer */
+	pdu = bt_att_pdu_alloc(BT_ATT_OP_HANDLE_VAL_NOT, length + 2, &buf);
+	if (!pdu)
+		return 0;
+
+	put_le16(handle, buf);
+	if (length)
+		memcpy(buf + 2, value, length);
+
+	for (i = 0; i < count; i++) {
+		if (!servers[i])
+			continue;
+
+		if (bt_att_send_pdu(servers[i]->att, pdu))
+			sent++;
+	}
+
+	bt_att_pdu_unref(pdu);
+
+	return sent;
+}
+
 struct ind_data {
 	bt_gatt_server_conf_func_t callback;
 	bt_gatt_server_destroy_func_t destroy;
@@ -40,10 +40,20 @@ bool bt_gatt_server_set_debug(struct bt_gatt_server *server,
 					void *user_data,
 					bt_gatt_server_destroy_func_t destroy);
 
+struct bt_att_stats;
+
+bool bt_gatt_server_get_att_stats(struct bt_gatt_server *server,
+						struct bt_att_stats *stats);
+
 bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length);
 
+unsigned int bt_gatt_server_send_notification_multi(
+					struct bt_gatt_server **servers,
+					unsigned int count, uint16_t handle,
+					const uint8_t *value, uint16_t length);
+
 bool bt_gatt_server_send_indication(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length,
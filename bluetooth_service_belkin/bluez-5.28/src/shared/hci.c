@@ -37,6 +37,7 @@
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
 #include "src/shared/hci.h"
+#include "src/shared/trace.h"
 
 #define BTPROTO_HCI	1
 struct sockaddr_hci {
@@ -136,6 +137,9 @@ static void send_command(struct bt_hci *hci, uint16_t opcode,
 	if (io_send(hci->io, iov, iovcnt) < 0)
 		return;
 
+	TRACE(TRACE_HCI_CMD, size, opcode, hci->num_cmds,
+						io_get_fd(hci->io));
+
 	hci->num_cmds--;
 }
 
@@ -232,6 +236,8 @@ static void process_event(struct bt_hci *hci, const void *data, size_t size)
 		if (size < sizeof(*cc))
 			return;
 		cc = data;
+		TRACE(TRACE_HCI_COMPLETE, size, le16_to_cpu(cc->opcode),
+						cc->ncmd, io_get_fd(hci->io));
 		hci->num_cmds = cc->ncmd;
 		process_response(hci, le16_to_cpu(cc->opcode),
 						data + sizeof(*cc),
@@ -242,11 +248,14 @@ static void process_event(struct bt_hci *hci, const void *data, size_t size)
 		if (size < sizeof(*cs))
 			return;
 		cs = data;
+		TRACE(TRACE_HCI_STATUS, size, le16_to_cpu(cs->opcode),
+						cs->status, io_get_fd(hci->io));
 		hci->num_cmds = cs->ncmd;
 		process_response(hci, le16_to_cpu(cs->opcode), &cs->status, 1);
 		break;
 
 	default:
+		TRACE(TRACE_HCI_EVENT, size, hdr->evt, 0, io_get_fd(hci->io));
 		queue_foreach(hci->evt_list, process_notify, (void *) hdr);
 		break;
 	}
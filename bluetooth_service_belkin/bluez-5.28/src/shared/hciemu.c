@@ -0,0 +1,1433 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/socket.h>
+
+#include "lib/bluetooth.h"
+#include "lib/hci.h"
+#include "lib/uuid.h"
+
+#include "src/shared/io.h"
+#include "src/shared/queue.h"
+#include "src/shared/util.h"
+#include "src/shared/timeout.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-server.h"
+#include "src/shared/hciemu.h"
+
+#define EMU_ACL_MTU		251	/* Reported as LE buffer size */
+#define EMU_ACL_PKTS		8
+#define EMU_ATT_MTU		247	/* One ATT PDU per ACL packet */
+#define EMU_MAX_PKT		(HCI_TYPE_LEN + HCI_ACL_HDR_SIZE + 1024)
+#define EMU_ADV_INTERVAL	10	/* msec between advertising bursts */
+#define EMU_MAX_BACKLOG		256	/* Queued packets before reports drop */
+#define EMU_CONN_DELAY		10
+
+#define L2CAP_CID_ATT		0x0004
+#define L2CAP_CID_SMP		0x0006
+
+#define BELKIN_COMPANY_ID	0x005c
+
+struct emu_pkt {
+	size_t len;
+	size_t offset;
+	uint8_t data[0];
+};
+
+struct emu_conn {
+	struct hciemu *emu;
+	uint16_t handle;
+	uint8_t peer_type;
+	bdaddr_t peer;
+	struct io *io;			/* Emulator end of the ATT socket */
+	struct bt_att *att;
+	struct bt_gatt_server *server;
+	uint8_t *rx_buf;		/* L2CAP reassembly */
+	uint16_t rx_len;
+	uint16_t rx_expect;
+};
+
+struct hciemu {
+	int ref_count;
+	int fd;
+	int host_fd;
+	char *pty_path;
+	struct io *io;
+	bdaddr_t bdaddr;
+
+	uint8_t buf[EMU_MAX_PKT];	/* H4 reassembly */
+	size_t buf_len;
+
+	struct queue *out;		/* Packets waiting for the host */
+	bool writer_active;
+
+	uint8_t event_mask[8];
+	uint8_t le_event_mask[8];
+
+	bool scan_enable;
+	bool filter_dup;
+	struct hciemu_adv_config adv;
+	unsigned int adv_id;
+	uint64_t adv_start;
+	uint64_t adv_sent;
+	unsigned int adv_next;
+	uint32_t *adv_seen;		/* Per device RPA epoch + 1 */
+	uint32_t seed;
+
+	bool le_conn_pending;
+	uint8_t le_conn_type;
+	bdaddr_t le_conn_addr;
+	unsigned int conn_id;
+	unsigned int conn_delay;
+	uint16_t next_handle;
+	struct queue *conns;
+	struct gatt_db *db;
+
+	struct hciemu_stats stats;
+
+	hciemu_debug_func_t debug_callback;
+	hciemu_destroy_func_t debug_destroy;
+	void *debug_data;
+};
+
+static uint64_t get_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* xorshift32, deterministic so runs can be repeated */
+static uint32_t emu_rand(struct hciemu *emu)
+{
+	uint32_t x = emu->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	emu->seed = x;
+
+	return x;
+}
+
+static bool can_write_data(struct io *io, void *user_data)
+{
+	struct hciemu *emu = user_data;
+	struct emu_pkt *pkt;
+
+	/* One write per packet, /dev/vhci takes nothing else */
+	while ((pkt = queue_peek_head(emu->out))) {
+		ssize_t ret;
+
+		ret = write(emu->fd, pkt->data + pkt->offset,
+						pkt->len - pkt->offset);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return true;
+
+			util_debug(emu->debug_callback, emu->debug_data,
+					"write failed: %s", strerror(errno));
+			queue_remove_all(emu->out, NULL, NULL, free);
+			break;
+		}
+
+		pkt->offset += ret;
+		if (pkt->offset < pkt->len)
+			return true;
+
+		free(queue_pop_head(emu->out));
+	}
+
+	return false;
+}
+
+static void write_watch_destroy(void *user_data)
+{
+	struct hciemu *emu = user_data;
+
+	emu->writer_active = false;
+}
+
+static void send_packet(struct hciemu *emu, uint8_t type, const void *hdr,
+				size_t hdr_len, const void *data, size_t len)
+{
+	struct emu_pkt *pkt;
+
+	pkt = malloc(sizeof(*pkt) + 1 + hdr_len + len);
+	if (!pkt)
+		return;
+
+	pkt->len = 1 + hdr_len + len;
+	pkt->offset = 0;
+	pkt->data[0] = type;
+	memcpy(pkt->data + 1, hdr, hdr_len);
+	if (len)
+		memcpy(pkt->data + 1 + hdr_len, data, len);
+
+	if (!queue_push_tail(emu->out, pkt)) {
+		free(pkt);
+		return;
+	}
+
+	if (emu->writer_active)
+		return;
+
+	/* Try right away, only fall back to the watch on a full socket */
+	if (!can_write_data(emu->io, emu))
+		return;
+
+	if (io_set_write_handler(emu->io, can_write_data, emu,
+							write_watch_destroy))
+		emu->writer_active = true;
+}
+
+static void send_event(struct hciemu *emu, uint8_t event, const void *data,
+								uint8_t len)
+{
+	hci_event_hdr hdr;
+
+	hdr.evt = event;
+	hdr.plen = len;
+
+	send_packet(emu, HCI_EVENT_PKT, &hdr, sizeof(hdr), data, len);
+}
+
+static void send_le_event(struct hciemu *emu, uint8_t subevent,
+					const void *data, uint8_t len)
+{
+	uint8_t buf[HCI_MAX_EVENT_SIZE];
+
+	buf[0] = subevent;
+	memcpy(buf + 1, data, len);
+
+	send_event(emu, EVT_LE_META_EVENT, buf, len + 1);
+}
+
+static void cmd_complete(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	uint8_t buf[HCI_MAX_EVENT_SIZE];
+	evt_cmd_complete *cc = (void *) buf;
+
+	cc->ncmd = 1;
+	cc->opcode = htobs(opcode);
+	memcpy(buf + EVT_CMD_COMPLETE_SIZE, data, len);
+
+	send_event(emu, EVT_CMD_COMPLETE, buf, EVT_CMD_COMPLETE_SIZE + len);
+}
+
+static void cmd_status(struct hciemu *emu, uint16_t opcode, uint8_t status)
+{
+	evt_cmd_status cs;
+
+	cs.status = status;
+	cs.ncmd = 1;
+	cs.opcode = htobs(opcode);
+
+	send_event(emu, EVT_CMD_STATUS, &cs, sizeof(cs));
+}
+
+static void cmd_complete_status(struct hciemu *emu, uint16_t opcode,
+								uint8_t status)
+{
+	cmd_complete(emu, opcode, &status, 1);
+}
+
+static void send_acl(struct hciemu *emu, uint16_t handle, uint16_t cid,
+					const uint8_t *data, uint16_t len)
+{
+	uint8_t buf[EMU_ACL_MTU];
+	hci_acl_hdr hdr;
+	uint16_t offset = 0;
+	uint8_t flags = 0x02;	/* Start of a flushable packet */
+
+	/* The L2CAP basic header goes into the first fragment */
+	put_le16(len, buf);
+	put_le16(cid, buf + 2);
+
+	do {
+		uint16_t head = offset ? 0 : 4;
+		uint16_t chunk = len - offset;
+
+		if (chunk > EMU_ACL_MTU - head)
+			chunk = EMU_ACL_MTU - head;
+
+		memcpy(buf + head, data + offset, chunk);
+
+		hdr.handle = htobs(acl_handle_pack(handle, flags));
+		hdr.dlen = htobs(head + chunk);
+
+		send_packet(emu, HCI_ACLDATA_PKT, &hdr, sizeof(hdr), buf,
+								head + chunk);
+		emu->stats.acl_tx++;
+
+		offset += chunk;
+		flags = 0x01;	/* Continuing fragment */
+	} while (offset < len);
+}
+
+static void conn_free(void *data)
+{
+	struct emu_conn *conn = data;
+
+	bt_gatt_server_unref(conn->server);
+	bt_att_unref(conn->att);
+	io_destroy(conn->io);
+	free(conn->rx_buf);
+	free(conn);
+}
+
+static bool match_conn_handle(const void *a, const void *b)
+{
+	const struct emu_conn *conn = a;
+
+	return conn->handle == PTR_TO_UINT(b);
+}
+
+static void disconn_complete(struct hciemu *emu, struct emu_conn *conn,
+								uint8_t reason)
+{
+	evt_disconn_complete ev;
+
+	ev.status = 0x00;
+	ev.handle = htobs(conn->handle);
+	ev.reason = reason;
+
+	queue_remove(emu->conns, conn);
+	emu->stats.connections--;
+
+	send_event(emu, EVT_DISCONN_COMPLETE, &ev, sizeof(ev));
+
+	conn_free(conn);
+}
+
+static bool conn_read(struct io *io, void *user_data)
+{
+	struct emu_conn *conn = user_data;
+	uint8_t buf[EMU_ATT_MTU + 1];
+	ssize_t len;
+
+	len = read(io_get_fd(io), buf, sizeof(buf));
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR;
+
+	if (len > 0)
+		send_acl(conn->emu, conn->handle, L2CAP_CID_ATT, buf, len);
+
+	return true;
+}
+
+static bool conn_disconnected(struct io *io, void *user_data)
+{
+	struct emu_conn *conn = user_data;
+
+	/* The peripheral gave up on the link, e.g. after an ATT timeout */
+	disconn_complete(conn->emu, conn, 0x13);
+
+	return false;
+}
+
+static struct emu_conn *conn_new(struct hciemu *emu, uint8_t peer_type,
+							const bdaddr_t *peer)
+{
+	struct emu_conn *conn;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK,
+								0, fds) < 0)
+		return NULL;
+
+	conn = new0(struct emu_conn, 1);
+	if (!conn)
+		goto fail;
+
+	conn->emu = emu;
+	conn->peer_type = peer_type;
+	bacpy(&conn->peer, peer);
+
+	conn->io = io_new(fds[0]);
+	if (!conn->io)
+		goto fail;
+
+	io_set_close_on_destroy(conn->io, true);
+	fds[0] = -1;
+
+	conn->att = bt_att_new(fds[1]);
+	if (!conn->att)
+		goto fail;
+
+	bt_att_set_close_on_unref(conn->att, true);
+	fds[1] = -1;
+
+	if (emu->db) {
+		conn->server = bt_gatt_server_new(emu->db, conn->att,
+								EMU_ATT_MTU);
+		if (!conn->server)
+			goto fail;
+	}
+
+	io_set_read_handler(conn->io, conn_read, conn, NULL);
+	io_set_disconnect_handler(conn->io, conn_disconnected, conn, NULL);
+
+	do {
+		conn->handle = emu->next_handle++;
+		if (emu->next_handle > 0x0eff)
+			emu->next_handle = 0x0001;
+	} while (queue_find(emu->conns, match_conn_handle,
+						UINT_TO_PTR(conn->handle)));
+
+	return conn;
+
+fail:
+	if (fds[0] >= 0)
+		close(fds[0]);
+
+	if (fds[1] >= 0)
+		close(fds[1]);
+
+	if (conn)
+		conn_free(conn);
+
+	return NULL;
+}
+
+static void le_conn_complete(struct hciemu *emu, uint8_t status,
+						struct emu_conn *conn)
+{
+	evt_le_connection_complete ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.status = status;
+	ev.role = 0x00;		/* Master */
+	ev.peer_bdaddr_type = emu->le_conn_type;
+	bacpy(&ev.peer_bdaddr, &emu->le_conn_addr);
+
+	if (conn) {
+		ev.handle = htobs(conn->handle);
+		ev.interval = htobs(0x0018);
+		ev.supervision_timeout = htobs(0x002a);
+	}
+
+	emu->le_conn_pending = false;
+
+	send_le_event(emu, EVT_LE_CONN_COMPLETE, &ev, sizeof(ev));
+}
+
+static bool conn_timeout(void *user_data)
+{
+	struct hciemu *emu = user_data;
+	struct emu_conn *conn;
+
+	emu->conn_id = 0;
+
+	conn = conn_new(emu, emu->le_conn_type, &emu->le_conn_addr);
+	if (!conn) {
+		le_conn_complete(emu, 0x07, NULL);	/* Memory exceeded */
+		return false;
+	}
+
+	queue_push_tail(emu->conns, conn);
+
+	if (++emu->stats.connections > emu->stats.max_connections)
+		emu->stats.max_connections = emu->stats.connections;
+
+	le_conn_complete(emu, 0x00, conn);
+
+	return false;
+}
+
+/*
+ * Synthetic advertisers. Device i keeps its address and data for the
+ * whole run, except that RPA devices pick a new address every
+ * rpa_timeout seconds.
+ */
+static uint32_t adv_epoch(struct hciemu *emu, unsigned int i)
+{
+	if (i * 100 / emu->adv.num_devices >= emu->adv.rpa_percent)
+		return 0;
+
+	if (!emu->adv.rpa_timeout)
+		return 1;
+
+	return 1 + (get_msec() - emu->adv_start) /
+					(emu->adv.rpa_timeout * 1000ULL);
+}
+
+static bool adv_is_belkin(struct hciemu *emu, unsigned int i)
+{
+	/* Spread Belkin devices evenly, independent of the RPA share */
+	return (i * 37 % 100) < emu->adv.belkin_percent;
+}
+
+static void adv_address(unsigned int i, uint32_t epoch, uint8_t *type,
+							bdaddr_t *bdaddr)
+{
+	if (!epoch) {
+		*type = LE_PUBLIC_ADDRESS;
+		bdaddr->b[0] = i;
+		bdaddr->b[1] = i >> 8;
+		bdaddr->b[2] = i >> 16;
+		bdaddr->b[3] = 0x00;
+		bdaddr->b[4] = 0x5c;
+		bdaddr->b[5] = 0x00;
+		return;
+	}
+
+	/* prand with the two top bits set to 0b01, then a 24-bit hash */
+	*type = LE_RANDOM_ADDRESS;
+	bdaddr->b[0] = i;
+	bdaddr->b[1] = i >> 8;
+	bdaddr->b[2] = i >> 16;
+	bdaddr->b[3] = epoch;
+	bdaddr->b[4] = epoch >> 8;
+	bdaddr->b[5] = 0x40 | ((epoch >> 16) & 0x3f);
+}
+
+static uint8_t adv_data(struct hciemu *emu, unsigned int i, uint8_t *data)
+{
+	uint8_t len = 0;
+	int name_len;
+
+	data[len++] = 2;
+	data[len++] = 0x01;	/* Flags */
+	data[len++] = 0x06;	/* LE General Discoverable, no BR/EDR */
+
+	if (adv_is_belkin(emu, i)) {
+		/* bt_auto_connect reads type and status from the last bytes */
+		data[len++] = 5;
+		data[len++] = 0xff;
+		put_le16(BELKIN_COMPANY_ID, data + len);
+		len += 2;
+		data[len++] = emu->adv.belkin_type;
+		data[len++] = emu->adv.belkin_status;
+	}
+
+	name_len = snprintf((char *) data + len + 2, 31 - len - 2, "%s-%04X",
+				adv_is_belkin(emu, i) ? "Belkin" : "Emu",
+				i & 0xffff);
+	data[len] = name_len + 1;
+	data[len + 1] = 0x09;	/* Complete Local Name */
+	len += name_len + 2;
+
+	return len;
+}
+
+static void send_adv_report(struct hciemu *emu, unsigned int i)
+{
+	uint8_t buf[2 + LE_ADVERTISING_INFO_SIZE + 31 + 1];
+	le_advertising_info *info = (void *) (buf + 1);
+	uint32_t epoch = adv_epoch(emu, i);
+
+	if (emu->filter_dup) {
+		if (emu->adv_seen[i] == epoch + 1)
+			return;
+
+		emu->adv_seen[i] = epoch + 1;
+	}
+
+	buf[0] = 1;	/* Number of reports */
+	info->evt_type = 0x00;	/* ADV_IND */
+	adv_address(i, epoch, &info->bdaddr_type, &info->bdaddr);
+	info->length = adv_data(emu, i, info->data);
+
+	/* RSSI follows the data, somewhere between -40 and -95 dBm */
+	info->data[info->length] = (uint8_t) -(40 + emu_rand(emu) % 56);
+
+	send_le_event(emu, EVT_LE_ADVERTISING_REPORT, buf,
+				1 + LE_ADVERTISING_INFO_SIZE + info->length + 1);
+
+	emu->stats.adv_reports++;
+}
+
+static bool adv_timeout(void *user_data)
+{
+	struct hciemu *emu = user_data;
+	uint64_t target;
+
+	target = (get_msec() - emu->adv_start) * emu->adv.reports_per_sec /
+									1000;
+
+	while (emu->adv_sent < target) {
+		emu->adv_sent++;
+
+		/* Like a controller running out of buffers */
+		if (queue_length(emu->out) > EMU_MAX_BACKLOG) {
+			emu->stats.adv_dropped++;
+			continue;
+		}
+
+		send_adv_report(emu, emu->adv_next);
+
+		if (++emu->adv_next >= emu->adv.num_devices)
+			emu->adv_next = 0;
+	}
+
+	return true;
+}
+
+static void adv_update(struct hciemu *emu)
+{
+	bool run = emu->scan_enable && emu->adv.num_devices &&
+						emu->adv.reports_per_sec;
+
+	if (!run) {
+		if (emu->adv_id) {
+			timeout_remove(emu->adv_id);
+			emu->adv_id = 0;
+		}
+
+		return;
+	}
+
+	if (emu->adv_id)
+		return;
+
+	emu->adv_start = get_msec();
+	emu->adv_sent = 0;
+
+	emu->adv_id = timeout_add(EMU_ADV_INTERVAL, adv_timeout, emu, NULL);
+}
+
+static void cmd_reset(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	emu->scan_enable = false;
+	emu->filter_dup = false;
+	adv_update(emu);
+
+	if (emu->conn_id) {
+		timeout_remove(emu->conn_id);
+		emu->conn_id = 0;
+	}
+
+	emu->le_conn_pending = false;
+
+	/* Links go away without events, the host has forgotten them */
+	queue_remove_all(emu->conns, NULL, NULL, conn_free);
+	emu->stats.connections = 0;
+
+	memset(emu->event_mask, 0, sizeof(emu->event_mask));
+	memset(emu->le_event_mask, 0, sizeof(emu->le_event_mask));
+
+	cmd_complete_status(emu, opcode, 0x00);
+}
+
+static void cmd_set_event_mask(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	if (len < 8) {
+		cmd_complete_status(emu, opcode, 0x12);
+		return;
+	}
+
+	memcpy(emu->event_mask, data, 8);
+
+	cmd_complete_status(emu, opcode, 0x00);
+}
+
+static void cmd_le_set_event_mask(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	if (len < 8) {
+		cmd_complete_status(emu, opcode, 0x12);
+		return;
+	}
+
+	memcpy(emu->le_event_mask, data, 8);
+
+	cmd_complete_status(emu, opcode, 0x00);
+}
+
+static void cmd_read_local_version(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	read_local_version_rp rp;
+
+	rp.status = 0x00;
+	rp.hci_ver = 0x06;		/* 4.0 */
+	rp.hci_rev = htobs(0x0000);
+	rp.lmp_ver = 0x06;
+	rp.manufacturer = htobs(0x003f);	/* Bluetooth SIG */
+	rp.lmp_subver = htobs(0x0000);
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_read_local_commands(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	read_local_commands_rp rp;
+
+	memset(&rp, 0, sizeof(rp));
+
+	rp.commands[0] |= 0x20;		/* Disconnect */
+	rp.commands[5] |= 0x40;		/* Set Event Mask */
+	rp.commands[5] |= 0x80;		/* Reset */
+	rp.commands[14] |= 0x08;	/* Read Local Version */
+	rp.commands[14] |= 0x20;	/* Read Local Features */
+	rp.commands[14] |= 0x80;	/* Read Buffer Size */
+	rp.commands[15] |= 0x02;	/* Read BD ADDR */
+	rp.commands[25] |= 0x01;	/* LE Set Event Mask */
+	rp.commands[25] |= 0x02;	/* LE Read Buffer Size */
+	rp.commands[25] |= 0x04;	/* LE Read Local Features */
+	rp.commands[25] |= 0x10;	/* LE Set Random Address */
+	rp.commands[25] |= 0x20;	/* LE Set Adv Parameters */
+	rp.commands[25] |= 0x40;	/* LE Read Adv TX Power */
+	rp.commands[25] |= 0x80;	/* LE Set Adv Data */
+	rp.commands[26] |= 0x01;	/* LE Set Scan Response Data */
+	rp.commands[26] |= 0x02;	/* LE Set Adv Enable */
+	rp.commands[26] |= 0x04;	/* LE Set Scan Parameters */
+	rp.commands[26] |= 0x08;	/* LE Set Scan Enable */
+	rp.commands[26] |= 0x10;	/* LE Create Connection */
+	rp.commands[26] |= 0x20;	/* LE Create Connection Cancel */
+	rp.commands[26] |= 0x40;	/* LE Read White List Size */
+	rp.commands[26] |= 0x80;	/* LE Clear White List */
+	rp.commands[27] |= 0x01;	/* LE Add Device To White List */
+	rp.commands[27] |= 0x02;	/* LE Remove Device From White List */
+	rp.commands[27] |= 0x80;	/* LE Rand */
+	rp.commands[28] |= 0x08;	/* LE Read Supported States */
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_read_local_features(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	read_local_features_rp rp;
+
+	memset(&rp, 0, sizeof(rp));
+	rp.features[4] |= 0x20;		/* BR/EDR Not Supported */
+	rp.features[4] |= 0x40;		/* LE Supported */
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_read_buffer_size(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	read_buffer_size_rp rp;
+
+	/* LE only, the host has to use LE Read Buffer Size */
+	memset(&rp, 0, sizeof(rp));
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_read_bd_addr(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	read_bd_addr_rp rp;
+
+	rp.status = 0x00;
+	bacpy(&rp.bdaddr, &emu->bdaddr);
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_le_read_buffer_size(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	le_read_buffer_size_rp rp;
+
+	rp.status = 0x00;
+	rp.pkt_len = htobs(EMU_ACL_MTU);
+	rp.max_pkt = EMU_ACL_PKTS;
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_le_read_local_features(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	le_read_local_supported_features_rp rp;
+
+	memset(&rp, 0, sizeof(rp));
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_le_read_adv_tx_power(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	le_read_advertising_channel_tx_power_rp rp;
+
+	rp.status = 0x00;
+	rp.level = 0;
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_le_read_white_list_size(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	le_read_white_list_size_rp rp;
+
+	rp.status = 0x00;
+	rp.size = 16;
+
+	cmd_complete(emu, opcode, &rp, sizeof(rp));
+}
+
+static void cmd_le_read_supported_states(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	uint8_t rp[9];
+
+	memset(rp, 0, sizeof(rp));
+	rp[1] = 0xff;		/* Scanning and initiating, no advertising */
+	rp[2] = 0x03;
+
+	cmd_complete(emu, opcode, rp, sizeof(rp));
+}
+
+static void cmd_le_rand(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	uint8_t rp[9];
+
+	rp[0] = 0x00;
+	put_le32(emu_rand(emu), rp + 1);
+	put_le32(emu_rand(emu), rp + 5);
+
+	cmd_complete(emu, opcode, rp, sizeof(rp));
+}
+
+/* Accepted but without effect, this controller never advertises */
+static void cmd_ack(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	cmd_complete_status(emu, opcode, 0x00);
+}
+
+static void cmd_le_set_scan_enable(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	const le_set_scan_enable_cp *cp = data;
+
+	if (len < sizeof(*cp) || cp->enable > 0x01) {
+		cmd_complete_status(emu, opcode, 0x12);
+		return;
+	}
+
+	/* A new scan reports every device again */
+	if (cp->enable && !emu->scan_enable && emu->adv_seen)
+		memset(emu->adv_seen, 0, emu->adv.num_devices *
+						sizeof(*emu->adv_seen));
+
+	emu->scan_enable = cp->enable;
+	emu->filter_dup = cp->filter_dup;
+
+	cmd_complete_status(emu, opcode, 0x00);
+
+	adv_update(emu);
+}
+
+static void cmd_le_create_conn(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	const le_create_connection_cp *cp = data;
+
+	if (len < sizeof(*cp)) {
+		cmd_status(emu, opcode, 0x12);
+		return;
+	}
+
+	if (emu->le_conn_pending) {
+		cmd_status(emu, opcode, 0x0c);	/* Command Disallowed */
+		return;
+	}
+
+	emu->le_conn_pending = true;
+	emu->le_conn_type = cp->peer_bdaddr_type;
+	bacpy(&emu->le_conn_addr, &cp->peer_bdaddr);
+
+	cmd_status(emu, opcode, 0x00);
+
+	emu->conn_id = timeout_add(emu->conn_delay, conn_timeout, emu, NULL);
+}
+
+static void cmd_le_create_conn_cancel(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	if (!emu->le_conn_pending) {
+		cmd_complete_status(emu, opcode, 0x0c);
+		return;
+	}
+
+	timeout_remove(emu->conn_id);
+	emu->conn_id = 0;
+
+	cmd_complete_status(emu, opcode, 0x00);
+
+	le_conn_complete(emu, 0x02, NULL);	/* Unknown Connection Id */
+}
+
+static void cmd_disconnect(struct hciemu *emu, uint16_t opcode,
+					const void *data, uint8_t len)
+{
+	const disconnect_cp *cp = data;
+	struct emu_conn *conn;
+
+	if (len < sizeof(*cp)) {
+		cmd_status(emu, opcode, 0x12);
+		return;
+	}
+
+	conn = queue_find(emu->conns, match_conn_handle,
+				UINT_TO_PTR(btohs(cp->handle)));
+	if (!conn) {
+		cmd_status(emu, opcode, 0x02);
+		return;
+	}
+
+	cmd_status(emu, opcode, 0x00);
+
+	disconn_complete(emu, conn, 0x16);	/* Local Host Terminated */
+}
+
+#define CMD(ogf, ocf, func) { cmd_opcode_pack(ogf, ocf), func }
+
+static const struct {
+	uint16_t opcode;
+	void (*func)(struct hciemu *emu, uint16_t opcode, const void *data,
+								uint8_t len);
+} cmd_table[] = {
+	CMD(OGF_LINK_CTL, OCF_DISCONNECT, cmd_disconnect),
+	CMD(OGF_HOST_CTL, OCF_SET_EVENT_MASK, cmd_set_event_mask),
+	CMD(OGF_HOST_CTL, OCF_RESET, cmd_reset),
+	CMD(OGF_HOST_CTL, OCF_SET_EVENT_FLT, cmd_ack),
+	CMD(OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION, cmd_read_local_version),
+	CMD(OGF_INFO_PARAM, OCF_READ_LOCAL_COMMANDS, cmd_read_local_commands),
+	CMD(OGF_INFO_PARAM, OCF_READ_LOCAL_FEATURES, cmd_read_local_features),
+	CMD(OGF_INFO_PARAM, OCF_READ_BUFFER_SIZE, cmd_read_buffer_size),
+	CMD(OGF_INFO_PARAM, OCF_READ_BD_ADDR, cmd_read_bd_addr),
+	CMD(OGF_LE_CTL, OCF_LE_SET_EVENT_MASK, cmd_le_set_event_mask),
+	CMD(OGF_LE_CTL, OCF_LE_READ_BUFFER_SIZE, cmd_le_read_buffer_size),
+	CMD(OGF_LE_CTL, OCF_LE_READ_LOCAL_SUPPORTED_FEATURES,
+						cmd_le_read_local_features),
+	CMD(OGF_LE_CTL, OCF_LE_SET_RANDOM_ADDRESS, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_SET_ADVERTISING_PARAMETERS, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_READ_ADVERTISING_CHANNEL_TX_POWER,
+						cmd_le_read_adv_tx_power),
+	CMD(OGF_LE_CTL, OCF_LE_SET_ADVERTISING_DATA, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_SET_SCAN_RESPONSE_DATA, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_SET_ADVERTISE_ENABLE, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_SET_SCAN_PARAMETERS, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_SET_SCAN_ENABLE, cmd_le_set_scan_enable),
+	CMD(OGF_LE_CTL, OCF_LE_CREATE_CONN, cmd_le_create_conn),
+	CMD(OGF_LE_CTL, OCF_LE_CREATE_CONN_CANCEL, cmd_le_create_conn_cancel),
+	CMD(OGF_LE_CTL, OCF_LE_READ_WHITE_LIST_SIZE,
+						cmd_le_read_white_list_size),
+	CMD(OGF_LE_CTL, OCF_LE_CLEAR_WHITE_LIST, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_ADD_DEVICE_TO_WHITE_LIST, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_REMOVE_DEVICE_FROM_WHITE_LIST, cmd_ack),
+	CMD(OGF_LE_CTL, OCF_LE_RAND, cmd_le_rand),
+	CMD(OGF_LE_CTL, OCF_LE_READ_SUPPORTED_STATES,
+						cmd_le_read_supported_states),
+	{ }
+};
+
+static void process_cmd(struct hciemu *emu, const uint8_t *data, size_t len)
+{
+	const hci_command_hdr *hdr = (const void *) data;
+	uint16_t opcode = btohs(hdr->opcode);
+	int i;
+
+	emu->stats.commands++;
+
+	util_debug(emu->debug_callback, emu->debug_data,
+					"command 0x%04x plen %u", opcode,
+					hdr->plen);
+
+	for (i = 0; cmd_table[i].func; i++) {
+		if (cmd_table[i].opcode == opcode) {
+			cmd_table[i].func(emu, opcode, data + sizeof(*hdr),
+								hdr->plen);
+			return;
+		}
+	}
+
+	cmd_complete_status(emu, opcode, 0x01);	/* Unknown Command */
+}
+
+static void process_smp(struct hciemu *emu, struct emu_conn *conn,
+					const uint8_t *data, uint16_t len)
+{
+	uint8_t rsp[2];
+
+	/* Pairing Request, answered with Pairing Failed: Not Supported */
+	if (len < 1 || data[0] != 0x01)
+		return;
+
+	rsp[0] = 0x05;
+	rsp[1] = 0x05;
+
+	send_acl(emu, conn->handle, L2CAP_CID_SMP, rsp, sizeof(rsp));
+}
+
+static void process_l2cap(struct hciemu *emu, struct emu_conn *conn,
+					const uint8_t *data, uint16_t len)
+{
+	uint16_t cid = get_le16(data + 2);
+
+	switch (cid) {
+	case L2CAP_CID_ATT:
+		if (write(io_get_fd(conn->io), data + 4, len - 4) < 0)
+			util_debug(emu->debug_callback, emu->debug_data,
+					"ATT write failed: %s",
+					strerror(errno));
+		break;
+	case L2CAP_CID_SMP:
+		process_smp(emu, conn, data + 4, len - 4);
+		break;
+	default:
+		util_debug(emu->debug_callback, emu->debug_data,
+					"dropping L2CAP CID 0x%04x", cid);
+		break;
+	}
+}
+
+static void num_completed(struct hciemu *emu, uint16_t handle)
+{
+	uint8_t buf[5];
+
+	buf[0] = 1;
+	put_le16(handle, buf + 1);
+	put_le16(1, buf + 3);
+
+	send_event(emu, EVT_NUM_COMP_PKTS, buf, sizeof(buf));
+}
+
+static void process_acl(struct hciemu *emu, const uint8_t *data, size_t len)
+{
+	const hci_acl_hdr *hdr = (const void *) data;
+	uint16_t handle = acl_handle(btohs(hdr->handle));
+	uint8_t flags = acl_flags(btohs(hdr->handle)) & 0x03;
+	uint16_t dlen = btohs(hdr->dlen);
+	struct emu_conn *conn;
+
+	data += sizeof(*hdr);
+
+	emu->stats.acl_rx++;
+
+	conn = queue_find(emu->conns, match_conn_handle, UINT_TO_PTR(handle));
+	if (!conn)
+		return;
+
+	num_completed(emu, handle);
+
+	if (flags != 0x01) {
+		uint16_t l2cap_len;
+
+		if (dlen < 4)
+			return;
+
+		l2cap_len = get_le16(data);
+
+		if (l2cap_len == dlen - 4) {
+			process_l2cap(emu, conn, data, dlen);
+			return;
+		}
+
+		free(conn->rx_buf);
+		conn->rx_buf = malloc(l2cap_len + 4);
+		if (!conn->rx_buf)
+			return;
+
+		conn->rx_expect = l2cap_len + 4;
+		conn->rx_len = 0;
+	}
+
+	if (!conn->rx_buf || conn->rx_len + dlen > conn->rx_expect) {
+		free(conn->rx_buf);
+		conn->rx_buf = NULL;
+		return;
+	}
+
+	memcpy(conn->rx_buf + conn->rx_len, data, dlen);
+	conn->rx_len += dlen;
+
+	if (conn->rx_len < conn->rx_expect)
+		return;
+
+	process_l2cap(emu, conn, conn->rx_buf, conn->rx_len);
+
+	free(conn->rx_buf);
+	conn->rx_buf = NULL;
+}
+
+/* Length of the H4 packet at the start of buf, 0 if more is needed */
+static size_t packet_len(const uint8_t *buf, size_t len)
+{
+	switch (buf[0]) {
+	case HCI_COMMAND_PKT:
+		if (len < 1 + HCI_COMMAND_HDR_SIZE)
+			return 0;
+
+		return 1 + HCI_COMMAND_HDR_SIZE + buf[3];
+	case HCI_ACLDATA_PKT:
+		if (len < 1 + HCI_ACL_HDR_SIZE)
+			return 0;
+
+		return 1 + HCI_ACL_HDR_SIZE + get_le16(buf + 3);
+	case HCI_VENDOR_PKT:
+		/* /dev/vhci reporting the controller index */
+		return 4;
+	}
+
+	return SIZE_MAX;
+}
+
+static bool can_read_data(struct io *io, void *user_data)
+{
+	struct hciemu *emu = user_data;
+	size_t offset = 0;
+	ssize_t ret;
+
+	ret = read(emu->fd, emu->buf + emu->buf_len,
+					sizeof(emu->buf) - emu->buf_len);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EINTR;
+
+	if (!ret)
+		return false;
+
+	emu->buf_len += ret;
+
+	hciemu_ref(emu);
+
+	while (offset < emu->buf_len) {
+		uint8_t *pkt = emu->buf + offset;
+		size_t len = emu->buf_len - offset;
+		size_t pkt_len = packet_len(pkt, len);
+
+		if (pkt_len == SIZE_MAX || pkt_len > sizeof(emu->buf)) {
+			util_debug(emu->debug_callback, emu->debug_data,
+					"bad packet type 0x%02x, resyncing",
+					pkt[0]);
+			offset = emu->buf_len;
+			break;
+		}
+
+		if (!pkt_len || pkt_len > len)
+			break;
+
+		if (pkt[0] == HCI_COMMAND_PKT)
+			process_cmd(emu, pkt + 1, pkt_len - 1);
+		else if (pkt[0] == HCI_ACLDATA_PKT)
+			process_acl(emu, pkt + 1, pkt_len - 1);
+
+		offset += pkt_len;
+	}
+
+	memmove(emu->buf, emu->buf + offset, emu->buf_len - offset);
+	emu->buf_len -= offset;
+
+	hciemu_unref(emu);
+
+	return true;
+}
+
+static struct hciemu *emu_new(int fd)
+{
+	struct hciemu *emu;
+
+	emu = new0(struct hciemu, 1);
+	if (!emu)
+		return NULL;
+
+	emu->fd = fd;
+	emu->host_fd = -1;
+	emu->seed = 0x5c5c5c5c;
+	emu->next_handle = 0x0001;
+	emu->conn_delay = EMU_CONN_DELAY;
+
+	/* Static random style address, unique enough per process */
+	emu->bdaddr.b[0] = getpid();
+	emu->bdaddr.b[1] = getpid() >> 8;
+	emu->bdaddr.b[2] = 0x00;
+	emu->bdaddr.b[3] = 0x5c;
+	emu->bdaddr.b[4] = 0x00;
+	emu->bdaddr.b[5] = 0xc0;
+
+	emu->out = queue_new();
+	emu->conns = queue_new();
+	if (!emu->out || !emu->conns)
+		goto fail;
+
+	emu->io = io_new(fd);
+	if (!emu->io)
+		goto fail;
+
+	if (!io_set_read_handler(emu->io, can_read_data, emu, NULL))
+		goto fail;
+
+	return hciemu_ref(emu);
+
+fail:
+	queue_destroy(emu->out, NULL);
+	queue_destroy(emu->conns, NULL);
+	io_destroy(emu->io);
+	free(emu);
+
+	return NULL;
+}
+
+struct hciemu *hciemu_new(void)
+{
+	struct hciemu *emu;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		return NULL;
+
+	/* Only the emulator end is non-blocking, the host decides its own */
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+	emu = emu_new(fds[0]);
+	if (!emu) {
+		close(fds[0]);
+		close(fds[1]);
+		return NULL;
+	}
+
+	io_set_close_on_destroy(emu->io, true);
+	emu->host_fd = fds[1];
+
+	return emu;
+}
+
+struct hciemu *hciemu_new_pty(void)
+{
+	struct hciemu *emu;
+	struct termios ti;
+	char *path;
+	int fd;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (grantpt(fd) < 0 || unlockpt(fd) < 0)
+		goto fail;
+
+	if (tcgetattr(fd, &ti) < 0)
+		goto fail;
+
+	/* H4 is binary, nothing may be translated or echoed */
+	cfmakeraw(&ti);
+	if (tcsetattr(fd, TCSANOW, &ti) < 0)
+		goto fail;
+
+	path = ptsname(fd);
+	if (!path)
+		goto fail;
+
+	emu = emu_new(fd);
+	if (!emu)
+		goto fail;
+
+	io_set_close_on_destroy(emu->io, true);
+
+	emu->pty_path = strdup(path);
+
+	return emu;
+
+fail:
+	close(fd);
+	return NULL;
+}
+
+struct hciemu *hciemu_new_fd(int fd)
+{
+	if (fd < 0)
+		return NULL;
+
+	return emu_new(fd);
+}
+
+struct hciemu *hciemu_ref(struct hciemu *emu)
+{
+	if (!emu)
+		return NULL;
+
+	__sync_fetch_and_add(&emu->ref_count, 1);
+
+	return emu;
+}
+
+void hciemu_unref(struct hciemu *emu)
+{
+	if (!emu)
+		return;
+
+	if (__sync_sub_and_fetch(&emu->ref_count, 1))
+		return;
+
+	if (emu->adv_id)
+		timeout_remove(emu->adv_id);
+
+	if (emu->conn_id)
+		timeout_remove(emu->conn_id);
+
+	queue_destroy(emu->conns, conn_free);
+	queue_destroy(emu->out, free);
+
+	io_destroy(emu->io);
+
+	if (emu->host_fd >= 0)
+		close(emu->host_fd);
+
+	gatt_db_unref(emu->db);
+
+	if (emu->debug_destroy)
+		emu->debug_destroy(emu->debug_data);
+
+	free(emu->adv_seen);
+	free(emu->pty_path);
+	free(emu);
+}
+
+bool hciemu_set_debug(struct hciemu *emu, hciemu_debug_func_t callback,
+			void *user_data, hciemu_destroy_func_t destroy)
+{
+	if (!emu)
+		return false;
+
+	if (emu->debug_destroy)
+		emu->debug_destroy(emu->debug_data);
+
+	emu->debug_callback = callback;
+	emu->debug_destroy = destroy;
+	emu->debug_data = user_data;
+
+	return true;
+}
+
+int hciemu_get_fd(struct hciemu *emu)
+{
+	if (!emu)
+		return -1;
+
+	return emu->host_fd;
+}
+
+const char *hciemu_get_pty_path(struct hciemu *emu)
+{
+	if (!emu)
+		return NULL;
+
+	return emu->pty_path;
+}
+
+const uint8_t *hciemu_get_address(struct hciemu *emu)
+{
+	if (!emu)
+		return NULL;
+
+	return emu->bdaddr.b;
+}
+
+bool hciemu_set_adv_config(struct hciemu *emu,
+				const struct hciemu_adv_config *config)
+{
+	uint32_t *seen = NULL;
+
+	if (!emu || !config)
+		return false;
+
+	if (config->belkin_percent > 100 || config->rpa_percent > 100)
+		return false;
+
+	/* Device indexes have to fit the three address bytes they use */
+	if (config->num_devices > 0xffffff)
+		return false;
+
+	if (config->num_devices) {
+		seen = calloc(config->num_devices, sizeof(*seen));
+		if (!seen)
+			return false;
+	}
+
+	free(emu->adv_seen);
+	emu->adv_seen = seen;
+	emu->adv = *config;
+	emu->adv_next = 0;
+
+	/* Restart the rate accounting with the new settings */
+	if (emu->adv_id) {
+		timeout_remove(emu->adv_id);
+		emu->adv_id = 0;
+	}
+
+	adv_update(emu);
+
+	return true;
+}
+
+bool hciemu_set_peripheral_db(struct hciemu *emu, struct gatt_db *db)
+{
+	if (!emu)
+		return false;
+
+	gatt_db_unref(emu->db);
+	emu->db = gatt_db_ref(db);
+
+	return true;
+}
+
+bool hciemu_set_conn_delay(struct hciemu *emu, unsigned int msec)
+{
+	if (!emu)
+		return false;
+
+	emu->conn_delay = msec;
+
+	return true;
+}
+
+bool hciemu_get_stats(struct hciemu *emu, struct hciemu_stats *stats)
+{
+	if (!emu || !stats)
+		return false;
+
+	*stats = emu->stats;
+
+	return true;
+}
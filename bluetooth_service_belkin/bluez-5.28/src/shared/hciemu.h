@@ -0,0 +1,85 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A user-space stand-in for an LE-only controller speaking H4 over a
+ * stream. While the host scans it reports synthetic advertisers, and
+ * every LE connection it accepts is served by a bt_gatt_server running
+ * on the database given with hciemu_set_peripheral_db().
+ */
+
+struct hciemu;
+struct gatt_db;
+
+/* Host end of a socketpair, see hciemu_get_fd() */
+struct hciemu *hciemu_new(void);
+
+/* Master side of a raw pty, the host opens hciemu_get_pty_path() */
+struct hciemu *hciemu_new_pty(void);
+
+/* Any H4 transport, e.g. an opened /dev/vhci */
+struct hciemu *hciemu_new_fd(int fd);
+
+struct hciemu *hciemu_ref(struct hciemu *emu);
+void hciemu_unref(struct hciemu *emu);
+
+typedef void (*hciemu_debug_func_t)(const char *str, void *user_data);
+typedef void (*hciemu_destroy_func_t)(void *user_data);
+
+bool hciemu_set_debug(struct hciemu *emu, hciemu_debug_func_t callback,
+			void *user_data, hciemu_destroy_func_t destroy);
+
+int hciemu_get_fd(struct hciemu *emu);
+const char *hciemu_get_pty_path(struct hciemu *emu);
+
+/* Six bytes in bdaddr_t order */
+const uint8_t *hciemu_get_address(struct hciemu *emu);
+
+struct hciemu_adv_config {
+	unsigned int num_devices;
+	unsigned int reports_per_sec;
+	unsigned int belkin_percent;	/* Share with 0x005C manufacturer data */
+	uint8_t belkin_type;
+	uint8_t belkin_status;
+	unsigned int rpa_percent;	/* Share using resolvable private addr */
+	unsigned int rpa_timeout;	/* Seconds between RPA changes, 0 never */
+};
+
+bool hciemu_set_adv_config(struct hciemu *emu,
+				const struct hciemu_adv_config *config);
+
+bool hciemu_set_peripheral_db(struct hciemu *emu, struct gatt_db *db);
+
+/* Delay between LE Create Connection and its Connection Complete */
+bool hciemu_set_conn_delay(struct hciemu *emu, unsigned int msec);
+
+struct hciemu_stats {
+	uint64_t commands;
+	uint64_t adv_reports;
+	uint64_t adv_dropped;		/* Skipped while the host lagged */
+	uint64_t acl_rx;
+	uint64_t acl_tx;
+	unsigned int connections;
+	unsigned int max_connections;
+};
+
+bool hciemu_get_stats(struct hciemu *emu, struct hciemu_stats *stats);
@@ -37,6 +37,26 @@
 #include "src/shared/io.h"
 #include "src/shared/hfp.h"
 
+#define HFP_BUF_SIZE 4096
+
+/* Longest AT command or result prefix looked up in the handler tables */
+#define HFP_PREFIX_MAX 17
+
+/* Room for a caller format string wrapped with its line delimiters */
+#define HFP_FORMAT_MAX 128
+
+struct prefix_entry {
+	const char *prefix;
+	void *handler;
+};
+
+/* Handlers kept sorted by prefix for binary search dispatch */
+struct prefix_table {
+	struct prefix_entry *entries;
+	unsigned int count;
+	unsigned int size;
+};
+
 struct hfp_gw {
 	int ref_count;
 	int fd;
@@ -44,7 +64,7 @@ struct hfp_gw {
 	struct io *io;
 	struct ringbuf *read_buf;
 	struct ringbuf *write_buf;
-	struct queue *cmd_handlers;
+	struct prefix_table cmd_handlers;
 	bool writer_active;
 	bool result_pending;
 	hfp_command_func_t command_callback;
@@ -73,7 +93,7 @@ struct hfp_hf {
 	bool writer_active;
 	struct queue *cmd_queue;
 
-	struct queue *event_handlers;
+	struct prefix_table event_handlers;
 
 	hfp_debug_func_t debug_callback;
 	hfp_destroy_func_t debug_destroy;
@@ -94,8 +114,15 @@ struct cmd_handler {
 	hfp_result_func_t callback;
 };
 
+/*
+ * A line is parsed in place from the ring buffer, so it may be split in
+ * two segments when it wraps. Reading past the end yields '\0'.
+ */
 struct hfp_context {
 	const char *data;
+	unsigned int len;
+	const char *data2;
+	unsigned int len2;
 	unsigned int offset;
 };
 
@@ -125,17 +152,185 @@ static void destroy_cmd_handler(void *data)
 	free(handler);
 }
 
-static bool match_handler_prefix(const void *a, const void *b)
+static inline char context_char(const struct hfp_context *context,
+							unsigned int offset)
+{
+	if (offset < context->len)
+		return context->data[offset];
+
+	offset -= context->len;
+	if (offset < context->len2)
+		return context->data2[offset];
+
+	return '\0';
+}
+
+static void context_init(struct hfp_context *context, const char *data,
+				unsigned int len, const char *data2,
+				unsigned int len2)
+{
+	context->data = data;
+	context->len = len;
+	context->data2 = data2;
+	context->len2 = len2;
+	context->offset = 0;
+}
+
+/*
+ * Compare len bytes of key at start against a prefix. Received lines are
+ * upper-cased (fold) before the comparison, registered prefixes are
+ * matched exactly as given.
+ */
+static int prefix_cmp(const struct hfp_context *key, unsigned int start,
+				unsigned int len, bool fold, const char *prefix)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		int c = (unsigned char) context_char(key, start + i);
+		int p = (unsigned char) prefix[i];
+
+		if (fold)
+			c = toupper(c);
+
+		if (c != p)
+			return c - p;
+	}
+
+	return prefix[i] ? -1 : 0;
+}
+
+static bool prefix_table_search(const struct prefix_table *table,
+				const struct hfp_context *key,
+				unsigned int start, unsigned int len,
+				bool fold, unsigned int *index)
+{
+	unsigned int lo = 0, hi = table->count;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		int cmp;
+
+		cmp = prefix_cmp(key, start, len, fold,
+						table->entries[mid].prefix);
+		if (!cmp) {
+			*index = mid;
+			return true;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	*index = lo;
+	return false;
+}
+
+static void *prefix_table_lookup(const struct prefix_table *table,
+				const struct hfp_context *key,
+				unsigned int start, unsigned int len)
+{
+	unsigned int index;
+
+	if (!prefix_table_search(table, key, start, len, true, &index))
+		return NULL;
+
+	return table->entries[index].handler;
+}
+
+static bool prefix_table_insert(struct prefix_table *table,
+					const char *prefix, void *handler)
 {
-	const struct cmd_handler *handler = a;
-	const char *prefix = b;
+	struct hfp_context key;
+	unsigned int index;
+
+	context_init(&key, prefix, strlen(prefix), NULL, 0);
 
-	if (strcmp(handler->prefix, prefix) != 0)
+	if (prefix_table_search(table, &key, 0, key.len, false, &index))
 		return false;
 
+	if (table->count == table->size) {
+		struct prefix_entry *entries;
+		unsigned int size = table->size ? table->size * 2 : 16;
+
+		entries = realloc(table->entries, size * sizeof(*entries));
+		if (!entries)
+			return false;
+
+		table->entries = entries;
+		table->size = size;
+	}
+
+	memmove(&table->entries[index + 1], &table->entries[index],
+			(table->count - index) * sizeof(*table->entries));
+
+	table->entries[index].prefix = prefix;
+	table->entries[index].handler = handler;
+	table->count++;
+
 	return true;
 }
 
+static void *prefix_table_remove(struct prefix_table *table,
+							const char *prefix)
+{
+	struct hfp_context key;
+	unsigned int index;
+	void *handler;
+
+	context_init(&key, prefix, strlen(prefix), NULL, 0);
+
+	if (!prefix_table_search(table, &key, 0, key.len, false, &index))
+		return NULL;
+
+	handler = table->entries[index].handler;
+
+	table->count--;
+	memmove(&table->entries[index], &table->entries[index + 1],
+			(table->count - index) * sizeof(*table->entries));
+
+	return handler;
+}
+
+static void prefix_table_clear(struct prefix_table *table,
+						void (*destroy)(void *data))
+{
+	unsigned int i;
+
+	for (i = 0; i < table->count; i++)
+		destroy(table->entries[i].handler);
+
+	free(table->entries);
+	table->entries = NULL;
+	table->count = 0;
+	table->size = 0;
+}
+
+/*
+ * Wrap a caller format string with line delimiters. The result is built
+ * in buf, which must hold HFP_FORMAT_MAX bytes, unless it is too long.
+ */
+static char *format_line(char *buf, const char *head, const char *format,
+							const char *tail)
+{
+	char *fmt;
+	int len;
+
+	len = snprintf(buf, HFP_FORMAT_MAX, "%s%s%s", head, format, tail);
+	if (len < 0)
+		return NULL;
+
+	if (len < HFP_FORMAT_MAX)
+		return buf;
+
+	if (asprintf(&fmt, "%s%s%s", head, format, tail) < 0)
+		return NULL;
+
+	return fmt;
+}
+
 static void write_watch_destroy(void *user_data)
 {
 	struct hfp_gw *hfp = user_data;
@@ -175,70 +370,98 @@ static void wakeup_writer(struct hfp_gw *hfp)
 
 static void skip_whitespace(struct hfp_context *context)
 {
-	while (context->data[context->offset] == ' ')
+	while (context_char(context, context->offset) == ' ')
 		context->offset++;
 }
 
 static void handle_unknown_at_command(struct hfp_gw *hfp,
-							const char *data)
+						struct hfp_context *context)
 {
 	if (hfp->command_callback) {
-		hfp->command_callback(data, hfp->command_data);
+		char *line = NULL;
+
+		/*
+		 * Upper layer expects a plain string, join a wrapped line.
+		 * That includes a line whose <cr> is the first byte after the
+		 * wrap, where data2 is set but empty. Lines only wrap at the
+		 * end of the ring buffer, so this is rare enough to allocate.
+		 */
+		if (context->data2) {
+			line = malloc(context->len + context->len2 + 1);
+			if (!line) {
+				hfp_gw_send_result(hfp, HFP_RESULT_ERROR);
+				return;
+			}
+
+			memcpy(line, context->data, context->len);
+			memcpy(line + context->len, context->data2,
+								context->len2);
+			line[context->len + context->len2] = '\0';
+		}
+
+		hfp->command_callback(line ? line : context->data,
+							hfp->command_data);
+		free(line);
+
 		hfp->result_pending = true;
 	} else {
 		hfp_gw_send_result(hfp, HFP_RESULT_ERROR);
 	}
 }
 
-static bool handle_at_command(struct hfp_gw *hfp, const char *data)
+static bool handle_at_command(struct hfp_gw *hfp,
+						struct hfp_context *context)
 {
 	struct cmd_handler *handler;
-	const char *separators = ";?=\0";
-	struct hfp_context context;
 	enum hfp_gw_cmd_type type;
-	char lookup_prefix[18];
-	uint8_t pref_len = 0;
-	const char *prefix;
-	int i;
-
-	context.offset = 0;
-	context.data = data;
+	unsigned int prefix, pref_len;
+	char c;
 
-	skip_whitespace(&context);
+	skip_whitespace(context);
 
-	if (strlen(data + context.offset) < 3)
+	if (!context_char(context, context->offset) ||
+				!context_char(context, context->offset + 1) ||
+				!context_char(context, context->offset + 2))
 		return false;
 
-	if (strncmp(data + context.offset, "AT", 2))
-		if (strncmp(data + context.offset, "at", 2))
+	c = context_char(context, context->offset);
+	if (c == 'A') {
+		if (context_char(context, context->offset + 1) != 'T')
+			return false;
+	} else if (c == 'a') {
+		if (context_char(context, context->offset + 1) != 't')
 			return false;
+	} else {
+		return false;
+	}
 
-	context.offset += 2;
-	prefix = data + context.offset;
+	context->offset += 2;
+	prefix = context->offset;
 
-	if (isalpha(prefix[0])) {
-		lookup_prefix[pref_len++] = toupper(prefix[0]);
+	if (isalpha(context_char(context, prefix))) {
+		pref_len = 1;
 	} else {
-		pref_len = strcspn(prefix, separators);
-		if (pref_len > 17 || pref_len < 2)
-			return false;
+		for (pref_len = 0; pref_len <= HFP_PREFIX_MAX; pref_len++) {
+			c = context_char(context, prefix + pref_len);
+			if (c == ';' || c == '?' || c == '=' || c == '\0')
+				break;
+		}
 
-		for (i = 0; i < pref_len; i++)
-			lookup_prefix[i] = toupper(prefix[i]);
+		if (pref_len > HFP_PREFIX_MAX || pref_len < 2)
+			return false;
 	}
 
-	lookup_prefix[pref_len] = '\0';
-	context.offset += pref_len;
+	context->offset += pref_len;
 
-	if (lookup_prefix[0] == 'D') {
+	if (toupper(context_char(context, prefix)) == 'D') {
 		type = HFP_GW_CMD_TYPE_SET;
 		goto done;
 	}
 
-	if (data[context.offset] == '=') {
-		context.offset++;
-		if (data[context.offset] == '?') {
-			context.offset++;
+	if (context_char(context, context->offset) == '=') {
+		context->offset++;
+		if (context_char(context, context->offset) == '?') {
+			context->offset++;
 			type = HFP_GW_CMD_TYPE_TEST;
 		} else {
 			type = HFP_GW_CMD_TYPE_SET;
@@ -246,8 +469,8 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 		goto done;
 	}
 
-	if (data[context.offset] == '?') {
-		context.offset++;
+	if (context_char(context, context->offset) == '?') {
+		context->offset++;
 		type = HFP_GW_CMD_TYPE_READ;
 		goto done;
 	}
@@ -256,21 +479,21 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 
 done:
 
-	handler = queue_find(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
+	handler = prefix_table_lookup(&hfp->cmd_handlers, context, prefix,
+								pref_len);
 	if (!handler) {
-		handle_unknown_at_command(hfp, data);
+		handle_unknown_at_command(hfp, context);
 		return true;
 	}
 
-	handler->callback(&context, type, handler->user_data);
+	handler->callback(context, type, handler->user_data);
 
 	return true;
 }
 
 static void next_field(struct hfp_context *context)
 {
-	if (context->data[context->offset] == ',')
+	if (context_char(context, context->offset) == ',')
 		context->offset++;
 }
 
@@ -280,7 +503,7 @@ bool hfp_context_get_number_default(struct hfp_context *context,
 {
 	skip_whitespace(context);
 
-	if (context->data[context->offset] == ',') {
+	if (context_char(context, context->offset) == ',') {
 		if (val)
 			*val = default_val;
 
@@ -296,13 +519,15 @@ bool hfp_context_get_number(struct hfp_context *context,
 {
 	unsigned int i;
 	int tmp = 0;
+	char c;
 
 	skip_whitespace(context);
 
 	i = context->offset;
 
-	while (context->data[i] >= '0' && context->data[i] <= '9')
-		tmp = tmp * 10 + context->data[i++] - '0';
+	for (c = context_char(context, i); c >= '0' && c <= '9';
+						c = context_char(context, ++i))
+		tmp = tmp * 10 + c - '0';
 
 	if (i == context->offset)
 		return false;
@@ -322,7 +547,7 @@ bool hfp_context_open_container(struct hfp_context *context)
 	skip_whitespace(context);
 
 	/* The list shall be preceded by a left parenthesis "(") */
-	if (context->data[context->offset] != '(')
+	if (context_char(context, context->offset) != '(')
 		return false;
 
 	context->offset++;
@@ -335,7 +560,7 @@ bool hfp_context_close_container(struct hfp_context *context)
 	skip_whitespace(context);
 
 	/* The list shall be followed by a right parenthesis (")" V250 5.7.3.1*/
-	if (context->data[context->offset] != ')')
+	if (context_char(context, context->offset) != ')')
 		return false;
 
 	context->offset++;
@@ -349,23 +574,23 @@ bool hfp_context_get_string(struct hfp_context *context, char *buf,
 								uint8_t len)
 {
 	int i = 0;
-	const char *data = context->data;
 	unsigned int offset;
+	char c;
 
 	skip_whitespace(context);
 
-	if (data[context->offset] != '"')
+	if (context_char(context, context->offset) != '"')
 		return false;
 
 	offset = context->offset;
 	offset++;
 
-	while (data[offset] != '\0' && data[offset] != '"') {
+	for (c = context_char(context, offset); c != '\0' && c != '"';
+					c = context_char(context, ++offset)) {
 		if (i == len)
 			return false;
 
-		buf[i++] = data[offset];
-		offset++;
+		buf[i++] = c;
 	}
 
 	if (i == len)
@@ -373,7 +598,7 @@ bool hfp_context_get_string(struct hfp_context *context, char *buf,
 
 	buf[i] = '\0';
 
-	if (data[offset] == '"')
+	if (c == '"')
 		offset++;
 	else
 		return false;
@@ -389,26 +614,24 @@ bool hfp_context_get_string(struct hfp_context *context, char *buf,
 bool hfp_context_get_unquoted_string(struct hfp_context *context,
 							char *buf, uint8_t len)
 {
-	const char *data = context->data;
 	unsigned int offset;
 	int i = 0;
 	char c;
 
 	skip_whitespace(context);
 
-	c = data[context->offset];
+	c = context_char(context, context->offset);
 	if (c == '"' || c == ')' || c == '(')
 		return false;
 
 	offset = context->offset;
 
-	while (data[offset] != '\0' && data[offset] != ',' &&
-							data[offset] != ')') {
+	for (; c != '\0' && c != ',' && c != ')';
+					c = context_char(context, ++offset)) {
 		if (i == len)
 			return false;
 
-		buf[i++] = data[offset];
-		offset++;
+		buf[i++] = c;
 	}
 
 	if (i == len)
@@ -425,16 +648,17 @@ bool hfp_context_get_unquoted_string(struct hfp_context *context,
 
 bool hfp_context_has_next(struct hfp_context *context)
 {
-	return context->data[context->offset] != '\0';
+	return context_char(context, context->offset) != '\0';
 }
 
 void hfp_context_skip_field(struct hfp_context *context)
 {
-	const char *data = context->data;
 	unsigned int offset = context->offset;
+	char c;
 
-	while (data[offset] != '\0' && data[offset] != ',')
-		offset++;
+	for (c = context_char(context, offset); c != '\0' && c != ',';
+					c = context_char(context, ++offset))
+		;
 
 	context->offset = offset;
 	next_field(context);
@@ -451,7 +675,7 @@ bool hfp_context_get_range(struct hfp_context *context, uint32_t *min,
 	if (!hfp_context_get_number(context, &l))
 		goto failed;
 
-	if (context->data[context->offset] != '-')
+	if (context_char(context, context->offset) != '-')
 		goto failed;
 
 	context->offset++;
@@ -473,9 +697,9 @@ failed:
 
 static void process_input(struct hfp_gw *hfp)
 {
-	char *str, *ptr;
-	size_t len, count;
-	bool free_ptr = false;
+	struct hfp_context context;
+	char *str, *str2, *ptr;
+	size_t len, len2, count;
 	bool read_again;
 
 	do {
@@ -484,10 +708,10 @@ static void process_input(struct hfp_gw *hfp)
 			return;
 
 		ptr = memchr(str, '\r', len);
-		if (!ptr) {
-			char *str2;
-			size_t len2;
-
+		if (ptr) {
+			count = ptr - str;
+			context_init(&context, str, count, NULL, 0);
+		} else {
 			/*
 			 * If there is no more data in ringbuffer,
 			 * it's just an incomplete command.
@@ -503,24 +727,15 @@ static void process_input(struct hfp_gw *hfp)
 			if (!ptr)
 				return;
 
-			*ptr = '\0';
-
-			count = len2 + len;
-			ptr = malloc(count);
-			if (!ptr)
-				return;
-
-			memcpy(ptr, str, len);
-			memcpy(ptr + len, str2, len2);
-
-			free_ptr = true;
-			str = ptr;
-		} else {
-			count = ptr - str;
-			*ptr = '\0';
+			/* Parse the wrapped command from both segments */
+			count = len + (ptr - str2);
+			context_init(&context, str, len, str2, ptr - str2);
 		}
 
-		if (!handle_at_command(hfp, str))
+		/* Keep unknown commands NUL terminated for the upper layer */
+		*ptr = '\0';
+
+		if (!handle_at_command(hfp, &context))
 			/*
 			 * Command is not handled that means that was some
 			 * trash. Let's skip that and keep reading from ring
@@ -538,10 +753,6 @@ static void process_input(struct hfp_gw *hfp)
 			read_again = !hfp->result_pending;
 
 		ringbuf_drain(hfp->read_buf, count + 1);
-
-		if (free_ptr)
-			free(ptr);
-
 	} while (read_again);
 }
 
@@ -580,13 +791,13 @@ struct hfp_gw *hfp_gw_new(int fd)
 	hfp->fd = fd;
 	hfp->close_on_unref = false;
 
-	hfp->read_buf = ringbuf_new(4096);
+	hfp->read_buf = ringbuf_new(HFP_BUF_SIZE);
 	if (!hfp->read_buf) {
 		free(hfp);
 		return NULL;
 	}
 
-	hfp->write_buf = ringbuf_new(4096);
+	hfp->write_buf = ringbuf_new(HFP_BUF_SIZE);
 	if (!hfp->write_buf) {
 		ringbuf_free(hfp->read_buf);
 		free(hfp);
@@ -601,19 +812,8 @@ struct hfp_gw *hfp_gw_new(int fd)
 		return NULL;
 	}
 
-	hfp->cmd_handlers = queue_new();
-	if (!hfp->cmd_handlers) {
-		io_destroy(hfp->io);
-		ringbuf_free(hfp->write_buf);
-		ringbuf_free(hfp->read_buf);
-		free(hfp);
-		return NULL;
-	}
-
 	if (!io_set_read_handler(hfp->io, can_read_data,
 					hfp, read_watch_destroy)) {
-		queue_destroy(hfp->cmd_handlers,
-						destroy_cmd_handler);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -665,8 +865,7 @@ void hfp_gw_unref(struct hfp_gw *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->cmd_handlers, destroy_cmd_handler);
-	hfp->cmd_handlers = NULL;
+	prefix_table_clear(&hfp->cmd_handlers, destroy_cmd_handler);
 
 	if (!hfp->in_disconnect) {
 		free(hfp);
@@ -758,11 +957,11 @@ bool hfp_gw_send_result(struct hfp_gw *hfp, enum hfp_result result)
 
 	/*
 	 * There might be already something to read in the ring buffer.
-	 * If so, let's read it.
+	 * If so, let's parse it, new data is picked up by the read handler.
 	 */
 	if (hfp->result_pending) {
 		hfp->result_pending = false;
-		can_read_data(hfp->io, hfp);
+		process_input(hfp);
 	}
 
 	return true;
@@ -778,7 +977,10 @@ bool hfp_gw_send_error(struct hfp_gw *hfp, enum hfp_error error)
 
 	wakeup_writer(hfp);
 
-	hfp->result_pending = false;
+	if (hfp->result_pending) {
+		hfp->result_pending = false;
+		process_input(hfp);
+	}
 
 	return true;
 }
@@ -786,20 +988,23 @@ bool hfp_gw_send_error(struct hfp_gw *hfp, enum hfp_error error)
 bool hfp_gw_send_info(struct hfp_gw *hfp, const char *format, ...)
 {
 	va_list ap;
+	char buf[HFP_FORMAT_MAX];
 	char *fmt;
 	int len;
 
 	if (!hfp || !format)
 		return false;
 
-	if (asprintf(&fmt, "\r\n%s\r\n", format) < 0)
+	fmt = format_line(buf, "\r\n", format, "\r\n");
+	if (!fmt)
 		return false;
 
 	va_start(ap, format);
 	len = ringbuf_vprintf(hfp->write_buf, fmt, ap);
 	va_end(ap);
 
-	free(fmt);
+	if (fmt != buf)
+		free(fmt);
 
 	if (len < 0)
 		return false;
@@ -849,30 +1054,22 @@ bool hfp_gw_register(struct hfp_gw *hfp, hfp_result_func_t callback,
 		return false;
 	}
 
-	if (queue_find(hfp->cmd_handlers, match_handler_prefix,
-							handler->prefix)) {
+	if (!prefix_table_insert(&hfp->cmd_handlers, handler->prefix,
+								handler)) {
 		destroy_cmd_handler(handler);
 		return false;
 	}
 
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->cmd_handlers, handler);
+	return true;
 }
 
 bool hfp_gw_unregister(struct hfp_gw *hfp, const char *prefix)
 {
 	struct cmd_handler *handler;
-	char *lookup_prefix;
-
-	lookup_prefix = strdup(prefix);
-	if (!lookup_prefix)
-		return false;
-
-	handler = queue_remove_if(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
-	free(lookup_prefix);
 
+	handler = prefix_table_remove(&hfp->cmd_handlers, prefix);
 	if (!handler)
 		return false;
 
@@ -940,17 +1137,6 @@ bool hfp_gw_disconnect(struct hfp_gw *hfp)
 	return io_shutdown(hfp->io);
 }
 
-static bool match_handler_event_prefix(const void *a, const void *b)
-{
-	const struct event_handler *handler = a;
-	const char *prefix = b;
-
-	if (strcmp(handler->prefix, prefix) != 0)
-		return false;
-
-	return true;
-}
-
 static void destroy_event_handler(void *data)
 {
 	struct event_handler *handler = data;
@@ -987,75 +1173,59 @@ static void hf_write_watch_destroy(void *user_data)
 
 static void hf_skip_whitespace(struct hfp_context *context)
 {
-	while (context->data[context->offset] == ' ')
+	while (context_char(context, context->offset) == ' ')
 		context->offset++;
 }
 
-static bool is_response(const char *prefix, enum hfp_result *result,
-						enum hfp_error *cme_err,
-						struct hfp_context *context)
-{
-	if (strcmp(prefix, "OK") == 0) {
-		*result = HFP_RESULT_OK;
-		/*
-		 * Set cme_err to 0 as this is not valid when result is not
-		 * CME ERROR
-		 */
-		*cme_err = 0;
-		return true;
-	}
-
-	if (strcmp(prefix, "ERROR") == 0) {
-		*result = HFP_RESULT_ERROR;
-		*cme_err = 0;
-		return true;
-	}
+static const struct {
+	const char *prefix;
+	enum hfp_result result;
+} responses[] = {
+	{ "OK",			HFP_RESULT_OK		},
+	{ "ERROR",		HFP_RESULT_ERROR	},
+	{ "NO CARRIER",		HFP_RESULT_NO_CARRIER	},
+	{ "NO ANSWER",		HFP_RESULT_NO_ANSWER	},
+	{ "BUSY",		HFP_RESULT_BUSY		},
+	{ "DELAYED",		HFP_RESULT_DELAYED	},
+	{ "BLACKLISTED",	HFP_RESULT_BLACKLISTED	},
+	{ "+CME ERROR",		HFP_RESULT_CME_ERROR	},
+	{ }
+};
 
-	if (strcmp(prefix, "NO CARRIER") == 0) {
-		*result = HFP_RESULT_NO_CARRIER;
-		*cme_err = 0;
-		return true;
-	}
+static bool is_response(struct hfp_context *context, unsigned int prefix,
+				unsigned int pref_len, enum hfp_result *result,
+				enum hfp_error *cme_err)
+{
+	unsigned int i;
+	uint32_t val;
 
-	if (strcmp(prefix, "NO ANSWER") == 0) {
-		*result = HFP_RESULT_NO_ANSWER;
-		*cme_err = 0;
-		return true;
+	for (i = 0; responses[i].prefix; i++) {
+		if (!prefix_cmp(context, prefix, pref_len, true,
+						responses[i].prefix))
+			break;
 	}
 
-	if (strcmp(prefix, "BUSY") == 0) {
-		*result = HFP_RESULT_BUSY;
-		*cme_err = 0;
-		return true;
-	}
+	if (!responses[i].prefix)
+		return false;
 
-	if (strcmp(prefix, "DELAYED") == 0) {
-		*result = HFP_RESULT_DELAYED;
-		*cme_err = 0;
-		return true;
-	}
+	*result = responses[i].result;
 
-	if (strcmp(prefix, "BLACKLISTED") == 0) {
-		*result = HFP_RESULT_BLACKLISTED;
+	/*
+	 * Set cme_err to 0 as this is not valid when result is not
+	 * CME ERROR
+	 */
+	if (*result != HFP_RESULT_CME_ERROR) {
 		*cme_err = 0;
 		return true;
 	}
 
-	if (strcmp(prefix, "+CME ERROR") == 0) {
-		uint32_t val;
-
-		*result = HFP_RESULT_CME_ERROR;
-
-		if (hfp_context_get_number(context, &val) &&
-					val <= HFP_ERROR_NETWORK_NOT_ALLOWED)
-			*cme_err = val;
-		else
-			*cme_err = HFP_ERROR_AG_FAILURE;
-
-		return true;
-	}
+	if (hfp_context_get_number(context, &val) &&
+				val <= HFP_ERROR_NETWORK_NOT_ALLOWED)
+		*cme_err = val;
+	else
+		*cme_err = HFP_ERROR_AG_FAILURE;
 
-	return false;
+	return true;
 }
 
 static void hf_wakeup_writer(struct hfp_hf *hfp)
@@ -1073,39 +1243,35 @@ static void hf_wakeup_writer(struct hfp_hf *hfp)
 	hfp->writer_active = true;
 }
 
-static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
+static void hf_call_prefix_handler(struct hfp_hf *hfp,
+						struct hfp_context *context)
 {
 	struct event_handler *handler;
-	const char *separators = ";:\0";
-	struct hfp_context context;
 	enum hfp_result result;
 	enum hfp_error cme_err;
-	char lookup_prefix[18];
-	uint8_t pref_len = 0;
-	const char *prefix;
-	int i;
-
-	context.offset = 0;
-	context.data = data;
+	unsigned int prefix, pref_len;
+	char c;
 
-	hf_skip_whitespace(&context);
+	hf_skip_whitespace(context);
 
-	if (strlen(data + context.offset) < 2)
+	if (!context_char(context, context->offset) ||
+				!context_char(context, context->offset + 1))
 		return;
 
-	prefix = data + context.offset;
+	prefix = context->offset;
 
-	pref_len = strcspn(prefix, separators);
-	if (pref_len > 17 || pref_len < 2)
-		return;
+	for (pref_len = 0; pref_len <= HFP_PREFIX_MAX; pref_len++) {
+		c = context_char(context, prefix + pref_len);
+		if (c == ';' || c == ':' || c == '\0')
+			break;
+	}
 
-	for (i = 0; i < pref_len; i++)
-		lookup_prefix[i] = toupper(prefix[i]);
+	if (pref_len > HFP_PREFIX_MAX || pref_len < 2)
+		return;
 
-	lookup_prefix[pref_len] = '\0';
-	context.offset += pref_len + 1;
+	context->offset += pref_len + 1;
 
-	if (is_response(lookup_prefix, &result, &cme_err, &context)) {
+	if (is_response(context, prefix, pref_len, &result, &cme_err)) {
 		struct cmd_response *cmd;
 
 		cmd = queue_peek_head(hfp->cmd_queue);
@@ -1121,116 +1287,93 @@ static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
 		return;
 	}
 
-	handler = queue_find(hfp->event_handlers, match_handler_event_prefix,
-								lookup_prefix);
+	handler = prefix_table_lookup(&hfp->event_handlers, context, prefix,
+								pref_len);
 	if (!handler)
 		return;
 
-	handler->callback(&context, handler->user_data);
+	handler->callback(context, handler->user_data);
 }
 
-static char *find_cr_lf(char *str, size_t len)
+/* Find the next <cr><lf> at or after offset across both ring segments */
+static bool find_cr_lf(const struct hfp_context *input, unsigned int offset,
+							unsigned int *pos)
 {
-	char *ptr;
-	size_t count, offset;
-
-	offset = 0;
+	unsigned int total = input->len + input->len2;
+	const char *ptr;
+
+	while (offset + 1 < total) {
+		if (offset < input->len) {
+			ptr = memchr(input->data + offset, '\r',
+						input->len - offset);
+			if (!ptr) {
+				offset = input->len;
+				continue;
+			}
+
+			offset = ptr - input->data;
+		} else {
+			unsigned int off2 = offset - input->len;
 
-	ptr = memchr(str, '\r', len);
-	while (ptr) {
-		/*
-		 * Check if there is more data after '\r'. If so check for
-		 * '\n'
-		 */
-		count = ptr - str;
-		if ((count < (len - 1)) && *(ptr + 1) == '\n')
-			return ptr;
+			ptr = memchr(input->data2 + off2, '\r',
+						input->len2 - off2);
+			if (!ptr)
+				return false;
 
-		/* There is only '\r'? Let's try to find next one */
-		offset += count + 1;
+			offset = input->len + (ptr - input->data2);
+		}
 
-		if (offset >= len)
-			return NULL;
+		if (context_char(input, offset + 1) == '\n') {
+			*pos = offset;
+			return true;
+		}
 
-		ptr = memchr(str + offset, '\r', len - offset);
+		/* There is only '\r'? Let's try to find next one */
+		offset++;
 	}
 
-	return NULL;
+	return false;
 }
 
 static void hf_process_input(struct hfp_hf *hfp)
 {
-	char *str, *ptr, *str2, *tmp;
-	size_t len, count, offset, len2;
-	bool free_tmp = false;
+	struct hfp_context input, line;
+	char *str, *str2 = NULL;
+	size_t len, len2 = 0;
+	unsigned int offset = 0, pos;
 
 	str = ringbuf_peek(hfp->read_buf, 0, &len);
 	if (!str)
 		return;
 
-	offset = 0;
+	/* Data might wrap in ring buffer, parse both parts in place */
+	if (len < ringbuf_len(hfp->read_buf))
+		str2 = ringbuf_peek(hfp->read_buf, len, &len2);
 
-	ptr = find_cr_lf(str, len);
-	while (ptr) {
-		count = ptr - (str + offset);
-		if (count == 0) {
+	context_init(&input, str, len, str2, len2);
+
+	while (find_cr_lf(&input, offset, &pos)) {
+		if (pos == offset) {
 			/* 2 is for <cr><lf> */
 			offset += 2;
-		} else {
-			*ptr = '\0';
-			hf_call_prefix_handler(hfp, str + offset);
-			offset += count + 2;
+			continue;
 		}
 
-		ptr = find_cr_lf(str + offset, len - offset);
-	}
-
-	/*
-	 * Just check if there is no wrapped data in ring buffer.
-	 * Should not happen too often
-	 */
-	if (len == ringbuf_len(hfp->read_buf))
-		goto done;
-
-	str2 = ringbuf_peek(hfp->read_buf, len, &len2);
-	if (!str2)
-		goto done;
-
-	ptr = find_cr_lf(str2, len2);
-	if (!ptr) {
-		/* Might happen that we wrap between \r and \n */
-		ptr = memchr(str2, '\n', len2);
-		if (!ptr)
-			goto done;
-	}
-
-	count = ptr - str2;
-
-	if (count) {
-		*ptr = '\0';
-
-		tmp = malloc(len + count);
-		if (!tmp)
-			goto done;
-
-		/* "str" here is not a string so we need to use memcpy */
-		memcpy(tmp, str, len);
-		memcpy(tmp + len, str2, count);
+		if (offset >= len)
+			context_init(&line, str2 + offset - len, pos - offset,
+								NULL, 0);
+		else if (pos <= len)
+			context_init(&line, str + offset, pos - offset,
+								NULL, 0);
+		else
+			context_init(&line, str + offset, len - offset,
+							str2, pos - len);
 
-		free_tmp = true;
-	} else {
-		str[len-1] = '\0';
-		tmp = str;
+		hf_call_prefix_handler(hfp, &line);
+		offset = pos + 2;
 	}
 
-	hf_call_prefix_handler(hfp, tmp);
-	offset += count;
-
-done:
 	ringbuf_drain(hfp->read_buf, offset);
-
-	if (free_tmp)
-		free(tmp);
 }
 
 static bool hf_can_read_data(struct io *io, void *user_data)
@@ -1261,13 +1404,13 @@ struct hfp_hf *hfp_hf_new(int fd)
 	hfp->fd = fd;
 	hfp->close_on_unref = false;
 
-	hfp->read_buf = ringbuf_new(4096);
+	hfp->read_buf = ringbuf_new(HFP_BUF_SIZE);
 	if (!hfp->read_buf) {
 		free(hfp);
 		return NULL;
 	}
 
-	hfp->write_buf = ringbuf_new(4096);
+	hfp->write_buf = ringbuf_new(HFP_BUF_SIZE);
 	if (!hfp->write_buf) {
 		ringbuf_free(hfp->read_buf);
 		free(hfp);
@@ -1282,21 +1425,11 @@ struct hfp_hf *hfp_hf_new(int fd)
 		return NULL;
 	}
 
-	hfp->event_handlers = queue_new();
-	if (!hfp->event_handlers) {
-		io_destroy(hfp->io);
-		ringbuf_free(hfp->write_buf);
-		ringbuf_free(hfp->read_buf);
-		free(hfp);
-		return NULL;
-	}
-
 	hfp->cmd_queue = queue_new();
 	if (!hfp->cmd_queue) {
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
-		queue_destroy(hfp->event_handlers, NULL);
 		free(hfp);
 		return NULL;
 	}
@@ -1305,8 +1438,7 @@ struct hfp_hf *hfp_hf_new(int fd)
 
 	if (!io_set_read_handler(hfp->io, hf_can_read_data, hfp,
 							read_watch_destroy)) {
-		queue_destroy(hfp->event_handlers,
-						destroy_event_handler);
+		queue_destroy(hfp->cmd_queue, NULL);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -1353,8 +1485,7 @@ void hfp_hf_unref(struct hfp_hf *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->event_handlers, destroy_event_handler);
-	hfp->event_handlers = NULL;
+	prefix_table_clear(&hfp->event_handlers, destroy_event_handler);
 
 	queue_destroy(hfp->cmd_queue, free);
 	hfp->cmd_queue = NULL;
@@ -1422,6 +1553,7 @@ bool hfp_hf_send_command(struct hfp_hf *hfp, hfp_response_func_t resp_cb,
 				void *user_data, const char *format, ...)
 {
 	va_list ap;
+	char buf[HFP_FORMAT_MAX];
 	char *fmt;
 	int len;
 	struct cmd_response *cmd;
@@ -1429,12 +1561,13 @@ bool hfp_hf_send_command(struct hfp_hf *hfp, hfp_response_func_t resp_cb,
 	if (!hfp || !format || !resp_cb)
 		return false;
 
-	if (asprintf(&fmt, "%s\r", format) < 0)
+	cmd = new0(struct cmd_response, 1);
+	if (!cmd)
 		return false;
 
-	cmd = new0(struct cmd_response, 1);
-	if (!cmd) {
-		free(fmt);
+	fmt = format_line(buf, "", format, "\r");
+	if (!fmt) {
+		free(cmd);
 		return false;
 	}
 
@@ -1442,7 +1575,8 @@ bool hfp_hf_send_command(struct hfp_hf *hfp, hfp_response_func_t resp_cb,
 	len = ringbuf_vprintf(hfp->write_buf, fmt, ap);
 	va_end(ap);
 
-	free(fmt);
+	if (fmt != buf)
+		free(fmt);
 
 	if (len < 0) {
 		free(cmd);
@@ -1486,26 +1620,22 @@ bool hfp_hf_register(struct hfp_hf *hfp, hfp_hf_result_func_t callback,
 		return false;
 	}
 
-	if (queue_find(hfp->event_handlers, match_handler_event_prefix,
-							handler->prefix)) {
+	if (!prefix_table_insert(&hfp->event_handlers, handler->prefix,
+								handler)) {
 		destroy_event_handler(handler);
 		return false;
 	}
 
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->event_handlers, handler);
+	return true;
 }
 
 bool hfp_hf_unregister(struct hfp_hf *hfp, const char *prefix)
 {
-	struct cmd_handler *handler;
-
-	/* Cast to void as queue_remove needs that */
-	handler = queue_remove_if(hfp->event_handlers,
-						match_handler_event_prefix,
-						(void *) prefix);
+	struct event_handler *handler;
 
+	handler = prefix_table_remove(&hfp->event_handlers, prefix);
 	if (!handler)
 		return false;
 
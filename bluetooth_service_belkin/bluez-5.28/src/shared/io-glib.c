@@ -33,7 +33,7 @@
 
 struct io_watch {
 	struct io *io;
-	guint id;
+	GSource *source;
 	io_callback_func_t callback;
 	io_destroy_func_t destroy;
 	void *user_data;
@@ -41,6 +41,7 @@ struct io_watch {
 
 struct io {
 	int ref_count;
+	GMainContext *context;
 	GIOChannel *channel;
 	struct io_watch *read_watch;
 	struct io_watch *write_watch;
@@ -65,6 +66,7 @@ static void io_unref(struct io *io)
 	if (__sync_sub_and_fetch(&io->ref_count, 1))
 		return;
 
+	g_main_context_unref(io->context);
 	g_free(io);
 }
 
@@ -79,6 +81,12 @@ struct io *io_new(int fd)
 	if (!io)
 		return NULL;
 
+	/*
+	 * Watches are attached to the main context of the creating thread,
+	 * so an io created from a worker thread's loop is served there.
+	 */
+	io->context = g_main_context_ref_thread_default();
+
 	io->channel = g_io_channel_unix_new(fd);
 
 	g_io_channel_set_encoding(io->channel, NULL, NULL);
@@ -114,17 +122,17 @@ void io_destroy(struct io *io)
 		return;
 
 	if (io->read_watch) {
-		g_source_remove(io->read_watch->id);
+		g_source_destroy(io->read_watch->source);
 		io->read_watch = NULL;
 	}
 
 	if (io->write_watch) {
-		g_source_remove(io->write_watch->id);
+		g_source_destroy(io->write_watch->source);
 		io->write_watch = NULL;
 	}
 
 	if (io->disconnect_watch) {
-		g_source_remove(io->disconnect_watch->id);
+		g_source_destroy(io->disconnect_watch->source);
 		io->disconnect_watch = NULL;
 	}
 
@@ -189,14 +197,14 @@ static struct io_watch *watch_new(struct io *io, GIOCondition cond,
 	watch->destroy = destroy;
 	watch->user_data = user_data;
 
-	watch->id = g_io_add_watch_full(io->channel, G_PRIORITY_DEFAULT,
-						cond | G_IO_ERR | G_IO_NVAL,
-						watch_callback, watch,
-						watch_destroy);
-	if (watch->id == 0) {
-		watch_destroy(watch);
-		return NULL;
-	}
+	watch->source = g_io_create_watch(io->channel,
+						cond | G_IO_ERR | G_IO_NVAL);
+	g_source_set_callback(watch->source, (GSourceFunc) watch_callback,
+							watch, watch_destroy);
+
+	/* The context keeps the source alive until it is destroyed */
+	g_source_attach(watch->source, io->context);
+	g_source_unref(watch->source);
 
 	return watch;
 }
@@ -228,7 +236,7 @@ static bool io_set_handler(struct io *io, GIOCondition cond,
 	}
 
 	if (*watch) {
-		g_source_remove((*watch)->id);
+		g_source_destroy((*watch)->source);
 		*watch = NULL;
 	}
 
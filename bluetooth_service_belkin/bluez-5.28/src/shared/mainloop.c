@@ -0,0 +1,804 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2014  Intel Corporation
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "src/shared/util.h"
+#include "src/shared/mainloop.h"
+
+/* Ready fds handled per epoll_wait() round trip */
+#define MAX_EPOLL_EVENTS 64
+
+#define MAINLOOP_LIST_STEP 64
+
+/*
+ * Loop state is per thread, so worker threads can each run their own
+ * loop with the io and timeouts they create. Signals stay process wide.
+ */
+static __thread int epoll_fd = -1;
+static __thread int epoll_terminate;
+static __thread int exit_status;
+
+struct mainloop_data {
+	int fd;
+	uint32_t events;
+	bool removed;
+	mainloop_event_func callback;
+	mainloop_destroy_func destroy;
+	void *user_data;
+	struct mainloop_data *next_removed;
+};
+
+/* Indexed by fd, grown on demand */
+static __thread struct mainloop_data **mainloop_list;
+static __thread unsigned int mainloop_size;
+
+/*
+ * Entries removed while a batch of events is being dispatched stay
+ * allocated until the batch is done, so later events of the same batch
+ * never point at freed memory.
+ */
+static __thread bool dispatching;
+static __thread struct mainloop_data *removed_list;
+
+/*
+ * All timeouts share one timerfd armed for the earliest expiry, with
+ * the pending timeouts kept in a binary min-heap. Ids combine a slot
+ * with a generation so a stale id never removes a newer timeout.
+ */
+#define TIMEOUT_SLOT_BITS	16
+#define TIMEOUT_SLOT_MASK	((1U << TIMEOUT_SLOT_BITS) - 1)
+#define TIMEOUT_GEN_MASK	0x7fff
+#define TIMEOUT_NONE		UINT32_MAX
+
+#define TIMEOUT_IDLE		0
+#define TIMEOUT_QUEUED		1
+#define TIMEOUT_DUE		2
+
+struct timeout_data {
+	int id;
+	int state;
+	unsigned int index;
+	uint64_t expires;
+	mainloop_timeout_func callback;
+	mainloop_destroy_func destroy;
+	void *user_data;
+	struct timeout_data *next_due;
+};
+
+struct timeout_slot {
+	struct timeout_data *data;
+	unsigned int generation;
+	unsigned int next_free;
+};
+
+static __thread int timer_fd = -1;
+static __thread uint64_t timer_armed = UINT64_MAX;
+
+static __thread struct timeout_data **timeout_heap;
+static __thread unsigned int timeout_heap_len;
+static __thread unsigned int timeout_heap_size;
+
+static __thread struct timeout_slot *timeout_slots;
+static __thread unsigned int timeout_slots_size;
+static __thread unsigned int timeout_free = TIMEOUT_NONE;
+
+struct signal_data {
+	int fd;
+	sigset_t mask;
+	mainloop_signal_func callback;
+	mainloop_destroy_func destroy;
+	void *user_data;
+};
+
+static struct signal_data *signal_data;
+
+static void timeout_cleanup(void);
+
+static void free_removed(void)
+{
+	while (removed_list) {
+		struct mainloop_data *data = removed_list;
+
+		removed_list = data->next_removed;
+		free(data);
+	}
+}
+
+void mainloop_init(void)
+{
+	if (epoll_fd < 0)
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	epoll_terminate = 0;
+}
+
+void mainloop_quit(void)
+{
+	epoll_terminate = 1;
+}
+
+void mainloop_exit_success(void)
+{
+	exit_status = EXIT_SUCCESS;
+	epoll_terminate = 1;
+}
+
+void mainloop_exit_failure(void)
+{
+	exit_status = EXIT_FAILURE;
+	epoll_terminate = 1;
+}
+
+static void signal_callback(int fd, uint32_t events, void *user_data)
+{
+	struct signal_data *data = user_data;
+	struct signalfd_siginfo si;
+	ssize_t result;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		mainloop_quit();
+		return;
+	}
+
+	result = read(fd, &si, sizeof(si));
+	if (result != sizeof(si))
+		return;
+
+	if (data->callback)
+		data->callback(si.ssi_signo, data->user_data);
+}
+
+static void signal_destroy(void *user_data)
+{
+	struct signal_data *data = user_data;
+
+	close(data->fd);
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	if (signal_data == data)
+		signal_data = NULL;
+
+	free(data);
+}
+
+int mainloop_run(void)
+{
+	unsigned int i;
+
+	mainloop_init();
+
+	if (epoll_fd < 0)
+		return EXIT_FAILURE;
+
+	exit_status = EXIT_SUCCESS;
+
+	while (!epoll_terminate) {
+		struct epoll_event events[MAX_EPOLL_EVENTS];
+		int n, nfds;
+
+		nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+		if (nfds < 0)
+			continue;
+
+		dispatching = true;
+
+		for (n = 0; n < nfds; n++) {
+			struct mainloop_data *data = events[n].data.ptr;
+
+			if (data->removed)
+				continue;
+
+			data->callback(data->fd, events[n].events,
+							data->user_data);
+		}
+
+		dispatching = false;
+
+		free_removed();
+	}
+
+	for (i = 0; i < mainloop_size; i++) {
+		if (mainloop_list[i])
+			mainloop_remove_fd(i);
+	}
+
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_size = 0;
+
+	timeout_cleanup();
+
+	close(epoll_fd);
+	epoll_fd = -1;
+
+	return exit_status;
+}
+
+static int grow_list(int fd)
+{
+	struct mainloop_data **list;
+	unsigned int size;
+
+	size = (fd / MAINLOOP_LIST_STEP + 1) * MAINLOOP_LIST_STEP;
+
+	list = realloc(mainloop_list, size * sizeof(*list));
+	if (!list)
+		return -ENOMEM;
+
+	memset(list + mainloop_size, 0,
+				(size - mainloop_size) * sizeof(*list));
+
+	mainloop_list = list;
+	mainloop_size = size;
+
+	return 0;
+}
+
+int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
+				void *user_data, mainloop_destroy_func destroy)
+{
+	struct mainloop_data *data;
+	struct epoll_event ev;
+	int err;
+
+	if (fd < 0 || !callback)
+		return -EINVAL;
+
+	mainloop_init();
+
+	if (epoll_fd < 0)
+		return -EIO;
+
+	if ((unsigned int) fd >= mainloop_size) {
+		err = grow_list(fd);
+		if (err < 0)
+			return err;
+	}
+
+	if (mainloop_list[fd])
+		return -EEXIST;
+
+	data = new0(struct mainloop_data, 1);
+	if (!data)
+		return -ENOMEM;
+
+	data->fd = fd;
+	data->events = events;
+	data->callback = callback;
+	data->destroy = destroy;
+	data->user_data = user_data;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = data;
+
+	err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, data->fd, &ev);
+	if (err < 0) {
+		err = -errno;
+		free(data);
+		return err;
+	}
+
+	mainloop_list[fd] = data;
+
+	return 0;
+}
+
+int mainloop_modify_fd(int fd, uint32_t events)
+{
+	struct mainloop_data *data;
+	struct epoll_event ev;
+
+	if (fd < 0 || (unsigned int) fd >= mainloop_size)
+		return -EINVAL;
+
+	data = mainloop_list[fd];
+	if (!data)
+		return -ENXIO;
+
+	/* Writer toggles often ask for what is already registered */
+	if (data->events == events)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = data;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, data->fd, &ev) < 0)
+		return -errno;
+
+	data->events = events;
+
+	return 0;
+}
+
+int mainloop_remove_fd(int fd)
+{
+	struct mainloop_data *data;
+	int err;
+
+	if (fd < 0 || (unsigned int) fd >= mainloop_size)
+		return -EINVAL;
+
+	data = mainloop_list[fd];
+	if (!data)
+		return -ENXIO;
+
+	mainloop_list[fd] = NULL;
+
+	err = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, data->fd, NULL);
+
+	data->removed = true;
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	if (dispatching) {
+		data->next_removed = removed_list;
+		removed_list = data;
+	} else
+		free(data);
+
+	return err < 0 ? -errno : 0;
+}
+
+static uint64_t timeout_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void heap_set(unsigned int index, struct timeout_data *data)
+{
+	timeout_heap[index] = data;
+	data->index = index;
+}
+
+static void heap_up(unsigned int index)
+{
+	struct timeout_data *data = timeout_heap[index];
+
+	while (index > 0) {
+		unsigned int parent = (index - 1) / 2;
+
+		if (timeout_heap[parent]->expires <= data->expires)
+			break;
+
+		heap_set(index, timeout_heap[parent]);
+		index = parent;
+	}
+
+	heap_set(index, data);
+}
+
+static void heap_down(unsigned int index)
+{
+	struct timeout_data *data = timeout_heap[index];
+
+	while (1) {
+		unsigned int child = index * 2 + 1;
+
+		if (child >= timeout_heap_len)
+			break;
+
+		if (child + 1 < timeout_heap_len &&
+				timeout_heap[child + 1]->expires <
+						timeout_heap[child]->expires)
+			child++;
+
+		if (data->expires <= timeout_heap[child]->expires)
+			break;
+
+		heap_set(index, timeout_heap[child]);
+		index = child;
+	}
+
+	heap_set(index, data);
+}
+
+static int heap_push(struct timeout_data *data)
+{
+	if (timeout_heap_len == timeout_heap_size) {
+		struct timeout_data **heap;
+		unsigned int size;
+
+		size = timeout_heap_size ? timeout_heap_size * 2 : 64;
+
+		heap = realloc(timeout_heap, size * sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+
+		timeout_heap = heap;
+		timeout_heap_size = size;
+	}
+
+	heap_set(timeout_heap_len++, data);
+	heap_up(data->index);
+
+	data->state = TIMEOUT_QUEUED;
+
+	return 0;
+}
+
+static void heap_remove(struct timeout_data *data)
+{
+	unsigned int index = data->index;
+	struct timeout_data *last = timeout_heap[--timeout_heap_len];
+
+	data->state = TIMEOUT_IDLE;
+
+	if (last == data)
+		return;
+
+	heap_set(index, last);
+
+	if (index > 0 && timeout_heap[(index - 1) / 2]->expires >
+								last->expires)
+		heap_up(index);
+	else
+		heap_down(index);
+}
+
+/*
+ * Only ever move the timerfd earlier. When the earliest timeout goes
+ * away the timer is left as is and the spurious wakeup rearms it.
+ */
+static void timer_arm(void)
+{
+	struct itimerspec itimer;
+	uint64_t expires;
+
+	if (!timeout_heap_len)
+		return;
+
+	expires = timeout_heap[0]->expires;
+	if (expires >= timer_armed)
+		return;
+
+	memset(&itimer, 0, sizeof(itimer));
+	itimer.it_value.tv_sec = expires / 1000;
+	itimer.it_value.tv_nsec = (expires % 1000) * 1000000;
+
+	/* An all zero value would disarm the timer */
+	if (!itimer.it_value.tv_sec && !itimer.it_value.tv_nsec)
+		itimer.it_value.tv_nsec = 1;
+
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &itimer, NULL) < 0)
+		return;
+
+	timer_armed = expires;
+}
+
+static void timer_callback(int fd, uint32_t events, void *user_data)
+{
+	struct timeout_data *due = NULL, **tail = &due;
+	uint64_t expired, now;
+
+	if (read(fd, &expired, sizeof(expired)) < 0 && errno != EAGAIN)
+		return;
+
+	timer_armed = UINT64_MAX;
+	now = timeout_now();
+
+	/* Collect first so timeouts rearmed with no delay wait a round */
+	while (timeout_heap_len && timeout_heap[0]->expires <= now) {
+		struct timeout_data *data = timeout_heap[0];
+
+		heap_remove(data);
+		data->state = TIMEOUT_DUE;
+		data->next_due = NULL;
+
+		*tail = data;
+		tail = &data->next_due;
+	}
+
+	while (due) {
+		struct timeout_data *data = due;
+
+		due = data->next_due;
+
+		/* Removed by an earlier callback of this round */
+		if (!data->callback) {
+			free(data);
+			continue;
+		}
+
+		/* Rearmed by an earlier callback of this round */
+		if (data->state != TIMEOUT_DUE)
+			continue;
+
+		data->state = TIMEOUT_IDLE;
+		data->callback(data->id, data->user_data);
+	}
+
+	timer_arm();
+}
+
+static void timer_destroy(void *user_data)
+{
+	close(timer_fd);
+	timer_fd = -1;
+	timer_armed = UINT64_MAX;
+}
+
+static struct timeout_data *timeout_alloc(void)
+{
+	struct timeout_data *data;
+	struct timeout_slot *slot;
+	unsigned int index;
+
+	if (timeout_free == TIMEOUT_NONE) {
+		struct timeout_slot *slots;
+		unsigned int i, size;
+
+		size = timeout_slots_size ? timeout_slots_size * 2 : 64;
+		if (size > TIMEOUT_SLOT_MASK + 1)
+			return NULL;
+
+		slots = realloc(timeout_slots, size * sizeof(*slots));
+		if (!slots)
+			return NULL;
+
+		for (i = size; i > timeout_slots_size; i--) {
+			slots[i - 1].data = NULL;
+			slots[i - 1].generation = 0;
+			slots[i - 1].next_free = timeout_free;
+			timeout_free = i - 1;
+		}
+
+		timeout_slots = slots;
+		timeout_slots_size = size;
+	}
+
+	data = new0(struct timeout_data, 1);
+	if (!data)
+		return NULL;
+
+	index = timeout_free;
+	slot = &timeout_slots[index];
+	timeout_free = slot->next_free;
+
+	slot->generation = (slot->generation + 1) & TIMEOUT_GEN_MASK;
+	if (!slot->generation)
+		slot->generation = 1;
+
+	slot->data = data;
+	data->id = (slot->generation << TIMEOUT_SLOT_BITS) | index;
+
+	return data;
+}
+
+static struct timeout_data *timeout_lookup(int id)
+{
+	unsigned int index = id & TIMEOUT_SLOT_MASK;
+
+	if (id <= 0 || index >= timeout_slots_size)
+		return NULL;
+
+	if (timeout_slots[index].generation !=
+				(unsigned int) id >> TIMEOUT_SLOT_BITS)
+		return NULL;
+
+	return timeout_slots[index].data;
+}
+
+static void timeout_release(struct timeout_data *data)
+{
+	unsigned int index = data->id & TIMEOUT_SLOT_MASK;
+
+	timeout_slots[index].data = NULL;
+	timeout_slots[index].next_free = timeout_free;
+	timeout_free = index;
+}
+
+static void timeout_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < timeout_slots_size; i++) {
+		struct timeout_data *data = timeout_slots[i].data;
+
+		if (!data)
+			continue;
+
+		timeout_release(data);
+
+		if (data->destroy)
+			data->destroy(data->user_data);
+
+		free(data);
+	}
+
+	/* Shard threads run a loop each, give the tables back on exit */
+	free(timeout_heap);
+	timeout_heap = NULL;
+	timeout_heap_len = 0;
+	timeout_heap_size = 0;
+
+	free(timeout_slots);
+	timeout_slots = NULL;
+	timeout_slots_size = 0;
+	timeout_free = TIMEOUT_NONE;
+}
+
+int mainloop_add_timeout(unsigned int msec, mainloop_timeout_func callback,
+				void *user_data, mainloop_destroy_func destroy)
+{
+	struct timeout_data *data;
+	int err;
+
+	if (!callback)
+		return -EINVAL;
+
+	if (timer_fd < 0) {
+		timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timer_fd < 0)
+			return -errno;
+
+		err = mainloop_add_fd(timer_fd, EPOLLIN, timer_callback,
+							NULL, timer_destroy);
+		if (err < 0) {
+			close(timer_fd);
+			timer_fd = -1;
+			return err;
+		}
+	}
+
+	data = timeout_alloc();
+	if (!data)
+		return -ENOMEM;
+
+	data->callback = callback;
+	data->destroy = destroy;
+	data->user_data = user_data;
+	data->expires = timeout_now() + msec;
+
+	err = heap_push(data);
+	if (err < 0) {
+		timeout_release(data);
+		free(data);
+		return err;
+	}
+
+	timer_arm();
+
+	return data->id;
+}
+
+int mainloop_modify_timeout(int id, unsigned int msec)
+{
+	struct timeout_data *data;
+	int err;
+
+	data = timeout_lookup(id);
+	if (!data)
+		return -ENXIO;
+
+	if (data->state == TIMEOUT_QUEUED)
+		heap_remove(data);
+
+	data->expires = timeout_now() + msec;
+
+	err = heap_push(data);
+	if (err < 0)
+		return err;
+
+	timer_arm();
+
+	return 0;
+}
+
+int mainloop_remove_timeout(int id)
+{
+	struct timeout_data *data;
+
+	data = timeout_lookup(id);
+	if (!data)
+		return -ENXIO;
+
+	if (data->state == TIMEOUT_QUEUED)
+		heap_remove(data);
+
+	timeout_release(data);
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	/* Still linked for the current round, freed once reached there */
+	if (data->state == TIMEOUT_DUE) {
+		data->callback = NULL;
+		return 0;
+	}
+
+	free(data);
+
+	return 0;
+}
+
+int mainloop_set_signal(sigset_t *mask, mainloop_signal_func callback,
+				void *user_data, mainloop_destroy_func destroy)
+{
+	struct signal_data *data;
+	int err;
+
+	if (!mask || !callback)
+		return -EINVAL;
+
+	if (signal_data)
+		return -EALREADY;
+
+	data = new0(struct signal_data, 1);
+	if (!data)
+		return -ENOMEM;
+
+	data->callback = callback;
+	data->destroy = destroy;
+	data->user_data = user_data;
+	memcpy(&data->mask, mask, sizeof(sigset_t));
+
+	if (sigprocmask(SIG_BLOCK, mask, NULL) < 0) {
+		err = -errno;
+		free(data);
+		return err;
+	}
+
+	data->fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (data->fd < 0) {
+		err = -errno;
+		free(data);
+		return err;
+	}
+
+	err = mainloop_add_fd(data->fd, EPOLLIN, signal_callback, data,
+							signal_destroy);
+	if (err < 0) {
+		close(data->fd);
+		free(data);
+		return err;
+	}
+
+	signal_data = data;
+
+	return 0;
+}
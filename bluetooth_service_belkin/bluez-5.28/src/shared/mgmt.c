@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/socket.h>
 
 #include "lib/bluetooth.h"
 #include "lib/mgmt.h"
@@ -37,8 +38,22 @@
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
 #include "src/shared/util.h"
+#include "src/shared/trace.h"
 #include "src/shared/mgmt.h"
 
+/*
+ * Events below MGMT_EV_TABLE_SIZE get their own handler list so that
+ * dispatching does not have to walk handlers registered for other events.
+ * Anything above (future kernel events) falls back to notify_list.
+ */
+#define MGMT_EV_TABLE_SIZE	0x40
+
+/* Pending requests are hashed by opcode and controller index */
+#define MGMT_PENDING_BUCKETS	16
+
+/* Upper bound of events processed per read wakeup */
+#define MGMT_READ_BUDGET	32
+
 struct mgmt {
 	int ref_count;
 	int fd;
@@ -47,8 +62,12 @@ struct mgmt {
 	bool writer_active;
 	struct queue *request_queue;
 	struct queue *reply_queue;
-	struct queue *pending_list;
+	struct queue *pending_table[MGMT_PENDING_BUCKETS];
+	unsigned int pending_count;
+	struct queue *notify_table[MGMT_EV_TABLE_SIZE];
 	struct queue *notify_list;
+	uint64_t event_count[MGMT_EV_TABLE_SIZE];
+	uint64_t other_event_count;
 	unsigned int next_request_id;
 	unsigned int next_notify_id;
 	void *buf;
@@ -131,6 +150,60 @@ static bool match_notify_index(const void *a, const void *b)
 	return notify->index == index;
 }
 
+static struct queue **pending_bucket(struct mgmt *mgmt, uint16_t opcode,
+							uint16_t index)
+{
+	return &mgmt->pending_table[(opcode ^ index) % MGMT_PENDING_BUCKETS];
+}
+
+static bool pending_push(struct mgmt *mgmt, struct mgmt_request *request)
+{
+	struct queue **bucket;
+
+	bucket = pending_bucket(mgmt, request->opcode, request->index);
+	if (!*bucket) {
+		*bucket = queue_new();
+		if (!*bucket)
+			return false;
+	}
+
+	if (!queue_push_tail(*bucket, request))
+		return false;
+
+	mgmt->pending_count++;
+
+	return true;
+}
+
+static struct mgmt_request *pending_remove_id(struct mgmt *mgmt,
+							unsigned int id)
+{
+	struct mgmt_request *request;
+	int i;
+
+	for (i = 0; i < MGMT_PENDING_BUCKETS; i++) {
+		request = queue_remove_if(mgmt->pending_table[i],
+					match_request_id, UINT_TO_PTR(id));
+		if (request) {
+			mgmt->pending_count--;
+			return request;
+		}
+	}
+
+	return NULL;
+}
+
+static void pending_remove_all(struct mgmt *mgmt, queue_match_func_t match,
+							void *match_data)
+{
+	int i;
+
+	for (i = 0; i < MGMT_PENDING_BUCKETS; i++)
+		mgmt->pending_count -= queue_remove_all(mgmt->pending_table[i],
+						match, match_data,
+						destroy_request);
+}
+
 static void write_watch_destroy(void *user_data)
 {
 	struct mgmt *mgmt = user_data;
@@ -157,14 +230,18 @@ static bool send_request(struct mgmt *mgmt, struct mgmt_request *request)
 		return false;
 	}
 
-	util_debug(mgmt->debug_callback, mgmt->debug_data,
-				"[0x%04x] command 0x%04x",
-				request->index, request->opcode);
+	TRACE(TRACE_MGMT_CMD, ret, request->opcode, request->index, 0);
 
 	util_hexdump('<', request->buf, ret, mgmt->debug_callback,
 							mgmt->debug_data);
 
-	queue_push_tail(mgmt->pending_list, request);
+	if (!pending_push(mgmt, request)) {
+		if (request->callback)
+			request->callback(MGMT_STATUS_NO_RESOURCES, 0, NULL,
+							request->user_data);
+		destroy_request(request);
+		return false;
+	}
 
 	return true;
 }
@@ -178,7 +255,7 @@ static bool can_write_data(struct io *io, void *user_data)
 	request = queue_pop_head(mgmt->reply_queue);
 	if (!request) {
 		/* only reply commands can jump the queue */
-		if (!queue_isempty(mgmt->pending_list))
+		if (mgmt->pending_count)
 			return false;
 
 		request = queue_pop_head(mgmt->request_queue);
@@ -199,7 +276,7 @@ static bool can_write_data(struct io *io, void *user_data)
 
 static void wakeup_writer(struct mgmt *mgmt)
 {
-	if (!queue_isempty(mgmt->pending_list)) {
+	if (mgmt->pending_count) {
 		/* only queued reply commands trigger wakeup */
 		if (queue_isempty(mgmt->reply_queue))
 			return;
@@ -235,9 +312,11 @@ static void request_complete(struct mgmt *mgmt, uint8_t status,
 	struct opcode_index match = { .opcode = opcode, .index = index };
 	struct mgmt_request *request;
 
-	request = queue_remove_if(mgmt->pending_list,
+	request = queue_remove_if(*pending_bucket(mgmt, opcode, index),
 					match_request_opcode_index, &match);
 	if (request) {
+		mgmt->pending_count--;
+
 		if (request->callback)
 			request->callback(status, length, param,
 							request->user_data);
@@ -276,28 +355,31 @@ static void process_notify(struct mgmt *mgmt, uint16_t event, uint16_t index,
 {
 	struct event_index match = { .event = event, .index = index,
 					.length = length, .param = param };
+	struct queue *queue;
+
+	if (event < MGMT_EV_TABLE_SIZE) {
+		mgmt->event_count[event]++;
+		queue = mgmt->notify_table[event];
+	} else {
+		mgmt->other_event_count++;
+		queue = mgmt->notify_list;
+	}
 
-	queue_foreach(mgmt->notify_list, notify_handler, &match);
+	queue_foreach(queue, notify_handler, &match);
 }
 
-static bool can_read_data(struct io *io, void *user_data)
+static void process_event(struct mgmt *mgmt, ssize_t bytes_read)
 {
-	struct mgmt *mgmt = user_data;
 	struct mgmt_hdr *hdr;
 	struct mgmt_ev_cmd_complete *cc;
 	struct mgmt_ev_cmd_status *cs;
-	ssize_t bytes_read;
 	uint16_t opcode, event, index, length;
 
-	bytes_read = read(mgmt->fd, mgmt->buf, mgmt->len);
-	if (bytes_read < 0)
-		return false;
-
 	util_hexdump('>', mgmt->buf, bytes_read,
 				mgmt->debug_callback, mgmt->debug_data);
 
 	if (bytes_read < MGMT_HDR_SIZE)
-		return true;
+		return;
 
 	hdr = mgmt->buf;
 	event = btohs(hdr->opcode);
@@ -305,18 +387,14 @@ static bool can_read_data(struct io *io, void *user_data)
 	length = btohs(hdr->len);
 
 	if (bytes_read < length + MGMT_HDR_SIZE)
-		return true;
-
-	mgmt_ref(mgmt);
+		return;
 
 	switch (event) {
 	case MGMT_EV_CMD_COMPLETE:
 		cc = mgmt->buf + MGMT_HDR_SIZE;
 		opcode = btohs(cc->opcode);
 
-		util_debug(mgmt->debug_callback, mgmt->debug_data,
-				"[0x%04x] command 0x%04x complete: 0x%02x",
-						index, opcode, cc->status);
+		TRACE(TRACE_MGMT_COMPLETE, length, opcode, index, cc->status);
 
 		request_complete(mgmt, cc->status, opcode, index, length - 3,
 						mgmt->buf + MGMT_HDR_SIZE + 3);
@@ -325,20 +403,47 @@ static bool can_read_data(struct io *io, void *user_data)
 		cs = mgmt->buf + MGMT_HDR_SIZE;
 		opcode = btohs(cs->opcode);
 
-		util_debug(mgmt->debug_callback, mgmt->debug_data,
-				"[0x%04x] command 0x%02x status: 0x%02x",
-						index, opcode, cs->status);
+		TRACE(TRACE_MGMT_STATUS, length, opcode, index, cs->status);
 
 		request_complete(mgmt, cs->status, opcode, index, 0, NULL);
 		break;
 	default:
-		util_debug(mgmt->debug_callback, mgmt->debug_data,
-				"[0x%04x] event 0x%04x", index, event);
+		TRACE(TRACE_MGMT_EVENT, length, event, index, 0);
 
 		process_notify(mgmt, event, index, length,
 						mgmt->buf + MGMT_HDR_SIZE);
 		break;
 	}
+}
+
+static bool can_read_data(struct io *io, void *user_data)
+{
+	struct mgmt *mgmt = user_data;
+	ssize_t bytes_read;
+	int budget = MGMT_READ_BUDGET;
+
+	bytes_read = read(mgmt->fd, mgmt->buf, mgmt->len);
+	if (bytes_read < 0)
+		return false;
+
+	mgmt_ref(mgmt);
+
+	/*
+	 * Events arrive in bursts during discovery, so drain whatever is
+	 * already queued on the socket instead of going back to the main
+	 * loop for each one. Stop once the last user reference is gone.
+	 */
+	while (1) {
+		process_event(mgmt, bytes_read);
+
+		if (--budget == 0 || mgmt->ref_count < 2)
+			break;
+
+		bytes_read = recv(mgmt->fd, mgmt->buf, mgmt->len,
+								MSG_DONTWAIT);
+		if (bytes_read < 0)
+			break;
+	}
 
 	mgmt_unref(mgmt);
 
@@ -390,19 +495,8 @@ struct mgmt *mgmt_new(int fd)
 		return NULL;
 	}
 
-	mgmt->pending_list = queue_new();
-	if (!mgmt->pending_list) {
-		queue_destroy(mgmt->reply_queue, NULL);
-		queue_destroy(mgmt->request_queue, NULL);
-		io_destroy(mgmt->io);
-		free(mgmt->buf);
-		free(mgmt);
-		return NULL;
-	}
-
 	mgmt->notify_list = queue_new();
 	if (!mgmt->notify_list) {
-		queue_destroy(mgmt->pending_list, NULL);
 		queue_destroy(mgmt->reply_queue, NULL);
 		queue_destroy(mgmt->request_queue, NULL);
 		io_destroy(mgmt->io);
@@ -413,7 +507,6 @@ struct mgmt *mgmt_new(int fd)
 
 	if (!io_set_read_handler(mgmt->io, can_read_data, mgmt, NULL)) {
 		queue_destroy(mgmt->notify_list, NULL);
-		queue_destroy(mgmt->pending_list, NULL);
 		queue_destroy(mgmt->reply_queue, NULL);
 		queue_destroy(mgmt->request_queue, NULL);
 		io_destroy(mgmt->io);
@@ -474,6 +567,8 @@ struct mgmt *mgmt_ref(struct mgmt *mgmt)
 
 void mgmt_unref(struct mgmt *mgmt)
 {
+	int i;
+
 	if (!mgmt)
 		return;
 
@@ -501,8 +596,13 @@ void mgmt_unref(struct mgmt *mgmt)
 	free(mgmt->buf);
 	mgmt->buf = NULL;
 
+	for (i = 0; i < MGMT_EV_TABLE_SIZE; i++)
+		queue_destroy(mgmt->notify_table[i], NULL);
+
+	for (i = 0; i < MGMT_PENDING_BUCKETS; i++)
+		queue_destroy(mgmt->pending_table[i], NULL);
+
 	queue_destroy(mgmt->notify_list, NULL);
-	queue_destroy(mgmt->pending_list, NULL);
 	free(mgmt);
 
 	return;
@@ -682,8 +782,7 @@ bool mgmt_cancel(struct mgmt *mgmt, unsigned int id)
 	if (request)
 		goto done;
 
-	request = queue_remove_if(mgmt->pending_list, match_request_id,
-							UINT_TO_PTR(id));
+	request = pending_remove_id(mgmt, id);
 	if (!request)
 		return false;
 
@@ -704,8 +803,7 @@ bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 					UINT_TO_PTR(index), destroy_request);
 	queue_remove_all(mgmt->reply_queue, match_request_index,
 					UINT_TO_PTR(index), destroy_request);
-	queue_remove_all(mgmt->pending_list, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
+	pending_remove_all(mgmt, match_request_index, UINT_TO_PTR(index));
 
 	return true;
 }
@@ -715,7 +813,7 @@ bool mgmt_cancel_all(struct mgmt *mgmt)
 	if (!mgmt)
 		return false;
 
-	queue_remove_all(mgmt->pending_list, NULL, NULL, destroy_request);
+	pending_remove_all(mgmt, NULL, NULL);
 	queue_remove_all(mgmt->reply_queue, NULL, NULL, destroy_request);
 	queue_remove_all(mgmt->request_queue, NULL, NULL, destroy_request);
 
@@ -727,10 +825,21 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 				void *user_data, mgmt_destroy_func_t destroy)
 {
 	struct mgmt_notify *notify;
+	struct queue **queue;
 
 	if (!mgmt || !event)
 		return 0;
 
+	if (event < MGMT_EV_TABLE_SIZE) {
+		queue = &mgmt->notify_table[event];
+		if (!*queue) {
+			*queue = queue_new();
+			if (!*queue)
+				return 0;
+		}
+	} else
+		queue = &mgmt->notify_list;
+
 	notify = new0(struct mgmt_notify, 1);
 	if (!notify)
 		return 0;
@@ -747,7 +856,7 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 
 	notify->id = mgmt->next_notify_id++;
 
-	if (!queue_push_tail(mgmt->notify_list, notify)) {
+	if (!queue_push_tail(*queue, notify)) {
 		free(notify);
 		return 0;
 	}
@@ -758,12 +867,18 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 bool mgmt_unregister(struct mgmt *mgmt, unsigned int id)
 {
 	struct mgmt_notify *notify;
+	int i;
 
 	if (!mgmt || !id)
 		return false;
 
 	notify = queue_remove_if(mgmt->notify_list, match_notify_id,
 							UINT_TO_PTR(id));
+
+	for (i = 0; !notify && i < MGMT_EV_TABLE_SIZE; i++)
+		notify = queue_remove_if(mgmt->notify_table[i],
+					match_notify_id, UINT_TO_PTR(id));
+
 	if (!notify)
 		return false;
 
@@ -773,9 +888,15 @@ bool mgmt_unregister(struct mgmt *mgmt, unsigned int id)
 
 bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index)
 {
+	int i;
+
 	if (!mgmt)
 		return false;
 
+	for (i = 0; i < MGMT_EV_TABLE_SIZE; i++)
+		queue_remove_all(mgmt->notify_table[i], match_notify_index,
+					UINT_TO_PTR(index), destroy_notify);
+
 	queue_remove_all(mgmt->notify_list, match_notify_index,
 					UINT_TO_PTR(index), destroy_notify);
 
@@ -784,10 +905,36 @@ bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index)
 
 bool mgmt_unregister_all(struct mgmt *mgmt)
 {
+	int i;
+
 	if (!mgmt)
 		return false;
 
+	for (i = 0; i < MGMT_EV_TABLE_SIZE; i++)
+		queue_remove_all(mgmt->notify_table[i], NULL, NULL,
+							destroy_notify);
+
 	queue_remove_all(mgmt->notify_list, NULL, NULL, destroy_notify);
 
 	return true;
 }
+
+uint64_t mgmt_get_event_count(struct mgmt *mgmt, uint16_t event)
+{
+	if (!mgmt)
+		return 0;
+
+	if (event < MGMT_EV_TABLE_SIZE)
+		return mgmt->event_count[event];
+
+	return mgmt->other_event_count;
+}
+
+void mgmt_reset_event_count(struct mgmt *mgmt)
+{
+	if (!mgmt)
+		return;
+
+	memset(mgmt->event_count, 0, sizeof(mgmt->event_count));
+	mgmt->other_event_count = 0;
+}
@@ -71,3 +71,6 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 bool mgmt_unregister(struct mgmt *mgmt, unsigned int id);
 bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index);
 bool mgmt_unregister_all(struct mgmt *mgmt);
+
+uint64_t mgmt_get_event_count(struct mgmt *mgmt, uint16_t event);
+void mgmt_reset_event_count(struct mgmt *mgmt);
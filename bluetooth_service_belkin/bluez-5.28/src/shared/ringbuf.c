@@ -223,7 +223,9 @@ int ringbuf_printf(struct ringbuf *ringbuf, const char *format, ...)
 int ringbuf_vprintf(struct ringbuf *ringbuf, const char *format, va_list ap)
 {
 	size_t avail, offset, end;
+	char tmp[256];
 	char *str;
+	va_list aq;
 	int len;
 
 	if (!ringbuf || !format)
@@ -234,18 +236,41 @@ int ringbuf_vprintf(struct ringbuf *ringbuf, const char *format, va_list ap)
 	if (!avail)
 		return -1;
 
-	len = vasprintf(&str, format, ap);
+	/*
+	 * Format straight into the ring when the string fits before the
+	 * end of the buffer. The terminating NUL needs one spare byte.
+	 */
+	offset = ringbuf->in & (ringbuf->size - 1);
+	end = MIN(avail, ringbuf->size - offset);
+
+	va_copy(aq, ap);
+	len = vsnprintf(ringbuf->buffer + offset, end, format, aq);
+	va_end(aq);
+
 	if (len < 0)
 		return -1;
 
-	if ((size_t) len > avail) {
-		free(str);
+	if ((size_t) len > avail)
+		return -1;
+
+	if ((size_t) len < end) {
+		if (ringbuf->in_tracing)
+			ringbuf->in_tracing(ringbuf->buffer + offset, len,
+							ringbuf->in_data);
+
+		ringbuf->in += len;
+
+		return len;
+	}
+
+	/* String wraps, format it aside and copy both parts */
+	if ((size_t) len < sizeof(tmp)) {
+		str = tmp;
+		vsnprintf(str, sizeof(tmp), format, ap);
+	} else if (vasprintf(&str, format, ap) < 0) {
 		return -1;
 	}
 
-	/* Determine possible length of string before wrapping */
-	offset = ringbuf->in & (ringbuf->size - 1);
-	end = MIN((size_t) len, ringbuf->size - offset);
 	memcpy(ringbuf->buffer + offset, str, end);
 
 	if (ringbuf->in_tracing)
@@ -261,7 +286,8 @@ int ringbuf_vprintf(struct ringbuf *ringbuf, const char *format, va_list ap)
 							ringbuf->in_data);
 	}
 
-	free(str);
+	if (str != tmp)
+		free(str);
 
 	ringbuf->in += len;
 
@@ -0,0 +1,270 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "src/shared/shard.h"
+
+struct shard {
+	struct shard_pool *pool;
+	unsigned int index;
+	int load;
+	GMainContext *context;
+	GMainLoop *loop;
+	GThread *thread;
+};
+
+struct shard_pool {
+	GMainContext *home;
+	unsigned int num_shards;
+	struct shard *shards;
+};
+
+struct shard_call {
+	shard_func_t func;
+	shard_destroy_func_t destroy;
+	void *user_data;
+};
+
+static gboolean call_dispatch(gpointer user_data)
+{
+	struct shard_call *call = user_data;
+
+	call->func(call->user_data);
+
+	return FALSE;
+}
+
+static void call_destroy(gpointer user_data)
+{
+	struct shard_call *call = user_data;
+
+	if (call->destroy)
+		call->destroy(call->user_data);
+
+	g_free(call);
+}
+
+static bool invoke(GMainContext *context, shard_func_t func, void *user_data,
+						shard_destroy_func_t destroy)
+{
+	struct shard_call *call;
+	GSource *source;
+
+	if (!func)
+		return false;
+
+	call = g_try_new0(struct shard_call, 1);
+	if (!call)
+		return false;
+
+	call->func = func;
+	call->destroy = destroy;
+	call->user_data = user_data;
+
+	/*
+	 * Unlike g_main_context_invoke() this never runs the function in
+	 * the calling thread, even before the target loop got going.
+	 */
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, call_dispatch, call, call_destroy);
+	g_source_attach(source, context);
+	g_source_unref(source);
+
+	return true;
+}
+
+static gpointer shard_thread(gpointer user_data)
+{
+	struct shard *shard = user_data;
+
+	/* Makes io_new() and timeout_add() attach to this loop */
+	g_main_context_push_thread_default(shard->context);
+
+	g_main_loop_run(shard->loop);
+
+	g_main_context_pop_thread_default(shard->context);
+
+	return NULL;
+}
+
+static void shard_quit(void *user_data)
+{
+	struct shard *shard = user_data;
+
+	g_main_loop_quit(shard->loop);
+}
+
+static void shard_stop(struct shard *shard)
+{
+	/*
+	 * Quit from inside the loop, a g_main_loop_quit() issued before the
+	 * thread entered g_main_loop_run() would be lost.
+	 */
+	if (shard->thread) {
+		invoke(shard->context, shard_quit, shard, NULL);
+		g_thread_join(shard->thread);
+	}
+
+	if (shard->loop)
+		g_main_loop_unref(shard->loop);
+
+	if (shard->context)
+		g_main_context_unref(shard->context);
+}
+
+struct shard_pool *shard_pool_new(unsigned int num_shards)
+{
+	struct shard_pool *pool;
+	unsigned int i;
+
+	if (!num_shards)
+		return NULL;
+
+	pool = g_try_new0(struct shard_pool, 1);
+	if (!pool)
+		return NULL;
+
+	pool->shards = g_try_new0(struct shard, num_shards);
+	if (!pool->shards) {
+		g_free(pool);
+		return NULL;
+	}
+
+	pool->home = g_main_context_ref_thread_default();
+
+	for (i = 0; i < num_shards; i++) {
+		struct shard *shard = &pool->shards[i];
+
+		shard->pool = pool;
+		shard->index = i;
+		shard->context = g_main_context_new();
+		shard->loop = g_main_loop_new(shard->context, FALSE);
+
+		shard->thread = g_thread_try_new("shard", shard_thread,
+								shard, NULL);
+		if (!shard->thread) {
+			pool->num_shards = i + 1;
+			shard_pool_free(pool);
+			return NULL;
+		}
+	}
+
+	pool->num_shards = num_shards;
+
+	return pool;
+}
+
+void shard_pool_free(struct shard_pool *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	for (i = 0; i < pool->num_shards; i++)
+		shard_stop(&pool->shards[i]);
+
+	g_main_context_unref(pool->home);
+	g_free(pool->shards);
+	g_free(pool);
+}
+
+unsigned int shard_pool_get_size(struct shard_pool *pool)
+{
+	if (!pool)
+		return 0;
+
+	return pool->num_shards;
+}
+
+struct shard *shard_pool_acquire(struct shard_pool *pool)
+{
+	struct shard *best = NULL;
+	int best_load = G_MAXINT;
+	unsigned int i;
+
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < pool->num_shards; i++) {
+		struct shard *shard = &pool->shards[i];
+		int load = g_atomic_int_get(&shard->load);
+
+		if (load < best_load) {
+			best = shard;
+			best_load = load;
+		}
+	}
+
+	g_atomic_int_inc(&best->load);
+
+	return best;
+}
+
+void shard_release(struct shard *shard)
+{
+	if (!shard)
+		return;
+
+	g_atomic_int_add(&shard->load, -1);
+}
+
+unsigned int shard_get_index(struct shard *shard)
+{
+	if (!shard)
+		return 0;
+
+	return shard->index;
+}
+
+unsigned int shard_get_load(struct shard *shard)
+{
+	if (!shard)
+		return 0;
+
+	return g_atomic_int_get(&shard->load);
+}
+
+bool shard_invoke(struct shard *shard, shard_func_t func, void *user_data,
+						shard_destroy_func_t destroy)
+{
+	if (!shard)
+		return false;
+
+	return invoke(shard->context, func, user_data, destroy);
+}
+
+bool shard_pool_invoke_home(struct shard_pool *pool, shard_func_t func,
+			void *user_data, shard_destroy_func_t destroy)
+{
+	if (!pool)
+		return false;
+
+	return invoke(pool->home, func, user_data, destroy);
+}
@@ -0,0 +1,357 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "src/shared/mainloop.h"
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/shard.h"
+
+/*
+ * Every loop, the home one included, owns a call queue woken through an
+ * eventfd. The eventfd counter keeps a wakeup written before the worker
+ * registered it, so calls queued while a thread starts are not lost.
+ */
+struct call_queue {
+	int fd;
+	pthread_mutex_t lock;
+	struct queue *calls;
+};
+
+struct shard {
+	struct shard_pool *pool;
+	unsigned int index;
+	int load;
+	struct call_queue queue;
+	pthread_t thread;
+	bool started;
+};
+
+struct shard_pool {
+	struct call_queue home;
+	unsigned int num_shards;
+	struct shard *shards;
+};
+
+struct shard_call {
+	shard_func_t func;
+	shard_destroy_func_t destroy;
+	void *user_data;
+};
+
+static void call_free(void *data)
+{
+	struct shard_call *call = data;
+
+	if (call->destroy)
+		call->destroy(call->user_data);
+
+	free(call);
+}
+
+static bool call_queue_init(struct call_queue *queue)
+{
+	queue->calls = queue_new();
+	if (!queue->calls)
+		return false;
+
+	queue->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (queue->fd < 0) {
+		queue_destroy(queue->calls, NULL);
+		queue->calls = NULL;
+		return false;
+	}
+
+	pthread_mutex_init(&queue->lock, NULL);
+
+	return true;
+}
+
+static void call_queue_clear(struct call_queue *queue)
+{
+	if (!queue->calls)
+		return;
+
+	/* Calls that never ran still release their user data */
+	queue_destroy(queue->calls, call_free);
+	queue->calls = NULL;
+
+	close(queue->fd);
+	pthread_mutex_destroy(&queue->lock);
+}
+
+static void call_queue_dispatch(int fd, uint32_t events, void *user_data)
+{
+	struct call_queue *queue = user_data;
+	struct queue *calls, *empty;
+	struct shard_call *call;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return;
+
+	empty = queue_new();
+	if (!empty)
+		return;
+
+	/* Run outside the lock, calls may queue further calls */
+	pthread_mutex_lock(&queue->lock);
+	calls = queue->calls;
+	queue->calls = empty;
+	pthread_mutex_unlock(&queue->lock);
+
+	while ((call = queue_pop_head(calls))) {
+		call->func(call->user_data);
+		call_free(call);
+	}
+
+	queue_destroy(calls, NULL);
+}
+
+static bool invoke(struct call_queue *queue, shard_func_t func,
+			void *user_data, shard_destroy_func_t destroy)
+{
+	struct shard_call *call;
+	uint64_t one = 1;
+	bool queued;
+
+	if (!func)
+		return false;
+
+	call = new0(struct shard_call, 1);
+	if (!call)
+		return false;
+
+	call->func = func;
+	call->destroy = destroy;
+	call->user_data = user_data;
+
+	pthread_mutex_lock(&queue->lock);
+	queued = queue_push_tail(queue->calls, call);
+	pthread_mutex_unlock(&queue->lock);
+
+	if (!queued) {
+		free(call);
+		return false;
+	}
+
+	if (write(queue->fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return false;
+
+	return true;
+}
+
+static void *shard_thread(void *user_data)
+{
+	struct shard *shard = user_data;
+
+	/* The loop state is per thread, io and timeouts attach to it */
+	mainloop_init();
+
+	if (mainloop_add_fd(shard->queue.fd, EPOLLIN, call_queue_dispatch,
+						&shard->queue, NULL) < 0)
+		return NULL;
+
+	mainloop_run();
+
+	return NULL;
+}
+
+static void shard_quit(void *user_data)
+{
+	mainloop_quit();
+}
+
+static void shard_stop(struct shard *shard)
+{
+	/*
+	 * Quit from inside the loop, after every call queued before, like
+	 * the GLib backend does.
+	 */
+	if (shard->started) {
+		invoke(&shard->queue, shard_quit, shard, NULL);
+		pthread_join(shard->thread, NULL);
+	}
+
+	call_queue_clear(&shard->queue);
+}
+
+struct shard_pool *shard_pool_new(unsigned int num_shards)
+{
+	struct shard_pool *pool;
+	unsigned int i;
+
+	if (!num_shards)
+		return NULL;
+
+	pool = new0(struct shard_pool, 1);
+	if (!pool)
+		return NULL;
+
+	pool->shards = new0(struct shard, num_shards);
+	if (!pool->shards)
+		goto failed;
+
+	if (!call_queue_init(&pool->home))
+		goto failed;
+
+	/* The home loop is the one of the creating thread */
+	mainloop_init();
+
+	if (mainloop_add_fd(pool->home.fd, EPOLLIN, call_queue_dispatch,
+						&pool->home, NULL) < 0) {
+		call_queue_clear(&pool->home);
+		goto failed;
+	}
+
+	for (i = 0; i < num_shards; i++) {
+		struct shard *shard = &pool->shards[i];
+
+		shard->pool = pool;
+		shard->index = i;
+		pool->num_shards = i + 1;
+
+		if (!call_queue_init(&shard->queue))
+			break;
+
+		if (pthread_create(&shard->thread, NULL, shard_thread, shard))
+			break;
+
+		shard->started = true;
+	}
+
+	if (i < num_shards) {
+		shard_pool_free(pool);
+		return NULL;
+	}
+
+	return pool;
+
+failed:
+	free(pool->shards);
+	free(pool);
+
+	return NULL;
+}
+
+void shard_pool_free(struct shard_pool *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	for (i = 0; i < pool->num_shards; i++)
+		shard_stop(&pool->shards[i]);
+
+	mainloop_remove_fd(pool->home.fd);
+	call_queue_clear(&pool->home);
+
+	free(pool->shards);
+	free(pool);
+}
+
+unsigned int shard_pool_get_size(struct shard_pool *pool)
+{
+	if (!pool)
+		return 0;
+
+	return pool->num_shards;
+}
+
+struct shard *shard_pool_acquire(struct shard_pool *pool)
+{
+	struct shard *best = NULL;
+	int best_load = INT_MAX;
+	unsigned int i;
+
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < pool->num_shards; i++) {
+		struct shard *shard = &pool->shards[i];
+		int load = __sync_fetch_and_add(&shard->load, 0);
+
+		if (load < best_load) {
+			best = shard;
+			best_load = load;
+		}
+	}
+
+	__sync_fetch_and_add(&best->load, 1);
+
+	return best;
+}
+
+void shard_release(struct shard *shard)
+{
+	if (!shard)
+		return;
+
+	__sync_fetch_and_sub(&shard->load, 1);
+}
+
+unsigned int shard_get_index(struct shard *shard)
+{
+	if (!shard)
+		return 0;
+
+	return shard->index;
+}
+
+unsigned int shard_get_load(struct shard *shard)
+{
+	if (!shard)
+		return 0;
+
+	return __sync_fetch_and_add(&shard->load, 0);
+}
+
+bool shard_invoke(struct shard *shard, shard_func_t func, void *user_data,
+						shard_destroy_func_t destroy)
+{
+	if (!shard)
+		return false;
+
+	return invoke(&shard->queue, func, user_data, destroy);
+}
+
+bool shard_pool_invoke_home(struct shard_pool *pool, shard_func_t func,
+			void *user_data, shard_destroy_func_t destroy)
+{
+	if (!pool)
+		return false;
+
+	return invoke(&pool->home, func, user_data, destroy);
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ */
+
+#include <stdbool.h>
+
+/*
+ * A shard pool runs a fixed number of worker threads, each with its own
+ * event loop. Every io and timeout created from a function invoked on a
+ * shard is bound to that shard's loop, so a bt_att together with the
+ * bt_gatt_client or bt_gatt_server built on top of it is created inside
+ * shard_invoke() and from then on only touched from that thread.
+ *
+ * Results that need the daemon (D-Bus, storage) are handed back with
+ * shard_pool_invoke_home(), which runs on the thread that created the
+ * pool. The pool is created, used and freed from that thread.
+ *
+ * A gatt_db must never be shared between shards, not even read only: a
+ * read queues a pending request, arms its timeout and may fill the value
+ * cache. Every shard builds its own copy of the local database from a
+ * function run with shard_invoke() and serves its connections from it.
+ * Changes are made on the home thread and replayed on every shard with
+ * shard_invoke().
+ *
+ * shard-glib.c runs the workers on GMainLoops for io-glib and
+ * timeout-glib, shard-mainloop.c on the epoll loop of shared/mainloop.
+ */
+
+struct shard_pool;
+struct shard;
+
+typedef void (*shard_func_t)(void *user_data);
+typedef void (*shard_destroy_func_t)(void *user_data);
+
+struct shard_pool *shard_pool_new(unsigned int num_shards);
+void shard_pool_free(struct shard_pool *pool);
+
+unsigned int shard_pool_get_size(struct shard_pool *pool);
+
+/* Pick the least loaded shard and count one more connection on it */
+struct shard *shard_pool_acquire(struct shard_pool *pool);
+void shard_release(struct shard *shard);
+
+unsigned int shard_get_index(struct shard *shard);
+unsigned int shard_get_load(struct shard *shard);
+
+bool shard_invoke(struct shard *shard, shard_func_t func, void *user_data,
+						shard_destroy_func_t destroy);
+bool shard_pool_invoke_home(struct shard_pool *pool, shard_func_t func,
+			void *user_data, shard_destroy_func_t destroy);
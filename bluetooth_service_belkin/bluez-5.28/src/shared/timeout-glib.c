@@ -17,62 +17,557 @@
  *
  */
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
 #include "timeout.h"
 
 #include <glib.h>
 
+/*
+ * All timeouts share a single GSource driving a hierarchical timer
+ * wheel with millisecond ticks. Arming and cancelling only link or
+ * unlink a timer from a wheel slot, expiry runs a whole slot at once
+ * and timers further out are cascaded down as the wheel turns.
+ */
+#define WHEEL_BITS		6
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS		4
+#define WHEEL_MAX_DELTA		((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Level of a timer taken off the wheel to be run */
+#define LEVEL_EXPIRED		WHEEL_LEVELS
+
+/* Ids carry a generation so a stale id never matches a reused timer */
+#define TIMER_INDEX_BITS	20
+#define TIMER_INDEX_MASK	((1U << TIMER_INDEX_BITS) - 1)
+#define TIMER_GEN_MASK		((1U << (32 - TIMER_INDEX_BITS)) - 1)
+#define TIMER_CHUNK_BITS	8
+#define TIMER_CHUNK_SIZE	(1U << TIMER_CHUNK_BITS)
+#define TIMER_MAX_CHUNKS	(1U << (TIMER_INDEX_BITS - TIMER_CHUNK_BITS))
+
+struct timer_link {
+	struct timer_link *next;
+	struct timer_link *prev;
+};
+
 struct timeout_data {
+	struct timer_link link;
+	uint64_t expires;
+	unsigned int interval;
+	unsigned int index;
+	unsigned int generation;
+	unsigned int level;
+	bool active;
+	bool running;
+	bool removed;
 	timeout_func_t func;
 	timeout_destroy_func_t destroy;
 	void *user_data;
+	struct timeout_data *next_free;
 };
 
-static gboolean timeout_callback(gpointer user_data)
+struct timer_wheel {
+	GSource source;
+	uint64_t current;		/* Next tick to be processed */
+	uint64_t next_expiry;		/* No timer expires before this */
+	unsigned int count[WHEEL_LEVELS + 1];
+	struct timer_link slots[WHEEL_LEVELS][WHEEL_SIZE];
+	struct timer_link pending;	/* Due before the current tick */
+	struct timeout_data *chunks[TIMER_MAX_CHUNKS];
+	unsigned int num_chunks;
+	struct timeout_data *free_list;
+};
+
+/*
+ * One wheel per thread, attached to that thread's default main context
+ * so timeouts armed from a worker thread's loop also expire there. The
+ * key only exists to free the wheel when its thread exits.
+ */
+static __thread struct timer_wheel *wheel;
+static pthread_key_t wheel_key;
+static pthread_once_t wheel_key_once = PTHREAD_ONCE_INIT;
+
+/* Time of the current main loop iteration, what expiry is checked against */
+static uint64_t wheel_now(struct timer_wheel *w)
+{
+	return g_source_get_time(&w->source) / 1000;
+}
+
+/*
+ * Timers are armed from the real time instead. The iteration time goes
+ * stale while callbacks run, so a timer armed after slow work in the same
+ * iteration would otherwise expire early, like g_timeout_add() does not.
+ */
+static uint64_t wheel_clock(void)
+{
+	return g_get_monotonic_time() / 1000;
+}
+
+static void link_init(struct timer_link *head)
 {
-	struct timeout_data *data  = user_data;
+	head->next = head;
+	head->prev = head;
+}
+
+static bool link_empty(const struct timer_link *head)
+{
+	return head->next == head;
+}
+
+static void link_add_tail(struct timer_link *head, struct timer_link *link)
+{
+	link->prev = head->prev;
+	link->next = head;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+static void link_del(struct timer_link *link)
+{
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+}
+
+static void link_splice(struct timer_link *from, struct timer_link *to)
+{
+	if (link_empty(from))
+		return;
+
+	from->next->prev = to->prev;
+	to->prev->next = from->next;
+	from->prev->next = to;
+	to->prev = from->prev;
+
+	link_init(from);
+}
+
+static unsigned int wheel_total(struct timer_wheel *w)
+{
+	unsigned int i, total = 0;
+
+	for (i = 0; i <= WHEEL_LEVELS; i++)
+		total += w->count[i];
+
+	return total;
+}
+
+static void wheel_insert(struct timer_wheel *w, struct timeout_data *data)
+{
+	uint64_t expires = data->expires;
+	uint64_t delta;
+	unsigned int level;
+
+	if (data->expires < w->next_expiry)
+		w->next_expiry = data->expires;
+
+	/* Already late, run on the next dispatch */
+	if (expires < w->current) {
+		link_add_tail(&w->pending, &data->link);
+		data->level = LEVEL_EXPIRED;
+		w->count[LEVEL_EXPIRED]++;
+		return;
+	}
+
+	/* Too far out, park in the top level and recascade later */
+	delta = expires - w->current;
+	if (delta > WHEEL_MAX_DELTA) {
+		delta = WHEEL_MAX_DELTA;
+		expires = w->current + delta;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < 1ULL << (WHEEL_BITS * (level + 1)))
+			break;
+	}
+
+	link_add_tail(&w->slots[level][(expires >> (WHEEL_BITS * level)) &
+							WHEEL_MASK], &data->link);
+	data->level = level;
+	w->count[level]++;
+}
+
+static void wheel_unlink(struct timer_wheel *w, struct timeout_data *data)
+{
+	link_del(&data->link);
+	w->count[data->level]--;
+}
+
+static void cascade(struct timer_wheel *w, unsigned int level)
+{
+	struct timer_link list;
+	unsigned int index;
+
+	index = (w->current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+	link_init(&list);
+	link_splice(&w->slots[level][index], &list);
+
+	while (!link_empty(&list)) {
+		struct timeout_data *data = (struct timeout_data *) list.next;
+
+		link_del(&data->link);
+		w->count[level]--;
+		wheel_insert(w, data);
+	}
+}
+
+/* Earliest tick at which a timer could run, UINT64_MAX when empty */
+static uint64_t wheel_next_expiry(struct timer_wheel *w)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level, i, start;
+
+	/* Late timers are run straight away */
+	if (!link_empty(&w->pending))
+		return 0;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		unsigned int shift = WHEEL_BITS * level;
+		uint64_t base = w->current >> shift;
+
+		if (!w->count[level])
+			continue;
+
+		/*
+		 * Level 0 slots run on their tick, upper level slots run
+		 * once cascaded on their boundary. Unless the current tick
+		 * is that boundary, the slot under it was cascaded already
+		 * and only comes round again after a full turn.
+		 */
+		start = (base << shift) == w->current ? 0 : 1;
+
+		for (i = start; i < start + WHEEL_SIZE; i++) {
+			uint64_t tick;
+
+			if (link_empty(&w->slots[level][(base + i) &
+								WHEEL_MASK]))
+				continue;
+
+			tick = (base + i) << shift;
+			if (tick < next)
+				next = tick;
+
+			break;
+		}
+	}
+
+	return next;
+}
+
+static struct timeout_data *timer_lookup(struct timer_wheel *w,
+							unsigned int id)
+{
+	unsigned int index = id & TIMER_INDEX_MASK;
+	struct timeout_data *data;
+
+	if (index >> TIMER_CHUNK_BITS >= w->num_chunks)
+		return NULL;
+
+	data = &w->chunks[index >> TIMER_CHUNK_BITS]
+					[index & (TIMER_CHUNK_SIZE - 1)];
+
+	if (!data->active ||
+			data->generation != id >> TIMER_INDEX_BITS)
+		return NULL;
+
+	return data;
+}
+
+static struct timeout_data *timer_alloc(struct timer_wheel *w)
+{
+	struct timeout_data *data, *chunk;
+	unsigned int i;
+
+	if (!w->free_list) {
+		if (w->num_chunks == TIMER_MAX_CHUNKS)
+			return NULL;
 
-	if (data->func(data->user_data))
+		chunk = g_try_new0(struct timeout_data, TIMER_CHUNK_SIZE);
+		if (!chunk)
+			return NULL;
+
+		for (i = TIMER_CHUNK_SIZE; i > 0; i--) {
+			data = &chunk[i - 1];
+			data->index = (w->num_chunks << TIMER_CHUNK_BITS) +
+									i - 1;
+			data->next_free = w->free_list;
+			w->free_list = data;
+		}
+
+		w->chunks[w->num_chunks++] = chunk;
+	}
+
+	data = w->free_list;
+	w->free_list = data->next_free;
+
+	data->generation = (data->generation + 1) & TIMER_GEN_MASK;
+	if (!data->generation)
+		data->generation = 1;
+
+	data->active = true;
+	data->running = false;
+	data->removed = false;
+
+	return data;
+}
+
+static void timer_free(struct timer_wheel *w, struct timeout_data *data)
+{
+	timeout_destroy_func_t destroy = data->destroy;
+	void *user_data = data->user_data;
+
+	data->active = false;
+	data->func = NULL;
+	data->destroy = NULL;
+	data->user_data = NULL;
+	data->next_free = w->free_list;
+	w->free_list = data;
+
+	if (destroy)
+		destroy(user_data);
+}
+
+static void run_expired(struct timer_wheel *w, struct timer_link *list,
+								uint64_t now)
+{
+	while (!link_empty(list)) {
+		struct timeout_data *data = (struct timeout_data *) list->next;
+
+		wheel_unlink(w, data);
+
+		/* Parked in the top level and not due yet */
+		if (data->expires >= w->current) {
+			wheel_insert(w, data);
+			continue;
+		}
+
+		data->running = true;
+
+		if (!data->func(data->user_data) || data->removed) {
+			data->running = false;
+			timer_free(w, data);
+			continue;
+		}
+
+		data->running = false;
+		data->expires = now + data->interval;
+		wheel_insert(w, data);
+	}
+}
+
+static void wheel_run(struct timer_wheel *w, uint64_t now)
+{
+	struct timer_link expired;
+
+	link_init(&expired);
+
+	/* Timers that were armed already late or rearmed with no delay */
+	link_splice(&w->pending, &expired);
+	run_expired(w, &expired, now);
+
+	while (w->current <= now) {
+		unsigned int index, level;
+
+		/* Skip ticks where nothing can run or cascade */
+		if (!w->count[0]) {
+			uint64_t next = wheel_next_expiry(w);
+
+			if (next > now) {
+				w->current = now + 1;
+				break;
+			}
+
+			if (next > w->current)
+				w->current = next;
+		}
+
+		index = w->current & WHEEL_MASK;
+
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			if ((w->current >> (WHEEL_BITS * (level - 1))) &
+								WHEEL_MASK)
+				break;
+
+			cascade(w, level);
+		}
+
+		w->current++;
+
+		if (link_empty(&w->slots[0][index]))
+			continue;
+
+		/* Take the slot off the wheel so callbacks can rearm */
+		while (!link_empty(&w->slots[0][index])) {
+			struct timeout_data *data;
+
+			data = (struct timeout_data *) w->slots[0][index].next;
+			wheel_unlink(w, data);
+			link_add_tail(&expired, &data->link);
+			data->level = LEVEL_EXPIRED;
+			w->count[LEVEL_EXPIRED]++;
+		}
+
+		run_expired(w, &expired, now);
+	}
+
+	w->next_expiry = wheel_next_expiry(w);
+}
+
+static gboolean wheel_prepare(GSource *source, gint *timeout)
+{
+	struct timer_wheel *w = (struct timer_wheel *) source;
+	uint64_t now;
+
+	if (w->next_expiry == UINT64_MAX) {
+		*timeout = -1;
+		return FALSE;
+	}
+
+	now = wheel_now(w);
+	if (w->next_expiry <= now)
 		return TRUE;
 
+	*timeout = MIN(w->next_expiry - now, G_MAXINT);
+
 	return FALSE;
 }
 
-static void timeout_destroy(gpointer user_data)
+static gboolean wheel_check(GSource *source)
+{
+	struct timer_wheel *w = (struct timer_wheel *) source;
+
+	return w->next_expiry <= wheel_now(w);
+}
+
+static gboolean wheel_dispatch(GSource *source, GSourceFunc callback,
+							gpointer user_data)
 {
-	struct timeout_data *data = user_data;
+	struct timer_wheel *w = (struct timer_wheel *) source;
 
-	if (data->destroy)
-		data->destroy(data->user_data);
+	wheel_run(w, wheel_now(w));
 
-	g_free(data);
+	return TRUE;
+}
+
+static GSourceFuncs wheel_funcs = {
+	.prepare = wheel_prepare,
+	.check = wheel_check,
+	.dispatch = wheel_dispatch,
+};
+
+/* Thread exit, timers still armed are dropped like removed ones */
+static void wheel_free(void *user_data)
+{
+	struct timer_wheel *w = user_data;
+	unsigned int i, j;
+
+	if (wheel == w)
+		wheel = NULL;
+
+	g_source_destroy(&w->source);
+
+	for (i = 0; i < w->num_chunks; i++) {
+		for (j = 0; j < TIMER_CHUNK_SIZE; j++) {
+			struct timeout_data *data = &w->chunks[i][j];
+
+			if (data->active && data->destroy)
+				data->destroy(data->user_data);
+		}
+
+		g_free(w->chunks[i]);
+	}
+
+	g_source_unref(&w->source);
+}
+
+static void wheel_key_create(void)
+{
+	pthread_key_create(&wheel_key, wheel_free);
+}
+
+static struct timer_wheel *wheel_get(void)
+{
+	unsigned int level, i;
+
+	if (wheel)
+		return wheel;
+
+	wheel = (struct timer_wheel *) g_source_new(&wheel_funcs,
+						sizeof(struct timer_wheel));
+	if (!wheel)
+		return NULL;
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		for (i = 0; i < WHEEL_SIZE; i++)
+			link_init(&wheel->slots[level][i]);
+
+	link_init(&wheel->pending);
+
+	wheel->next_expiry = UINT64_MAX;
+
+	g_source_set_priority(&wheel->source, G_PRIORITY_DEFAULT);
+	g_source_attach(&wheel->source, g_main_context_get_thread_default());
+
+	wheel->current = wheel_clock();
+
+	pthread_once(&wheel_key_once, wheel_key_create);
+	pthread_setspecific(wheel_key, wheel);
+
+	return wheel;
 }
 
 unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy)
 {
+	struct timer_wheel *w;
 	struct timeout_data *data;
-	guint id;
+	uint64_t now;
+
+	w = wheel_get();
+	if (!w)
+		return 0;
 
-	data = g_try_new0(struct timeout_data, 1);
+	data = timer_alloc(w);
 	if (!data)
 		return 0;
 
 	data->func = func;
 	data->destroy = destroy;
 	data->user_data = user_data;
+	data->interval = timeout;
+
+	now = wheel_clock();
+
+	/* Nothing pending, the wheel can jump straight to now */
+	if (!wheel_total(w))
+		w->current = now;
 
-	id = g_timeout_add_full(G_PRIORITY_DEFAULT, timeout, timeout_callback,
-						data, timeout_destroy);
-	if (!id)
-		g_free(data);
+	data->expires = now + timeout;
+	wheel_insert(w, data);
 
-	return id;
+	return (data->generation << TIMER_INDEX_BITS) | data->index;
 }
 
 void timeout_remove(unsigned int id)
 {
-	GSource *source = g_main_context_find_source_by_id(NULL, id);
+	struct timeout_data *data;
+
+	if (!wheel || !id)
+		return;
+
+	data = timer_lookup(wheel, id);
+	if (!data)
+		return;
+
+	/* Freed by the dispatcher once the callback returns */
+	if (data->running) {
+		data->removed = true;
+		return;
+	}
 
-	if (source)
-		g_source_destroy(source);
+	wheel_unlink(wheel, data);
+	timer_free(wheel, data);
 }
@@ -19,7 +19,7 @@
 
 #include <stdlib.h>
 
-#include "monitor/mainloop.h"
+#include "src/shared/mainloop.h"
 
 #include "util.h"
 #include "timeout.h"
@@ -35,12 +35,14 @@ struct timeout_data {
 static void timeout_callback(int id, void *user_data)
 {
 	struct timeout_data *data = user_data;
+	unsigned int timeout = data->timeout;
 
+	/* The callback may remove its own timeout and free data */
 	if (data->func(data->user_data) &&
-			!mainloop_modify_timeout(data->id, data->timeout))
+			!mainloop_modify_timeout(id, timeout))
 		return;
 
-	mainloop_remove_timeout(data->id);
+	mainloop_remove_timeout(id);
 }
 
 static void timeout_destroy(void *user_data)
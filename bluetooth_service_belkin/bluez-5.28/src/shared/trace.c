@@ -0,0 +1,268 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "src/shared/trace.h"
+
+/*
+ * Every thread writes into its own ring, so recording an event takes no
+ * lock and no atomic read-modify-write. The owner only publishes its
+ * head with a release store. A dump from another thread copies the
+ * ring and then discards whatever the owner may have overwritten while
+ * it was copying.
+ */
+struct trace_ring {
+	struct trace_ring *next;
+	uint32_t tid;
+	uint32_t mask;
+	uint64_t head;
+	struct trace_event events[0];
+};
+
+int trace_enabled;
+
+static unsigned int trace_size;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *rings;
+static __thread struct trace_ring *thread_ring;
+
+static const struct {
+	uint16_t id;
+	const char *str;
+} event_table[] = {
+	{ TRACE_ATT_TX,		"ATT TX"		},
+	{ TRACE_ATT_RX,		"ATT RX"		},
+	{ TRACE_ATT_TIMEOUT,	"ATT Timeout"		},
+	{ TRACE_ATT_DISCONNECT,	"ATT Disconnect"	},
+	{ TRACE_MGMT_CMD,	"MGMT Command"		},
+	{ TRACE_MGMT_EVENT,	"MGMT Event"		},
+	{ TRACE_MGMT_COMPLETE,	"MGMT Complete"		},
+	{ TRACE_MGMT_STATUS,	"MGMT Status"		},
+	{ TRACE_HCI_CMD,	"HCI Command"		},
+	{ TRACE_HCI_EVENT,	"HCI Event"		},
+	{ TRACE_HCI_COMPLETE,	"HCI Complete"		},
+	{ TRACE_HCI_STATUS,	"HCI Status"		},
+	{ TRACE_GATT_PRIMARY,	"GATT Primary"		},
+	{ TRACE_GATT_SECONDARY,	"GATT Secondary"	},
+	{ TRACE_GATT_INCLUDE,	"GATT Include"		},
+	{ TRACE_GATT_CHRC,	"GATT Characteristic"	},
+	{ TRACE_GATT_DESC,	"GATT Descriptor"	},
+	{ TRACE_GATT_SVC_CHANGED, "GATT Service Changed" },
+	{ TRACE_GATT_READ_LONG,	"GATT Read Long"	},
+	{ TRACE_GATT_WRITE_LONG, "GATT Write Long"	},
+	{ TRACE_GATT_SERVER_REQ, "GATT Server Request"	},
+	{ TRACE_GATT_SERVER_READ_MULT, "GATT Server Read Multiple" },
+	{ TRACE_GATT_SERVER_EXEC, "GATT Server Execute"	},
+	{ }
+};
+
+const char *trace_event_str(uint16_t id)
+{
+	int i;
+
+	for (i = 0; event_table[i].str; i++) {
+		if (event_table[i].id == id)
+			return event_table[i].str;
+	}
+
+	return "Unknown";
+}
+
+static struct trace_ring *ring_new(void)
+{
+	struct trace_ring *ring;
+	unsigned int size = trace_size;
+
+	if (!size)
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring) + size * sizeof(struct trace_event));
+	if (!ring)
+		return NULL;
+
+	ring->tid = syscall(SYS_gettid);
+	ring->mask = size - 1;
+
+	/* Rings live as long as the process, threads may come and go */
+	pthread_mutex_lock(&rings_lock);
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&rings_lock);
+
+	thread_ring = ring;
+
+	return ring;
+}
+
+void trace_record(uint16_t id, uint16_t len, uint32_t arg1, uint32_t arg2,
+								uint32_t arg3)
+{
+	struct trace_ring *ring = thread_ring;
+	struct trace_event *ev;
+	struct timespec ts;
+	uint64_t head;
+
+	if (!ring) {
+		ring = ring_new();
+		if (!ring)
+			return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	head = ring->head;
+	ev = &ring->events[head & ring->mask];
+
+	ev->time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	ev->id = id;
+	ev->len = len;
+	ev->arg1 = arg1;
+	ev->arg2 = arg2;
+	ev->arg3 = arg3;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool trace_enable(unsigned int size)
+{
+	unsigned int rounded = 1;
+
+	if (!size)
+		return false;
+
+	while (rounded < size)
+		rounded <<= 1;
+
+	/* Rings already handed out keep their size */
+	if (!trace_size)
+		trace_size = rounded;
+
+	__atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void trace_disable(void)
+{
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+static bool dump_ring(int fd, struct trace_ring *ring,
+						struct trace_event *copy)
+{
+	struct trace_ring_hdr hdr;
+	uint64_t size = ring->mask + 1;
+	uint64_t head, first, last, i;
+	struct iovec iov[2];
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	first = head > size ? head - size : 0;
+
+	for (i = first; i < head; i++)
+		copy[i - first] = ring->events[i & ring->mask];
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	/* Drop slots the owner reused, or is writing, during the copy */
+	last = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	if (last + 1 > size) {
+		uint64_t valid = last + 1 - size;
+
+		if (valid > head)
+			valid = head;
+
+		if (valid > first) {
+			memmove(copy, copy + (valid - first),
+					(head - valid) * sizeof(*copy));
+			first = valid;
+		}
+	}
+
+	hdr.tid = ring->tid;
+	hdr.count = head - first;
+	hdr.dropped = first;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = copy;
+	iov[1].iov_len = hdr.count * sizeof(*copy);
+
+	return writev(fd, iov, 2) == (ssize_t) (iov[0].iov_len +
+							iov[1].iov_len);
+}
+
+bool trace_dump(const char *path)
+{
+	struct trace_hdr hdr;
+	struct trace_ring *ring;
+	struct trace_event *copy;
+	bool result = true;
+	int fd;
+
+	if (!path || !trace_size)
+		return false;
+
+	copy = malloc(trace_size * sizeof(*copy));
+	if (!copy)
+		return false;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		free(copy);
+		return false;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	hdr.version = TRACE_VERSION;
+
+	pthread_mutex_lock(&rings_lock);
+
+	for (ring = rings; ring; ring = ring->next)
+		hdr.num_rings++;
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+		result = false;
+
+	for (ring = rings; ring && result; ring = ring->next)
+		result = dump_ring(fd, ring, copy);
+
+	pthread_mutex_unlock(&rings_lock);
+
+	close(fd);
+	free(copy);
+
+	return result;
+}
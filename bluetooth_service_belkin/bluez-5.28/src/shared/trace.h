@@ -0,0 +1,97 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ATT PDUs carry their first 16-bit parameter, usually the handle */
+#define TRACE_ATT_TX			0x0101	/* opcode, handle, fd */
+#define TRACE_ATT_RX			0x0102	/* opcode, handle, fd */
+#define TRACE_ATT_TIMEOUT		0x0103	/* opcode, id, fd */
+#define TRACE_ATT_DISCONNECT		0x0104	/* error, 0, fd */
+
+#define TRACE_MGMT_CMD			0x0201	/* opcode, index, 0 */
+#define TRACE_MGMT_EVENT		0x0202	/* event, index, 0 */
+#define TRACE_MGMT_COMPLETE		0x0203	/* opcode, index, status */
+#define TRACE_MGMT_STATUS		0x0204	/* opcode, index, status */
+
+#define TRACE_HCI_CMD			0x0301	/* opcode, credits, fd */
+#define TRACE_HCI_EVENT			0x0302	/* event, 0, fd */
+#define TRACE_HCI_COMPLETE		0x0303	/* opcode, ncmd, fd */
+#define TRACE_HCI_STATUS		0x0304	/* opcode, status, fd */
+
+/* uuid is the leading 32 bits, the 16-bit value for SIG assigned UUIDs */
+#define TRACE_GATT_PRIMARY		0x0401	/* start, end, uuid */
+#define TRACE_GATT_SECONDARY		0x0402	/* start, end, uuid */
+#define TRACE_GATT_INCLUDE		0x0403	/* handle, start, end */
+#define TRACE_GATT_CHRC			0x0404	/* value, props, uuid */
+#define TRACE_GATT_DESC			0x0405	/* handle, 0, uuid */
+#define TRACE_GATT_SVC_CHANGED		0x0406	/* start, end, 0 */
+#define TRACE_GATT_READ_LONG		0x0407	/* usec, 0, 0 */
+#define TRACE_GATT_WRITE_LONG		0x0408	/* usec, 0, 0 */
+
+/* Server requests carry the handle or range they act on */
+#define TRACE_GATT_SERVER_REQ		0x0501	/* opcode, handle, arg */
+#define TRACE_GATT_SERVER_READ_MULT	0x0502	/* handle, number, count */
+#define TRACE_GATT_SERVER_EXEC		0x0503	/* writes, bytes, 0 */
+
+/* Fixed size record, stored and dumped in host byte order */
+struct trace_event {
+	uint64_t time;		/* CLOCK_MONOTONIC in ns */
+	uint16_t id;
+	uint16_t len;
+	uint32_t arg1;
+	uint32_t arg2;
+	uint32_t arg3;
+} __attribute__ ((packed));
+
+#define TRACE_MAGIC		"BZTRACE"
+#define TRACE_VERSION		1
+
+/* Dump file header, followed by one trace_ring_hdr plus events per thread */
+struct trace_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_rings;
+} __attribute__ ((packed));
+
+struct trace_ring_hdr {
+	uint32_t tid;
+	uint32_t count;
+	uint64_t dropped;
+} __attribute__ ((packed));
+
+extern int trace_enabled;
+
+void trace_record(uint16_t id, uint16_t len, uint32_t arg1, uint32_t arg2,
+								uint32_t arg3);
+
+#define TRACE(id, len, arg1, arg2, arg3)				\
+do {									\
+	if (__builtin_expect(trace_enabled, 0))				\
+		trace_record(id, len, arg1, arg2, arg3);		\
+} while (0)
+
+/* Events kept per thread, rounded up to a power of two */
+bool trace_enable(unsigned int size);
+void trace_disable(void);
+
+bool trace_dump(const char *path);
+
+const char *trace_event_str(uint16_t id);
@@ -27,6 +27,8 @@
 #endif
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 #include <errno.h>
 #include <ctype.h>
 #include <fcntl.h>
@@ -35,6 +37,7 @@
 #include <time.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <glib.h>
 
@@ -43,6 +46,7 @@
 #include <bluetooth/sdp_lib.h>
 
 #include "lib/uuid.h"
+#include "src/shared/util.h"
 #include "textfile.h"
 #include "uuid-helper.h"
 #include "storage.h"
@@ -196,3 +200,229 @@ sdp_record_t *find_record_in_list(sdp_list_t *recs, const char *uuid)
 	}
 	return NULL;
 }
+
+/*
+ * Binary SDP cache: a header, an index of (handle, offset, length)
+ * entries sorted by handle and the raw record PDUs. All fields are
+ * little endian.
+ */
+static const uint8_t sdp_cache_magic[8] = { 'B', 'Z', 'S', 'D', 'P',
+							'C', 0x00, 0x01 };
+
+struct sdp_cache_hdr {
+	uint8_t magic[8];
+	uint32_t count;
+} __attribute__ ((packed));
+
+struct sdp_cache_entry {
+	uint32_t handle;
+	uint32_t offset;
+	uint32_t len;
+} __attribute__ ((packed));
+
+struct sdp_cache {
+	uint8_t *map;
+	size_t size;
+	const struct sdp_cache_entry *entries;
+	uint32_t count;
+};
+
+static bool sdp_cache_open(const char *filename, struct sdp_cache *cache)
+{
+	const struct sdp_cache_hdr *hdr;
+	struct stat st;
+	uint32_t i;
+	int fd;
+
+	memset(cache, 0, sizeof(*cache));
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr)) {
+		close(fd);
+		return false;
+	}
+
+	cache->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (cache->map == MAP_FAILED) {
+		cache->map = NULL;
+		return false;
+	}
+
+	cache->size = st.st_size;
+
+	hdr = (const struct sdp_cache_hdr *) cache->map;
+	if (memcmp(hdr->magic, sdp_cache_magic, sizeof(sdp_cache_magic)))
+		goto failed;
+
+	cache->count = get_le32(&hdr->count);
+	cache->entries = (const void *) (cache->map + sizeof(*hdr));
+
+	if (cache->count > (cache->size - sizeof(*hdr)) /
+					sizeof(struct sdp_cache_entry))
+		goto failed;
+
+	for (i = 0; i < cache->count; i++) {
+		uint32_t offset = get_le32(&cache->entries[i].offset);
+		uint32_t len = get_le32(&cache->entries[i].len);
+
+		if (offset > cache->size || len > cache->size - offset)
+			goto failed;
+	}
+
+	return true;
+
+failed:
+	munmap(cache->map, cache->size);
+	cache->map = NULL;
+	return false;
+}
+
+static void sdp_cache_close(struct sdp_cache *cache)
+{
+	if (cache->map)
+		munmap(cache->map, cache->size);
+}
+
+sdp_list_t *read_sdp_cache(const char *filename)
+{
+	struct sdp_cache cache;
+	sdp_list_t *recs = NULL;
+	uint32_t i;
+
+	if (!sdp_cache_open(filename, &cache))
+		return NULL;
+
+	for (i = 0; i < cache.count; i++) {
+		uint32_t offset = get_le32(&cache.entries[i].offset);
+		uint32_t len = get_le32(&cache.entries[i].len);
+		sdp_record_t *rec;
+		int scanned;
+
+		rec = sdp_extract_pdu(cache.map + offset, len, &scanned);
+		if (rec)
+			recs = sdp_list_append(recs, rec);
+	}
+
+	sdp_cache_close(&cache);
+
+	return recs;
+}
+
+struct sdp_cache_pdu {
+	uint32_t handle;
+	const uint8_t *data;
+	uint32_t len;
+};
+
+static int pdu_cmp(const void *a, const void *b)
+{
+	const struct sdp_cache_pdu *p1 = a;
+	const struct sdp_cache_pdu *p2 = b;
+
+	if (p1->handle == p2->handle)
+		return 0;
+
+	return p1->handle < p2->handle ? -1 : 1;
+}
+
+static bool pdu_has_handle(struct sdp_cache_pdu *pdus, unsigned int count,
+							uint32_t handle)
+{
+	struct sdp_cache_pdu key = { .handle = handle };
+
+	return bsearch(&key, pdus, count, sizeof(*pdus), pdu_cmp) != NULL;
+}
+
+int update_sdp_cache(const char *filename, sdp_list_t *recs)
+{
+	struct sdp_cache cache;
+	struct sdp_cache_pdu *pdus;
+	struct sdp_cache_hdr *hdr;
+	struct sdp_cache_entry *entry;
+	unsigned int count = 0, added, i;
+	sdp_buf_t *bufs;
+	sdp_list_t *l;
+	size_t size;
+	uint8_t *data, *ptr;
+	int err = 0;
+
+	sdp_cache_open(filename, &cache);
+
+	added = sdp_list_len(recs);
+	bufs = g_new0(sdp_buf_t, added);
+	pdus = g_new0(struct sdp_cache_pdu, added + cache.count);
+
+	for (l = recs; l; l = l->next) {
+		sdp_record_t *rec = l->data;
+
+		if (sdp_gen_record_pdu(rec, &bufs[count]) < 0)
+			continue;
+
+		pdus[count].handle = rec->handle;
+		pdus[count].data = bufs[count].data;
+		pdus[count].len = bufs[count].data_size;
+		count++;
+	}
+
+	added = count;
+	qsort(pdus, added, sizeof(*pdus), pdu_cmp);
+
+	/* Keep cached records that this update does not replace */
+	for (i = 0; i < cache.count; i++) {
+		uint32_t handle = get_le32(&cache.entries[i].handle);
+
+		if (pdu_has_handle(pdus, added, handle))
+			continue;
+
+		pdus[count].handle = handle;
+		pdus[count].data = cache.map +
+				get_le32(&cache.entries[i].offset);
+		pdus[count].len = get_le32(&cache.entries[i].len);
+		count++;
+	}
+
+	qsort(pdus, count, sizeof(*pdus), pdu_cmp);
+
+	size = sizeof(*hdr) + count * sizeof(*entry);
+	for (i = 0; i < count; i++)
+		size += pdus[i].len;
+
+	data = g_malloc(size);
+
+	hdr = (struct sdp_cache_hdr *) data;
+	memcpy(hdr->magic, sdp_cache_magic, sizeof(sdp_cache_magic));
+	put_le32(count, &hdr->count);
+
+	entry = (struct sdp_cache_entry *) (data + sizeof(*hdr));
+	ptr = (uint8_t *) (entry + count);
+
+	for (i = 0; i < count; i++, entry++) {
+		put_le32(pdus[i].handle, &entry->handle);
+		put_le32(ptr - data, &entry->offset);
+		put_le32(pdus[i].len, &entry->len);
+
+		memcpy(ptr, pdus[i].data, pdus[i].len);
+		ptr += pdus[i].len;
+	}
+
+	/* Written to a temporary file and renamed over the old cache */
+	create_file(filename, S_IRUSR | S_IWUSR);
+	if (!g_file_set_contents(filename, (char *) data, size, NULL))
+		err = -EIO;
+
+	g_free(data);
+	sdp_cache_close(&cache);
+
+	for (i = 0; i < added; i++)
+		free(bufs[i].data);
+
+	g_free(bufs);
+	g_free(pdus);
+
+	return err;
+}
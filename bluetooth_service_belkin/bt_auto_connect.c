@@ -70,6 +70,8 @@ static struct hci_dev_info di;
 //static int opt_end = 0xffff;
 static int opt_handle = -1;
 static gchar *opt_value = NULL;
+static gchar *opt_bulk_file = NULL;
+static gboolean opt_bulk_prepare = FALSE;
 
 static gchar *opt_hci_list = FALSE;
 static gchar *opt_hci_reset = FALSE;
@@ -107,6 +109,11 @@ uint8_t flag_connect = 0;
 #define EIR_SLAVE_CONN_INTVAL	    0X12  /* Slave connectoin inteval*/
 #define SIZE_1024B 1024
 
+/* Largest ATT MTU, lets a single PDU carry a full attribute value */
+#define BULK_MAX_MTU		(ATT_MAX_VALUE_LEN + 5)
+/* Chunks queued in GAttrib ahead of the link */
+#define BULK_WINDOW		8
+
 #define EIR_MANUFACTURE_SPECIFIC    0xFF
 
 #define BLUETOOTH_DATABASE "devicelist.db"
@@ -116,6 +123,7 @@ uint8_t flag_connect = 0;
 static void char_write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
 							gpointer user_data);
 static gboolean char_write_auto( gpointer user_data);
+static gboolean bulk_write_start(gpointer user_data);
 //sqlite3 *bluetooth_db;
 struct le_devices
 {
@@ -633,6 +641,30 @@ static void gatts_exec_write_req(const uint8_t *pdu, uint16_t len, gpointer user
 		g_attrib_send(attrib, 0, opdu, olen, NULL, NULL, NULL);
 }
 
+static void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	uint16_t mtu;
+
+	if (status != 0 || !dec_mtu_resp(pdu, plen, &mtu)) {
+		printf("# MTU exchange failed, using %u\n", ATT_DEFAULT_LE_MTU);
+		opt_mtu = ATT_DEFAULT_LE_MTU;
+		goto done;
+	}
+
+	mtu = MAX(MIN(mtu, BULK_MAX_MTU), ATT_DEFAULT_LE_MTU);
+
+	if (g_attrib_set_mtu(attrib, mtu))
+		opt_mtu = mtu;
+	else
+		opt_mtu = ATT_DEFAULT_LE_MTU;
+
+	printf("# MTU negotiated: %d\n", opt_mtu);
+
+done:
+	operation(attrib);
+}
+
 static void connect_cb(GIOChannel *io, GError *err, gpointer user_data)
 {
 	uint16_t mtu;
@@ -677,7 +709,10 @@ static void connect_cb(GIOChannel *io, GError *err, gpointer user_data)
 	                  gatts_exec_write_req, attrib, NULL);
 
 	set_state(STATE_CONNECTED);
-	operation(attrib);
+
+	/* Ask for the largest MTU first, every operation benefits from it */
+	if (!gatt_exchange_mtu(attrib, BULK_MAX_MTU, exchange_mtu_cb, NULL))
+		operation(attrib);
 }
 
 static void disconnect_io()
@@ -1332,7 +1367,7 @@ static void * lescan_bt_devices(int dev_id, int argc, char **argv)
 	{
 	le_connect(user_data);	
 	
-	operation = char_write_auto;
+	operation = opt_bulk_file ? bulk_write_start : char_write_auto;
 	g_main_loop_run(event_loop);
 	}
 
@@ -1502,6 +1537,258 @@ error:
 	return FALSE ;
 }
 
+struct bulk_xfer {
+	GAttrib *attrib;
+	uint16_t handle;
+	gchar *data;
+	gsize len;
+	gsize round;
+	gsize sent;
+	gsize done;
+	guint chunks;
+	guint writes;
+	guint in_flight;
+	gboolean failed;
+	gint64 start;
+	gint64 max_latency;
+};
+
+struct bulk_chunk {
+	struct bulk_xfer *xfer;
+	guint index;
+	gsize offset;
+	uint16_t len;
+	gint64 queued;
+};
+
+static struct bulk_xfer bulk;
+
+static void bulk_fill_window(struct bulk_xfer *xfer);
+
+static void bulk_finish(struct bulk_xfer *xfer)
+{
+	gint64 usec = MAX(g_get_monotonic_time() - xfer->start, 1);
+
+	printf("# Bulk %s: %" G_GSIZE_FORMAT " bytes in %u chunks, "
+		"%u writes, %" G_GINT64_FORMAT " ms, %" G_GINT64_FORMAT " B/s, "
+		"max chunk latency %" G_GINT64_FORMAT " us (MTU %d)\n",
+		xfer->failed ? "failed" : "done", xfer->done, xfer->chunks,
+		opt_bulk_prepare ? xfer->writes : xfer->chunks,
+		usec / 1000, (gint64) xfer->done * G_USEC_PER_SEC / usec,
+		xfer->max_latency, opt_mtu);
+
+	if (xfer->failed)
+		resp_error(err_COMM_ERR);
+	else {
+		resp_begin(rsp_WRITE);
+		resp_end();
+	}
+
+	g_free(xfer->data);
+	xfer->data = NULL;
+
+	if (opt_listen == FALSE)
+		g_main_loop_quit(event_loop);
+}
+
+static void bulk_chunk_done(struct bulk_chunk *chunk)
+{
+	struct bulk_xfer *xfer = chunk->xfer;
+	gint64 latency = g_get_monotonic_time() - chunk->queued;
+
+	printf("# chunk %u: offset %" G_GSIZE_FORMAT " len %u latency %"
+				G_GINT64_FORMAT " us\n", chunk->index,
+				chunk->offset, chunk->len, latency);
+
+	xfer->max_latency = MAX(xfer->max_latency, latency);
+	xfer->done += chunk->len;
+	xfer->in_flight--;
+
+	g_free(chunk);
+
+	bulk_fill_window(xfer);
+}
+
+/* Write Commands have no response, the chunk is done once it hits the link */
+static void bulk_cmd_written(gpointer user_data)
+{
+	bulk_chunk_done(user_data);
+}
+
+static void bulk_exec_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct bulk_xfer *xfer = user_data;
+
+	if (status != 0 || !dec_exec_write_resp(pdu, plen)) {
+		xfer->failed = TRUE;
+		xfer->done = xfer->round;
+	} else if (xfer->sent < xfer->len) {
+		/* Committed, go on with the next slice */
+		xfer->round = xfer->sent;
+		bulk_fill_window(xfer);
+		return;
+	}
+
+	bulk_finish(xfer);
+}
+
+static void bulk_prep_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct bulk_chunk *chunk = user_data;
+
+	if (status != 0) {
+		chunk->xfer->failed = TRUE;
+		chunk->len = 0;
+	}
+
+	bulk_chunk_done(chunk);
+}
+
+/*
+ * An Execute Write commits a single attribute value, which is at most
+ * ATT_MAX_VALUE_LEN bytes. Prepared Writes therefore send the file one
+ * value sized slice at a time, each prepared from offset 0 and executed
+ * before the next one starts.
+ */
+static gsize bulk_limit(struct bulk_xfer *xfer)
+{
+	if (opt_bulk_prepare)
+		return MIN(xfer->len, xfer->round + ATT_MAX_VALUE_LEN);
+
+	return xfer->len;
+}
+
+static gboolean bulk_send_chunk(struct bulk_xfer *xfer, gsize limit)
+{
+	struct bulk_chunk *chunk;
+	uint8_t *buf;
+	size_t buflen;
+	guint16 plen;
+	guint id;
+
+	buf = g_attrib_get_buffer(xfer->attrib, &buflen);
+
+	chunk = g_new0(struct bulk_chunk, 1);
+	chunk->xfer = xfer;
+	chunk->index = xfer->chunks;
+	chunk->offset = xfer->sent;
+	chunk->queued = g_get_monotonic_time();
+
+	if (opt_bulk_prepare) {
+		chunk->len = MIN(limit - xfer->sent, buflen - 5);
+		plen = enc_prep_write_req(xfer->handle,
+					chunk->offset - xfer->round,
+					(uint8_t *) xfer->data + chunk->offset,
+					chunk->len, buf, buflen);
+		id = plen ? g_attrib_send(xfer->attrib, 0, buf, plen,
+					bulk_prep_cb, chunk, NULL) : 0;
+	} else {
+		chunk->len = MIN(limit - xfer->sent, buflen - 3);
+		id = gatt_write_cmd(xfer->attrib, xfer->handle,
+					(uint8_t *) xfer->data + chunk->offset,
+					chunk->len, bulk_cmd_written, chunk);
+	}
+
+	if (!id) {
+		g_free(chunk);
+		return FALSE;
+	}
+
+	xfer->sent += chunk->len;
+	xfer->chunks++;
+	xfer->in_flight++;
+
+	return TRUE;
+}
+
+/*
+ * Flow control: at most BULK_WINDOW chunks are queued in GAttrib, each
+ * completion (written command or prepare response) releases the next one.
+ */
+static void bulk_fill_window(struct bulk_xfer *xfer)
+{
+	gsize limit = bulk_limit(xfer);
+
+	while (!xfer->failed && xfer->in_flight < BULK_WINDOW &&
+						xfer->sent < limit) {
+		if (!bulk_send_chunk(xfer, limit))
+			xfer->failed = TRUE;
+	}
+
+	if (xfer->in_flight)
+		return;
+
+	if (xfer->failed && opt_bulk_prepare && xfer->done > xfer->round) {
+		gatt_execute_write(xfer->attrib, ATT_CANCEL_ALL_PREP_WRITES,
+								NULL, NULL);
+		xfer->done = xfer->round;
+		bulk_finish(xfer);
+		return;
+	}
+
+	if (!xfer->failed && opt_bulk_prepare) {
+		if (gatt_execute_write(xfer->attrib, ATT_WRITE_ALL_PREP_WRITES,
+							bulk_exec_cb, xfer)) {
+			xfer->writes++;
+			return;
+		}
+
+		xfer->failed = TRUE;
+	}
+
+	bulk_finish(xfer);
+}
+
+static gboolean bulk_write_start(gpointer user_data)
+{
+	GError *gerr = NULL;
+
+	if (opt_handle <= 0) {
+		g_printerr("A valid handle is required\n");
+		goto error;
+	}
+
+	memset(&bulk, 0, sizeof(bulk));
+
+	if (!g_file_get_contents(opt_bulk_file, &bulk.data, &bulk.len,
+								&gerr)) {
+		g_printerr("%s\n", gerr->message);
+		g_error_free(gerr);
+		goto error;
+	}
+
+	if (!bulk.len) {
+		g_printerr("Invalid payload size %" G_GSIZE_FORMAT "\n",
+								bulk.len);
+		g_free(bulk.data);
+		bulk.data = NULL;
+		goto error;
+	}
+
+	bulk.attrib = user_data;
+	bulk.handle = opt_handle;
+	bulk.start = g_get_monotonic_time();
+
+	printf("# Bulk %s of %" G_GSIZE_FORMAT " bytes to 0x%04x\n",
+			opt_bulk_prepare ? "prepared write" : "write command",
+			bulk.len, bulk.handle);
+
+	if (opt_bulk_prepare && bulk.len > ATT_MAX_VALUE_LEN)
+		printf("# Split into %" G_GSIZE_FORMAT " writes of %d bytes\n",
+				(bulk.len + ATT_MAX_VALUE_LEN - 1) /
+				ATT_MAX_VALUE_LEN, ATT_MAX_VALUE_LEN);
+
+	bulk_fill_window(&bulk);
+
+	return FALSE;
+
+error:
+	g_main_loop_quit(event_loop);
+	return FALSE;
+}
+
 static void cmd_char_write(int parameter ,int argcp, char **argvp)
 {
   operation = cmd_char_write_common ;
@@ -1551,6 +1838,13 @@ static void cmd_help(int parameter,int argc ,char **argvp)
 }
 
 static GOptionEntry bt_options[] = {
+	{ "handle", 'a', 0, G_OPTION_ARG_INT, &opt_handle,
+		"Characteristic value handle", "0x0001" },
+	{ "bulk-file", 'F', 0, G_OPTION_ARG_STRING, &opt_bulk_file,
+		"Stream the file to --handle after connecting", "FILE" },
+	{ "bulk-prepare", 0, 0, G_OPTION_ARG_NONE, &opt_bulk_prepare,
+		"Use Prepared Writes instead of Write Commands, "
+		"512 bytes per Execute Write", NULL },
 	{ NULL },
 };
 
@@ -1616,6 +1910,7 @@ finish:
 	g_free(opt_src);
 	g_free(opt_dst);
 	g_free(opt_sec_level);
+	g_free(opt_bulk_file);
 
 	if (got_error)
 		exit(EXIT_FAILURE);
@@ -0,0 +1,194 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "src/shared/ecc.h"
+
+/*
+ * Latency of getting an LE Secure Connections key pair: generated on the
+ * spot, taken from a warm ecc_keypool, and taken from a pool that is
+ * drained faster than its thread refills it. Prints one JSON object per
+ * case on stdout, like bt_gattbench.
+ */
+
+#define DEFAULT_POOL_SIZE	16
+#define DEFAULT_COUNT		64
+#define WARM_TIMEOUT		30	/* seconds to wait for a full pool */
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void report(const char *name, unsigned int pool_size,
+				unsigned int ops, uint64_t usec,
+				uint64_t max, unsigned int failures)
+{
+	printf("{\"bench\":\"%s\",\"pool\":%u,\"ops\":%u,\"secs\":%.6f,"
+		"\"usec_per_op\":%.3f,\"usec_max\":%llu,\"failures\":%u}\n",
+		name, pool_size, ops, usec / 1000000.0,
+		ops ? usec / (double) ops : 0.0,
+		(unsigned long long) max, failures);
+	fflush(stdout);
+}
+
+static bool run_take(const char *name, struct ecc_keypool *pool,
+				unsigned int pool_size, unsigned int count)
+{
+	uint8_t public_key[64], private_key[32];
+	uint64_t start, total = 0, max = 0;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		uint64_t delta;
+
+		start = get_usec();
+
+		if (!ecc_keypool_take(pool, public_key, private_key)) {
+			fprintf(stderr, "%s: key generation failed\n", name);
+			return false;
+		}
+
+		delta = get_usec() - start;
+		total += delta;
+		if (delta > max)
+			max = delta;
+	}
+
+	report(name, pool_size, count, total, max,
+					ecc_keypool_get_failures(pool));
+
+	return true;
+}
+
+static bool wait_full(struct ecc_keypool *pool, unsigned int size)
+{
+	uint64_t deadline = get_usec() + WARM_TIMEOUT * 1000000ULL;
+
+	while (ecc_keypool_count(pool) < size) {
+		if (get_usec() > deadline)
+			return false;
+
+		usleep(10000);
+	}
+
+	return true;
+}
+
+static void usage(void)
+{
+	printf("bt_eccbench - ECC key pair pool benchmark\n"
+		"Usage:\n");
+	printf("\tbt_eccbench [options]\n");
+	printf("Options:\n"
+		"\t-p, --pool <num>\tPool size (default 16)\n"
+		"\t-c, --count <num>\tKey pairs per case (default 64)\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "pool",	required_argument,	NULL, 'p' },
+	{ "count",	required_argument,	NULL, 'c' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int pool_size = DEFAULT_POOL_SIZE;
+	unsigned int count = DEFAULT_COUNT;
+	struct ecc_keypool *pool;
+	bool ok;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "p:c:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'p':
+			pool_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !pool_size || !count) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Without a pool every take generates synchronously */
+	if (!run_take("make-key", NULL, 0, count))
+		return EXIT_FAILURE;
+
+	pool = ecc_keypool_new(pool_size);
+	if (!pool) {
+		fprintf(stderr, "Failed to create key pool\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!wait_full(pool, pool_size)) {
+		fprintf(stderr, "Pool not full after %u seconds\n",
+							WARM_TIMEOUT);
+		ecc_keypool_free(pool);
+		return EXIT_FAILURE;
+	}
+
+	/* At most a full pool, every take is served from memory */
+	ok = run_take("take-warm", pool, pool_size,
+				count < pool_size ? count : pool_size);
+
+	/* Back to back takes drain it, the rest falls back to generating */
+	if (ok && wait_full(pool, pool_size))
+		ok = run_take("take-drain", pool, pool_size,
+						pool_size + count);
+
+	ecc_keypool_free(pool);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
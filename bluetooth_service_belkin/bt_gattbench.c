@@ -0,0 +1,1410 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "lib/bluetooth.h"
+#include "lib/uuid.h"
+
+#ifdef GATTBENCH_GLIB
+#include <glib.h>
+#else
+#include "src/shared/mainloop.h"
+#endif
+
+#include "src/shared/queue.h"
+#include "src/shared/util.h"
+#include "src/shared/timeout.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-server.h"
+#include "src/shared/gatt-client.h"
+#include "src/shared/shard.h"
+
+/*
+ * ATT/GATT benchmarks with bt_gatt_client and bt_gatt_server talking
+ * over SOCK_SEQPACKET socketpairs in one process. Every case prints
+ * one JSON object per line on stdout, so results can be collected and
+ * compared between builds. CPU time covers both ends of every link.
+ *
+ * Built with GATTBENCH_GLIB the links run on io-glib and timeout-glib
+ * from a GMainLoop instead of the epoll mainloop, so both backends can
+ * be compared on the same cases, e.g. read-each over 200 links.
+ */
+
+#define DEFAULT_DURATION	1000	/* msec per case */
+#define DEFAULT_CLIENTS		20
+#define MAX_WORKERS		64
+#define NOTIFY_WINDOW		64	/* Notification rounds in flight */
+#define LONG_VALUE_LEN		512
+#define MAX_WRITE_LEN		4096	/* Provisioning blobs, above 512 */
+
+#define UUID_BENCH_SERVICE	0xfff0
+#define UUID_BENCH_VALUE	0xfff1
+#define UUID_BENCH_READ		0xfff2
+#define UUID_BENCH_WRITE	0xfff3
+
+struct bench;
+struct shard_ctx;
+
+struct bench_case {
+	const char *name;
+	void (*start)(struct bench *bench);
+	bool discovery;		/* Swept over database sizes */
+	bool multi;		/* Runs on --clients links */
+	bool cached;		/* Values published with gatt_db cache */
+	bool sized;		/* Swept over --length values */
+	bool sharded;		/* Swept over --workers shard threads */
+};
+
+struct link {
+	struct bench *bench;
+	struct shard_ctx *ctx;	/* Shard the link lives on, if any */
+	struct bt_att *server_att;
+	struct bt_att *client_att;
+	struct bt_gatt_server *server;
+	struct bt_gatt_client *client;
+	struct gatt_db *client_db;
+};
+
+struct bench {
+	const struct bench_case *bcase;
+	uint16_t mtu;
+	unsigned int services;
+	uint16_t len;
+
+	struct gatt_db *server_db;
+	uint16_t value_handle;
+	uint16_t read_handle;
+
+	unsigned int num_links;
+	struct link *links;
+	struct bt_gatt_server **servers;
+	unsigned int links_ready;
+
+	unsigned int notify_registered;
+	unsigned int notify_pending;
+
+	unsigned int workers;
+	struct shard_pool *pool;
+	struct shard_ctx *ctxs;
+	unsigned int shards_ready;
+	unsigned int shards_done;
+	unsigned int stop_id;
+	bool read_failed;
+	uint8_t att_ecode;
+
+	bool running;
+	uint64_t start;
+	uint64_t end;
+	struct rusage start_usage;
+	uint64_t ops;
+	uint64_t bytes;
+};
+
+/*
+ * State of one worker of a sharded case. Everything but the counters
+ * handed back at the end is only touched from the worker's thread.
+ */
+struct shard_ctx {
+	struct bench *bench;
+	struct shard *shard;
+	struct gatt_db *db;
+	uint16_t value_handle;
+	uint16_t read_handle;
+	struct link *links;
+	unsigned int num_links;
+	unsigned int links_ready;
+	bool setup_failed;
+	bool running;
+	bool read_failed;
+	uint8_t att_ecode;
+	uint64_t ops;
+	uint64_t bytes;
+};
+
+static uint8_t value[MAX_WRITE_LEN];
+static size_t value_len = LONG_VALUE_LEN;
+static uint8_t ccc_value[2];
+
+static unsigned int duration = DEFAULT_DURATION;
+static struct queue *pending;
+static struct bench *current;
+static bool failed;
+
+#ifdef GATTBENCH_GLIB
+#define LOOP_NAME	"glib"
+
+static GMainLoop *main_loop;
+
+static void loop_init(void)
+{
+	main_loop = g_main_loop_new(NULL, FALSE);
+}
+
+static void loop_quit(void)
+{
+	g_main_loop_quit(main_loop);
+}
+
+static int loop_run(void)
+{
+	g_main_loop_run(main_loop);
+	g_main_loop_unref(main_loop);
+
+	return EXIT_SUCCESS;
+}
+#else
+#define LOOP_NAME	"epoll"
+
+static void loop_init(void)
+{
+	mainloop_init();
+}
+
+static void loop_quit(void)
+{
+	mainloop_exit_success();
+}
+
+static int loop_run(void)
+{
+	return mainloop_run();
+}
+#endif
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t rusage_usec(const struct rusage *usage)
+{
+	return usage->ru_utime.tv_sec * 1000000ULL + usage->ru_utime.tv_usec +
+		usage->ru_stime.tv_sec * 1000000ULL + usage->ru_stime.tv_usec;
+}
+
+static void value_read_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	if (offset > value_len) {
+		gatt_db_attribute_read_result(attrib, id,
+					BT_ATT_ERROR_INVALID_OFFSET, NULL, 0);
+		return;
+	}
+
+	gatt_db_attribute_read_result(attrib, id, 0, value + offset,
+							value_len - offset);
+}
+
+static void value_write_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, const uint8_t *data,
+					size_t len, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	if (offset + len > sizeof(value)) {
+		gatt_db_attribute_write_result(attrib, id,
+					BT_ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LEN);
+		return;
+	}
+
+	memcpy(value + offset, data, len);
+
+	gatt_db_attribute_write_result(attrib, id, 0);
+}
+
+static void ccc_read_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	gatt_db_attribute_read_result(attrib, id, 0, ccc_value,
+							sizeof(ccc_value));
+}
+
+static void ccc_write_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, const uint8_t *data,
+					size_t len, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	if (offset || len != sizeof(ccc_value)) {
+		gatt_db_attribute_write_result(attrib, id,
+					BT_ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LEN);
+		return;
+	}
+
+	memcpy(ccc_value, data, len);
+
+	gatt_db_attribute_write_result(attrib, id, 0);
+}
+
+/*
+ * Every service holds a read/write/notify value with its CCC plus a read
+ * only and a write only characteristic, eight handles in total. The
+ * value handles of the first service are the ones the operation cases
+ * use.
+ */
+static struct gatt_db *create_db(unsigned int services,
+						uint16_t *value_handle,
+						uint16_t *read_handle)
+{
+	struct gatt_db *db;
+	unsigned int i;
+
+	db = gatt_db_new();
+	if (!db)
+		return NULL;
+
+	for (i = 0; i < services; i++) {
+		struct gatt_db_attribute *service, *attrib;
+		bt_uuid_t uuid;
+
+		bt_uuid16_create(&uuid, UUID_BENCH_SERVICE);
+		service = gatt_db_add_service(db, &uuid, true, 8);
+		if (!service)
+			goto fail;
+
+		bt_uuid16_create(&uuid, UUID_BENCH_VALUE);
+		attrib = gatt_db_service_add_characteristic(service, &uuid,
+					BT_ATT_PERM_READ | BT_ATT_PERM_WRITE,
+					BT_GATT_CHRC_PROP_READ |
+					BT_GATT_CHRC_PROP_WRITE |
+					BT_GATT_CHRC_PROP_NOTIFY,
+					value_read_cb, value_write_cb, NULL);
+		if (!attrib)
+			goto fail;
+
+		if (!i)
+			*value_handle = gatt_db_attribute_get_handle(attrib);
+
+		bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+		gatt_db_service_add_descriptor(service, &uuid,
+					BT_ATT_PERM_READ | BT_ATT_PERM_WRITE,
+					ccc_read_cb, ccc_write_cb, NULL);
+
+		bt_uuid16_create(&uuid, UUID_BENCH_READ);
+		attrib = gatt_db_service_add_characteristic(service, &uuid,
+					BT_ATT_PERM_READ,
+					BT_GATT_CHRC_PROP_READ,
+					value_read_cb, NULL, NULL);
+		if (!attrib)
+			goto fail;
+
+		if (!i)
+			*read_handle = gatt_db_attribute_get_handle(attrib);
+
+		bt_uuid16_create(&uuid, UUID_BENCH_WRITE);
+		gatt_db_service_add_characteristic(service, &uuid,
+					BT_ATT_PERM_WRITE,
+					BT_GATT_CHRC_PROP_WRITE,
+					NULL, value_write_cb, NULL);
+
+		gatt_db_service_set_active(service, true);
+	}
+
+	return db;
+
+fail:
+	gatt_db_unref(db);
+	return NULL;
+}
+
+static void link_destroy(struct link *link)
+{
+	bt_gatt_client_unref(link->client);
+	link->client = NULL;
+
+	bt_gatt_server_unref(link->server);
+	link->server = NULL;
+
+	bt_att_unref(link->client_att);
+	link->client_att = NULL;
+
+	bt_att_unref(link->server_att);
+	link->server_att = NULL;
+
+	gatt_db_unref(link->client_db);
+	link->client_db = NULL;
+}
+
+static void links_destroy(struct bench *bench)
+{
+	unsigned int i;
+
+	for (i = 0; i < bench->num_links; i++) {
+		link_destroy(&bench->links[i]);
+		bench->servers[i] = NULL;
+	}
+
+	bench->links_ready = 0;
+	bench->notify_registered = 0;
+	bench->notify_pending = 0;
+}
+
+static void shards_destroy(struct bench *bench);
+
+static void bench_free(void *data)
+{
+	struct bench *bench = data;
+
+	if (bench->stop_id)
+		timeout_remove(bench->stop_id);
+
+	if (bench->pool)
+		shards_destroy(bench);
+	else
+		links_destroy(bench);
+
+	gatt_db_unref(bench->server_db);
+	free(bench->ctxs);
+	free(bench->servers);
+	free(bench->links);
+	free(bench);
+}
+
+static void ready_cb(bool success, uint8_t att_ecode, void *user_data);
+
+static bool link_create(struct link *link)
+{
+	struct bench *bench = link->bench;
+	struct gatt_db *db = link->ctx ? link->ctx->db : bench->server_db;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+		return false;
+
+	link->server_att = bt_att_new(fds[0]);
+	if (!link->server_att) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	bt_att_set_close_on_unref(link->server_att, true);
+
+	link->client_att = bt_att_new(fds[1]);
+	if (!link->client_att) {
+		close(fds[1]);
+		return false;
+	}
+
+	bt_att_set_close_on_unref(link->client_att, true);
+
+	link->server = bt_gatt_server_new(db, link->server_att, bench->mtu);
+	if (!link->server)
+		return false;
+
+	link->client_db = gatt_db_new();
+	if (!link->client_db)
+		return false;
+
+	link->client = bt_gatt_client_new(link->client_db, link->client_att,
+								bench->mtu);
+	if (!link->client)
+		return false;
+
+	return bt_gatt_client_set_ready_handler(link->client, ready_cb, link,
+									NULL);
+}
+
+static bool links_create(struct bench *bench)
+{
+	unsigned int i;
+
+	for (i = 0; i < bench->num_links; i++) {
+		if (!link_create(&bench->links[i]))
+			return false;
+
+		bench->servers[i] = bench->links[i].server;
+	}
+
+	return true;
+}
+
+static bool next_case(void *user_data);
+
+/* Tear down from the loop, never from inside a client callback */
+static void schedule_next(void)
+{
+	timeout_add(0, next_case, NULL, NULL);
+}
+
+static void report(struct bench *bench)
+{
+	struct rusage usage;
+	double secs;
+	uint64_t cpu;
+
+	getrusage(RUSAGE_SELF, &usage);
+	cpu = rusage_usec(&usage) - rusage_usec(&bench->start_usage);
+	secs = (bench->end - bench->start) / 1000000.0;
+
+	printf("{\"bench\":\"%s\",\"loop\":\"%s\",\"mtu\":%u,"
+		"\"services\":%u,\"links\":%u,\"workers\":%u,\"len\":%u,\"ops\":%llu,\"bytes\":%llu,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"bytes_per_sec\":%.1f,"
+		"\"usec_per_op\":%.3f,\"cpu_usec_per_op\":%.3f}\n",
+		bench->bcase->name, LOOP_NAME, bench->mtu, bench->services,
+		bench->num_links, bench->workers, bench->len,
+		(unsigned long long) bench->ops,
+		(unsigned long long) bench->bytes, secs,
+		secs > 0 ? bench->ops / secs : 0.0,
+		secs > 0 ? bench->bytes / secs : 0.0,
+		bench->ops ? (bench->end - bench->start) /
+					(double) bench->ops : 0.0,
+		bench->ops ? cpu / (double) bench->ops : 0.0);
+	fflush(stdout);
+}
+
+static void bench_begin(struct bench *bench)
+{
+	getrusage(RUSAGE_SELF, &bench->start_usage);
+	bench->start = get_usec();
+	bench->ops = 0;
+	bench->bytes = 0;
+	bench->running = true;
+}
+
+/* Counts one finished operation, returns false once time is up */
+static bool bench_op_done(struct bench *bench, uint16_t bytes)
+{
+	if (!bench->running)
+		return false;
+
+	bench->ops++;
+	bench->bytes += bytes;
+
+	bench->end = get_usec();
+	if (bench->end - bench->start < duration * 1000ULL)
+		return true;
+
+	bench->running = false;
+
+	report(bench);
+	schedule_next();
+
+	return false;
+}
+
+static void bench_fail(struct bench *bench, const char *what,
+							uint8_t att_ecode)
+{
+	/* Every link of a case may fail the same way, report it once */
+	if (!bench->running && bench->ops)
+		return;
+
+	fprintf(stderr, "%s (mtu %u, services %u): %s failed, ecode 0x%02x\n",
+				bench->bcase->name, bench->mtu,
+				bench->services, what, att_ecode);
+
+	failed = true;
+	bench->running = false;
+	bench->ops = 1;
+
+	schedule_next();
+}
+
+static uint16_t payload_len(struct link *link, uint16_t overhead)
+{
+	uint16_t len = bt_gatt_client_get_mtu(link->client) - overhead;
+
+	return len > LONG_VALUE_LEN ? LONG_VALUE_LEN : len;
+}
+
+/* Cached cases publish the value so the server answers without read_func */
+static void publish_value(struct bench *bench, uint16_t handle)
+{
+	struct gatt_db_attribute *attrib;
+
+	if (!bench->bcase->cached)
+		return;
+
+	attrib = gatt_db_get_attribute(bench->server_db, handle);
+	gatt_db_attribute_set_cache(attrib, value, value_len);
+}
+
+static void read_cb(bool success, uint8_t att_ecode, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (!success) {
+		bench_fail(bench, "read", att_ecode);
+		return;
+	}
+
+	if (!bench_op_done(bench, length))
+		return;
+
+	bt_gatt_client_read_value(link->client, bench->value_handle,
+						read_cb, link, NULL);
+}
+
+/* One read in flight per link, read-each runs it on --clients links */
+static void start_read(struct bench *bench)
+{
+	unsigned int i;
+
+	value_len = payload_len(&bench->links[0], 1);
+	bench->len = value_len;
+
+	publish_value(bench, bench->value_handle);
+
+	bench_begin(bench);
+
+	for (i = 0; i < bench->num_links; i++)
+		bt_gatt_client_read_value(bench->links[i].client,
+						bench->value_handle, read_cb,
+						&bench->links[i], NULL);
+}
+
+static void read_multiple_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+	uint16_t handles[2] = { bench->value_handle, bench->read_handle };
+
+	if (!success) {
+		bench_fail(bench, "read multiple", att_ecode);
+		return;
+	}
+
+	if (!bench_op_done(bench, length))
+		return;
+
+	bt_gatt_client_read_multiple(link->client, handles, 2,
+					read_multiple_cb, link, NULL);
+}
+
+static void start_read_multiple(struct bench *bench)
+{
+	struct link *link = &bench->links[0];
+	uint16_t handles[2] = { bench->value_handle, bench->read_handle };
+
+	/* Both values fit into one response */
+	value_len = payload_len(link, 1) / 2;
+	bench->len = value_len * 2;
+
+	publish_value(bench, bench->value_handle);
+	publish_value(bench, bench->read_handle);
+
+	bench_begin(bench);
+
+	bt_gatt_client_read_multiple(link->client, handles, 2,
+					read_multiple_cb, link, NULL);
+}
+
+static void write_cb(bool success, uint8_t att_ecode, void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (!success) {
+		bench_fail(bench, "write", att_ecode);
+		return;
+	}
+
+	if (!bench_op_done(bench, bench->len))
+		return;
+
+	bt_gatt_client_write_value(link->client, bench->value_handle,
+					value, bench->len, write_cb, link, NULL);
+}
+
+static void start_write(struct bench *bench)
+{
+	struct link *link = &bench->links[0];
+
+	bench->len = payload_len(link, 3);
+
+	bench_begin(bench);
+
+	bt_gatt_client_write_value(link->client, bench->value_handle, value,
+					bench->len, write_cb, link, NULL);
+}
+
+/*
+ * Notifications are sent in rounds, one per link and round. The
+ * fan-out case encodes a round once and shares it between all links,
+ * the others encode it for every link.
+ */
+static void notify_rounds(struct bench *bench, unsigned int rounds)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		if (!strcmp(bench->bcase->name, "notify-fanout")) {
+			bt_gatt_server_send_notification_multi(bench->servers,
+						bench->num_links,
+						bench->value_handle,
+						value, bench->len);
+			continue;
+		}
+
+		for (j = 0; j < bench->num_links; j++)
+			bt_gatt_server_send_notification(bench->servers[j],
+						bench->value_handle,
+						value, bench->len);
+	}
+
+	bench->notify_pending += rounds * bench->num_links;
+}
+
+static void notify_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (!bench->notify_pending)
+		return;
+
+	bench->notify_pending--;
+
+	if (!bench_op_done(bench, length))
+		return;
+
+	/* Keep the socket busy without flooding it */
+	if (bench->notify_pending == NOTIFY_WINDOW / 2 * bench->num_links)
+		notify_rounds(bench, NOTIFY_WINDOW / 2);
+}
+
+static void register_notify_cb(unsigned int id, uint16_t att_ecode,
+							void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (att_ecode) {
+		bench_fail(bench, "notify registration", att_ecode);
+		return;
+	}
+
+	if (++bench->notify_registered < bench->num_links)
+		return;
+
+	bench_begin(bench);
+	notify_rounds(bench, NOTIFY_WINDOW);
+}
+
+static void start_notify(struct bench *bench)
+{
+	unsigned int i;
+
+	bench->len = payload_len(&bench->links[0], 3);
+
+	for (i = 0; i < bench->num_links; i++) {
+		struct link *link = &bench->links[i];
+
+		if (!bt_gatt_client_register_notify(link->client,
+						bench->value_handle,
+						register_notify_cb, notify_cb,
+						link, NULL)) {
+			bench_fail(bench, "notify registration", 0);
+			return;
+		}
+	}
+}
+
+static void read_long_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (!success) {
+		bench_fail(bench, "long read", att_ecode);
+		return;
+	}
+
+	if (!bench_op_done(bench, length))
+		return;
+
+	bt_gatt_client_read_long_value(link->client, bench->value_handle, 0,
+						read_long_cb, link, NULL);
+}
+
+static void start_read_long(struct bench *bench)
+{
+	struct link *link = &bench->links[0];
+
+	value_len = LONG_VALUE_LEN;
+	bench->len = value_len;
+
+	bench_begin(bench);
+
+	bt_gatt_client_read_long_value(link->client, bench->value_handle, 0,
+						read_long_cb, link, NULL);
+}
+
+static void write_long_cb(bool success, bool reliable_error,
+					uint8_t att_ecode, void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	if (!success) {
+		bench_fail(bench, "long write", att_ecode);
+		return;
+	}
+
+	if (!bench_op_done(bench, bench->len))
+		return;
+
+	bt_gatt_client_write_long_value(link->client, false,
+					bench->value_handle, 0, value,
+					bench->len, write_long_cb, link, NULL);
+}
+
+static void start_write_long(struct bench *bench)
+{
+	struct link *link = &bench->links[0];
+
+	bench_begin(bench);
+
+	bt_gatt_client_write_long_value(link->client, false,
+					bench->value_handle, 0, value,
+					bench->len, write_long_cb, link, NULL);
+}
+
+/*
+ * Sharded reads keep one read in flight per link like read-each, with
+ * the links spread over a pool of --workers threads. A gatt_db is not
+ * thread safe, so every shard builds its own server database and
+ * creates, runs and destroys its links on its own loop. The home thread
+ * only starts and stops the shards and adds up their counts.
+ */
+static void home_shard_ready(void *user_data);
+static void home_shard_done(void *user_data);
+
+static void shard_report_ready(struct shard_ctx *ctx)
+{
+	shard_pool_invoke_home(ctx->bench->pool, home_shard_ready, ctx, NULL);
+}
+
+static void shard_setup(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+	unsigned int i;
+
+	ctx->db = create_db(1, &ctx->value_handle, &ctx->read_handle);
+	if (!ctx->db)
+		goto failed;
+
+	for (i = 0; i < ctx->num_links; i++) {
+		if (!link_create(&ctx->links[i]))
+			goto failed;
+	}
+
+	if (!ctx->num_links)
+		shard_report_ready(ctx);
+
+	return;
+
+failed:
+	ctx->setup_failed = true;
+	shard_report_ready(ctx);
+}
+
+static void shard_link_ready(struct link *link, bool success,
+							uint8_t att_ecode)
+{
+	struct shard_ctx *ctx = link->ctx;
+
+	if (ctx->setup_failed)
+		return;
+
+	if (!success) {
+		ctx->setup_failed = true;
+		ctx->att_ecode = att_ecode;
+		shard_report_ready(ctx);
+		return;
+	}
+
+	if (++ctx->links_ready == ctx->num_links)
+		shard_report_ready(ctx);
+}
+
+static void shard_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct link *link = user_data;
+	struct shard_ctx *ctx = link->ctx;
+
+	if (!ctx->running)
+		return;
+
+	if (!success) {
+		ctx->read_failed = true;
+		ctx->att_ecode = att_ecode;
+		ctx->running = false;
+		return;
+	}
+
+	ctx->ops++;
+	ctx->bytes += length;
+
+	bt_gatt_client_read_value(link->client, ctx->value_handle,
+						shard_read_cb, link, NULL);
+}
+
+static void shard_start(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+	unsigned int i;
+
+	ctx->running = true;
+
+	for (i = 0; i < ctx->num_links; i++)
+		bt_gatt_client_read_value(ctx->links[i].client,
+						ctx->value_handle, shard_read_cb,
+						&ctx->links[i], NULL);
+}
+
+static void shard_stop(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+
+	ctx->running = false;
+
+	shard_pool_invoke_home(ctx->bench->pool, home_shard_done, ctx, NULL);
+}
+
+static void shard_teardown(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+	unsigned int i;
+
+	for (i = 0; i < ctx->num_links; i++)
+		link_destroy(&ctx->links[i]);
+
+	gatt_db_unref(ctx->db);
+	ctx->db = NULL;
+}
+
+static bool shards_stop(void *user_data)
+{
+	struct bench *bench = user_data;
+	unsigned int i;
+
+	bench->stop_id = 0;
+	bench->end = get_usec();
+	bench->running = false;
+
+	for (i = 0; i < bench->workers; i++)
+		shard_invoke(bench->ctxs[i].shard, shard_stop,
+						&bench->ctxs[i], NULL);
+
+	return false;
+}
+
+static void home_shard_ready(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+	struct bench *bench = ctx->bench;
+	unsigned int i;
+
+	/* A failed case has ops set and is already on its way out */
+	if (bench->ops)
+		return;
+
+	if (ctx->setup_failed) {
+		bench_fail(bench, "link setup", ctx->att_ecode);
+		return;
+	}
+
+	if (++bench->shards_ready < bench->workers)
+		return;
+
+	bench_begin(bench);
+
+	for (i = 0; i < bench->workers; i++)
+		shard_invoke(bench->ctxs[i].shard, shard_start,
+						&bench->ctxs[i], NULL);
+
+	bench->stop_id = timeout_add(duration, shards_stop, bench, NULL);
+}
+
+static void home_shard_done(void *user_data)
+{
+	struct shard_ctx *ctx = user_data;
+	struct bench *bench = ctx->bench;
+
+	bench->ops += ctx->ops;
+	bench->bytes += ctx->bytes;
+
+	if (ctx->read_failed) {
+		bench->read_failed = true;
+		bench->att_ecode = ctx->att_ecode;
+	}
+
+	if (++bench->shards_done < bench->workers)
+		return;
+
+	if (bench->read_failed) {
+		fprintf(stderr, "%s (mtu %u, workers %u): read failed, "
+					"ecode 0x%02x\n", bench->bcase->name,
+					bench->mtu, bench->workers,
+					bench->att_ecode);
+		failed = true;
+	} else
+		report(bench);
+
+	schedule_next();
+}
+
+static bool shards_create(struct bench *bench)
+{
+	unsigned int i;
+
+	bench->pool = shard_pool_new(bench->workers);
+	if (!bench->pool)
+		return false;
+
+	/* Both ends run on the worker, size the value for the MTU here */
+	value_len = bench->mtu - 1 > LONG_VALUE_LEN ? LONG_VALUE_LEN :
+								bench->mtu - 1;
+	bench->len = value_len;
+
+	for (i = 0; i < bench->workers; i++) {
+		struct shard_ctx *ctx = &bench->ctxs[i];
+
+		ctx->shard = shard_pool_acquire(bench->pool);
+
+		if (!shard_invoke(ctx->shard, shard_setup, ctx, NULL))
+			return false;
+	}
+
+	return true;
+}
+
+static void shards_destroy(struct bench *bench)
+{
+	unsigned int i;
+
+	/* Queued ahead of the quit, so links go away on their own thread */
+	for (i = 0; i < bench->workers; i++) {
+		if (!bench->ctxs[i].shard)
+			continue;
+
+		shard_invoke(bench->ctxs[i].shard, shard_teardown,
+						&bench->ctxs[i], NULL);
+		shard_release(bench->ctxs[i].shard);
+	}
+
+	shard_pool_free(bench->pool);
+	bench->pool = NULL;
+}
+
+static const struct bench_case cases[] = {
+	{ "discovery",	NULL,			true,	false,	false,	false },
+	{ "read",	start_read,		false,	false,	false,	false },
+	{ "read-cached", start_read,		false,	false,	true,	false },
+	{ "read-each",	start_read,		false,	true,	false,	false },
+	{ "read-sharded", NULL,			false,	true,	false,	false,	true },
+	{ "read-multiple", start_read_multiple,	false,	false,	false,	false },
+	{ "read-multiple-cached", start_read_multiple,
+						false,	false,	true,	false },
+	{ "write",	start_write,		false,	false,	false,	false },
+	{ "notify",	start_notify,		false,	false,	false,	false },
+	{ "notify-each", start_notify,		false,	true,	false,	false },
+	{ "notify-fanout", start_notify,	false,	true,	false,	false },
+	{ "read-long",	start_read_long,	false,	false,	false,	false },
+	{ "write-long",	start_write_long,	false,	false,	false,	true  },
+	{ }
+};
+
+static bool rediscover(void *user_data)
+{
+	struct bench *bench = user_data;
+
+	link_destroy(&bench->links[0]);
+
+	if (!link_create(&bench->links[0]))
+		bench_fail(bench, "link setup", 0);
+
+	return false;
+}
+
+static void ready_cb(bool success, uint8_t att_ecode, void *user_data)
+{
+	struct link *link = user_data;
+	struct bench *bench = link->bench;
+
+	/* Runs on the link's shard, leave the home state alone */
+	if (link->ctx) {
+		shard_link_ready(link, success, att_ecode);
+		return;
+	}
+
+	if (!success) {
+		bench_fail(bench, "discovery", att_ecode);
+		return;
+	}
+
+	if (!bench->bcase->discovery) {
+		if (++bench->links_ready == bench->num_links)
+			bench->bcase->start(bench);
+
+		return;
+	}
+
+	/* One operation is one full discovery on a fresh link */
+	if (!bench_op_done(bench, 0))
+		return;
+
+	timeout_add(0, rediscover, bench, NULL);
+}
+
+static bool next_case(void *user_data)
+{
+	if (current) {
+		bench_free(current);
+		current = NULL;
+	}
+
+	current = queue_pop_head(pending);
+	if (!current) {
+		loop_quit();
+		return false;
+	}
+
+	if (current->bcase->sharded) {
+		if (!shards_create(current))
+			bench_fail(current, "shard setup", 0);
+
+		return false;
+	}
+
+	if (current->bcase->discovery)
+		bench_begin(current);
+
+	if (!links_create(current))
+		bench_fail(current, "link setup", 0);
+
+	return false;
+}
+
+static bool add_case(const struct bench_case *bcase, uint16_t mtu,
+				unsigned int services, unsigned int num_links,
+				uint16_t len, unsigned int workers)
+{
+	struct bench *bench;
+	unsigned int i;
+
+	bench = new0(struct bench, 1);
+	if (!bench)
+		return false;
+
+	bench->bcase = bcase;
+	bench->mtu = mtu;
+	bench->services = services;
+	bench->num_links = num_links;
+	bench->len = len;
+	bench->workers = workers;
+
+	bench->links = new0(struct link, num_links);
+	bench->servers = new0(struct bt_gatt_server *, num_links);
+	bench->ctxs = new0(struct shard_ctx, workers);
+	bench->server_db = create_db(services, &bench->value_handle,
+							&bench->read_handle);
+
+	if (!bench->links || !bench->servers || !bench->ctxs ||
+						!bench->server_db) {
+		bench_free(bench);
+		return false;
+	}
+
+	for (i = 0; i < num_links; i++)
+		bench->links[i].bench = bench;
+
+	/* Sharded cases split the links into one contiguous run per shard */
+	for (i = 0; bcase->sharded && i < workers; i++) {
+		struct shard_ctx *ctx = &bench->ctxs[i];
+		unsigned int first = i * num_links / workers;
+		unsigned int j;
+
+		ctx->bench = bench;
+		ctx->links = &bench->links[first];
+		ctx->num_links = (i + 1) * num_links / workers - first;
+
+		for (j = 0; j < ctx->num_links; j++)
+			ctx->links[j].ctx = ctx;
+	}
+
+	if (!queue_push_tail(pending, bench)) {
+		bench_free(bench);
+		return false;
+	}
+
+	return true;
+}
+
+static bool parse_list(const char *str, unsigned int *list,
+					unsigned int *count, unsigned int max)
+{
+	char *end;
+
+	*count = 0;
+
+	while (*str) {
+		unsigned long val = strtoul(str, &end, 0);
+
+		if (end == str || !val || *count == max)
+			return false;
+
+		list[(*count)++] = val;
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return false;
+
+		str = end;
+	}
+
+	return *count > 0;
+}
+
+static void usage(void)
+{
+	printf("bt_gattbench - ATT/GATT benchmarks over socketpairs\n"
+		"Usage:\n");
+	printf("\tbt_gattbench [options]\n");
+	printf("Options:\n"
+		"\t-t, --time <msec>\tDuration of every case (default 1000)\n"
+		"\t-m, --mtu <list>\tMTUs for operation cases "
+							"(default 23,185,247)\n"
+		"\t-s, --services <list>\tDatabase sizes for discovery "
+							"(default 8,64,512)\n"
+		"\t-c, --clients <num>\tLinks for read-each, read-sharded, "
+				"notify-each and notify-fanout (default 20)\n"
+		"\t-l, --length <list>\tValue lengths for write-long "
+						"(default 512,4096)\n"
+		"\t-w, --workers <list>\tShard threads for read-sharded "
+							"(default 1,2,4)\n"
+		"\t-b, --bench <name>\tOnly run the named case\n"
+		"\t-h, --help\t\tShow help options\n");
+	printf("Cases:\n");
+	printf("\tdiscovery read read-cached read-each read-sharded\n"
+		"\tread-multiple read-multiple-cached\n"
+		"\twrite notify notify-each notify-fanout read-long "
+							"write-long\n");
+}
+
+static const struct option main_options[] = {
+	{ "time",	required_argument,	NULL, 't' },
+	{ "mtu",	required_argument,	NULL, 'm' },
+	{ "services",	required_argument,	NULL, 's' },
+	{ "clients",	required_argument,	NULL, 'c' },
+	{ "length",	required_argument,	NULL, 'l' },
+	{ "workers",	required_argument,	NULL, 'w' },
+	{ "bench",	required_argument,	NULL, 'b' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int mtus[8] = { 23, 185, 247 };
+	unsigned int num_mtus = 3;
+	unsigned int sizes[8] = { 8, 64, 512 };
+	unsigned int num_sizes = 3;
+	unsigned int lengths[8] = { LONG_VALUE_LEN, MAX_WRITE_LEN };
+	unsigned int num_lengths = 2;
+	unsigned int workers[8] = { 1, 2, 4 };
+	unsigned int num_workers = 3;
+	unsigned int clients = DEFAULT_CLIENTS;
+	const char *only = NULL;
+	const struct bench_case *bcase;
+	unsigned int i;
+	int exit_status;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "t:m:s:c:l:w:b:h", main_options,
+									NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			if (!parse_list(optarg, mtus, &num_mtus, 8)) {
+				fprintf(stderr, "Invalid MTU list\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			if (!parse_list(optarg, sizes, &num_sizes, 8)) {
+				fprintf(stderr, "Invalid database sizes\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'c':
+			clients = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			if (!parse_list(optarg, lengths, &num_lengths, 8)) {
+				fprintf(stderr, "Invalid value lengths\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'w':
+			if (!parse_list(optarg, workers, &num_workers, 8)) {
+				fprintf(stderr, "Invalid worker counts\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			only = optarg;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !clients) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < num_mtus; i++) {
+		if (mtus[i] < 23 || mtus[i] > 517) {
+			fprintf(stderr, "MTU %u out of range\n", mtus[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Services take eight handles each */
+	for (i = 0; i < num_sizes; i++) {
+		if (sizes[i] > 0xffff / 8) {
+			fprintf(stderr, "Too many services: %u\n", sizes[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < num_lengths; i++) {
+		if (lengths[i] > MAX_WRITE_LEN) {
+			fprintf(stderr, "Value length %u above %u\n",
+						lengths[i], MAX_WRITE_LEN);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		if (workers[i] > MAX_WORKERS) {
+			fprintf(stderr, "Too many workers: %u\n", workers[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < sizeof(value); i++)
+		value[i] = i;
+
+	pending = queue_new();
+
+	for (bcase = cases; bcase->name; bcase++) {
+		unsigned int j;
+
+		if (only && strcmp(only, bcase->name))
+			continue;
+
+		for (j = 0; j < (bcase->discovery ? num_sizes : num_mtus); j++) {
+			unsigned int k, num_k = 1;
+
+			if (bcase->sized)
+				num_k = num_lengths;
+			else if (bcase->sharded)
+				num_k = num_workers;
+
+			for (k = 0; k < num_k; k++) {
+				bool ok;
+
+				if (bcase->discovery)
+					ok = add_case(bcase, 247, sizes[j], 1,
+									0, 1);
+				else
+					ok = add_case(bcase, mtus[j], 1,
+						bcase->multi ? clients : 1,
+						bcase->sized ? lengths[k] : 0,
+						bcase->sharded ? workers[k] : 1);
+
+				if (!ok)
+					goto fail;
+			}
+		}
+	}
+
+	if (queue_isempty(pending)) {
+		fprintf(stderr, "Unknown benchmark: %s\n", only);
+		queue_destroy(pending, NULL);
+		return EXIT_FAILURE;
+	}
+
+	loop_init();
+
+	timeout_add(0, next_case, NULL, NULL);
+
+	exit_status = loop_run();
+
+	if (current)
+		bench_free(current);
+
+	queue_destroy(pending, bench_free);
+
+	return failed ? EXIT_FAILURE : exit_status;
+
+fail:
+	fprintf(stderr, "Failed to set up %s\n", bcase->name);
+	queue_destroy(pending, bench_free);
+
+	return EXIT_FAILURE;
+}
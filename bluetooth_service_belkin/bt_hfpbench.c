@@ -0,0 +1,619 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "src/shared/mainloop.h"
+#include "src/shared/io.h"
+#include "src/shared/timeout.h"
+#include "src/shared/hfp.h"
+
+/*
+ * Fuzz and throughput harness for the AT command parser in shared/hfp.
+ *
+ * The parse case streams random AT lines into an hfp_gw in random sized
+ * chunks, so lines keep straddling the end of its ring buffer, and checks
+ * every dispatch against what the generator expects: upper-cased prefix
+ * lookup against prefixes matched as registered, command type, numeric
+ * arguments and the raw line for unknown commands. Lines with a mixed case
+ * "At" are dropped by the parser and must not dispatch at all.
+ *
+ * The roundtrip case runs hfp_hf against hfp_gw over a socketpair and
+ * times AT+VGS=<n> / OK exchanges. Both print one JSON object per line
+ * and the tool exits non-zero on any mismatch.
+ */
+
+#define DEFAULT_COMMANDS	100000
+#define DEFAULT_ROUNDTRIPS	200000
+#define MAX_OUTSTANDING		256	/* Expected dispatches in flight */
+#define MAX_NUMBERS		4
+#define MAX_LINE		64
+#define STALL_TIMEOUT		5000	/* msec without progress */
+
+enum expect_kind {
+	EXPECT_HANDLER,
+	EXPECT_UNKNOWN,
+};
+
+struct expect {
+	enum expect_kind kind;
+	const char *prefix;
+	enum hfp_gw_cmd_type type;
+	unsigned int numbers[MAX_NUMBERS];
+	unsigned int num_numbers;
+	char line[MAX_LINE];
+};
+
+/* Registered prefixes start with '+' unless they are single letters */
+static const char *registered[] = {
+	"A", "D", "+BRSF", "+CIND", "+CMER", "+CHLD", "+BAC", "+VGS",
+	"+VGM", "+CLIP", "+CCWA", "+NREC", "+BVRA", "+CLCC", "+COPS",
+	"+CMEE", "+CNUM", "+BIA", "+BCC", "+BCS", "+CHUP", "+xlow",
+	NULL
+};
+
+static const char *unregistered[] = {
+	"Z", "+XAPL", "+IPHONEACCEV", "+BTRH", "+CSRSF", "+XLOW", NULL
+};
+
+static struct expect expected[MAX_OUTSTANDING];
+static unsigned int expect_head;
+static unsigned int expect_count;
+
+static struct hfp_gw *gw;
+static struct io *peer_io;
+static int peer_fd = -1;
+
+static char stream[MAX_LINE + 2];
+static size_t stream_len;
+static size_t stream_off;
+
+static unsigned int commands = DEFAULT_COMMANDS;
+static unsigned int generated;
+static unsigned int dispatched;
+static unsigned int mismatches;
+static unsigned int progress;
+static uint64_t start;
+static uint32_t seed = 1;
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint32_t rand32(void)
+{
+	/* xorshift32, reproducible for a given --seed */
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	return seed;
+}
+
+static unsigned int list_len(const char **list)
+{
+	unsigned int i;
+
+	for (i = 0; list[i]; i++)
+		;
+
+	return i;
+}
+
+static void mismatch(const char *fmt, const char *a, const char *b)
+{
+	if (mismatches++ < 10) {
+		fprintf(stderr, "mismatch at command %u: ", dispatched);
+		fprintf(stderr, fmt, a, b);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void random_case(char *dst, const char *src)
+{
+	for (; *src; src++)
+		*dst++ = rand32() & 1 ? tolower(*src) : toupper(*src);
+
+	*dst = '\0';
+}
+
+static const char *find_registered(const char *prefix)
+{
+	unsigned int i;
+
+	for (i = 0; registered[i]; i++) {
+		if (!strcmp(registered[i], prefix))
+			return registered[i];
+	}
+
+	return NULL;
+}
+
+/* Builds the next line into stream and records what it must dispatch */
+static void generate(void)
+{
+	struct expect *exp = &expected[(expect_head + expect_count) %
+							MAX_OUTSTANDING];
+	const char *base, *match;
+	char prefix[24], upper[24], args[40];
+	unsigned int i, r = rand32() % 16;
+
+	memset(exp, 0, sizeof(*exp));
+	args[0] = '\0';
+
+	if (r < 11)
+		base = registered[rand32() % list_len(registered)];
+	else
+		base = unregistered[rand32() % list_len(unregistered)];
+
+	random_case(prefix, base);
+
+	for (i = 0; prefix[i]; i++)
+		upper[i] = toupper(prefix[i]);
+	upper[i] = '\0';
+
+	if (!strcmp(upper, "D")) {
+		exp->type = HFP_GW_CMD_TYPE_SET;
+		exp->numbers[0] = rand32() % 1000000000;
+		exp->num_numbers = 1;
+		sprintf(args, "%u;", exp->numbers[0]);
+	} else {
+		switch (rand32() % 4) {
+		case 0:
+			exp->type = HFP_GW_CMD_TYPE_COMMAND;
+			break;
+		case 1:
+			exp->type = HFP_GW_CMD_TYPE_READ;
+			strcpy(args, "?");
+			break;
+		case 2:
+			exp->type = HFP_GW_CMD_TYPE_TEST;
+			strcpy(args, "=?");
+			break;
+		default:
+			exp->type = HFP_GW_CMD_TYPE_SET;
+			exp->num_numbers = 1 + rand32() % MAX_NUMBERS;
+			strcpy(args, "=");
+
+			for (i = 0; i < exp->num_numbers; i++) {
+				exp->numbers[i] = rand32() % 100000;
+				sprintf(args + strlen(args), "%s%u",
+						i ? "," : "", exp->numbers[i]);
+			}
+			break;
+		}
+	}
+
+	/* Lines only dispatch on "AT" or "at", anything else is dropped */
+	switch (rand32() % 32) {
+	case 0:
+		snprintf(exp->line, MAX_LINE, "aT%s%s", prefix, args);
+		goto send;
+	case 1:
+		snprintf(exp->line, MAX_LINE, "At%s%s", prefix, args);
+		goto send;
+	default:
+		snprintf(exp->line, MAX_LINE, "%s%s%s", rand32() & 1 ?
+						"AT" : "at", prefix, args);
+		break;
+	}
+
+	/* Input is upper-cased, registered prefixes are matched as given */
+	match = find_registered(upper);
+	if (match) {
+		exp->kind = EXPECT_HANDLER;
+		exp->prefix = match;
+	} else {
+		exp->kind = EXPECT_UNKNOWN;
+	}
+
+	expect_count++;
+
+send:
+	stream_len = snprintf(stream, sizeof(stream), "%s\r", exp->line);
+	stream_off = 0;
+	generated++;
+}
+
+static void check_done(void);
+
+static struct expect *next_expected(void)
+{
+	struct expect *exp;
+
+	if (!expect_count) {
+		mismatch("dispatch without a command%s%s", "", "");
+		return NULL;
+	}
+
+	exp = &expected[expect_head];
+	expect_head = (expect_head + 1) % MAX_OUTSTANDING;
+	expect_count--;
+	dispatched++;
+	progress++;
+
+	return exp;
+}
+
+static void handler_cb(struct hfp_context *context,
+				enum hfp_gw_cmd_type type, void *user_data)
+{
+	const char *prefix = user_data;
+	struct expect *exp = next_expected();
+	unsigned int numbers[MAX_NUMBERS];
+	unsigned int count = 0;
+	char buf[16];
+
+	if (!exp)
+		return;
+
+	while (count < MAX_NUMBERS &&
+			hfp_context_get_number(context, &numbers[count]))
+		count++;
+
+	if (exp->kind != EXPECT_HANDLER) {
+		mismatch("%s dispatched to handler %s", exp->line, prefix);
+		goto done;
+	}
+
+	if (exp->prefix != prefix) {
+		mismatch("%s dispatched to handler %s", exp->line, prefix);
+		goto done;
+	}
+
+	if (exp->type != type) {
+		sprintf(buf, "%d", type);
+		mismatch("%s parsed as type %s", exp->line, buf);
+		goto done;
+	}
+
+	if (exp->num_numbers != count || memcmp(exp->numbers, numbers,
+					count * sizeof(numbers[0]))) {
+		sprintf(buf, "%u", count);
+		mismatch("%s parsed with %s numbers", exp->line, buf);
+		goto done;
+	}
+
+done:
+	check_done();
+}
+
+static bool reply_cb(void *user_data)
+{
+	hfp_gw_send_result(gw, HFP_RESULT_OK);
+
+	check_done();
+
+	return false;
+}
+
+static void command_cb(const char *command, void *user_data)
+{
+	struct expect *exp = next_expected();
+
+	if (exp && exp->kind != EXPECT_UNKNOWN)
+		mismatch("%s reported as unknown command %s", exp->line,
+								command);
+	else if (exp && strcmp(exp->line, command))
+		mismatch("%s reported as %s", exp->line, command);
+
+	/* The gateway waits for the upper layer, answer from the loop */
+	timeout_add(0, reply_cb, NULL, NULL);
+}
+
+static bool peer_read_cb(struct io *io, void *user_data)
+{
+	char buf[1024];
+
+	/* Results from the gateway are not checked, just drained */
+	if (read(io_get_fd(io), buf, sizeof(buf)) <= 0)
+		return false;
+
+	return true;
+}
+
+static bool peer_write_cb(struct io *io, void *user_data)
+{
+	while (generated < commands || stream_off < stream_len) {
+		size_t len;
+		ssize_t written;
+
+		if (stream_off == stream_len) {
+			/* Let dispatches catch up with what is in flight */
+			if (expect_count == MAX_OUTSTANDING)
+				return false;
+
+			generate();
+		}
+
+		/* Random chunks make lines straddle the ring buffer end */
+		len = 1 + rand32() % 64;
+		if (len > stream_len - stream_off)
+			len = stream_len - stream_off;
+
+		written = write(peer_fd, stream + stream_off, len);
+		if (written < 0)
+			return true;
+
+		stream_off += written;
+	}
+
+	return false;
+}
+
+static void report(const char *name, unsigned int ops)
+{
+	double secs = (get_usec() - start) / 1000000.0;
+
+	printf("{\"bench\":\"%s\",\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"usec_per_op\":%.3f,"
+		"\"mismatches\":%u}\n",
+		name, ops, secs, secs > 0 ? ops / secs : 0.0,
+		ops ? secs * 1000000.0 / ops : 0.0, mismatches);
+	fflush(stdout);
+}
+
+static void check_done(void)
+{
+	static bool done;
+
+	if (done)
+		return;
+
+	if (expect_count || generated < commands ||
+						stream_off < stream_len) {
+		/* Refill once half of the window has been dispatched */
+		if (expect_count == MAX_OUTSTANDING / 2)
+			io_set_write_handler(peer_io, peer_write_cb, NULL,
+									NULL);
+		return;
+	}
+
+	done = true;
+
+	report("parse", generated);
+	mainloop_quit();
+}
+
+static void stall_cb(int id, void *user_data)
+{
+	if (!progress) {
+		fprintf(stderr, "parser stalled after %u dispatches\n",
+								dispatched);
+		mismatches++;
+		mainloop_quit();
+		return;
+	}
+
+	progress = 0;
+	mainloop_modify_timeout(id, STALL_TIMEOUT);
+}
+
+static bool run_parse(void)
+{
+	int fds[2];
+	unsigned int i;
+
+	/* Every run tears the loop down when it returns */
+	mainloop_init();
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+								0, fds) < 0)
+		return false;
+
+	gw = hfp_gw_new(fds[0]);
+	if (!gw) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	hfp_gw_set_close_on_unref(gw, true);
+	hfp_gw_set_command_handler(gw, command_cb, NULL, NULL);
+
+	for (i = 0; registered[i]; i++)
+		hfp_gw_register(gw, handler_cb, registered[i],
+						(void *) registered[i], NULL);
+
+	peer_fd = fds[1];
+	peer_io = io_new(peer_fd);
+	io_set_close_on_destroy(peer_io, true);
+	io_set_read_handler(peer_io, peer_read_cb, NULL, NULL);
+	io_set_write_handler(peer_io, peer_write_cb, NULL, NULL);
+
+	mainloop_add_timeout(STALL_TIMEOUT, stall_cb, NULL, NULL);
+
+	start = get_usec();
+
+	mainloop_run();
+
+	io_destroy(peer_io);
+	hfp_gw_unref(gw);
+
+	if (expect_count)
+		mismatches++;
+
+	return !mismatches;
+}
+
+static struct hfp_hf *hf;
+static unsigned int roundtrips = DEFAULT_ROUNDTRIPS;
+static unsigned int completed;
+
+static void vgs_cb(struct hfp_context *context, enum hfp_gw_cmd_type type,
+							void *user_data)
+{
+	unsigned int val;
+
+	if (type != HFP_GW_CMD_TYPE_SET ||
+				!hfp_context_get_number(context, &val) ||
+				val != completed % 16) {
+		mismatches++;
+		hfp_gw_send_result(gw, HFP_RESULT_ERROR);
+		return;
+	}
+
+	hfp_gw_send_result(gw, HFP_RESULT_OK);
+}
+
+static void response_cb(enum hfp_result result, enum hfp_error cme_err,
+							void *user_data)
+{
+	if (result != HFP_RESULT_OK) {
+		fprintf(stderr, "AT+VGS=%u failed: %d\n", completed % 16,
+								result);
+		mismatches++;
+		mainloop_quit();
+		return;
+	}
+
+	if (++completed == roundtrips) {
+		report("roundtrip", completed);
+		mainloop_quit();
+		return;
+	}
+
+	hfp_hf_send_command(hf, response_cb, NULL, "AT+VGS=%u",
+							completed % 16);
+}
+
+static bool run_roundtrip(void)
+{
+	int fds[2];
+
+	/* Every run tears the loop down when it returns */
+	mainloop_init();
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+								0, fds) < 0)
+		return false;
+
+	gw = hfp_gw_new(fds[0]);
+	hf = hfp_hf_new(fds[1]);
+	if (!gw || !hf) {
+		hfp_gw_unref(gw);
+		hfp_hf_unref(hf);
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	hfp_gw_set_close_on_unref(gw, true);
+	hfp_hf_set_close_on_unref(hf, true);
+	hfp_gw_register(gw, vgs_cb, "+VGS", NULL, NULL);
+
+	start = get_usec();
+
+	hfp_hf_send_command(hf, response_cb, NULL, "AT+VGS=%u", 0);
+
+	mainloop_run();
+
+	hfp_hf_unref(hf);
+	hfp_gw_unref(gw);
+
+	return !mismatches && completed == roundtrips;
+}
+
+static void usage(void)
+{
+	printf("bt_hfpbench - HFP AT parser fuzz and throughput harness\n"
+		"Usage:\n");
+	printf("\tbt_hfpbench [options]\n");
+	printf("Options:\n"
+		"\t-n, --commands <num>\tRandom commands to parse "
+							"(default 100000)\n"
+		"\t-r, --roundtrips <num>\tHF/AG round trips "
+							"(default 200000)\n"
+		"\t-s, --seed <num>\tRandom seed (default 1)\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "commands",	required_argument,	NULL, 'n' },
+	{ "roundtrips",	required_argument,	NULL, 'r' },
+	{ "seed",	required_argument,	NULL, 's' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "n:r:s:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'n':
+			commands = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			roundtrips = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !commands || !roundtrips || !seed) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!run_parse()) {
+		fprintf(stderr, "parse: %u mismatches\n", mismatches);
+		return EXIT_FAILURE;
+	}
+
+	if (!run_roundtrip()) {
+		fprintf(stderr, "roundtrip failed\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
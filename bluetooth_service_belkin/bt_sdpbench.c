@@ -0,0 +1,384 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
+
+#include "src/storage.h"
+
+/*
+ * Timing of the SDP record cache that device.c keeps in cache/<peer>.sdp.
+ *
+ * Each iteration runs what a browse of a peer with --records services
+ * does to the cache: update_sdp_cache() merging the browsed records into
+ * the file, then read_sdp_cache() loading them back the way the records
+ * are restored on the next start. The store and reload halves are also
+ * timed on their own, and the legacy case does the hex round trip records
+ * used to make through the [ServiceRecords] key file group, without the
+ * GKeyFile parsing on top. Prints one JSON object per case on stdout,
+ * like bt_gattbench, and exits non-zero if a reload loses records.
+ */
+
+#define DEFAULT_RECORDS		40
+#define DEFAULT_ITERATIONS	1000
+#define RECORD_HANDLE_BASE	0x00010000
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void report(const char *name, unsigned int records,
+					unsigned int ops, uint64_t usec)
+{
+	printf("{\"bench\":\"%s\",\"records\":%u,\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"usec_per_op\":%.3f}\n",
+		name, records, ops, usec / 1000000.0,
+		usec ? ops * 1000000.0 / usec : 0.0,
+		ops ? usec / (double) ops : 0.0);
+	fflush(stdout);
+}
+
+/* Roughly what a phone advertises: class, protocols, profile and name */
+static sdp_record_t *create_record(unsigned int i)
+{
+	sdp_list_t *svclass, *root, *protos, *aproto, *pfseq;
+	sdp_list_t *l2cap_list, *proto_list;
+	sdp_profile_desc_t profile;
+	uuid_t svc_uuid, root_uuid, l2cap_uuid, proto_uuid;
+	sdp_data_t *value;
+	sdp_record_t *rec;
+	uint16_t psm = 0x1001 + 2 * i;
+	uint8_t channel = 1 + i % 30;
+	char name[32];
+
+	rec = sdp_record_alloc();
+	if (!rec)
+		return NULL;
+
+	rec->handle = RECORD_HANDLE_BASE + i;
+
+	sdp_uuid16_create(&svc_uuid, 0x1100 + i % 0x40);
+	svclass = sdp_list_append(NULL, &svc_uuid);
+	sdp_set_service_classes(rec, svclass);
+
+	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
+	root = sdp_list_append(NULL, &root_uuid);
+	sdp_set_browse_groups(rec, root);
+
+	sdp_uuid16_create(&l2cap_uuid, L2CAP_UUID);
+	l2cap_list = sdp_list_append(NULL, &l2cap_uuid);
+
+	/* Half the services sit on RFCOMM, the rest directly on L2CAP */
+	if (i % 2) {
+		sdp_uuid16_create(&proto_uuid, RFCOMM_UUID);
+		value = sdp_data_alloc(SDP_UINT8, &channel);
+	} else {
+		sdp_uuid16_create(&proto_uuid, AVDTP_UUID);
+		value = sdp_data_alloc(SDP_UINT16, &psm);
+	}
+
+	proto_list = sdp_list_append(NULL, &proto_uuid);
+	proto_list = sdp_list_append(proto_list, value);
+
+	aproto = sdp_list_append(NULL, l2cap_list);
+	aproto = sdp_list_append(aproto, proto_list);
+	protos = sdp_list_append(NULL, aproto);
+	sdp_set_access_protos(rec, protos);
+
+	sdp_uuid16_create(&profile.uuid, 0x1100 + i % 0x40);
+	profile.version = 0x0102;
+	pfseq = sdp_list_append(NULL, &profile);
+	sdp_set_profile_descs(rec, pfseq);
+
+	snprintf(name, sizeof(name), "Service %u", i);
+	sdp_set_info_attr(rec, name, "BlueZ", "Benchmark record");
+
+	sdp_data_free(value);
+	sdp_list_free(proto_list, NULL);
+	sdp_list_free(l2cap_list, NULL);
+	sdp_list_free(aproto, NULL);
+	sdp_list_free(protos, NULL);
+	sdp_list_free(pfseq, NULL);
+	sdp_list_free(root, NULL);
+	sdp_list_free(svclass, NULL);
+
+	return rec;
+}
+
+static bool check_reload(const char *path, unsigned int records)
+{
+	sdp_list_t *recs;
+	unsigned int len;
+
+	recs = read_sdp_cache(path);
+	len = sdp_list_len(recs);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+
+	if (len != records) {
+		fprintf(stderr, "Reloaded %u of %u records\n", len, records);
+		return false;
+	}
+
+	return true;
+}
+
+static bool run_store(const char *path, sdp_list_t *recs,
+				unsigned int records, unsigned int iterations)
+{
+	uint64_t start;
+	unsigned int i;
+
+	/* Every browse after the first merges into an existing file */
+	update_sdp_cache(path, recs);
+
+	start = get_usec();
+
+	for (i = 0; i < iterations; i++) {
+		if (update_sdp_cache(path, recs) < 0) {
+			fprintf(stderr, "Failed to write %s\n", path);
+			return false;
+		}
+	}
+
+	report("store", records, iterations, get_usec() - start);
+
+	return check_reload(path, records);
+}
+
+static bool run_reload(const char *path, unsigned int records,
+						unsigned int iterations)
+{
+	uint64_t start, total = 0;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		sdp_list_t *recs;
+
+		start = get_usec();
+		recs = read_sdp_cache(path);
+		total += get_usec() - start;
+
+		if (sdp_list_len(recs) != (int) records) {
+			fprintf(stderr, "Reloaded %d of %u records\n",
+						sdp_list_len(recs), records);
+			sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+			return false;
+		}
+
+		sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+	}
+
+	report("reload", records, iterations, total);
+
+	return true;
+}
+
+static bool run_cycle(const char *path, sdp_list_t *recs,
+				unsigned int records, unsigned int iterations)
+{
+	uint64_t start, total = 0;
+	unsigned int i;
+
+	unlink(path);
+
+	for (i = 0; i < iterations; i++) {
+		sdp_list_t *loaded;
+		int len;
+
+		start = get_usec();
+
+		if (update_sdp_cache(path, recs) < 0) {
+			fprintf(stderr, "Failed to write %s\n", path);
+			return false;
+		}
+
+		loaded = read_sdp_cache(path);
+		total += get_usec() - start;
+
+		len = sdp_list_len(loaded);
+		sdp_list_free(loaded, (sdp_free_func_t) sdp_record_free);
+
+		if (len != (int) records) {
+			fprintf(stderr, "Reloaded %d of %u records\n", len,
+								records);
+			return false;
+		}
+	}
+
+	report("store-reload", records, iterations, total);
+
+	return true;
+}
+
+/* What store_sdp_record() and record_from_string() used to do per record */
+static bool run_legacy(sdp_list_t *recs, unsigned int records,
+						unsigned int iterations)
+{
+	uint64_t start, total = 0;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		sdp_list_t *l;
+
+		start = get_usec();
+
+		for (l = recs; l; l = l->next) {
+			sdp_record_t *rec;
+			sdp_buf_t buf;
+			char *str;
+			int j;
+
+			if (sdp_gen_record_pdu(l->data, &buf) < 0)
+				return false;
+
+			str = malloc(buf.data_size * 2 + 1);
+			if (!str) {
+				free(buf.data);
+				return false;
+			}
+
+			for (j = 0; j < buf.data_size; j++)
+				sprintf(str + (j * 2), "%02X", buf.data[j]);
+
+			free(buf.data);
+
+			rec = record_from_string(str);
+			free(str);
+
+			if (!rec)
+				return false;
+
+			sdp_record_free(rec);
+		}
+
+		total += get_usec() - start;
+	}
+
+	report("legacy-hex", records, iterations, total);
+
+	return true;
+}
+
+static void usage(void)
+{
+	printf("bt_sdpbench - SDP record cache benchmark\n"
+		"Usage:\n");
+	printf("\tbt_sdpbench [options]\n");
+	printf("Options:\n"
+		"\t-n, --records <num>\tRecords per peer (default 40)\n"
+		"\t-i, --iterations <num>\tCycles per case (default 1000)\n"
+		"\t-d, --dir <path>\tDirectory for the cache file"
+							" (default /tmp)\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "records",	required_argument,	NULL, 'n' },
+	{ "iterations",	required_argument,	NULL, 'i' },
+	{ "dir",	required_argument,	NULL, 'd' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int records = DEFAULT_RECORDS;
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	const char *dir = "/tmp";
+	char path[PATH_MAX];
+	sdp_list_t *recs = NULL;
+	unsigned int i;
+	bool ok;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "n:i:d:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'n':
+			records = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !records || !iterations) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/bt_sdpbench.%d.sdp", dir, getpid());
+
+	for (i = 0; i < records; i++) {
+		sdp_record_t *rec = create_record(i);
+
+		if (!rec) {
+			fprintf(stderr, "Failed to create record %u\n", i);
+			return EXIT_FAILURE;
+		}
+
+		recs = sdp_list_append(recs, rec);
+	}
+
+	ok = run_cycle(path, recs, records, iterations) &&
+		run_store(path, recs, records, iterations) &&
+		run_reload(path, records, iterations) &&
+		run_legacy(recs, records, iterations);
+
+	unlink(path);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,849 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "src/shared/btsnoop.h"
+
+/*
+ * Reading btsnoop captures with src/shared/btsnoop.
+ *
+ * A monitor capture of --packets commands, events and ACL data on
+ * NUM_HANDLES connections is generated first. read walks it with
+ * btsnoop_read_hci() over read(), the reader btmon and the tools use,
+ * next walks it mapped with BTSNOOP_FLAG_MAP and btsnoop_next_hci().
+ * index times btsnoop_build_index(), filter-scan and filter-index read
+ * the ACL packets of one connection without and with the index, and seek
+ * times btsnoop_seek_time() to random points. Every mapped walk is first
+ * checked packet by packet against the read() path, the run fails on
+ * the first difference.
+ *
+ * The ring cases write through btsnoop_create_ring(). ring-write rotates
+ * at RING_FILE_SIZE keeping RING_KEEP files and checks that exactly the
+ * newest files are left, in order and ending with the last packet the
+ * ring took. ring-flight checks that btsnoop_trigger() dumps the newest
+ * records back to back, ring-fail that a ring without a writable file
+ * counts every record it loses as a drop. Prints one JSON object per
+ * case on stdout, like bt_gattbench.
+ */
+
+#define DEFAULT_PACKETS		1000000
+#define DEFAULT_INTERVAL	1024
+#define DEFAULT_SEEKS		10000
+#define NUM_HANDLES		8
+#define FIRST_HANDLE		0x0040
+#define PACKET_GAP		100	/* usec */
+#define CAPTURE_START		1400000000
+#define RING_SIZE		(1024 * 1024)
+#define RING_FILE_SIZE		(256 * 1024)
+#define RING_KEEP		3
+#define RING_FLIGHT_SIZE	(64 * 1024)
+#define RING_FAIL_PACKETS	1000
+
+static unsigned int packets = DEFAULT_PACKETS;
+static unsigned int interval = DEFAULT_INTERVAL;
+static unsigned int seeks = DEFAULT_SEEKS;
+
+struct packet {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t size;
+	const uint8_t *data;
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+};
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint32_t rand32(uint32_t *seed)
+{
+	/* xorshift32, the same capture on every run */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+static void report(const char *name, unsigned int ops, uint64_t bytes,
+								uint64_t usec)
+{
+	printf("{\"bench\":\"%s\",\"ops\":%u,\"bytes\":%llu,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"bytes_per_sec\":%.1f}\n",
+		name, ops, (unsigned long long) bytes, usec / 1000000.0,
+		usec ? ops * 1000000.0 / usec : 0.0,
+		usec ? bytes * 1000000.0 / usec : 0.0);
+	fflush(stdout);
+}
+
+static void packet_time(unsigned int i, struct timeval *tv)
+{
+	uint64_t usec = (uint64_t) i * PACKET_GAP;
+
+	tv->tv_sec = CAPTURE_START + usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+static bool generate(const char *path)
+{
+	struct btsnoop *snoop;
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	uint32_t seed = 1;
+	unsigned int i;
+
+	snoop = btsnoop_create(path, BTSNOOP_TYPE_MONITOR);
+	if (!snoop)
+		return false;
+
+	for (i = 0; i < packets; i++) {
+		uint32_t r = rand32(&seed);
+		uint16_t opcode, size;
+		struct timeval tv;
+
+		/* Mostly ACL data, the rest commands and events */
+		switch (r % 8) {
+		case 0:
+			opcode = BTSNOOP_OPCODE_COMMAND_PKT;
+			size = 3 + (r >> 8) % 32;
+			break;
+		case 1:
+			opcode = BTSNOOP_OPCODE_EVENT_PKT;
+			size = 2 + (r >> 8) % 64;
+			break;
+		case 2:
+		case 3:
+		case 4:
+			opcode = BTSNOOP_OPCODE_ACL_TX_PKT;
+			size = 4 + (r >> 8) % 251;
+			break;
+		default:
+			opcode = BTSNOOP_OPCODE_ACL_RX_PKT;
+			size = 4 + (r >> 8) % 251;
+			break;
+		}
+
+		memset(buf, i & 0xff, size);
+
+		if (opcode == BTSNOOP_OPCODE_ACL_TX_PKT ||
+				opcode == BTSNOOP_OPCODE_ACL_RX_PKT) {
+			uint16_t handle = FIRST_HANDLE + (r >> 16) %
+								NUM_HANDLES;
+
+			buf[0] = handle & 0xff;
+			buf[1] = (handle >> 8) | 0x20;
+		}
+
+		packet_time(i, &tv);
+
+		if (!btsnoop_write_hci(snoop, &tv, 0, opcode, buf, size)) {
+			btsnoop_unref(snoop);
+			return false;
+		}
+	}
+
+	btsnoop_unref(snoop);
+
+	return true;
+}
+
+static bool read_packet(struct btsnoop *snoop, struct packet *pkt)
+{
+	if (!btsnoop_read_hci(snoop, &pkt->tv, &pkt->index, &pkt->opcode,
+						pkt->buf, &pkt->size))
+		return false;
+
+	pkt->data = pkt->buf;
+
+	return true;
+}
+
+static bool next_packet(struct btsnoop *snoop, struct packet *pkt)
+{
+	const void *data;
+
+	if (!btsnoop_next_hci(snoop, &pkt->tv, &pkt->index, &pkt->opcode,
+							&data, &pkt->size))
+		return false;
+
+	pkt->data = data;
+
+	return true;
+}
+
+static uint16_t packet_handle(const struct packet *pkt)
+{
+	if (pkt->opcode != BTSNOOP_OPCODE_ACL_TX_PKT &&
+				pkt->opcode != BTSNOOP_OPCODE_ACL_RX_PKT)
+		return 0xffff;
+
+	if (pkt->size < 2)
+		return 0xffff;
+
+	return (pkt->data[0] | (pkt->data[1] << 8)) & 0x0fff;
+}
+
+static bool packet_equal(const struct packet *a, const struct packet *b)
+{
+	return a->tv.tv_sec == b->tv.tv_sec &&
+		a->tv.tv_usec == b->tv.tv_usec &&
+		a->index == b->index && a->opcode == b->opcode &&
+		a->size == b->size && !memcmp(a->data, b->data, a->size);
+}
+
+/*
+ * Walk a mapped reader against the read() path, which skips what the
+ * filter would not return itself. Returns the packets seen or -1.
+ */
+static int verify(const char *path, struct btsnoop *map, uint16_t handle,
+							const char *name)
+{
+	struct btsnoop *ref;
+	struct packet *a, *b;
+	int count = 0;
+
+	ref = btsnoop_open(path, 0);
+	a = malloc(sizeof(*a));
+	b = malloc(sizeof(*b));
+	if (!ref || !a || !b) {
+		count = -1;
+		goto done;
+	}
+
+	while (1) {
+		bool more_ref, more_map;
+
+		do {
+			more_ref = read_packet(ref, a);
+		} while (more_ref && handle != 0xffff &&
+					packet_handle(a) != handle);
+
+		more_map = next_packet(map, b);
+
+		if (!more_ref && !more_map)
+			break;
+
+		if (more_ref != more_map || !packet_equal(a, b)) {
+			fprintf(stderr, "%s: packet %d differs from read()\n",
+								name, count);
+			count = -1;
+			break;
+		}
+
+		count++;
+	}
+
+done:
+	free(a);
+	free(b);
+	btsnoop_unref(ref);
+
+	return count;
+}
+
+static bool run_read(const char *path)
+{
+	struct btsnoop *snoop;
+	struct packet *pkt;
+	uint64_t start, bytes = 0;
+	unsigned int count = 0;
+
+	snoop = btsnoop_open(path, 0);
+	pkt = malloc(sizeof(*pkt));
+	if (!snoop || !pkt) {
+		btsnoop_unref(snoop);
+		free(pkt);
+		return false;
+	}
+
+	start = get_usec();
+
+	while (read_packet(snoop, pkt)) {
+		bytes += pkt->size;
+		count++;
+	}
+
+	report("read", count, bytes, get_usec() - start);
+
+	free(pkt);
+	btsnoop_unref(snoop);
+
+	if (count != packets) {
+		fprintf(stderr, "read: %u of %u packets\n", count, packets);
+		return false;
+	}
+
+	return true;
+}
+
+static bool run_next(const char *path)
+{
+	struct btsnoop *snoop;
+	struct packet pkt;
+	uint64_t start, bytes = 0;
+	unsigned int count = 0;
+	bool ok;
+
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_MAP);
+	if (!snoop)
+		return false;
+
+	ok = verify(path, snoop, 0xffff, "next") == (int) packets;
+
+	if (ok && btsnoop_rewind(snoop)) {
+		start = get_usec();
+
+		while (next_packet(snoop, &pkt)) {
+			bytes += pkt.size;
+			count++;
+		}
+
+		report("next", count, bytes, get_usec() - start);
+	}
+
+	btsnoop_unref(snoop);
+
+	return ok && count == packets;
+}
+
+static bool run_filter(const char *path, bool indexed)
+{
+	const char *name = indexed ? "filter-index" : "filter-scan";
+	struct btsnoop *snoop;
+	struct packet pkt;
+	uint64_t start, bytes = 0;
+	unsigned int count = 0;
+	int expected;
+
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_MAP);
+	if (!snoop)
+		return false;
+
+	if (indexed) {
+		start = get_usec();
+
+		if (!btsnoop_build_index(snoop, interval)) {
+			fprintf(stderr, "index: build failed\n");
+			btsnoop_unref(snoop);
+			return false;
+		}
+
+		report("index", packets, 0, get_usec() - start);
+	}
+
+	btsnoop_set_filter(snoop, 0xffff, FIRST_HANDLE);
+
+	expected = verify(path, snoop, FIRST_HANDLE, name);
+	if (expected < 0) {
+		btsnoop_unref(snoop);
+		return false;
+	}
+
+	btsnoop_rewind(snoop);
+
+	start = get_usec();
+
+	while (next_packet(snoop, &pkt)) {
+		bytes += pkt.size;
+		count++;
+	}
+
+	report(name, count, bytes, get_usec() - start);
+
+	btsnoop_unref(snoop);
+
+	return count == (unsigned int) expected;
+}
+
+static bool run_seek(const char *path)
+{
+	struct btsnoop *snoop;
+	struct packet pkt;
+	uint32_t seed = 7;
+	uint64_t start;
+	unsigned int i;
+
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_MAP);
+	if (!snoop)
+		return false;
+
+	if (!btsnoop_build_index(snoop, interval)) {
+		btsnoop_unref(snoop);
+		return false;
+	}
+
+	start = get_usec();
+
+	for (i = 0; i < seeks; i++) {
+		unsigned int target = rand32(&seed) % packets;
+		struct timeval tv, want;
+
+		/* Half way between two packets, the later one comes next */
+		packet_time(target, &tv);
+		packet_time(target + 1, &want);
+		tv.tv_usec += PACKET_GAP / 2;
+		if (tv.tv_usec >= 1000000) {
+			tv.tv_sec++;
+			tv.tv_usec -= 1000000;
+		}
+
+		btsnoop_seek_time(snoop, &tv);
+
+		if (target + 1 == packets) {
+			if (next_packet(snoop, &pkt))
+				goto wrong;
+			continue;
+		}
+
+		if (!next_packet(snoop, &pkt) ||
+				pkt.tv.tv_sec != want.tv_sec ||
+				pkt.tv.tv_usec != want.tv_usec)
+			goto wrong;
+	}
+
+	report("seek", seeks, 0, get_usec() - start);
+
+	btsnoop_unref(snoop);
+
+	return true;
+
+wrong:
+	fprintf(stderr, "seek: wrong packet after seek %u\n", i);
+	btsnoop_unref(snoop);
+
+	return false;
+}
+
+static void ring_packet(uint32_t seq, uint8_t *buf, uint16_t *size)
+{
+	uint16_t handle = FIRST_HANDLE + seq % NUM_HANDLES;
+
+	*size = 8 + seq % 64;
+	memset(buf, 0, *size);
+
+	buf[0] = handle & 0xff;
+	buf[1] = (handle >> 8) | 0x20;
+	buf[4] = seq & 0xff;
+	buf[5] = (seq >> 8) & 0xff;
+	buf[6] = (seq >> 16) & 0xff;
+	buf[7] = seq >> 24;
+}
+
+/*
+ * Read back one ring file, its sequence numbers must carry on rising
+ * from *last, without gaps when contiguous. Returns the packets in it
+ * or -1.
+ */
+static int ring_read(const char *path, int64_t *last, bool contiguous)
+{
+	struct btsnoop *snoop;
+	struct packet *pkt;
+	int count = 0;
+
+	snoop = btsnoop_open(path, 0);
+	pkt = malloc(sizeof(*pkt));
+	if (!snoop || !pkt) {
+		fprintf(stderr, "ring: cannot read %s\n", path);
+		count = -1;
+		goto done;
+	}
+
+	while (read_packet(snoop, pkt)) {
+		uint32_t seq;
+
+		seq = pkt->buf[4] | pkt->buf[5] << 8 | pkt->buf[6] << 16 |
+					(uint32_t) pkt->buf[7] << 24;
+
+		if (pkt->size < 8 || (int64_t) seq <= *last ||
+				(contiguous && *last >= 0 &&
+						seq != *last + 1)) {
+			fprintf(stderr, "ring: %s out of order at %d\n",
+								path, count);
+			count = -1;
+			break;
+		}
+
+		*last = seq;
+		count++;
+	}
+
+done:
+	free(pkt);
+	btsnoop_unref(snoop);
+
+	return count;
+}
+
+static void ring_unlink(const char *path)
+{
+	char name[PATH_MAX + 16];
+	unsigned int i;
+
+	unlink(path);
+
+	for (i = 1; i <= RING_KEEP + 1; i++) {
+		snprintf(name, sizeof(name), "%s.%u", path, i);
+		unlink(name);
+	}
+}
+
+/*
+ * Write seq 0 .. count - 1, returns the last one the ring took or -1.
+ * With retry a full ring kicks the writer and the packet goes again, so
+ * everything reaches the files and only the drop counter moves.
+ */
+static int64_t ring_fill(struct btsnoop *snoop, unsigned int count,
+						bool retry, uint64_t *usec)
+{
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	int64_t last = -1;
+	uint64_t start;
+	unsigned int i;
+
+	start = get_usec();
+
+	for (i = 0; i < count; i++) {
+		struct timeval tv;
+		uint16_t size;
+		bool taken;
+
+		ring_packet(i, buf, &size);
+		packet_time(i, &tv);
+
+		while (1) {
+			taken = btsnoop_write_hci(snoop, &tv, 0,
+					BTSNOOP_OPCODE_ACL_TX_PKT, buf, size);
+			if (taken || !retry)
+				break;
+
+			btsnoop_trigger(snoop);
+			usleep(1000);
+		}
+
+		if (taken)
+			last = i;
+	}
+
+	*usec = get_usec() - start;
+
+	return last;
+}
+
+static bool run_ring_write(const char *dir)
+{
+	struct btsnoop_ring_config config = {
+		.ring_size = RING_SIZE,
+		.max_file_size = RING_FILE_SIZE,
+		.keep_files = RING_KEEP,
+		.flush_interval = 10,
+	};
+	struct btsnoop *snoop;
+	char path[PATH_MAX], name[PATH_MAX + 16];
+	int64_t last, seen = -1;
+	unsigned int i, drops, files = 0, count = 0;
+	uint64_t usec;
+	bool ok = true;
+
+	snprintf(path, sizeof(path), "%s/bt_snoopbench.%d.ring", dir,
+								getpid());
+	ring_unlink(path);
+
+	snoop = btsnoop_create_ring(path, BTSNOOP_TYPE_MONITOR, &config);
+	if (!snoop)
+		return false;
+
+	last = ring_fill(snoop, packets, true, &usec);
+	drops = btsnoop_get_drops(snoop);
+
+	/* Joins the writer, which flushes what is left */
+	btsnoop_unref(snoop);
+
+	/* Oldest first: path.3, path.2, path.1, path and no path.4 */
+	for (i = RING_KEEP + 1; i > 0 && ok; i--) {
+		struct stat st;
+		int n;
+
+		if (i > 1)
+			snprintf(name, sizeof(name), "%s.%u", path, i - 1);
+		else
+			snprintf(name, sizeof(name), "%s", path);
+
+		if (stat(name, &st) < 0)
+			continue;
+
+		if ((size_t) st.st_size > RING_FILE_SIZE + RING_SIZE) {
+			fprintf(stderr, "ring-write: %s is %lld bytes\n", name,
+						(long long) st.st_size);
+			ok = false;
+		}
+
+		n = ring_read(name, &seen, false);
+		if (n < 0)
+			ok = false;
+		else
+			count += n;
+
+		files++;
+	}
+
+	snprintf(name, sizeof(name), "%s.%u", path, RING_KEEP + 1);
+	if (!access(name, F_OK)) {
+		fprintf(stderr, "ring-write: %s was kept\n", name);
+		ok = false;
+	}
+
+	if (ok && seen != last) {
+		fprintf(stderr, "ring-write: last on disk %lld, written %lld\n",
+					(long long) seen, (long long) last);
+		ok = false;
+	}
+
+	printf("{\"bench\":\"ring-write\",\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"drops\":%u,\"files\":%u,"
+		"\"kept\":%u}\n", packets, usec / 1000000.0,
+		usec ? packets * 1000000.0 / usec : 0.0, drops, files, count);
+	fflush(stdout);
+
+	ring_unlink(path);
+
+	return ok;
+}
+
+static bool run_ring_flight(const char *dir)
+{
+	struct btsnoop_ring_config config = {
+		.ring_size = RING_FLIGHT_SIZE,
+		.flight_recorder = true,
+	};
+	struct btsnoop *snoop;
+	char path[PATH_MAX];
+	int64_t last, seen = -1;
+	struct stat st;
+	uint64_t usec;
+	int count;
+	bool ok = true;
+
+	snprintf(path, sizeof(path), "%s/bt_snoopbench.%d.flight", dir,
+								getpid());
+	ring_unlink(path);
+
+	snoop = btsnoop_create_ring(path, BTSNOOP_TYPE_MONITOR, &config);
+	if (!snoop)
+		return false;
+
+	last = ring_fill(snoop, packets, false, &usec);
+
+	if (!btsnoop_trigger(snoop) || btsnoop_get_drops(snoop))
+		ok = false;
+
+	btsnoop_unref(snoop);
+
+	/* The dump holds the newest records, back to back */
+	count = ring_read(path, &seen, true);
+	if (count <= 0 || seen != last || stat(path, &st) < 0 ||
+			(size_t) st.st_size > RING_FLIGHT_SIZE + 16 ||
+			((unsigned int) count < packets &&
+				(size_t) st.st_size < RING_FLIGHT_SIZE / 2)) {
+		fprintf(stderr, "ring-flight: bad dump of %d packets\n",
+								count);
+		ok = false;
+	}
+
+	printf("{\"bench\":\"ring-flight\",\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"kept\":%d}\n", packets,
+		usec / 1000000.0, usec ? packets * 1000000.0 / usec : 0.0,
+		count);
+	fflush(stdout);
+
+	ring_unlink(path);
+
+	return ok;
+}
+
+static bool wait_drops(struct btsnoop *snoop, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (btsnoop_get_drops(snoop) >= count)
+			return btsnoop_get_drops(snoop) == count;
+
+		usleep(1000);
+	}
+
+	return false;
+}
+
+/* A ring that cannot open its file has to count what it loses */
+static bool run_ring_fail(const char *dir)
+{
+	struct btsnoop_ring_config config = {
+		.ring_size = RING_SIZE,
+		.flush_interval = 10,
+	};
+	struct btsnoop *snoop;
+	char path[PATH_MAX];
+	unsigned int count = packets < RING_FAIL_PACKETS ? packets :
+							RING_FAIL_PACKETS;
+	uint64_t usec;
+	bool ok;
+
+	snprintf(path, sizeof(path), "%s/bt_snoopbench.%d.missing/ring", dir,
+								getpid());
+
+	snoop = btsnoop_create_ring(path, BTSNOOP_TYPE_MONITOR, &config);
+	if (!snoop)
+		return false;
+
+	ok = ring_fill(snoop, count, false, &usec) == count - 1 &&
+			btsnoop_trigger(snoop) && wait_drops(snoop, count);
+
+	btsnoop_unref(snoop);
+
+	if (ok) {
+		config.flight_recorder = true;
+
+		snoop = btsnoop_create_ring(path, BTSNOOP_TYPE_MONITOR,
+								&config);
+		if (!snoop)
+			return false;
+
+		ok = ring_fill(snoop, count, false, &usec) == count - 1 &&
+			btsnoop_trigger(snoop) && wait_drops(snoop, count);
+
+		btsnoop_unref(snoop);
+	}
+
+	printf("{\"bench\":\"ring-fail\",\"ops\":%u,\"drops_counted\":%s}\n",
+					count, ok ? "true" : "false");
+	fflush(stdout);
+
+	if (!ok)
+		fprintf(stderr, "ring-fail: lost records were not counted\n");
+
+	return ok;
+}
+
+static void usage(void)
+{
+	printf("bt_snoopbench - btsnoop capture reader benchmark\n"
+		"Usage:\n");
+	printf("\tbt_snoopbench [options]\n");
+	printf("Options:\n"
+		"\t-n, --packets <num>\tPackets in the capture"
+						" (default 1000000)\n"
+		"\t-i, --interval <num>\tPackets per index mark"
+						" (default 1024)\n"
+		"\t-s, --seeks <num>\tSeeks for the seek case"
+						" (default 10000)\n"
+		"\t-d, --dir <path>\tDirectory for the capture"
+						" (default /tmp)\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "packets",	required_argument,	NULL, 'n' },
+	{ "interval",	required_argument,	NULL, 'i' },
+	{ "seeks",	required_argument,	NULL, 's' },
+	{ "dir",	required_argument,	NULL, 'd' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp";
+	char path[PATH_MAX];
+	bool ok;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "n:i:s:d:h", main_options,
+									NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'n':
+			packets = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seeks = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !packets || !interval || !seeks) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/bt_snoopbench.%d.btsnoop", dir,
+								getpid());
+
+	if (!generate(path)) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+
+	ok = run_read(path) && run_next(path) && run_filter(path, false) &&
+				run_filter(path, true) && run_seek(path) &&
+				run_ring_write(dir) && run_ring_flight(dir) &&
+				run_ring_fail(dir);
+
+	unlink(path);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
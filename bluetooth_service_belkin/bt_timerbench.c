@@ -0,0 +1,446 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "src/shared/timeout.h"
+
+/*
+ * Cost of the timer wheel in shared/timeout-glib.
+ *
+ * arm-cancel times timeout_add() immediately followed by timeout_remove()
+ * with timeouts spread over all wheel levels, the pattern of ATT and
+ * L2CAP request timers that are nearly always cancelled by the response.
+ * arm-cancel-loaded does the same with --load timers parked on the
+ * wheel, gsource-arm-cancel does it with g_timeout_add() as a baseline
+ * and threads splits the pairs over --threads threads, each with its
+ * own main context and wheel. expire arms --expire short timers and
+ * runs the main loop until they have all fired. arm-after-work arms a
+ * timer from a callback that first kept the loop busy for --work msec,
+ * and fails if the timer fires before its timeout has passed. Prints one
+ * JSON object per case on stdout, like bt_gattbench.
+ */
+
+#define DEFAULT_PAIRS		1000000
+#define DEFAULT_LOAD		10000
+#define DEFAULT_EXPIRE		100000
+#define DEFAULT_THREADS		4
+#define DEFAULT_WORK		500	/* msec */
+#define WORK_TIMEOUT		100	/* msec */
+#define MAX_TIMEOUT		600000	/* msec, reaches the top level */
+#define EXPIRE_SPREAD		50	/* msec */
+
+static unsigned int pairs = DEFAULT_PAIRS;
+static unsigned int load = DEFAULT_LOAD;
+static unsigned int expire = DEFAULT_EXPIRE;
+static unsigned int num_threads = DEFAULT_THREADS;
+static unsigned int work = DEFAULT_WORK;
+
+static unsigned int fired;
+static uint64_t *expire_due;
+static uint64_t max_late;
+static GMainLoop *main_loop;
+static uint64_t armed_at;
+static uint64_t fired_after;
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint32_t rand32(uint32_t *seed)
+{
+	/* xorshift32, the same sequence on every run */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+static void report(const char *name, unsigned int ops, uint64_t usec)
+{
+	printf("{\"bench\":\"%s\",\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"nsec_per_op\":%.1f}\n",
+		name, ops, usec / 1000000.0,
+		usec ? ops * 1000000.0 / usec : 0.0,
+		ops ? usec * 1000.0 / ops : 0.0);
+	fflush(stdout);
+}
+
+static bool never_cb(void *user_data)
+{
+	return false;
+}
+
+static gboolean never_gsource_cb(gpointer user_data)
+{
+	return FALSE;
+}
+
+static bool arm_cancel(unsigned int count, uint32_t seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		unsigned int id;
+
+		id = timeout_add(1 + rand32(&seed) % MAX_TIMEOUT, never_cb,
+								NULL, NULL);
+		if (!id)
+			return false;
+
+		timeout_remove(id);
+	}
+
+	return true;
+}
+
+static bool run_arm_cancel(void)
+{
+	uint64_t start;
+
+	start = get_usec();
+
+	if (!arm_cancel(pairs, 1)) {
+		fprintf(stderr, "arm-cancel: timeout_add failed\n");
+		return false;
+	}
+
+	report("arm-cancel", pairs, get_usec() - start);
+
+	return true;
+}
+
+static bool run_arm_cancel_loaded(void)
+{
+	unsigned int *ids, i;
+	uint32_t seed = 2;
+	uint64_t start;
+	bool ok;
+
+	ids = calloc(load, sizeof(*ids));
+	if (!ids)
+		return false;
+
+	for (i = 0; i < load; i++)
+		ids[i] = timeout_add(1000 + rand32(&seed) % MAX_TIMEOUT,
+						never_cb, NULL, NULL);
+
+	start = get_usec();
+	ok = arm_cancel(pairs, 3);
+
+	if (ok)
+		report("arm-cancel-loaded", pairs, get_usec() - start);
+	else
+		fprintf(stderr, "arm-cancel-loaded: timeout_add failed\n");
+
+	for (i = 0; i < load; i++)
+		timeout_remove(ids[i]);
+
+	free(ids);
+
+	return ok;
+}
+
+static bool run_gsource_arm_cancel(void)
+{
+	uint32_t seed = 1;
+	uint64_t start;
+	unsigned int i;
+
+	start = get_usec();
+
+	for (i = 0; i < pairs; i++) {
+		guint id;
+
+		id = g_timeout_add(1 + rand32(&seed) % MAX_TIMEOUT,
+						never_gsource_cb, NULL);
+		g_source_remove(id);
+	}
+
+	report("gsource-arm-cancel", pairs, get_usec() - start);
+
+	return true;
+}
+
+static void *thread_func(void *user_data)
+{
+	GMainContext *context;
+	bool *ok = user_data;
+
+	context = g_main_context_new();
+	g_main_context_push_thread_default(context);
+
+	/* The wheel is freed again when this thread exits */
+	*ok = arm_cancel(pairs / num_threads, 4);
+
+	g_main_context_pop_thread_default(context);
+	g_main_context_unref(context);
+
+	return NULL;
+}
+
+static bool run_threads(void)
+{
+	pthread_t *threads;
+	bool *results, ok = true;
+	unsigned int i, started;
+	uint64_t start;
+
+	threads = calloc(num_threads, sizeof(*threads));
+	results = calloc(num_threads, sizeof(*results));
+	if (!threads || !results) {
+		free(threads);
+		free(results);
+		return false;
+	}
+
+	start = get_usec();
+
+	for (started = 0; started < num_threads; started++) {
+		if (pthread_create(&threads[started], NULL, thread_func,
+						&results[started])) {
+			ok = false;
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+		ok = ok && results[i];
+	}
+
+	if (ok)
+		report("threads", pairs / num_threads * num_threads,
+							get_usec() - start);
+	else
+		fprintf(stderr, "threads: timeout_add failed\n");
+
+	free(threads);
+	free(results);
+
+	return ok;
+}
+
+static bool expire_cb(void *user_data)
+{
+	uint64_t due = expire_due[GPOINTER_TO_UINT(user_data)];
+	uint64_t now = get_usec();
+
+	if (now > due && now - due > max_late)
+		max_late = now - due;
+
+	if (++fired == expire)
+		g_main_loop_quit(main_loop);
+
+	return false;
+}
+
+static bool run_expire(void)
+{
+	uint32_t seed = 5;
+	uint64_t start;
+	unsigned int i;
+
+	expire_due = calloc(expire, sizeof(*expire_due));
+	if (!expire_due)
+		return false;
+
+	fired = 0;
+	max_late = 0;
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	/* Arming and firing, ops_per_sec is bounded by the spread */
+	start = get_usec();
+
+	for (i = 0; i < expire; i++) {
+		unsigned int timeout = rand32(&seed) % EXPIRE_SPREAD;
+
+		expire_due[i] = get_usec() + timeout * 1000;
+
+		if (!timeout_add(timeout, expire_cb, GUINT_TO_POINTER(i),
+								NULL)) {
+			fprintf(stderr, "expire: timeout_add failed\n");
+			g_main_loop_unref(main_loop);
+			free(expire_due);
+			return false;
+		}
+	}
+
+	g_main_loop_run(main_loop);
+
+	report("expire", expire, get_usec() - start);
+	printf("{\"bench\":\"expire-late\",\"usec_max\":%llu}\n",
+					(unsigned long long) max_late);
+	fflush(stdout);
+
+	g_main_loop_unref(main_loop);
+	free(expire_due);
+
+	return true;
+}
+
+static bool work_timeout_cb(void *user_data)
+{
+	fired_after = get_usec() - armed_at;
+
+	g_main_loop_quit(main_loop);
+
+	return false;
+}
+
+/* Slow work in a callback, then a timer armed in the same iteration */
+static gboolean work_cb(gpointer user_data)
+{
+	uint64_t start = get_usec();
+
+	while (get_usec() - start < work * 1000ULL)
+		;
+
+	armed_at = get_usec();
+
+	if (!timeout_add(WORK_TIMEOUT, work_timeout_cb, NULL, NULL)) {
+		fprintf(stderr, "arm-after-work: timeout_add failed\n");
+		g_main_loop_quit(main_loop);
+	}
+
+	return FALSE;
+}
+
+static bool run_arm_after_work(void)
+{
+	fired_after = 0;
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	g_idle_add(work_cb, NULL);
+	g_main_loop_run(main_loop);
+	g_main_loop_unref(main_loop);
+
+	printf("{\"bench\":\"arm-after-work\",\"work_msec\":%u,"
+		"\"timeout_msec\":%u,\"fired_after_usec\":%llu}\n",
+		work, WORK_TIMEOUT, (unsigned long long) fired_after);
+	fflush(stdout);
+
+	if (fired_after < WORK_TIMEOUT * 1000ULL) {
+		fprintf(stderr, "arm-after-work: fired %llu usec early\n",
+			(unsigned long long) (WORK_TIMEOUT * 1000ULL -
+								fired_after));
+		return false;
+	}
+
+	return true;
+}
+
+static void usage(void)
+{
+	printf("bt_timerbench - timer wheel benchmark\n"
+		"Usage:\n");
+	printf("\tbt_timerbench [options]\n");
+	printf("Options:\n"
+		"\t-n, --pairs <num>\tArm+cancel pairs per case"
+						" (default 1000000)\n"
+		"\t-l, --load <num>\tTimers parked for the loaded case"
+						" (default 10000)\n"
+		"\t-e, --expire <num>\tTimers for the expire case"
+						" (default 100000)\n"
+		"\t-t, --threads <num>\tThreads for the threads case"
+						" (default 4)\n"
+		"\t-w, --work <msec>\tBusy time before arm-after-work"
+						" arms (default 500)\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "pairs",	required_argument,	NULL, 'n' },
+	{ "load",	required_argument,	NULL, 'l' },
+	{ "expire",	required_argument,	NULL, 'e' },
+	{ "threads",	required_argument,	NULL, 't' },
+	{ "work",	required_argument,	NULL, 'w' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	bool ok;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "n:l:e:t:w:h", main_options,
+									NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'n':
+			pairs = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			load = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			expire = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			num_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			work = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !pairs || !load || !expire || !num_threads) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	ok = run_arm_cancel() && run_arm_cancel_loaded() &&
+		run_gsource_arm_cancel() && run_threads() && run_expire() &&
+		run_arm_after_work();
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "src/shared/trace.h"
+
+/* Decodes a file written by trace_dump(), events of all threads merged */
+
+struct ring {
+	uint32_t tid;
+	uint32_t count;
+	uint32_t pos;
+	uint64_t dropped;
+	struct trace_event *events;
+};
+
+static bool read_ring(FILE *fp, struct ring *ring)
+{
+	struct trace_ring_hdr hdr;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		return false;
+
+	ring->tid = hdr.tid;
+	ring->count = hdr.count;
+	ring->pos = 0;
+	ring->dropped = hdr.dropped;
+
+	if (!hdr.count) {
+		ring->events = NULL;
+		return true;
+	}
+
+	ring->events = calloc(hdr.count, sizeof(struct trace_event));
+	if (!ring->events)
+		return false;
+
+	return fread(ring->events, sizeof(struct trace_event), hdr.count,
+							fp) == hdr.count;
+}
+
+static void print_events(struct ring *rings, uint32_t num_rings)
+{
+	uint64_t start = 0;
+	bool first = true;
+
+	while (1) {
+		struct ring *next = NULL;
+		struct trace_event *ev;
+		uint64_t delta, secs, usecs;
+		uint32_t i;
+
+		for (i = 0; i < num_rings; i++) {
+			struct ring *ring = &rings[i];
+
+			if (ring->pos == ring->count)
+				continue;
+
+			if (!next || ring->events[ring->pos].time <
+						next->events[next->pos].time)
+				next = ring;
+		}
+
+		if (!next)
+			break;
+
+		ev = &next->events[next->pos++];
+
+		if (first) {
+			start = ev->time;
+			first = false;
+		}
+
+		delta = ev->time - start;
+		secs = delta / 1000000000;
+		usecs = delta % 1000000000 / 1000;
+
+		printf("%-6u %6" PRIu64 ".%06" PRIu64 " %-16s len %-5u "
+					"0x%04x 0x%04x 0x%08x\n", next->tid,
+					secs, usecs,
+					trace_event_str(ev->id), ev->len,
+					ev->arg1, ev->arg2, ev->arg3);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_hdr hdr;
+	struct ring *rings;
+	uint32_t i;
+	FILE *fp;
+	int result = EXIT_FAILURE;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fp = fopen(argv[1], "rb");
+	if (!fp) {
+		perror("Failed to open trace file");
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+			memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+			hdr.version != TRACE_VERSION) {
+		fprintf(stderr, "Not a trace file or unsupported version\n");
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
+
+	rings = calloc(hdr.num_rings ? hdr.num_rings : 1, sizeof(*rings));
+	if (!rings) {
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < hdr.num_rings; i++) {
+		if (!read_ring(fp, &rings[i])) {
+			fprintf(stderr, "Truncated trace file\n");
+			goto done;
+		}
+	}
+
+	/* Dropped events were overwritten before the dump, all at the start */
+	for (i = 0; i < hdr.num_rings; i++)
+		printf("Thread %u: %u events, %" PRIu64 " dropped\n",
+				rings[i].tid, rings[i].count, rings[i].dropped);
+
+	print_events(rings, hdr.num_rings);
+
+	result = EXIT_SUCCESS;
+
+done:
+	for (i = 0; i < hdr.num_rings; i++)
+		free(rings[i].events);
+
+	free(rings);
+	fclose(fp);
+
+	return result;
+}
@@ -0,0 +1,188 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/trace.h"
+
+/*
+ * Cost of one debug point on the ATT send path, the way bt_att makes it.
+ *
+ * off is a TRACE() point with tracing disabled, debug-off a util_debug()
+ * without a debug callback, the common case for both when no debugging
+ * was asked for. debug formats the line that bt_att used to log per PDU
+ * into a callback that drops it, so only the formatting is counted.
+ * trace records the same PDU into the ring, --output dumps it afterwards
+ * for bt_trace. Prints one JSON object per case on stdout, like
+ * bt_gattbench.
+ */
+
+#define DEFAULT_EVENTS		10000000
+#define DEFAULT_RING		65536
+
+static unsigned int events = DEFAULT_EVENTS;
+static unsigned int ring_size = DEFAULT_RING;
+static const char *output;
+
+static util_debug_func_t debug_func;
+static unsigned int debug_lines;
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, unsigned int ops, uint64_t nsec)
+{
+	printf("{\"bench\":\"%s\",\"ops\":%u,\"secs\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"nsec_per_op\":%.2f}\n",
+		name, ops, nsec / 1000000000.0,
+		nsec ? ops * 1000000000.0 / nsec : 0.0,
+		ops ? nsec / (double) ops : 0.0);
+	fflush(stdout);
+}
+
+static void drop_debug(const char *str, void *user_data)
+{
+	debug_lines++;
+}
+
+/* Kept out of line, so the loop cannot hoist the enabled check */
+static void __attribute__ ((noinline)) trace_point(unsigned int i)
+{
+	TRACE(TRACE_ATT_TX, 23, 0x52, i & 0xffff, 7);
+}
+
+static void __attribute__ ((noinline)) debug_point(unsigned int i)
+{
+	util_debug(debug_func, NULL, "ATT op 0x%02x handle 0x%04x len %u",
+							0x52, i & 0xffff, 23);
+}
+
+static void run(const char *name, void (*point)(unsigned int))
+{
+	uint64_t start;
+	unsigned int i;
+
+	start = get_nsec();
+
+	for (i = 0; i < events; i++)
+		point(i);
+
+	report(name, events, get_nsec() - start);
+}
+
+static void usage(void)
+{
+	printf("bt_tracebench - debug and trace point overhead benchmark\n"
+		"Usage:\n");
+	printf("\tbt_tracebench [options]\n");
+	printf("Options:\n"
+		"\t-n, --events <num>\tEvents per case (default 10000000)\n"
+		"\t-r, --ring <num>\tTrace ring size (default 65536)\n"
+		"\t-o, --output <path>\tDump the trace to a file\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "events",	required_argument,	NULL, 'n' },
+	{ "ring",	required_argument,	NULL, 'r' },
+	{ "output",	required_argument,	NULL, 'o' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "n:r:o:h", main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'n':
+			events = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			ring_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0 || !events || !ring_size) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	run("off", trace_point);
+	run("debug-off", debug_point);
+
+	debug_func = drop_debug;
+	run("debug", debug_point);
+
+	if (debug_lines != events) {
+		fprintf(stderr, "Formatted %u of %u lines\n", debug_lines,
+								events);
+		return EXIT_FAILURE;
+	}
+
+	if (!trace_enable(ring_size)) {
+		fprintf(stderr, "Failed to enable tracing\n");
+		return EXIT_FAILURE;
+	}
+
+	run("trace", trace_point);
+
+	trace_disable();
+
+	if (output && !trace_dump(output)) {
+		fprintf(stderr, "Failed to write %s\n", output);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
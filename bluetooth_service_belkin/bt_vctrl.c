@@ -0,0 +1,362 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  Belkin International, Inc.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <inttypes.h>
+
+#include "lib/bluetooth.h"
+#include "lib/uuid.h"
+
+#include "src/shared/mainloop.h"
+#include "src/shared/queue.h"
+#include "src/shared/att-types.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/hciemu.h"
+
+/*
+ * Virtual LE controller for load testing bluetoothd and bt_auto_connect
+ * without radios. With --vhci it registers as a regular hciX device,
+ * with --pty it can be attached through hciattach or btattach.
+ */
+
+#define STATS_INTERVAL		1000
+
+#define UUID_GAP		0x1800
+#define UUID_DEVICE_NAME	0x2a00
+#define UUID_BELKIN_SERVICE	0xfff0
+#define UUID_BELKIN_VALUE	0xfff1
+
+static struct hciemu *emu;
+static uint8_t value[20];
+static size_t value_len = 1;
+static bool verbose;
+
+static void debug_cb(const char *str, void *user_data)
+{
+	const char *prefix = user_data;
+
+	printf("%s%s\n", prefix, str);
+}
+
+static void name_read_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	static const char name[] = "bt_vctrl peripheral";
+	uint8_t err = 0;
+
+	if (offset > sizeof(name) - 1)
+		err = BT_ATT_ERROR_INVALID_OFFSET;
+
+	gatt_db_attribute_read_result(attrib, id, err,
+					(const uint8_t *) name + offset,
+					err ? 0 : sizeof(name) - 1 - offset);
+}
+
+static void value_read_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	uint8_t err = 0;
+
+	if (offset > value_len)
+		err = BT_ATT_ERROR_INVALID_OFFSET;
+
+	gatt_db_attribute_read_result(attrib, id, err, value + offset,
+					err ? 0 : value_len - offset);
+}
+
+static void value_write_cb(struct gatt_db_attribute *attrib, unsigned int id,
+					uint16_t offset, const uint8_t *data,
+					size_t len, uint8_t opcode,
+					bdaddr_t *bdaddr, void *user_data)
+{
+	if (offset + len > sizeof(value)) {
+		gatt_db_attribute_write_result(attrib, id,
+					BT_ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LEN);
+		return;
+	}
+
+	memcpy(value + offset, data, len);
+	value_len = offset + len;
+
+	gatt_db_attribute_write_result(attrib, id, 0);
+}
+
+static struct gatt_db *create_db(void)
+{
+	struct gatt_db *db;
+	struct gatt_db_attribute *service;
+	bt_uuid_t uuid;
+
+	db = gatt_db_new();
+	if (!db)
+		return NULL;
+
+	bt_uuid16_create(&uuid, UUID_GAP);
+	service = gatt_db_add_service(db, &uuid, true, 3);
+
+	bt_uuid16_create(&uuid, UUID_DEVICE_NAME);
+	gatt_db_service_add_characteristic(service, &uuid, BT_ATT_PERM_READ,
+					BT_GATT_CHRC_PROP_READ,
+					name_read_cb, NULL, NULL);
+	gatt_db_service_set_active(service, true);
+
+	bt_uuid16_create(&uuid, UUID_BELKIN_SERVICE);
+	service = gatt_db_add_service(db, &uuid, true, 3);
+
+	bt_uuid16_create(&uuid, UUID_BELKIN_VALUE);
+	gatt_db_service_add_characteristic(service, &uuid,
+					BT_ATT_PERM_READ | BT_ATT_PERM_WRITE,
+					BT_GATT_CHRC_PROP_READ |
+					BT_GATT_CHRC_PROP_WRITE,
+					value_read_cb, value_write_cb, NULL);
+	gatt_db_service_set_active(service, true);
+
+	return db;
+}
+
+static void stats_cb(int id, void *user_data)
+{
+	static struct hciemu_stats last;
+	struct hciemu_stats stats;
+
+	if (!hciemu_get_stats(emu, &stats))
+		return;
+
+	printf("adv %" PRIu64 "/s dropped %" PRIu64 " acl rx %" PRIu64
+			" tx %" PRIu64 " conns %u (max %u)\n",
+			stats.adv_reports - last.adv_reports,
+			stats.adv_dropped - last.adv_dropped,
+			stats.acl_rx - last.acl_rx, stats.acl_tx - last.acl_tx,
+			stats.connections, stats.max_connections);
+
+	last = stats;
+
+	mainloop_modify_timeout(id, STATS_INTERVAL);
+}
+
+static void signal_cb(int signum, void *user_data)
+{
+	switch (signum) {
+	case SIGINT:
+	case SIGTERM:
+		mainloop_quit();
+		break;
+	}
+}
+
+static struct hciemu *open_vhci(void)
+{
+	static const uint8_t create_req[] = { 0xff, 0x00 };
+	struct hciemu *emu;
+	int fd;
+
+	fd = open("/dev/vhci", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror("Failed to open /dev/vhci");
+		return NULL;
+	}
+
+	/* Ask for a BR/EDR type device right away, LE is a part of it */
+	if (write(fd, create_req, sizeof(create_req)) < 0) {
+		perror("Failed to create controller");
+		close(fd);
+		return NULL;
+	}
+
+	emu = hciemu_new_fd(fd);
+	if (!emu)
+		close(fd);
+
+	return emu;
+}
+
+static void usage(void)
+{
+	printf("bt_vctrl - Virtual LE controller\n"
+		"Usage:\n");
+	printf("\tbt_vctrl [options]\n");
+	printf("Options:\n"
+		"\t-V, --vhci\t\tRegister through /dev/vhci (default)\n"
+		"\t-p, --pty\t\tServe H4 on a pseudo terminal\n"
+		"\t-n, --devices <num>\tNumber of advertisers (default 100)\n"
+		"\t-r, --rate <num>\tAdvertising reports per second "
+							"(default 1000)\n"
+		"\t-b, --belkin <pct>\tShare of Belkin advertisers "
+							"(default 50)\n"
+		"\t-t, --type <num>\tBelkin device type (default 0x1c)\n"
+		"\t-s, --status <num>\tBelkin device status (default 0)\n"
+		"\t-R, --rpa <pct>\tShare using private addresses "
+							"(default 0)\n"
+		"\t-T, --rotate <sec>\tPrivate address lifetime "
+							"(default 900)\n"
+		"\t-d, --delay <msec>\tConnection setup delay (default 10)\n"
+		"\t-v, --verbose\t\tPrint emulator debug output\n"
+		"\t-h, --help\t\tShow help options\n");
+}
+
+static const struct option main_options[] = {
+	{ "vhci",	no_argument,		NULL, 'V' },
+	{ "pty",	no_argument,		NULL, 'p' },
+	{ "devices",	required_argument,	NULL, 'n' },
+	{ "rate",	required_argument,	NULL, 'r' },
+	{ "belkin",	required_argument,	NULL, 'b' },
+	{ "type",	required_argument,	NULL, 't' },
+	{ "status",	required_argument,	NULL, 's' },
+	{ "rpa",	required_argument,	NULL, 'R' },
+	{ "rotate",	required_argument,	NULL, 'T' },
+	{ "delay",	required_argument,	NULL, 'd' },
+	{ "verbose",	no_argument,		NULL, 'v' },
+	{ "help",	no_argument,		NULL, 'h' },
+	{ }
+};
+
+int main(int argc, char *argv[])
+{
+	struct hciemu_adv_config config;
+	struct gatt_db *db;
+	unsigned int delay = 10;
+	bool use_pty = false;
+	sigset_t mask;
+	int exit_status;
+
+	memset(&config, 0, sizeof(config));
+	config.num_devices = 100;
+	config.reports_per_sec = 1000;
+	config.belkin_percent = 50;
+	config.belkin_type = 0x1c;
+	config.rpa_timeout = 900;
+
+	for (;;) {
+		int opt;
+
+		opt = getopt_long(argc, argv, "Vpn:r:b:t:s:R:T:d:vh",
+						main_options, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'V':
+			use_pty = false;
+			break;
+		case 'p':
+			use_pty = true;
+			break;
+		case 'n':
+			config.num_devices = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			config.reports_per_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.belkin_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			config.belkin_type = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			config.belkin_status = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			config.rpa_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			config.rpa_timeout = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			delay = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind > 0) {
+		fprintf(stderr, "Invalid command line parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	mainloop_init();
+
+	emu = use_pty ? hciemu_new_pty() : open_vhci();
+	if (!emu) {
+		fprintf(stderr, "Failed to create virtual controller\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!hciemu_set_adv_config(emu, &config)) {
+		fprintf(stderr, "Invalid advertising parameters\n");
+		hciemu_unref(emu);
+		return EXIT_FAILURE;
+	}
+
+	db = create_db();
+	if (!db) {
+		fprintf(stderr, "Failed to create GATT database\n");
+		hciemu_unref(emu);
+		return EXIT_FAILURE;
+	}
+
+	hciemu_set_peripheral_db(emu, db);
+	hciemu_set_conn_delay(emu, delay);
+
+	if (verbose)
+		hciemu_set_debug(emu, debug_cb, "vctrl: ", NULL);
+
+	if (use_pty)
+		printf("Serving H4 on %s\n", hciemu_get_pty_path(emu));
+
+	mainloop_add_timeout(STATS_INTERVAL, stats_cb, NULL, NULL);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+
+	mainloop_set_signal(&mask, signal_cb, NULL, NULL);
+
+	exit_status = mainloop_run();
+
+	hciemu_unref(emu);
+	gatt_db_unref(db);
+
+	return exit_status;
+}
@@ -35,6 +35,7 @@
 #include "src/plugin.h"
 #include "src/adapter.h"
 #include "src/shared/util.h"
+#include "src/shared/hci.h"
 #include "src/log.h"
 #include "attrib/gattrib.h"
 #include "attrib/gatt-service.h"
@@ -48,8 +49,6 @@
 #include <curses.h>
 #include <ctype.h>
 #include <sys/ioctl.h>
-#include <signal.h>
-#include <sys/time.h>
 
 #include "lib/hci.h"
 #include "lib/hci_lib.h"
@@ -87,143 +86,176 @@ static int notifyData;
 #define EIR_NAME_COMPLETE           0x09
 #define EIR_MANUFACTURE_SPECIFIC    0xFF
 
-static unsigned int *uuid_str_to_data(char *uuid)
+static unsigned int twoc(int in, int t)
 {
-	char conv[] = "0123456789ABCDEF";
-	int len = strlen(uuid);
-	unsigned int *data = (unsigned int*)malloc(sizeof(unsigned int) * len);
-	unsigned int *dp = data;
-	char *cu = uuid;
+	return (in < 0) ? (in + (2 << (t-1))) : in;
+}
 
-	for(; cu<uuid+len; dp++,cu+=2)
-	{
-		*dp = ((strchr(conv, toupper(*cu)) - conv) * 16)
-			+ (strchr(conv, toupper(*(cu+1))) - conv);
+#define ADV_START_DELAY		5	/* seconds after probe */
+
+struct adv_manager {
+	struct bt_hci *hci;
+	uint8_t status;			/* configured/unconfigured byte */
+	gint64 disconnect_time;		/* monotonic time of last disconnect */
+	gint64 last_rearm;		/* disconnect to advertising, usec */
+	gint64 max_rearm;
+	unsigned int rearm_count;
+	guint start_id;
+};
+
+static struct adv_manager adv;
+
+static int hex_value(char c)
+{
+	static const char conv[] = "0123456789ABCDEF";
+	const char *p = strchr(conv, toupper(c));
+
+	return p ? p - conv : 0;
+}
+
+static uint8_t build_adv_data(uint8_t *data, uint8_t status)
+{
+	const char *uuid = SIMPLE_PERIPHERAL_UUID;
+	uint8_t len = 0, start;
+	size_t i;
+
+	data[len++] = 2;
+	data[len++] = EIR_FLAGS;
+	data[len++] = 0x16;
+
+	start = len++;
+	data[len++] = EIR_MANUFACTURE_SPECIFIC;
+	data[len++] = 0x5C;
+	data[len++] = 0x00;
+
+	for (i = 0; i < strlen(uuid) / 2; i++)
+		data[len++] = hex_value(uuid[2 * i]) * 16 +
+						hex_value(uuid[2 * i + 1]);
+
+	data[len++] = LINKSYS_DEV;
+	data[len++] = status;
+	data[start] = len - start - 1;
+
+	return len;
+}
+
+static void adv_cmd_complete(const void *data, uint8_t size, void *user_data)
+{
+	const char *cmd = user_data;
+	uint8_t status = size ? *((const uint8_t *) data) : 0xff;
+
+	if (status)
+		error("LE %s failed: 0x%02x", cmd, status);
+	else
+		DBG("LE %s done", cmd);
+}
+
+static void adv_enable_complete(const void *data, uint8_t size,
+							void *user_data)
+{
+	uint8_t status = size ? *((const uint8_t *) data) : 0xff;
+	gint64 elapsed;
+
+	if (status) {
+		error("LE Set Advertise Enable failed: 0x%02x", status);
+		adv.disconnect_time = 0;
+		return;
+	}
+
+	if (!adv.disconnect_time) {
+		DBG("Advertising enabled");
+		return;
 	}
 
-	return data;
+	elapsed = g_get_monotonic_time() - adv.disconnect_time;
+	adv.disconnect_time = 0;
+
+	adv.last_rearm = elapsed;
+	if (elapsed > adv.max_rearm)
+		adv.max_rearm = elapsed;
+	adv.rearm_count++;
+
+	info("Advertising %" G_GINT64_FORMAT " us after disconnect "
+			"(max %" G_GINT64_FORMAT " us, %u re-arms)",
+			adv.last_rearm, adv.max_rearm, adv.rearm_count);
 }
 
-static unsigned int twoc(int in, int t)
+static void adv_send_data(void)
 {
-	return (in < 0) ? (in + (2 << (t-1))) : in;
+	le_set_advertising_data_cp cp;
+
+	memset(&cp, 0, sizeof(cp));
+	cp.length = build_adv_data(cp.data, adv.status);
+
+	bt_hci_send(adv.hci, cmd_opcode_pack(OGF_LE_CTL,
+					OCF_LE_SET_ADVERTISING_DATA),
+					&cp, sizeof(cp), adv_cmd_complete,
+					"Set Advertising Data", NULL);
+}
+
+static void adv_send_enable(uint8_t enable)
+{
+	le_set_advertise_enable_cp cp;
+
+	cp.enable = enable;
+
+	bt_hci_send(adv.hci, cmd_opcode_pack(OGF_LE_CTL,
+					OCF_LE_SET_ADVERTISE_ENABLE),
+					&cp, sizeof(cp),
+					enable ? adv_enable_complete :
+							adv_cmd_complete,
+					"Set Advertise Enable", NULL);
 }
 
+/*
+ * Queue the whole sequence at once; bt_hci takes care of command flow
+ * control so the commands go out back-to-back as the controller
+ * completes them, without blocking the main loop.
+ */
 static void advertise_start(void)
 {
-	uint8_t status;
-	struct hci_request rq;
-	int i;
-	int ret;
-	unsigned int *uuid;
-	uint8_t segment_length;
-	int device_id, device_handle;
-
-	le_set_advertising_data_cp adv_data_cp;
-	le_set_advertising_parameters_cp adv_params_cp;
-	le_set_advertise_enable_cp advertise_cp;
-
-	device_handle = 0;
-	device_id = hci_get_route(NULL);
-	if((device_handle = hci_open_dev(device_id)) < 0)
-	{
-		perror("Could not open device");
-		exit(1);
-	}
+	le_set_advertising_parameters_cp params;
+
+	if (!adv.hci)
+		return;
+
+	adv_send_enable(0x00);
+
+	adv_send_data();
+
+	memset(&params, 0, sizeof(params));
+	params.min_interval = htobs(0x0800);
+	params.max_interval = htobs(0x0800);
+	params.chan_map = 7;
+
+	bt_hci_send(adv.hci, cmd_opcode_pack(OGF_LE_CTL,
+					OCF_LE_SET_ADVERTISING_PARAMETERS),
+					&params, sizeof(params),
+					adv_cmd_complete,
+					"Set Advertising Parameters", NULL);
+
+	adv_send_enable(0x01);
+}
+
+/* Update the status byte in place, advertising keeps running */
+static void advertise_set_status(uint8_t status)
+{
+	if (!adv.hci || adv.status == status)
+		return;
+
+	adv.status = status;
 
-	/* Disable Advertise */
-	memset(&advertise_cp, 0, sizeof(advertise_cp));
-
-	memset(&rq, 0, sizeof(rq));
-	rq.ogf = OGF_LE_CTL;
-	rq.ocf = OCF_LE_SET_ADVERTISE_ENABLE;
-	rq.cparam = &advertise_cp;
-	rq.clen = LE_SET_ADVERTISE_ENABLE_CP_SIZE;
-	rq.rparam = &status;
-	rq.rlen = 1;
-
-	ret = hci_send_req(device_handle, &rq, 1000);
-	if (ret < 0)
-		goto done;
-
-	sleep(2);
-
-	/* Set Advertise Data */
-	memset(&adv_data_cp, 0, sizeof(adv_data_cp));
-	segment_length = 1;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(EIR_FLAGS); segment_length++;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(0x16); segment_length++;
-	adv_data_cp.data[adv_data_cp.length] = htobs(segment_length - 1);
-	adv_data_cp.length += segment_length;
-
-	segment_length = 1;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(EIR_MANUFACTURE_SPECIFIC); segment_length++;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(0x5C); segment_length++;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(0x00); segment_length++;
-
-	uuid = uuid_str_to_data(SIMPLE_PERIPHERAL_UUID);
-
-        for(i = 0; i < strlen(SIMPLE_PERIPHERAL_UUID) / 2; i++) {
-                adv_data_cp.data[adv_data_cp.length + segment_length]  = htobs(uuid[i]); segment_length++;
-        }
-
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(LINKSYS_DEV); segment_length++;
-	adv_data_cp.data[adv_data_cp.length + segment_length] = htobs(DEV_CONFIGURED); segment_length++;
-	adv_data_cp.data[adv_data_cp.length] = htobs(segment_length - 1);
-	adv_data_cp.length += segment_length;
-
-	DBG("Segment_length:%x", adv_data_cp.length);
-
-	memset(&rq, 0, sizeof(rq));
-	rq.ogf = OGF_LE_CTL;
-	rq.ocf = OCF_LE_SET_ADVERTISING_DATA;
-	rq.cparam = &adv_data_cp;
-	rq.clen = LE_SET_ADVERTISING_DATA_CP_SIZE;
-	rq.rparam = &status;
-	rq.rlen = 1;
-
-	ret = hci_send_req(device_handle, &rq, 1000);
-	if (ret < 0)
-		goto done;
-
-	sleep(2);
-
-	/* Set Advertise Params */
-	memset(&adv_params_cp, 0, sizeof(adv_params_cp));
-	adv_params_cp.min_interval = htobs(0x0800);
-	adv_params_cp.max_interval = htobs(0x0800);
-	adv_params_cp.chan_map = 7;
-
-	memset(&rq, 0, sizeof(rq));
-	rq.ogf = OGF_LE_CTL;
-	rq.ocf = OCF_LE_SET_ADVERTISING_PARAMETERS;
-	rq.cparam = &adv_params_cp;
-	rq.clen = LE_SET_ADVERTISING_PARAMETERS_CP_SIZE;
-	rq.rparam = &status;
-	rq.rlen = 1;
-
-	ret = hci_send_req(device_handle, &rq, 1000);
-	if (ret < 0)
-		goto done;
-
-	sleep(2);
-
-	memset(&advertise_cp, 0, sizeof(advertise_cp));
-	advertise_cp.enable = 0x01;
-
-	memset(&rq, 0, sizeof(rq));
-	rq.ogf = OGF_LE_CTL;
-	rq.ocf = OCF_LE_SET_ADVERTISE_ENABLE;
-	rq.cparam = &advertise_cp;
-	rq.clen = LE_SET_ADVERTISE_ENABLE_CP_SIZE;
-	rq.rparam = &status;
-	rq.rlen = 1;
-
-	ret = hci_send_req(device_handle, &rq, 1000);
-	if (ret < 0)
-		goto done;
-done:
-	hci_close_dev(device_handle);
+	adv_send_data();
+}
+
+static gboolean advertise_start_cb(gpointer user_data)
+{
+	adv.start_id = 0;
+
+	DBG("========= Start Advertising");
+	advertise_start();
+
+	return FALSE;
 }
 
 static uint8_t SimpleCharacteristic1Read(struct attribute *a,
@@ -415,57 +447,52 @@ static void update_name(struct btd_adapter *adapter, gpointer user_data)
 	adapter_set_name(adapter, (char*)user_data);
 }
 
-static void alarm_wakeup (int i)
-{
-	DBG("\n Wakeup!!!\n");
-	DBG("========= Start Advertising");
-	advertise_start();
-	DBG("========= Done Advertising");
-}
-
 static void abc_disconnect_cb(struct btd_device *dev, uint8_t reason)
 {
-	struct itimerval tout_val;
-
-	DBG("==== abc_disconnect_cb called: %p", abc_disconnect_cb);
-	DBG("=============== abc_disconnect_cb called: %p ==================", abc_disconnect_cb);
-	tout_val.it_interval.tv_sec = 0;
-	tout_val.it_interval.tv_usec = 0;
-	tout_val.it_value.tv_sec = 5; /* 10 seconds timer */
-	tout_val.it_value.tv_usec = 0;
-	setitimer(ITIMER_REAL, &tout_val,0);
-
-	DBG("========= Trigger Timer");
-	signal(SIGALRM,alarm_wakeup);
+	DBG("==== abc_disconnect_cb called: reason %u", reason);
+
+	/*
+	 * The controller keeps advertising data and parameters across
+	 * the connection, so enabling it again is all that is needed.
+	 */
+	adv.disconnect_time = g_get_monotonic_time();
+	adv_send_enable(0x01);
 }
 
 static int wii_probe(struct btd_adapter *adapter)
 {
-	struct itimerval tout_val;
-
 	update_name(adapter, "LINKSYSNODE");
 	RegisterDeviceInfo(adapter);
 	RegisterSimpleService(adapter);
 
+	if (!adv.hci) {
+		adv.hci = bt_hci_new_raw_device(btd_adapter_get_index(adapter));
+		if (!adv.hci)
+			error("Unable to open HCI device for advertising");
+	}
+
+	advertise_set_status(DEV_CONFIGURED);
+
 	btd_add_disconnect_cb(abc_disconnect_cb);
 	DBG("=========abc_disconnect_cb: %p\n", abc_disconnect_cb);
 
 	/* Register to advertise 5s later */
-	tout_val.it_interval.tv_sec = 0;
-	tout_val.it_interval.tv_usec = 0;
-	tout_val.it_value.tv_sec = 5;
-	tout_val.it_value.tv_usec = 0;
-	setitimer(ITIMER_REAL, &tout_val,0);
-
-	DBG("========= Trigger Timer");
-	signal(SIGALRM,alarm_wakeup);
+	if (!adv.start_id)
+		adv.start_id = g_timeout_add_seconds(ADV_START_DELAY,
+						advertise_start_cb, NULL);
 
 	return 0;
 }
 
 static void wii_remove(struct btd_adapter *adapter)
 {
+	if (adv.start_id) {
+		g_source_remove(adv.start_id);
+		adv.start_id = 0;
+	}
 
+	bt_hci_unref(adv.hci);
+	adv.hci = NULL;
 }
 
 /*function pointers*/